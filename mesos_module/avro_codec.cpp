@@ -0,0 +1,100 @@
+#include "avro_codec.hpp"
+
+#include <sstream>
+#include <string.h>
+
+#include <glog/logging.h>
+#include <zlib.h>
+
+#include "byte_buffer.hpp"
+
+const std::string metrics::AvroCodec::NULL_CODEC("null");
+const std::string metrics::AvroCodec::DEFLATE_CODEC("deflate");
+
+namespace {
+  const size_t DEFLATE_DEFAULT_LEVEL = 6;
+  const size_t DEFLATE_MAX_LEVEL = 9;
+
+  /**
+   * Avro's deflate codec is raw deflate (RFC 1951): no zlib header or checksum.
+   */
+  const int DEFLATE_RAW_WINDOW_BITS = -15;
+  const int DEFLATE_MEM_LEVEL = 8;
+
+  class DeflateCodec : public metrics::AvroCodec {
+   public:
+    DeflateCodec() {
+      memset(&stream, 0, sizeof(stream));
+    }
+
+    virtual ~DeflateCodec() {
+      deflateEnd(&stream);
+    }
+
+    int init(size_t level) {
+      return deflateInit2(&stream, level, Z_DEFLATED,
+          DEFLATE_RAW_WINDOW_BITS, DEFLATE_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    }
+
+    const std::string& name() const {
+      return DEFLATE_CODEC;
+    }
+
+    bool compress(metrics::ByteBuffer& buf, size_t headroom) {
+      // Reuse the stream's allocated state across blocks.
+      int rc = deflateReset(&stream);
+      if (rc != Z_OK) {
+        LOG(ERROR) << "Failed to reset deflate stream: " << rc;
+        return false;
+      }
+      out_buf.reset(headroom);
+      size_t bound = deflateBound(&stream, buf.size());
+      stream.next_in = (Bytef*)buf.data();
+      stream.avail_in = buf.size();
+      stream.next_out = out_buf.prepare(bound);
+      stream.avail_out = bound;
+      rc = deflate(&stream, Z_FINISH);
+      if (rc != Z_STREAM_END) {
+        LOG(ERROR) << "Failed to deflate " << buf.size() << " bytes: " << rc;
+        return false;
+      }
+      out_buf.commit(stream.total_out);
+      // Keep the original buffer's allocation for the next block.
+      buf.swap(out_buf);
+      return true;
+    }
+
+   private:
+    z_stream stream;
+    metrics::ByteBuffer out_buf;
+  };
+}
+
+Try<std::shared_ptr<metrics::AvroCodec>> metrics::AvroCodec::create(
+    const std::string& name, size_t level) {
+  if (name == NULL_CODEC) {
+    return std::shared_ptr<AvroCodec>();
+  }
+
+  if (name == DEFLATE_CODEC) {
+    if (level == 0) {
+      level = DEFLATE_DEFAULT_LEVEL;
+    } else if (level > DEFLATE_MAX_LEVEL) {
+      std::ostringstream oss;
+      oss << "Invalid " << name << " level " << level << ": must be 1-" << DEFLATE_MAX_LEVEL;
+      return Error(oss.str());
+    }
+    DeflateCodec* codec = new DeflateCodec;
+    std::shared_ptr<AvroCodec> codec_ptr(codec);
+    int rc = codec->init(level);
+    if (rc != Z_OK) {
+      std::ostringstream oss;
+      oss << "Failed to initialize " << name << " codec with level " << level << ": " << rc;
+      return Error(oss.str());
+    }
+    return codec_ptr;
+  }
+
+  return Error("Unsupported codec '" + name + "': expected one of "
+      + NULL_CODEC + ", " + DEFLATE_CODEC);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <stout/try.hpp>
+
+namespace metrics {
+  class ByteBuffer;
+
+  /**
+   * Compresses the data within avro blocks, using one of the codecs listed in the avro spec.
+   * Instances keep their compression state between blocks, and are not thread-safe.
+   */
+  class AvroCodec {
+   public:
+    /**
+     * Codec names, as advertised in the avro file header.
+     */
+    static const std::string NULL_CODEC;
+    static const std::string DEFLATE_CODEC;
+
+    /**
+     * Returns a codec for the provided name, or an empty pointer for the null codec.
+     * A level of 0 selects the codec's default compression level.
+     * Returns an Error if the name or level isn't supported.
+     */
+    static Try<std::shared_ptr<AvroCodec>> create(const std::string& name, size_t level);
+
+    virtual ~AvroCodec() { }
+
+    virtual const std::string& name() const = 0;
+
+    /**
+     * Replaces the content of 'buf' with its compressed form, reserving at least 'headroom' bytes
+     * in front of it. Returns false and leaves 'buf' unchanged if compression failed.
+     */
+    virtual bool compress(ByteBuffer& buf, size_t headroom) = 0;
+  };
+}
@@ -1,14 +1,48 @@
 #include "avro_encoder.hpp"
 
-#include <boost/asio/streambuf.hpp>
 #include <glog/logging.h>
+#include <sstream>
 #include <sys/time.h>
 #include <unordered_map>
 
 #include <avro/Compiler.hh>
 #include <avro/Encoder.hh>
-#include "metrics_schema_struct.hpp"
+#include "avro_codec.hpp"
+#include "byte_buffer.hpp"
 #include "metrics_schema_json.hpp"
+#include "strntod.h"
+
+namespace avro {
+  /**
+   * Encodes the in-memory metrics structs exactly as their metrics_schema equivalents, writing
+   * strings straight from the StringInterner. Avro encodes strings and bytes identically.
+   */
+  template <> struct codec_traits<metrics::InternedString> {
+    static void encode(Encoder& e, const metrics::InternedString& v) {
+      e.encodeBytes((const uint8_t*)v.data(), v.size());
+    }
+  };
+  template <> struct codec_traits<metrics::Tag> {
+    static void encode(Encoder& e, const metrics::Tag& v) {
+      avro::encode(e, v.key);
+      avro::encode(e, v.value);
+    }
+  };
+  template <> struct codec_traits<metrics::Datapoint> {
+    static void encode(Encoder& e, const metrics::Datapoint& v) {
+      avro::encode(e, v.name);
+      avro::encode(e, v.time_ms);
+      avro::encode(e, v.value);
+    }
+  };
+  template <> struct codec_traits<metrics::MetricList> {
+    static void encode(Encoder& e, const metrics::MetricList& v) {
+      avro::encode(e, v.topic);
+      avro::encode(e, v.tags);
+      avro::encode(e, v.datapoints);
+    }
+  };
+}
 
 namespace {
   /**
@@ -28,8 +62,6 @@ namespace {
    */
   const std::string AVRO_SCHEMA_KEY("avro.schema");
   const std::string AVRO_CODEC_KEY("avro.codec");
-  const std::string AVRO_NULL_CODEC("null");
-  const std::string AVRO_DEFLATE_CODEC("deflate");//FIXME support deflate
 
   typedef std::vector<uint8_t> MetadataVal;
   typedef std::map<std::string, MetadataVal> MetadataMap;
@@ -37,6 +69,64 @@ namespace {
   const size_t MALLOC_BLOCK_SIZE = 64 * 1024;
   const boost::array<uint8_t, 4> magic = { { 'O', 'b', 'j', '\x01' } };
 
+  /**
+   * Block headers are two zigzag varint longs (object count + byte count), each up to 10 bytes.
+   */
+  const size_t BLOCK_HEADER_MAX_SIZE = 20;
+
+  /**
+   * Minimum number of bytes to hand to the avro encoder at a time.
+   */
+  const size_t ENCODE_CHUNK_SIZE = 4096;
+
+  /**
+   * Lets the avro encoder write directly into a ByteBuffer, rather than into its own chunks which
+   * then need to be copied out.
+   */
+  class ByteBufferOutputStream : public avro::OutputStream {
+   public:
+    ByteBufferOutputStream(metrics::ByteBuffer& buf)
+      : buf(buf), count(0) { }
+
+    bool next(uint8_t** data, size_t* len) {
+      *data = buf.prepare(ENCODE_CHUNK_SIZE);
+      *len = buf.tail_size();
+      buf.commit(*len);
+      count += *len;
+      return true;
+    }
+
+    void backup(size_t len) {
+      buf.uncommit(len);
+      count -= len;
+    }
+
+    uint64_t byteCount() const {
+      return count;
+    }
+
+    void flush() { }
+
+   private:
+    metrics::ByteBuffer& buf;
+    uint64_t count;
+  };
+
+  /**
+   * Writes a zigzag varint long to 'out', which must have room for 10 bytes.
+   * Returns the number of bytes written.
+   */
+  size_t encode_long(int64_t val, uint8_t* out) {
+    uint64_t n = ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+    size_t len = 0;
+    while (n & ~0x7FULL) {
+      out[len++] = (uint8_t)((n & 0x7f) | 0x80);
+      n >>= 7;
+    }
+    out[len++] = (uint8_t)n;
+    return len;
+  }
+
   void set_metadata(MetadataMap& map, const std::string& key, const std::string& value) {
     MetadataVal value_conv(value.size());
     std::copy(value.begin(), value.end(), value_conv.begin());
@@ -44,41 +134,42 @@ namespace {
   }
 
   void add_tag(const std::string& key, const std::string& value,
-    std::vector<metrics_schema::Tag>& tags) {
+    std::vector<metrics::Tag>& tags, metrics::StringInterner& strings) {
     if (key.empty() && value.empty()) {
       return;
     }
     tags.emplace_back();
-    metrics_schema::Tag& tag = tags.back();
-    tag.key.insert(0, key);
-    tag.value.insert(0, value);
+    metrics::Tag& tag = tags.back();
+    tag.key = strings.intern(key);
+    tag.value = strings.intern(value);
   }
 
   void add_tag(const char* key, size_t key_len, const char* value, size_t value_len,
-    std::vector<metrics_schema::Tag>& tags) {
+    std::vector<metrics::Tag>& tags, metrics::StringInterner& strings) {
     if (key_len == 0 && value_len == 0) {
       return;
     }
     tags.emplace_back();
-    metrics_schema::Tag& tag = tags.back();
-    tag.key.insert(0, key, key_len);
+    metrics::Tag& tag = tags.back();
+    tag.key = strings.intern(key, key_len);
     if (value != NULL) {
-      tag.value.insert(0, value, value_len);
+      tag.value = strings.intern(value, value_len);
     }
   }
 
   void init_list(
-      metrics_schema::MetricList& list,
-      const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info) {
+      metrics::MetricList& list,
+      const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
+      metrics::StringInterner& strings) {
     if (container_id != NULL && executor_info != NULL) {
       if (list.topic.empty()) {
-        list.topic = executor_info->framework_id().value();
+        list.topic = strings.intern(executor_info->framework_id().value());
       }
 
       bool found_framework_id = false,
         found_executor_id = false,
         found_container_id = false;
-      for (const metrics_schema::Tag& tag : list.tags) {
+      for (const metrics::Tag& tag : list.tags) {
         if (tag.key == FRAMEWORK_ID_AVRO_KEY) {
           found_framework_id = true;
         } else if (tag.key == EXECUTOR_ID_AVRO_KEY) {
@@ -88,17 +179,72 @@ namespace {
         }
       }
       if (!found_framework_id) {
-        add_tag(FRAMEWORK_ID_AVRO_KEY, executor_info->framework_id().value(), list.tags);
+        add_tag(FRAMEWORK_ID_AVRO_KEY, executor_info->framework_id().value(), list.tags, strings);
       }
       if (!found_executor_id) {
-        add_tag(EXECUTOR_ID_AVRO_KEY, executor_info->executor_id().value(), list.tags);
+        add_tag(EXECUTOR_ID_AVRO_KEY, executor_info->executor_id().value(), list.tags, strings);
       }
       if (!found_container_id) {
-        add_tag(CONTAINER_ID_AVRO_KEY, container_id->value(), list.tags);
+        add_tag(CONTAINER_ID_AVRO_KEY, container_id->value(), list.tags, strings);
       }
     } else {
-      list.topic = UNKNOWN_CONTAINER_TAG;
+      list.topic = strings.intern(UNKNOWN_CONTAINER_TAG);
+    }
+  }
+
+  const mesos::ContainerID& get_unknown_container_id() {
+    static mesos::ContainerID unknown_container_id;
+    if (unknown_container_id.value().empty()) {
+      unknown_container_id.set_value(UNKNOWN_CONTAINER_TAG);
     }
+    return unknown_container_id;
+  }
+
+  /**
+   * Returns a fingerprint of the provided tags which doesn't depend on their order, equivalent to
+   * hashing the sorted tags. Equal interned strings share the same address, so the addresses are
+   * hashed instead of the content.
+   */
+  uint64_t tags_fingerprint(const metrics::Tag* tags, size_t count) {
+    uint64_t fingerprint = count;
+    for (size_t i = 0; i < count; ++i) {
+      // 'empty' strings aren't necessarily interned: treat them as null
+      uint64_t key = tags[i].key.empty() ? 0 : (uintptr_t)tags[i].key.data();
+      uint64_t value = tags[i].value.empty() ? 0 : (uintptr_t)tags[i].value.data();
+      // splitmix64 finalizer, summed so that order doesn't matter
+      uint64_t hash = key * 0x9e3779b97f4a7c15ULL ^ value;
+      hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+      fingerprint += hash ^ (hash >> 31);
+    }
+    return fingerprint;
+  }
+
+  inline bool tag_eq(const metrics::Tag& a, const metrics::Tag& b) {
+    return a.key == b.key && a.value == b.value;
+  }
+
+  /**
+   * Returns whether the two tag arrays hold the same tags, in any order.
+   */
+  bool same_tag_set(const metrics::Tag* a, const metrics::Tag* b, size_t count) {
+    // Each tag must occur the same number of times in both. Custom tag sets are small, so O(n^2)
+    // beats sorting copies of them.
+    for (size_t i = 0; i < count; ++i) {
+      size_t count_a = 0, count_b = 0;
+      for (size_t j = 0; j < count; ++j) {
+        if (tag_eq(a[i], a[j])) {
+          ++count_a;
+        }
+        if (tag_eq(a[i], b[j])) {
+          ++count_b;
+        }
+      }
+      if (count_a != count_b) {
+        return false;
+      }
+    }
+    return true;
   }
 
   int64_t now_in_ms() {
@@ -110,7 +256,8 @@ namespace {
     return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
   }
 
-  void parse_datadog_tags(const char* data, size_t size, std::vector<metrics_schema::Tag>& tags) {
+  void parse_datadog_tags(const char* data, size_t size,
+      std::vector<metrics::Tag>& tags, metrics::StringInterner& strings) {
     // Expected input format: |#key:val,key2:val2,(...)
     if (size <= 2) {
       return;
@@ -125,11 +272,11 @@ namespace {
         const char* tag_delim = (const char*)memchr(tag_start, ':', size);
         if (tag_delim == NULL) {
           // no tag delim. treat as empty value.
-          add_tag(tag_start, size, NULL, 0, tags);
+          add_tag(tag_start, size, NULL, 0, tags, strings);
         } else {
           // tag delim found. key:value
           size_t key_len = tag_delim - tag_start;
-          add_tag(tag_start, key_len, tag_delim + 1, size - key_len - 1, tags);
+          add_tag(tag_start, key_len, tag_delim + 1, size - key_len - 1, tags, strings);
         }
         // parsed to end of buffer, exit:
         return;
@@ -139,11 +286,11 @@ namespace {
         const char* tag_delim = (const char*)memchr(tag_start, ':', tag_size);
         if (tag_delim == NULL) {
           // no tag delim. treat as empty value
-          add_tag(tag_start, tag_size, NULL, 0, tags);
+          add_tag(tag_start, tag_size, NULL, 0, tags, strings);
         } else {
           // tag delim found. key:value
           size_t key_len = tag_delim - tag_start;
-          add_tag(tag_start, key_len, tag_delim + 1, tag_size - key_len - 1, tags);
+          add_tag(tag_start, key_len, tag_delim + 1, tag_size - key_len - 1, tags, strings);
         }
         // parsed to end of this tag, continue to start of next tag:
         tag_start = tag_end + 1;
@@ -153,7 +300,7 @@ namespace {
   }
 
   void parse_statsd_name_val_tags(const char* data, size_t size,
-      metrics_schema::Datapoint& point, std::vector<metrics_schema::Tag>& tags) {
+      metrics::Datapoint& point, std::vector<metrics::Tag>& tags, metrics::StringInterner& strings) {
     // Expected input format:
     // name[:val][|section...][|@0.3][|#tag1:val1,tag2:val2][|section...]
     // first, find the start of any extra sections: we want to avoid going too far when searching for ':'s.
@@ -166,11 +313,11 @@ namespace {
     char* name_end = (char*)memchr(data, ':', nameval_size);
     if (name_end == NULL) {
       // value delim not found in nameval region. missing value? treat as 'name = 0'
-      point.name.insert(0, data, nameval_size);
+      point.name = strings.intern(data, nameval_size);
       point.value = 0;
     } else {
       size_t name_len = name_end - data;
-      point.name.insert(0, data, name_len);
+      point.name = strings.intern(data, name_len);
 
       size_t value_len;
       if (section_start == NULL) {
@@ -181,13 +328,9 @@ namespace {
         value_len = section_start - name_end;
       }
 
-      // note: we use std::stod(std::str) instead of strtod(char*) here, to avoid escaping buffer
-      //       (wish strntod(char*, size) was available...)
-      std::string val_str(name_end + 1, value_len - 1); // exclude ':' delim
-      try {
-        point.value = std::stod(val_str);
-      } catch (...) {
-        LOG(WARNING) << "Corrupt statsd value: '" << val_str << "' "
+      // parse straight from the packet buffer, excluding the ':' delim
+      if (!strntod(name_end + 1, value_len - 1, &point.value)) {
+        LOG(WARNING) << "Corrupt statsd value: '" << std::string(name_end + 1, value_len - 1) << "' "
                      << "(from data '" << std::string(data, size) << "')";
         point.value = 0;
       }
@@ -222,27 +365,26 @@ namespace {
             // on values reported by histograms (which are tagged with the metric type 'h').
             // This usually includes a histogram 'count'. The histogram count _does_ need to be
             // adjusted for sample rate, but since we don't perform such histogram processing
-            // here, we simply pass through any histogram values.
+            // here, we simply pass through any histogram values. (See StatsdAggregator, which
+            // summarizes timers and histograms upstream of here when enabled.)
             //
             // https://help.datadoghq.com/hc/en-us/articles/208398693--dog-statsd-sample-rate-parameter-explained
-            std::string factor_str(section_start + 2, section_end - section_start - 2);
-            try {
-              double sample_factor = std::stod(factor_str);
-              if (sample_factor != 0) {
-                point.value /= sample_factor;
-              } else {
-                throw std::invalid_argument("Zero sampling is invalid");
-              }
-            } catch (...) {
-              LOG(WARNING) << "Corrupt sampling value: '" << factor_str << "' "
-                           << "(from data '" << std::string(data, size) << "')";
+            const char* factor_start = section_start + 2;
+            size_t factor_size = section_end - factor_start;
+            double sample_factor;
+            if (strntod(factor_start, factor_size, &sample_factor) && sample_factor != 0) {
+              point.value /= sample_factor;
+            } else {
+              // zero sampling is invalid
+              LOG(WARNING) << "Corrupt sampling value: '" << std::string(factor_start, factor_size)
+                           << "' (from data '" << std::string(data, size) << "')";
             }
           }
           break;
         }
         case '#':
           // datadog tags: include in our tags
-          parse_datadog_tags(section_start, section_end - section_start, tags);
+          parse_datadog_tags(section_start, section_end - section_start, tags, strings);
           break;
         default: {
           // This section must contain the metric type.
@@ -282,136 +424,158 @@ namespace {
 
 const std::string& metrics::AvroEncoder::header() {
   if (header_data.empty()) {
-    std::ostringstream oss;
-    {
-      std::shared_ptr<avro::OutputStream> avro_outstream(avro::ostreamOutputStream(oss));
-      avro::EncoderPtr encoder = avro::binaryEncoder();
-      encoder->init(*avro_outstream);
-
-      MetadataMap metadata_map;
-      set_metadata(metadata_map, AVRO_CODEC_KEY, AVRO_NULL_CODEC);
-
-      // Pass minimized schema directly. Avro C++'s compileJsonSchemaFromString just de-minimizes it.
-      LOG(INFO) << "Using schema: " << metrics_schema::SCHEMA_JSON;
-      set_metadata(metadata_map, AVRO_SCHEMA_KEY, metrics_schema::SCHEMA_JSON);
-
-      avro::encode(*encoder, magic);
-      avro::encode(*encoder, metadata_map);
-      avro::encode(*encoder, *get_sync_bytes());
-      encoder->flush(); // required
-    }
-    header_data = oss.str();
+    header_data = header(AvroCodec::NULL_CODEC);
   }
-
   return header_data;
 }
 
+std::string metrics::AvroEncoder::header(const std::string& codec_name) {
+  std::ostringstream oss;
+  {
+    std::shared_ptr<avro::OutputStream> avro_outstream(avro::ostreamOutputStream(oss));
+    avro::EncoderPtr encoder = avro::binaryEncoder();
+    encoder->init(*avro_outstream);
+
+    MetadataMap metadata_map;
+    set_metadata(metadata_map, AVRO_CODEC_KEY, codec_name);
+
+    // Pass minimized schema directly. Avro C++'s compileJsonSchemaFromString just de-minimizes it.
+    LOG(INFO) << "Using codec " << codec_name << " with schema: " << metrics_schema::SCHEMA_JSON;
+    set_metadata(metadata_map, AVRO_SCHEMA_KEY, metrics_schema::SCHEMA_JSON);
+
+    avro::encode(*encoder, magic);
+    avro::encode(*encoder, metadata_map);
+    avro::encode(*encoder, *get_sync_bytes());
+    encoder->flush(); // required
+  }
+  return oss.str();
+}
+
 void metrics::AvroEncoder::encode_metrics_block(
-    const container_id_ord_map<ContainerMetrics>& metric_map,
+    const avro_metrics_map_t& metric_map,
     std::ostream& ostream) {
-  // in the first pass, encode the data so that we can get the byte count
+  ByteBuffer buf;
+  encode_metrics_block(metric_map, buf);
+  ostream.write(buf.data(), buf.size());
+}
+
+void metrics::AvroEncoder::encode_metrics_block(
+    const avro_metrics_map_t& metric_map,
+    ByteBuffer& buf,
+    AvroCodec* codec/*=NULL*/) {
+  // Encode the data directly into the buffer, leaving headroom for the block header. The header
+  // (obj count + byte count) depends on the encoded data, so it's filled in afterwards.
+  buf.reset(BLOCK_HEADER_MAX_SIZE);
   int64_t obj_count = 0;
-  std::ostringstream oss;
   {
-    std::shared_ptr<avro::OutputStream> avro_ostream(avro::ostreamOutputStream(oss));
+    ByteBufferOutputStream avro_ostream(buf);
     avro::EncoderPtr encoder = avro::binaryEncoder();
-    encoder->init(*avro_ostream);
+    encoder->init(avro_ostream);
 
-    for (auto container_metrics_entry : metric_map) {
+    for (const auto& container_metrics_entry : metric_map) {
       if (!empty(container_metrics_entry.second.without_custom_tags)) {
         ++obj_count;
         avro::encode(*encoder, container_metrics_entry.second.without_custom_tags);
       }
-      for (auto tagged_metrics_list : container_metrics_entry.second.with_custom_tags) {
+      for (const auto& tagged_metrics_list : container_metrics_entry.second.with_custom_tags) {
         if (!empty(tagged_metrics_list)) {
           ++obj_count;
           avro::encode(*encoder, tagged_metrics_list);
         }
       }
     }
-    if (obj_count == 0) {
-      // Nothing to encode, produce 0 bytes
-      return;
-    }
 
-    encoder->flush();
+    encoder->flush(); // required: returns any unused space to the buffer
+  }
+  if (obj_count == 0) {
+    // Nothing to encode, produce 0 bytes
+    buf.reset();
+    return;
   }
+  if (codec != NULL && !codec->compress(buf, BLOCK_HEADER_MAX_SIZE)) {
+    // An uncompressed block can't be mixed into a compressed stream, so drop it.
+    LOG(ERROR) << "Dropping " << obj_count << " metric lists which failed to compress";
+    buf.reset();
+    return;
+  }
+
+  // Write the block header in front of the data, and the block footer (sync bytes) after it.
+  uint8_t header[BLOCK_HEADER_MAX_SIZE];
+  size_t header_size = encode_long(obj_count, header);
+  header_size += encode_long((int64_t)buf.size(), header + header_size);
+  buf.prepend(header, header_size);
 
-  // in the second pass, write the block:
-  // - block header (obj count + byte count)
-  // - the encoded data (from first pass)
-  // - block footer (sync bytes)
-  std::shared_ptr<avro::OutputStream> avro_ostream(avro::ostreamOutputStream(ostream));
-  avro::EncoderPtr encoder = avro::binaryEncoder();
-  encoder->init(*avro_ostream);
-  avro::encode(*encoder, obj_count);
-  avro::encode(*encoder, (int64_t)oss.str().size());
-
-  encoder->flush(); // ensure header is written before we write data
-  ostream << oss.str();
-
-  avro::encode(*encoder, *get_sync_bytes());
-  encoder->flush(); // required
+  const DataFileSync& sync = *get_sync_bytes();
+  buf.append(sync.data(), sync.size());
 }
 
 size_t metrics::AvroEncoder::statsd_to_map(
     const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
     const char* data, size_t size,
-    container_id_ord_map<ContainerMetrics>& metric_map) {
-  ContainerMetrics* cm_out;
-  if (container_id == NULL) {
-    mesos::ContainerID missing_id;
-    missing_id.set_value(UNKNOWN_CONTAINER_TAG);
-    auto iter = metric_map.find(missing_id);
-    if (iter == metric_map.end()) {
-      cm_out = &metric_map[missing_id];
-    } else {
-      cm_out = &iter->second;
-    }
-  } else {
-    auto iter = metric_map.find(*container_id);
-    if (iter == metric_map.end()) {
-      cm_out = &metric_map[*container_id];
-    } else {
-      cm_out = &iter->second;
-    }
-  }
+    avro_metrics_map_t& metric_map) {
+  ContainerMetrics* cm_out =
+    &metric_map[(container_id == NULL) ? get_unknown_container_id() : *container_id];
 
-  metrics_schema::MetricList& without_custom_tags = cm_out->without_custom_tags;
+  MetricList& without_custom_tags = cm_out->without_custom_tags;
 
   without_custom_tags.datapoints.emplace_back();
-  metrics_schema::Datapoint& point = without_custom_tags.datapoints.back();
+  Datapoint& point = without_custom_tags.datapoints.back();
   point.time_ms = now_in_ms();
   // optimizing for the case where the sender didn't include datadog tags:
   // only do additional work if parsing the statsd data resulted in new tags added.
   size_t old_tag_count = without_custom_tags.tags.size();
-  parse_statsd_name_val_tags(data, size, point, without_custom_tags.tags);
+  parse_statsd_name_val_tags(data, size, point, without_custom_tags.tags, metric_map.strings);
   size_t new_tag_count = without_custom_tags.tags.size();
   if (new_tag_count - old_tag_count != 0) {
-    // has custom tags. create/init a new dedicated MetricList and move the datapoint+tags there.
-    cm_out->with_custom_tags.emplace_back();
-    metrics_schema::MetricList& new_custom_tag_list = cm_out->with_custom_tags.back();
-    init_list(new_custom_tag_list, container_id, executor_info);
+    // has custom tags in idx=[old_tag_count, new_tag_count). find the MetricList which already has
+    // the same custom tags, if any.
+    const Tag* custom_tags = without_custom_tags.tags.data() + old_tag_count;
+    size_t custom_tag_count = new_tag_count - old_tag_count;
+    uint64_t fingerprint = tags_fingerprint(custom_tags, custom_tag_count);
+    MetricList* custom_tag_list = NULL;
+    auto index_iter = cm_out->custom_tags_index.find(fingerprint);
+    if (index_iter != cm_out->custom_tags_index.end()) {
+      MetricList& candidate = cm_out->with_custom_tags[index_iter->second];
+      // the custom tags follow the container's own tags
+      if (candidate.tags.size() >= custom_tag_count
+          && same_tag_set(custom_tags,
+              candidate.tags.data() + candidate.tags.size() - custom_tag_count, custom_tag_count)) {
+        custom_tag_list = &candidate;
+      }
+    }
+
+    if (custom_tag_list == NULL) {
+      // create/init a new dedicated MetricList and move the tags there.
+      if (index_iter == cm_out->custom_tags_index.end()) {
+        // (on a fingerprint collision, the new list just doesn't get indexed)
+        cm_out->custom_tags_index[fingerprint] = cm_out->with_custom_tags.size();
+      }
+      cm_out->with_custom_tags.emplace_back();
+      custom_tag_list = &cm_out->with_custom_tags.back();
+      init_list(*custom_tag_list, container_id, executor_info, metric_map.strings);
+
+      auto tagiter = without_custom_tags.tags.begin();
+      std::advance(tagiter, old_tag_count);
+      std::move(tagiter, without_custom_tags.tags.end(),
+          std::back_inserter(custom_tag_list->tags));
+    }
+    without_custom_tags.tags.resize(old_tag_count);
 
     // move datapoint at back
-    new_custom_tag_list.datapoints.push_back(
-        std::move(without_custom_tags.datapoints.back()));
+    custom_tag_list->datapoints.push_back(std::move(without_custom_tags.datapoints.back()));
     without_custom_tags.datapoints.pop_back();
-
-    // move custom tags in idx=[old_tag_count, new_tag_count)
-    auto tagiter = without_custom_tags.tags.begin();
-    std::advance(tagiter, old_tag_count);
-    std::move(tagiter, without_custom_tags.tags.end(),
-        std::back_inserter(new_custom_tag_list.tags));
-    without_custom_tags.tags.resize(old_tag_count);
   } else {
     // no custom tags, data should stay in without_custom_tags.
-    init_list(without_custom_tags, container_id, executor_info);
+    // the container's tags only need to be added once.
+    if (!cm_out->without_custom_tags_init) {
+      init_list(without_custom_tags, container_id, executor_info, metric_map.strings);
+      cm_out->without_custom_tags_init = true;
+    }
   }
 
   return 1;
 }
 
-bool metrics::AvroEncoder::empty(const metrics_schema::MetricList& metric_list) {
+bool metrics::AvroEncoder::empty(const MetricList& metric_list) {
   return metric_list.datapoints.empty() && metric_list.tags.empty() && metric_list.topic.empty();
 }
@@ -1,39 +1,133 @@
 #pragma once
 
 #include <mesos/mesos.pb.h>
+#include <unordered_map>
 
 #include "mesos_hash.hpp"
-#include "metrics_schema_struct.hpp"
+#include "string_interner.hpp"
 
 namespace metrics {
+  class AvroCodec;
+  class ByteBuffer;
+
+  /**
+   * In-memory equivalents of the metrics_schema structs, whose strings reference a
+   * StringInterner rather than each owning an allocation. Encoded identically to their
+   * metrics_schema counterparts.
+   */
+  struct Tag {
+    InternedString key;
+    InternedString value;
+  };
+  struct Datapoint {
+    Datapoint()
+      : time_ms(0), value(0) { }
+
+    InternedString name;
+    int64_t time_ms;
+    double value;
+  };
+  struct MetricList {
+    InternedString topic;
+    std::vector<Tag> tags;
+    std::vector<Datapoint> datapoints;
+  };
+
   /**
    * We allow containers to emit metrics which contain their own custom tags.
-   * Tags are populated at the root of the MetricList, so we put each metric with custom tags into
-   * a separate MetricList of its own. In theory we could merge two MetricLists when they contain
-   * the same custom tag values, but that'd be a lot of work.
+   * Tags are populated at the root of the MetricList, so metrics with custom tags go into a
+   * separate MetricList for each distinct set of custom tags, regardless of the tags' order.
    *
    * In practice, most emitters don't include tags, so their datapoints all go into `without_tags`.
    */
   class ContainerMetrics {
    public:
-    metrics_schema::MetricList without_custom_tags;
-    std::vector<metrics_schema::MetricList> with_custom_tags;
+    ContainerMetrics()
+      : without_custom_tags_init(false) { }
+
+    MetricList without_custom_tags;
+    std::vector<MetricList> with_custom_tags;
+
+    /**
+     * Maps a fingerprint of each custom tag set to its MetricList in with_custom_tags.
+     */
+    std::unordered_map<uint64_t, size_t> custom_tags_index;
+
+    /**
+     * Whether the container's own tags have been added to without_custom_tags.
+     */
+    bool without_custom_tags_init;
+  };
+
+  /**
+   * The metrics collected between two flushes, by container. The MetricLists' strings are held by
+   * 'strings', and are released along with the MetricLists by clear().
+   */
+  class AvroMetricsMap {
+   public:
+    typedef container_id_ord_map<ContainerMetrics>::const_iterator const_iterator;
+
+    /**
+     * Returns the metrics for the provided container, adding an empty entry if there isn't one.
+     */
+    ContainerMetrics& operator[](const mesos::ContainerID& container_id) {
+      return containers[container_id];
+    }
+
+    const_iterator begin() const {
+      return containers.begin();
+    }
+
+    const_iterator end() const {
+      return containers.end();
+    }
+
+    size_t size() const {
+      return containers.size();
+    }
+
+    bool empty() const {
+      return containers.empty();
+    }
+
+    void clear() {
+      containers.clear();
+      strings.reset();
+    }
+
+    StringInterner strings;
+
+   private:
+    container_id_ord_map<ContainerMetrics> containers;
   };
-  typedef container_id_ord_map<ContainerMetrics> avro_metrics_map_t;
+  typedef AvroMetricsMap avro_metrics_map_t;
 
   class AvroEncoder {
    public:
     /**
-     * Returns a statically allocated header buffer.
+     * Returns a statically allocated header buffer, for blocks which use the null codec.
      */
     static const std::string& header();
 
+    /**
+     * Returns a header buffer advertising the provided codec name, see AvroCodec.
+     */
+    static std::string header(const std::string& codec_name);
+
     /**
      * Writes the provided metrics to the provided output stream.
      */
     static void encode_metrics_block(
         const avro_metrics_map_t& metric_map, std::ostream& ostream);
 
+    /**
+     * Replaces the content of the provided buffer with the provided metrics, reusing the buffer's
+     * allocation. The buffer is left empty if there was nothing to encode, or if compression failed.
+     * The block data is compressed with the provided codec, or left uncompressed if it's NULL.
+     */
+    static void encode_metrics_block(
+        const avro_metrics_map_t& metric_map, ByteBuffer& buf, AvroCodec* codec = NULL);
+
     /**
      * Returns the number of Datapoints added to the provided map of MetricLists
      */
@@ -45,7 +139,7 @@ namespace metrics {
     /**
      * Returns whether the provided MetricList has nothing in it.
      */
-    static bool empty(const metrics_schema::MetricList& metric_list);
+    static bool empty(const MetricList& metric_list);
 
    private:
     AvroEncoder() { /* do not instantiate */ }
@@ -0,0 +1,60 @@
+#include "byte_buffer.hpp"
+
+#include <string.h>
+#include <utility>
+
+namespace {
+  const size_t MIN_CAPACITY = 4096;
+}
+
+metrics::ByteBuffer::ByteBuffer(size_t headroom/*=0*/, size_t initial_capacity/*=0*/)
+  : buf(headroom + initial_capacity),
+    start(headroom),
+    end(headroom) { }
+
+void metrics::ByteBuffer::reset(size_t headroom/*=0*/) {
+  if (headroom > buf.size()) {
+    buf.resize(headroom);
+  }
+  start = headroom;
+  end = headroom;
+}
+
+uint8_t* metrics::ByteBuffer::prepare(size_t min_size) {
+  if (buf.size() - end < min_size) {
+    // Grow geometrically so that a stream of small writes stays amortized O(1).
+    size_t new_size = 2 * buf.size();
+    if (new_size < MIN_CAPACITY) {
+      new_size = MIN_CAPACITY;
+    }
+    if (new_size < end + min_size) {
+      new_size = end + min_size;
+    }
+    buf.resize(new_size);
+  }
+  return buf.data() + end;
+}
+
+void metrics::ByteBuffer::append(const void* data, size_t size) {
+  memcpy(prepare(size), data, size);
+  end += size;
+}
+
+void metrics::ByteBuffer::prepend(const void* data, size_t size) {
+  if (size > start) {
+    // Not enough headroom: shift the current data forward to make room.
+    size_t shift = size - start;
+    prepare(shift);
+    memmove(buf.data() + start + shift, buf.data() + start, end - start);
+    start += shift;
+    end += shift;
+  }
+  start -= size;
+  memcpy(buf.data() + start, data, size);
+}
+
+void metrics::ByteBuffer::swap(ByteBuffer& other) {
+  buf.swap(other.buf);
+  std::swap(start, other.start);
+  std::swap(end, other.end);
+}
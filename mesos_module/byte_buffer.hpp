@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace metrics {
+
+  /**
+   * A growable byte buffer which keeps its allocation across reset()s, so that it may be reused for
+   * each encoded block without reallocating.
+   *
+   * The buffer may reserve some headroom in front of its data. This allows a header whose size
+   * depends on the data (such as an avro block header) to be prepend()ed once the data has been
+   * written, without moving the data itself.
+   */
+  class ByteBuffer {
+   public:
+    explicit ByteBuffer(size_t headroom = 0, size_t initial_capacity = 0);
+
+    /**
+     * Discards any data, keeping the current allocation, and reserves 'headroom' bytes in front.
+     */
+    void reset(size_t headroom = 0);
+
+    const char* data() const {
+      return (const char*)buf.data() + start;
+    }
+    size_t size() const {
+      return end - start;
+    }
+    bool empty() const {
+      return start == end;
+    }
+    size_t capacity() const {
+      return buf.size();
+    }
+
+    /**
+     * Returns a pointer to at least 'min_size' writable bytes following the data, growing the
+     * buffer if needed. The writable region extends to the end of the current allocation, see
+     * tail_size(). Written bytes are then added to the data with commit().
+     */
+    uint8_t* prepare(size_t min_size);
+    size_t tail_size() const {
+      return buf.size() - end;
+    }
+    void commit(size_t size) {
+      end += size;
+    }
+    /**
+     * Returns the last 'size' bytes of data to the writable region. Must not exceed size().
+     */
+    void uncommit(size_t size) {
+      end -= size;
+    }
+
+    void append(const void* data, size_t size);
+
+    /**
+     * Inserts the provided data in front of the current data. This doesn't move the current data
+     * if enough headroom was reserved.
+     */
+    void prepend(const void* data, size_t size);
+
+    /**
+     * Exchanges the content and allocation of this buffer with another.
+     */
+    void swap(ByteBuffer& other);
+
+   private:
+    std::vector<uint8_t> buf;
+    size_t start, end;
+  };
+}
@@ -0,0 +1,122 @@
+#include "cardinality_limiter.hpp"
+
+#include <cmath>
+#include <string.h>
+
+#include "statsd_util.hpp"
+
+namespace {
+  const size_t MIN_TABLE_SIZE = 64; // must be a power of two
+
+  // 2^10 registers: ~3% standard error in 1KB
+  const size_t HLL_BITS = 10;
+  const size_t HLL_REGISTERS = 1 << HLL_BITS;
+}
+
+metrics::CardinalityLimiter::CardinalityLimiter(size_t max_series)
+  : max_series(max_series),
+    table(MIN_TABLE_SIZE, 0),
+    seen(MIN_TABLE_SIZE, 0),
+    count(0),
+    limited_lines(0) { }
+
+bool metrics::CardinalityLimiter::add(const char* data, size_t size) {
+  return add_hash(statsd_series_hash(data, size));
+}
+
+bool metrics::CardinalityLimiter::add(const StatsdIndex::Line& line) {
+  return add_hash(statsd_series_hash(line));
+}
+
+bool metrics::CardinalityLimiter::add_hash(uint64_t hash) {
+  if (registers.empty()) {
+    registers.resize(HLL_REGISTERS, 0);
+  }
+  uint8_t& reg = registers[hash >> (64 - HLL_BITS)];
+  // position of the first 1 bit after the register index bits, with a guard bit to cap the rank
+  uint8_t rank = __builtin_clzll((hash << HLL_BITS) | (1ULL << (HLL_BITS - 1))) + 1;
+  if (rank > reg) {
+    reg = rank;
+  }
+
+  size_t mask = table.size() - 1;
+  size_t idx = hash & mask;
+  for (; table[idx] != 0; idx = (idx + 1) & mask) {
+    if (table[idx] == hash) {
+      seen[idx] = 1;
+      return true;
+    }
+  }
+  if (count >= max_series) {
+    ++limited_lines;
+    return false;
+  }
+
+  table[idx] = hash;
+  seen[idx] = 1;
+  ++count;
+  if (count * 2 > table.size()) {
+    // grow: at most ~4 * max_series slots
+    rebuild(table.size() * 2, false);
+  }
+  return true;
+}
+
+void metrics::CardinalityLimiter::rebuild(size_t size, bool seen_only) {
+  std::vector<uint64_t> old_table(size, 0);
+  std::vector<uint8_t> old_seen(size, 0);
+  old_table.swap(table);
+  old_seen.swap(seen);
+  size_t mask = size - 1;
+  count = 0;
+  for (size_t i = 0; i < old_table.size(); ++i) {
+    if (old_table[i] == 0 || (seen_only && !old_seen[i])) {
+      continue;
+    }
+    size_t idx = old_table[i] & mask;
+    for (; table[idx] != 0; idx = (idx + 1) & mask) { }
+    table[idx] = old_table[i];
+    // a new period starts with nothing seen
+    seen[idx] = seen_only ? 0 : old_seen[i];
+    ++count;
+  }
+}
+
+double metrics::CardinalityLimiter::estimate() const {
+  if (registers.empty()) {
+    return 0;
+  }
+  double m = HLL_REGISTERS;
+  double sum = 0;
+  size_t zeros = 0;
+  for (uint8_t reg : registers) {
+    sum += std::ldexp(1., -reg);
+    if (reg == 0) {
+      ++zeros;
+    }
+  }
+  double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+  if (estimate <= 2.5 * m && zeros != 0) {
+    // small range: linear counting is more accurate
+    estimate = m * std::log(m / zeros);
+  }
+  return estimate;
+}
+
+void metrics::CardinalityLimiter::next_period() {
+  // Keep the series which are still being sent, so that they keep flowing rather than competing
+  // with new series for room every period. The rest are dropped, releasing any spike in series.
+  size_t kept = 0;
+  for (uint8_t entry_seen : seen) {
+    kept += entry_seen;
+  }
+  size_t size = MIN_TABLE_SIZE;
+  while (kept * 2 > size) {
+    size *= 2;
+  }
+  rebuild(size, true);
+  limited_lines = 0;
+  if (!registers.empty()) {
+    memset(registers.data(), 0, registers.size());
+  }
+}
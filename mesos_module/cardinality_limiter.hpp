@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "statsd_index.hpp"
+
+namespace metrics {
+
+  /**
+   * Limits the number of distinct statsd series (name, type and tags, in any order, as hashed by
+   * statsd_series_hash()) accepted from a single source. The first max_series series are admitted and tracked exactly, and keep being
+   * accepted for as long as they're seen at least once per period. Any other series are refused
+   * until admitted series stop being sent, so a source which keeps sending new series can't
+   * displace its established ones, or push more than max_series of them at a time.
+   *
+   * Alongside this, every series seen (including refused ones) is counted in a HyperLogLog, so
+   * that the source's actual cardinality can be reported in a fixed amount of memory.
+   */
+  class CardinalityLimiter {
+   public:
+    explicit CardinalityLimiter(size_t max_series);
+
+    /**
+     * Returns whether the series of the provided statsd line is admitted, adding it if it's new
+     * and there's still room.
+     */
+    bool add(const char* data, size_t size);
+
+    /**
+     * Same as above, for a line which has already been indexed.
+     */
+    bool add(const StatsdIndex::Line& line);
+
+    /**
+     * Returns the number of series currently admitted.
+     */
+    size_t series() const {
+      return count;
+    }
+
+    /**
+     * Returns the number of lines refused by add() since the last next_period().
+     */
+    size_t limited() const {
+      return limited_lines;
+    }
+
+    /**
+     * Returns an estimate of the number of distinct series seen since the last next_period(), whether
+     * or not they were admitted. Typically within a few percent.
+     */
+    double estimate() const;
+
+    /**
+     * Starts a new period: forgets the admitted series which weren't seen during the last period,
+     * making room for new ones, and resets the counts and the estimate.
+     */
+    void next_period();
+
+   private:
+    bool add_hash(uint64_t hash);
+    void rebuild(size_t size, bool seen_only);
+
+    size_t max_series;
+
+    // Open addressing set of series hashes, where 0 is an empty slot. Sized to a power of two.
+    std::vector<uint64_t> table;
+    // Whether each entry in 'table' has been seen during the current period
+    std::vector<uint8_t> seen;
+    size_t count;
+    size_t limited_lines;
+
+    // HyperLogLog registers: allocated on first use
+    std::vector<uint8_t> registers;
+  };
+
+}
@@ -1,9 +1,13 @@
 #include "collector_output_writer.hpp"
 
+#include <atomic>
 #include <glog/logging.h>
+#include <stout/path.hpp>
 
+#include "avro_codec.hpp"
 #include "avro_encoder.hpp"
 #include "metrics_tcp_sender.hpp"
+#include "output_spool.hpp"
 #include "sync_util.hpp"
 
 namespace {
@@ -18,19 +22,103 @@ namespace {
     }
     return ip;
   }
+
+  std::string get_codec_name(const mesos::Parameters& parameters) {
+    return metrics::params::get_str(parameters,
+        metrics::params::OUTPUT_COLLECTOR_CODEC, metrics::params::OUTPUT_COLLECTOR_CODEC_DEFAULT);
+  }
+
+  std::shared_ptr<metrics::AvroCodec> create_codec(const mesos::Parameters& parameters) {
+    Try<std::shared_ptr<metrics::AvroCodec>> codec = metrics::AvroCodec::create(
+        get_codec_name(parameters),
+        metrics::params::get_uint(parameters,
+            metrics::params::OUTPUT_COLLECTOR_CODEC_LEVEL,
+            metrics::params::OUTPUT_COLLECTOR_CODEC_LEVEL_DEFAULT));
+    if (codec.isError()) {
+      LOG(FATAL) << "Unable to configure " << metrics::params::OUTPUT_COLLECTOR_CODEC << ": "
+                 << codec.error();
+    }
+    return codec.get();
+  }
+
+  std::shared_ptr<metrics::OutputSpool> create_spool(
+      const mesos::Parameters& parameters, const std::string& session_header) {
+    size_t max_bytes = metrics::params::get_uint(parameters,
+        metrics::params::OUTPUT_COLLECTOR_SPOOL_MAX_BYTES,
+        metrics::params::OUTPUT_COLLECTOR_SPOOL_MAX_BYTES_DEFAULT);
+    if (max_bytes == 0) {
+      return std::shared_ptr<metrics::OutputSpool>();
+    }
+
+    std::string eviction_str = metrics::params::get_str(parameters,
+        metrics::params::OUTPUT_COLLECTOR_SPOOL_EVICTION,
+        metrics::params::OUTPUT_COLLECTOR_SPOOL_EVICTION_DEFAULT);
+    metrics::OutputSpool::Eviction eviction;
+    if (eviction_str == metrics::params::OUTPUT_COLLECTOR_SPOOL_EVICTION_DROP_OLDEST) {
+      eviction = metrics::OutputSpool::DROP_OLDEST;
+    } else if (eviction_str == metrics::params::OUTPUT_COLLECTOR_SPOOL_EVICTION_DROP_NEWEST) {
+      eviction = metrics::OutputSpool::DROP_NEWEST;
+    } else {
+      LOG(FATAL) << "Unknown " << metrics::params::OUTPUT_COLLECTOR_SPOOL_EVICTION
+                 << " config value: " << eviction_str;
+      return std::shared_ptr<metrics::OutputSpool>();
+    }
+
+    std::string dir = path::join(
+        metrics::params::get_str(parameters,
+            metrics::params::STATE_PATH_DIR, metrics::params::STATE_PATH_DIR_DEFAULT),
+        "collector_spool");
+    Try<std::shared_ptr<metrics::OutputSpool>> spool =
+      metrics::OutputSpool::create(dir, session_header, max_bytes, eviction);
+    if (spool.isError()) {
+      // Not fatal: carry on without one
+      LOG(ERROR) << "Unable to set up collector output spool: " << spool.error();
+      return std::shared_ptr<metrics::OutputSpool>();
+    }
+    return spool.get();
+  }
+
+  std::shared_ptr<metrics::MetricsTCPSender> create_sender(
+      std::shared_ptr<boost::asio::io_service> io_service,
+      const mesos::Parameters& parameters) {
+    std::string session_header = metrics::AvroEncoder::header(get_codec_name(parameters));
+    return std::shared_ptr<metrics::MetricsTCPSender>(new metrics::MetricsTCPSender(
+            io_service,
+            session_header,
+            get_collector_ip(parameters),
+            metrics::params::get_uint(parameters,
+                metrics::params::OUTPUT_COLLECTOR_PORT,
+                metrics::params::OUTPUT_COLLECTOR_PORT_DEFAULT),
+            metrics::MetricsTCPSender::PENDING_LIMIT,
+            create_spool(parameters, session_header),
+            metrics::params::get_uint(parameters,
+                metrics::params::OUTPUT_COLLECTOR_SPOOL_REPLAY_BYTES_PER_SEC,
+                metrics::params::OUTPUT_COLLECTOR_SPOOL_REPLAY_BYTES_PER_SEC_DEFAULT)));
+  }
 }
 
 metrics::output_writer_ptr_t metrics::CollectorOutputWriter::create(
     std::shared_ptr<boost::asio::io_service> io_service,
     const mesos::Parameters& parameters) {
-  std::shared_ptr<MetricsTCPSender> sender(new MetricsTCPSender(
-          io_service,
-          AvroEncoder::header(),
-          get_collector_ip(parameters),
-          params::get_uint(parameters,
-              params::OUTPUT_COLLECTOR_PORT, params::OUTPUT_COLLECTOR_PORT_DEFAULT)));
-  return metrics::output_writer_ptr_t(
-      new metrics::CollectorOutputWriter(io_service, parameters, sender));
+  return metrics::output_writer_ptr_t(new metrics::CollectorOutputWriter(
+          io_service, parameters, create_sender(io_service, parameters)));
+}
+
+std::vector<metrics::output_writer_ptr_t> metrics::CollectorOutputWriter::create_sharded(
+    const std::vector<std::shared_ptr<boost::asio::io_service>>& io_services,
+    const mesos::Parameters& parameters) {
+  std::vector<output_writer_ptr_t> writers;
+  if (io_services.empty()) {
+    return writers;
+  }
+  // The first writer owns the sender. The others hand their encoded blocks to it.
+  std::shared_ptr<MetricsTCPSender> sender = create_sender(io_services[0], parameters);
+  for (size_t i = 0; i < io_services.size(); ++i) {
+    CollectorOutputWriter* writer = new CollectorOutputWriter(io_services[i], parameters, sender);
+    writer->remote_sender = (i != 0);
+    writers.push_back(output_writer_ptr_t(writer));
+  }
+  return writers;
 }
 
 metrics::CollectorOutputWriter::CollectorOutputWriter(
@@ -53,7 +141,9 @@ metrics::CollectorOutputWriter::CollectorOutputWriter(
             params::OUTPUT_COLLECTOR_CHUNK_SIZE_DATAPOINTS_DEFAULT)),
     io_service(io_service),
     flush_timer(*io_service),
-    sender(sender) { }
+    codec(create_codec(parameters)),
+    sender(sender),
+    remote_sender(false) { }
 
 metrics::CollectorOutputWriter::~CollectorOutputWriter() {
   LOG(INFO) << "Asynchronously triggering CollectorOutputWriter shutdown";
@@ -69,7 +159,9 @@ metrics::CollectorOutputWriter::~CollectorOutputWriter() {
 void metrics::CollectorOutputWriter::start() {
   // Only run the timer callbacks within the io_service thread:
   LOG(INFO) << "CollectorOutputWriter starting work";
-  sender->start();
+  if (!remote_sender) {
+    sender->start();
+  }
   if (chunking) {
     start_chunk_flush_timer();
   }
@@ -97,14 +189,23 @@ void metrics::CollectorOutputWriter::flush() {
     return; // nothing to flush
   }
 
-  MetricsTCPSender::buf_ptr_t buf(new boost::asio::streambuf);
-  {
-    std::ostream ostream(buf.get());
-    AvroEncoder::encode_metrics_block(container_map, ostream);
+  if (!output_buffer || output_buffer.use_count() != 1) {
+    // The previous buffer is still queued in the sender (or this is the first flush).
+    output_buffer.reset(new ByteBuffer);
+  } else {
+    // Ensure the sender's last use of the buffer happens-before our writes to it.
+    std::atomic_thread_fence(std::memory_order_acquire);
   }
+  AvroEncoder::encode_metrics_block(container_map, *output_buffer, codec.get());
   container_map.clear();
-  if (buf->size() != 0) {
-    sender->send(buf);
+  if (output_buffer->empty()) {
+    return;
+  }
+  if (remote_sender) {
+    // Hand the whole encoded block over to the sender's thread in one go.
+    sender->dispatch_send(output_buffer);
+  } else {
+    sender->send(output_buffer);
   }
 }
 
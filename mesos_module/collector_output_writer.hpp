@@ -2,14 +2,14 @@
 
 #include <boost/asio.hpp>
 
-#include "mesos_hash.hpp"
-#include "metrics_schema_struct.hpp"
+#include "avro_encoder.hpp"
+#include "byte_buffer.hpp"
 #include "output_writer.hpp"
 #include "params.hpp"
 
 namespace metrics {
+  class AvroCodec;
   class MetricsTCPSender;
-  class ContainerMetrics;
 
   /**
    * A CollectorOutputWriter accepts data from one or more ContainerReaders, then tags and forwards it
@@ -29,6 +29,18 @@ namespace metrics {
         std::shared_ptr<boost::asio::io_service> io_service,
         const mesos::Parameters& parameters);
 
+    /**
+     * Creates one CollectorOutputWriter for each of the provided io_services, for use by a
+     * multi-threaded IORunner. Each writer encodes its own data independently, but all of them
+     * forward their encoded output to a single collector session which runs against the first
+     * io_service. This keeps the collector seeing one continuous stream from the agent.
+     *
+     * start() must be called on each writer before write()ing data, or else that data will be lost.
+     */
+    static std::vector<output_writer_ptr_t> create_sharded(
+        const std::vector<std::shared_ptr<boost::asio::io_service>>& io_services,
+        const mesos::Parameters& parameters);
+
     /**
      * Use create(). This is meant for access by tests.
      */
@@ -45,6 +57,13 @@ namespace metrics {
      */
     void start();
 
+    /**
+     * Gauge values are sent to the collector as-is, including negative ones.
+     */
+    bool relative_signed_gauges() const {
+      return false;
+    }
+
     /**
      * Outputs the provided statsd message associated with the given container information, or NULL
      * container information if none is available. The provided data should only be for a single
@@ -66,13 +85,18 @@ namespace metrics {
     const size_t datapoint_capacity;
     size_t datapoint_count;
 
-    container_id_ord_map<ContainerMetrics> container_map;
+    avro_metrics_map_t container_map;
 
     std::shared_ptr<boost::asio::io_service> io_service;
     boost::asio::deadline_timer flush_timer;
-    std::string output_buffer;
+    // Reused across flushes once the sender has released it.
+    std::shared_ptr<ByteBuffer> output_buffer;
+    // Compresses each block, or NULL for no compression.
+    std::shared_ptr<AvroCodec> codec;
 
     std::shared_ptr<MetricsTCPSender> sender;
+    // Whether the sender runs against another writer's io_service, see create_sharded().
+    bool remote_sender;
   };
 
 }
@@ -1,6 +1,8 @@
 #include "container_assigner_strategy.hpp"
 
 #include <glog/logging.h>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
 
 #include "params.hpp"
 #include "io_runner.hpp"
@@ -100,7 +102,8 @@ Try<std::shared_ptr<metrics::ContainerReader>> metrics::SinglePortStrategy::init
   if (!single_container_reader) {
     LOG(INFO) << "Creating single-port reader at port[" << single_port_value << "].";
     // Create/open/register a new port reader only if one doesn't exist.
-    std::shared_ptr<ContainerReader> reader = io_runner->create_container_reader(single_port_value);
+    std::shared_ptr<ContainerReader> reader = io_runner->create_container_reader(
+        single_port_value, NULL /* shared by all containers */);
     Try<UDPEndpoint> endpoint = reader->open();
     if (endpoint.isError()) {
       std::ostringstream oss;
@@ -142,7 +145,8 @@ Try<metrics::UDPEndpoint> metrics::EphemeralPortStrategy::register_container(
   }
 
   // Create/open/register a new reader against an ephemeral port.
-  std::shared_ptr<ContainerReader> reader = io_runner->create_container_reader(0 /* port */);
+  std::shared_ptr<ContainerReader> reader = io_runner->create_container_reader(
+      0 /* port */, &container_id);
   Try<UDPEndpoint> endpoint = reader->open();
   if (endpoint.isError()) {
     std::ostringstream oss;
@@ -167,7 +171,8 @@ void metrics::EphemeralPortStrategy::insert_container(
   // override any existing local state. This shouldn't come up in practice, but just sayin...
 
   // Skip ephemeral behavior: Create/open/register a new reader against the specified endpoint
-  std::shared_ptr<ContainerReader> reader = io_runner->create_container_reader(endpoint.port);
+  std::shared_ptr<ContainerReader> reader = io_runner->create_container_reader(
+      endpoint.port, &container_id);
   Try<UDPEndpoint> new_endpoint = reader->open();
   if (new_endpoint.isError()) {
     LOG(ERROR) << "Unable to insert recovered ephemeral-port reader "
@@ -265,7 +270,8 @@ Try<metrics::UDPEndpoint> metrics::PortRangeStrategy::register_container(
   }
 
   // Create/open/register a new reader against the obtained port.
-  std::shared_ptr<ContainerReader> reader = io_runner->create_container_reader(port.get());
+  std::shared_ptr<ContainerReader> reader = io_runner->create_container_reader(
+      port.get(), &container_id);
   Try<UDPEndpoint> endpoint = reader->open();
   if (endpoint.isError()) {
     std::ostringstream oss;
@@ -302,7 +308,8 @@ void metrics::PortRangeStrategy::insert_container(
   }
 
   // Create/open/register a new reader against the recovered port.
-  std::shared_ptr<ContainerReader> reader = io_runner->create_container_reader(port.get());
+  std::shared_ptr<ContainerReader> reader = io_runner->create_container_reader(
+      port.get(), &container_id);
   Try<UDPEndpoint> new_endpoint = reader->open();
   if (new_endpoint.isError()) {
     LOG(ERROR) << "Unable to open recovered port-range reader at port[" << port.get() << "]: "
@@ -341,3 +348,105 @@ void metrics::PortRangeStrategy::unregister_container(
   }
   container_to_reader.erase(iter);
 }
+
+// ---
+
+metrics::UnixSocketStrategy::UnixSocketStrategy(
+    std::shared_ptr<IORunner> io_runner, const mesos::Parameters& parameters)
+  : io_runner(io_runner),
+    socket_dir(params::get_str(parameters, params::LISTEN_UNIX_DIR, params::LISTEN_UNIX_DIR_DEFAULT)) { }
+
+metrics::UnixSocketStrategy::~UnixSocketStrategy() { }
+
+Try<metrics::UDPEndpoint> metrics::UnixSocketStrategy::register_container(
+    const mesos::ContainerID& container_id, const mesos::ExecutorInfo& executor_info) {
+  // Reuse existing reader if available.
+  // This isn't expected to happen in practice, but just in case..
+  auto iter = container_to_reader.find(container_id);
+  if (iter != container_to_reader.end()) {
+    Try<UDPEndpoint> ret = iter->second->endpoint();
+    if (ret.isError()) {
+      std::ostringstream oss;
+      oss << "Existing unix-socket endpoint unavailable for "
+          << "container[" << container_id.ShortDebugString() << "] "
+          << "executor[" << executor_info.ShortDebugString() << "] ";
+      LOG(ERROR) << oss.str();
+      return Try<UDPEndpoint>(Error(oss.str()));
+    }
+    LOG(INFO) << "Reusing existing unix-socket reader for "
+              << "container[" << container_id.ShortDebugString() << "] "
+              << "executor[" << executor_info.ShortDebugString() << "] "
+              << "at endpoint[" << ret.get().string() << "].";
+    return ret;
+  }
+
+  Try<Nothing> mkdir = os::mkdir(socket_dir);
+  if (mkdir.isError()) {
+    std::ostringstream oss;
+    oss << "Unable to create " << params::LISTEN_UNIX_DIR << "[" << socket_dir << "] for "
+        << "container[" << container_id.ShortDebugString() << "]: " << mkdir.error();
+    LOG(ERROR) << oss.str();
+    return Try<UDPEndpoint>(Error(oss.str()));
+  }
+
+  // Create/open/register a new reader against a socket named after the container.
+  std::string path = path::join(socket_dir, container_id.value() + ".sock");
+  std::shared_ptr<ContainerReader> reader =
+    io_runner->create_unix_container_reader(path, &container_id);
+  Try<UDPEndpoint> endpoint = reader->open();
+  if (endpoint.isError()) {
+    std::ostringstream oss;
+    oss << "Unable to open unix-socket reader at path[" << path << "]: " << endpoint.error();
+    LOG(ERROR) << oss.str();
+    return Try<UDPEndpoint>(Error(oss.str()));
+  }
+  container_to_reader[container_id] = reader;
+  reader->register_container(container_id, executor_info);
+  LOG(INFO) << "New unix-socket reader for container[" << container_id.ShortDebugString() << "] "
+            << "created at endpoint[" << endpoint.get().string() << "].";
+  return endpoint;
+}
+
+void metrics::UnixSocketStrategy::insert_container(
+    const mesos::ContainerID& container_id,
+    const mesos::ExecutorInfo& executor_info,
+    const UDPEndpoint& endpoint) {
+  if (!endpoint.is_unix()) {
+    // The container was launched before switching to unix sockets, and still expects that port.
+    LOG(ERROR) << "Unable to insert recovered "
+               << "container[" << container_id.ShortDebugString() << "]: "
+               << "endpoint[" << endpoint.string() << "] isn't a unix socket";
+    return;
+  }
+
+  // Create/open/register a new reader against the recovered path, which the container was given.
+  std::shared_ptr<ContainerReader> reader =
+    io_runner->create_unix_container_reader(endpoint.host, &container_id);
+  Try<UDPEndpoint> new_endpoint = reader->open();
+  if (new_endpoint.isError()) {
+    LOG(ERROR) << "Unable to insert recovered unix-socket reader "
+               << "at path[" << endpoint.host << "] "
+               << "for container[" << container_id.ShortDebugString() << "]: "
+               << new_endpoint.error();
+    return;
+  }
+  container_to_reader[container_id] = reader;
+  reader->register_container(container_id, executor_info);
+  LOG(INFO) << "Recovered unix-socket reader for "
+            << "container[" << container_id.ShortDebugString() << "] "
+            << "at endpoint[" << new_endpoint.get().string() << "].";
+}
+
+void metrics::UnixSocketStrategy::unregister_container(
+    const mesos::ContainerID& container_id) {
+  auto iter = container_to_reader.find(container_id);
+  if (iter == container_to_reader.end()) {
+    LOG(WARNING) << "No unix-socket reader had been assigned to "
+                 << "container[" << container_id.ShortDebugString() << "], cannot unregister";
+    return;
+  }
+  // Delete the reader (which closes and removes its socket)
+  LOG(INFO) << "Closing unix-socket reader for "
+            << "container[" << container_id.ShortDebugString() << "].";
+  container_to_reader.erase(iter);
+}
@@ -119,4 +119,31 @@ namespace metrics {
     // Allocator of ports within a range.
     std::shared_ptr<RangePool> range_pool;
   };
+
+  /**
+   * Listen on a unix datagram socket per container, rather than a UDP port.
+   * Avoids the IP stack and the port range entirely, and the socket identifies its container.
+   */
+  class UnixSocketStrategy : public ContainerAssignerStrategy {
+   public:
+    UnixSocketStrategy(std::shared_ptr<IORunner> io_runner, const mesos::Parameters& parameters);
+    virtual ~UnixSocketStrategy();
+
+    Try<UDPEndpoint> register_container(
+        const mesos::ContainerID& container_id, const mesos::ExecutorInfo& executor_info);
+    void insert_container(
+        const mesos::ContainerID& container_id,
+        const mesos::ExecutorInfo& executor_info,
+        const UDPEndpoint& endpoint);
+    void unregister_container(const mesos::ContainerID& container_id);
+
+   private:
+    std::shared_ptr<IORunner> io_runner;
+
+    // The directory where each container's socket is created.
+    const std::string socket_dir;
+    // Long-term mapping of container_id to the socket reader assigned to that container. This
+    // mapping exists for the lifespan of the container.
+    container_id_map<std::shared_ptr<ContainerReader>> container_to_reader;
+  };
 }
@@ -10,9 +10,9 @@ namespace metrics {
    * A ContainerReader opens a listen port and reads for incoming statsd data. The data may be
    * annotatated with container information before it is passed to the provided PortWriter.
    * In practice, there is one ContainerReader per listen port. Without ip-per-container, this means
-   * there is one ContainerReader for each container, since each is given a different port. Once
-   * ip-per-container is supported, this may change to a single ContainerReader for all containers
-   * on a mesos-agent, since all may share the same endpoint with distinct source ips.
+   * there is one ContainerReader for each container, since each is given a different port. With
+   * ip-per-container, there may instead be a single ContainerReader for all containers on a
+   * mesos-agent, in which case data is paired with containers by its source ip.
    *
    * This interface class is implemented in container_reader_impl.*. The interface is kept distinct
    * from the implementation to allow for easier mocking.
@@ -39,7 +39,8 @@ namespace metrics {
      * Registers the container with the provided information to this reader. The information will
      * be used for tagging data that comes through the listen socket. This interface allows
      * registering multiple containers to a single port/reader, but that behavior is only supported
-     * in an ip-per-container scenario.
+     * in an ip-per-container scenario, where the ips listed in the executor_info's container
+     * network info are used to tell the containers apart.
      */
     virtual void register_container(
         const mesos::ContainerID& container_id,
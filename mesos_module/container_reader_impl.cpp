@@ -1,5 +1,9 @@
 #include "container_reader_impl.hpp"
 
+#include <cmath>
+#include <sys/stat.h>
+#include <sys/un.h>
+
 #include <boost/asio.hpp>
 #include <glog/logging.h>
 
@@ -8,30 +12,161 @@
 #include "sync_util.hpp"
 
 #define UDP_MAX_PACKET_BYTES 65536 /* UDP size limit in IPv4 (may be larger in IPv6) */
+#define SOCKET_BUFFER_POOL_SIZE 4 /* buffers kept for when writers hold onto slices */
 #define RECEIVED_BYTES_STATSD_LABEL "container_received_bytes_per_sec"
 #define THROTTLED_BYTES_STATSD_LABEL "container_throttled_bytes_per_sec"
+#define THROTTLED_PACKETS_STATSD_LABEL "container_throttled_packets_per_sec"
+#define RECV_BATCH_DATAGRAMS_STATSD_LABEL "container_recv_batch_datagrams_per_wakeup"
+#define SERIES_ESTIMATE_STATSD_LABEL "container_series_estimate"
+#define SERIES_LIMITED_STATSD_LABEL "container_series_limited_per_sec"
+#define SERIES_OVERFLOW_STATSD_LABEL "container_series_overflow"
+#define INGEST_SHARE_STATSD_LABEL "container_ingest_share"
+#define INGEST_QUEUE_BYTES_STATSD_LABEL "container_ingest_queue_bytes"
+#define STREAM_CONNECTIONS_STATSD_LABEL "container_stream_connections"
+#define STREAM_PAUSED_STATSD_LABEL "container_stream_paused_per_sec"
 
 typedef boost::asio::ip::udp::endpoint udp_endpoint_t;
 typedef boost::asio::ip::udp::resolver resolver_t;
+typedef boost::asio::generic::datagram_protocol::endpoint generic_endpoint_t;
+typedef boost::asio::local::datagram_protocol::endpoint unix_endpoint_t;
+
+namespace {
+  size_t get_batch_size(size_t requested_batch_size) {
+    // Treat 0 as 1: always receive at least one datagram per wakeup
+    return (requested_batch_size == 0) ? 1 : requested_batch_size;
+  }
+
+  size_t get_buffer_size(size_t batch_size, size_t slot_bytes) {
+    if (batch_size <= 1) {
+      // Single-datagram receives: one buffer which fits any datagram
+      return UDP_MAX_PACKET_BYTES;
+    }
+    if (slot_bytes == 0 || slot_bytes > UDP_MAX_PACKET_BYTES) {
+      slot_bytes = UDP_MAX_PACKET_BYTES;
+    }
+    return batch_size * slot_bytes;
+  }
+
+  bool is_ip(const generic_endpoint_t& endpoint) {
+    return endpoint.size() >= sizeof(sa_family_t)
+      && (endpoint.data()->sa_family == AF_INET || endpoint.data()->sa_family == AF_INET6);
+  }
+
+  udp_endpoint_t to_udp_endpoint(const generic_endpoint_t& endpoint) {
+    udp_endpoint_t udp_endpoint;
+    size_t size = std::min(endpoint.size(), udp_endpoint.capacity());
+    memcpy(udp_endpoint.data(), endpoint.data(), size);
+    udp_endpoint.resize(size);
+    return udp_endpoint;
+  }
+
+  std::string endpoint_string(const generic_endpoint_t& endpoint) {
+    if (is_ip(endpoint)) {
+      std::ostringstream oss;
+      oss << to_udp_endpoint(endpoint);
+      return oss.str();
+    }
+    // Unix senders are usually unbound, in which case there's no path
+    const struct sockaddr_un* addr = (const struct sockaddr_un*) endpoint.data();
+    size_t path_offset = offsetof(struct sockaddr_un, sun_path);
+    if (endpoint.size() <= path_offset || addr->sun_family != AF_UNIX || addr->sun_path[0] == '\0') {
+      return "unnamed";
+    }
+    return std::string(addr->sun_path, strnlen(addr->sun_path, endpoint.size() - path_offset));
+  }
+}
+
+metrics::ContainerReaderOptions::ContainerReaderOptions(const mesos::Parameters& parameters)
+  : limit_period_ms(1000 * params::get_uint(parameters,
+            params::CONTAINER_LIMIT_PERIOD_SECS, params::CONTAINER_LIMIT_PERIOD_SECS_DEFAULT)),
+    limit_amount_bytes(1024 * params::get_uint(parameters,
+            params::CONTAINER_LIMIT_AMOUNT_KBYTES, params::CONTAINER_LIMIT_AMOUNT_KBYTES_DEFAULT)),
+    limit_burst_bytes(1024 * params::get_uint(parameters,
+            params::CONTAINER_LIMIT_BURST_KBYTES, params::CONTAINER_LIMIT_BURST_KBYTES_DEFAULT)),
+    limit_amount_packets(params::get_uint(parameters,
+            params::CONTAINER_LIMIT_AMOUNT_PACKETS,
+            params::CONTAINER_LIMIT_AMOUNT_PACKETS_DEFAULT)),
+    limit_series(params::get_uint(parameters,
+            params::CONTAINER_LIMIT_SERIES, params::CONTAINER_LIMIT_SERIES_DEFAULT)),
+    limit_series_overflow(params::get_bool(parameters,
+            params::CONTAINER_LIMIT_SERIES_OVERFLOW,
+            params::CONTAINER_LIMIT_SERIES_OVERFLOW_DEFAULT)),
+    recv_batch_size(params::get_uint(parameters,
+            params::LISTEN_RECV_BATCH_SIZE, params::LISTEN_RECV_BATCH_SIZE_DEFAULT)),
+    recv_batch_slot_bytes(params::get_uint(parameters,
+            params::LISTEN_RECV_BATCH_SLOT_BYTES, params::LISTEN_RECV_BATCH_SLOT_BYTES_DEFAULT)),
+    reuse_port_group_size(1),
+    reuse_port_cbpf(params::get_bool(parameters,
+            params::LISTEN_PORT_REUSE_CBPF, params::LISTEN_PORT_REUSE_CBPF_DEFAULT)),
+    stream_max_connections(params::get_uint(parameters,
+            params::LISTEN_STREAM_MAX_CONNECTIONS,
+            params::LISTEN_STREAM_MAX_CONNECTIONS_DEFAULT)),
+    stream_buffer_bytes(params::get_uint(parameters,
+            params::LISTEN_STREAM_BUFFER_BYTES, params::LISTEN_STREAM_BUFFER_BYTES_DEFAULT)),
+    recv_batch_fallback_for_tests(false) { }
 
 metrics::ContainerReaderImpl::ContainerReaderImpl(
     const std::shared_ptr<boost::asio::io_service>& io_service,
     const std::vector<output_writer_ptr_t>& writers,
     const UDPEndpoint& requested_endpoint,
-    size_t limit_period_ms,
-    size_t limit_amount_bytes)
+    const ContainerReaderOptions& options,
+    const std::shared_ptr<IngestScheduler>& ingest_scheduler)
   : writers(writers),
     requested_endpoint(requested_endpoint),
-    limit_period_ms(limit_period_ms),
-    limit_amount_bytes(limit_amount_bytes),
+    limit_period_ms(options.limit_period_ms),
+    limit_amount_bytes(options.limit_amount_bytes),
+    recv_batch_size(get_batch_size(options.recv_batch_size)),
+    recv_batch_slot_bytes(get_buffer_size(this->recv_batch_size, options.recv_batch_slot_bytes)
+        / this->recv_batch_size),
+    reuse_port_group_size(options.reuse_port_group_size),
+    reuse_port_cbpf(options.reuse_port_cbpf),
+    limit_series(options.limit_series),
+    limit_series_overflow(options.limit_series_overflow),
+    limit_amount_packets(options.limit_amount_packets),
+    stream_max_connections(options.stream_max_connections),
+    stream_buffer_bytes(options.stream_buffer_bytes),
+    recv_batch_fallback_for_tests(options.recv_batch_fallback_for_tests),
     io_service(io_service),
+    ingest_scheduler(ingest_scheduler),
     shutdown(false),
     limit_reset_timer(*io_service),
     socket(*io_service),
-    socket_buffer(UDP_MAX_PACKET_BYTES, '\0'),
+    buffer_pool(PacketBufferPool::create(
+            get_buffer_size(this->recv_batch_size, options.recv_batch_slot_bytes),
+            SOCKET_BUFFER_POOL_SIZE)),
+    socket_buffer(buffer_pool->acquire()),
+    // A burst of 0 means the whole period's amount may be sent at once, as before
+    limit_bytes_bucket(limit_amount_bytes, limit_period_ms,
+        (options.limit_burst_bytes == 0) ? limit_amount_bytes : options.limit_burst_bytes),
+    limit_packets_bucket(limit_amount_packets, limit_period_ms, limit_amount_packets),
+    container_cpus(1),
+    unregistered_series_limiter(limit_series),
     received_bytes(0),
-    dropped_bytes(0) {
-  LOG(INFO) << "Reader constructed for " << requested_endpoint.string();
+    dropped_bytes(0),
+    dropped_packets(0),
+    recv_wakeups(0),
+    recv_datagrams(0),
+    recv_batch_max(0),
+    ingest_queue_max_bytes(0) {
+#ifdef LINUX_RECVMMSG_AVAILABLE
+  if (this->recv_batch_size > 1 && !recv_batch_fallback_for_tests) {
+    // Point each message header at its own slot within socket_buffer. These pointers stay valid
+    // until socket_buffer is renewed, as none of the vectors are resized after this point.
+    batch_msgs.resize(this->recv_batch_size);
+    batch_iovecs.resize(this->recv_batch_size);
+    batch_addrs.resize(this->recv_batch_size);
+    for (size_t i = 0; i < this->recv_batch_size; ++i) {
+      batch_iovecs[i].iov_base = socket_buffer.mutable_data() + (i * this->recv_batch_slot_bytes);
+      batch_iovecs[i].iov_len = this->recv_batch_slot_bytes;
+      memset(&batch_msgs[i], 0, sizeof(struct mmsghdr));
+      batch_msgs[i].msg_hdr.msg_iov = &batch_iovecs[i];
+      batch_msgs[i].msg_hdr.msg_iovlen = 1;
+      batch_msgs[i].msg_hdr.msg_name = &batch_addrs[i];
+    }
+  }
+#endif
+  LOG(INFO) << "Reader constructed for " << requested_endpoint.string()
+            << " (recv batch size " << this->recv_batch_size << ")";
 }
 
 metrics::ContainerReaderImpl::~ContainerReaderImpl() {
@@ -50,17 +185,46 @@ Try<metrics::UDPEndpoint> metrics::ContainerReaderImpl::open() {
     return *actual_endpoint;
   }
 
-  resolver_t resolver(*io_service);
-  resolver_t::query query(requested_endpoint.host, "");
-  boost::system::error_code ec;
-  resolver_t::iterator iter = resolver.resolve(query, ec);
-  boost::asio::ip::address resolved_address;
-  if (!ec && iter != resolver_t::iterator()) {
-    // resolved, bind to first entry in list
-    resolved_address = iter->endpoint().address();
+  Try<UDPEndpoint> bound_endpoint = requested_endpoint.is_unix() ? open_unix() : open_udp();
+  if (bound_endpoint.isError()) {
+    return bound_endpoint;
+  }
+
+  // Set endpoint (indicates open socket) and start listening AFTER all error conditions are clear
+  actual_endpoint.reset(new UDPEndpoint(bound_endpoint.get()));
+  if (stream_max_connections > 0) {
+    open_stream();
+  }
+  if (ingest_scheduler) {
+    start_recv_wait();
+  } else if (recv_batch_size > 1) {
+    start_recv_batch();
   } else {
-    // failed or no results, fall back to using the host as-is
-    resolved_address = boost::asio::ip::address::from_string(requested_endpoint.host);
+    start_recv();
+  }
+  start_limit_reset_timer();
+
+  LOG(INFO) << "Reader listening on " << actual_endpoint->string();
+  return *actual_endpoint;
+}
+
+Try<metrics::UDPEndpoint> metrics::ContainerReaderImpl::open_udp() {
+  // The listen host is normally the agent's interface address, which is used as-is. Only fall
+  // back to a (blocking) DNS lookup for anything else, as this runs on the shared io thread.
+  boost::system::error_code ec;
+  boost::asio::ip::address resolved_address =
+    boost::asio::ip::address::from_string(requested_endpoint.host, ec);
+  if (ec) {
+    resolver_t resolver(*io_service);
+    resolver_t::query query(requested_endpoint.host, "");
+    resolver_t::iterator iter = resolver.resolve(query, ec);
+    if (!ec && iter != resolver_t::iterator()) {
+      // resolved, bind to first entry in list
+      resolved_address = iter->endpoint().address();
+    } else {
+      // failed or no results, fall back to using the host as-is
+      resolved_address = boost::asio::ip::address::from_string(requested_endpoint.host);
+    }
   }
 
   udp_endpoint_t bind_endpoint(resolved_address, requested_endpoint.port);
@@ -71,6 +235,12 @@ Try<metrics::UDPEndpoint> metrics::ContainerReaderImpl::open() {
     return Try<metrics::UDPEndpoint>(Error(oss.str()));
   }
   set_cloexec(socket, requested_endpoint.host, requested_endpoint.port);
+  if (reuse_port_group_size > 1
+      && !set_reuseport(socket, requested_endpoint.host, requested_endpoint.port)) {
+    std::ostringstream oss;
+    oss << "Failed to enable port reuse on reader socket at endpoint[" << bind_endpoint << "]";
+    return Try<metrics::UDPEndpoint>(Error(oss.str()));
+  }
 
   socket.bind(bind_endpoint, ec);
   if (ec) {
@@ -78,14 +248,26 @@ Try<metrics::UDPEndpoint> metrics::ContainerReaderImpl::open() {
     oss << "Failed to bind reader socket at endpoint[" << bind_endpoint << "]: " << ec;
     return Try<metrics::UDPEndpoint>(Error(oss.str()));
   }
+  if (reuse_port_group_size > 1 && reuse_port_cbpf) {
+    if (bind_endpoint.address().is_v4()) {
+      // Applies to the whole group. Each member attaches the same program, the last one wins.
+      attach_reuseport_cbpf(
+          socket, reuse_port_group_size, requested_endpoint.host, requested_endpoint.port);
+    } else {
+      // The program reads the source address at its offset in an IPv4 header
+      LOG(WARNING) << "Ignoring " << params::LISTEN_PORT_REUSE_CBPF << " for IPv6 reader socket "
+                   << "at endpoint[" << bind_endpoint << "]: Using the kernel's default flow hash";
+    }
+  }
 
-  udp_endpoint_t bound_endpoint = socket.local_endpoint(ec);
+  generic_endpoint_t local_endpoint = socket.local_endpoint(ec);
   if (ec) {
     std::ostringstream oss;
     oss << "Failed to retrieve reader socket's resulting endpoint for bind at "
         << "endpoint[" << bind_endpoint << "]: " << ec;
     return Try<metrics::UDPEndpoint>(Error(oss.str()));
   }
+  udp_endpoint_t bound_endpoint = to_udp_endpoint(local_endpoint);
 
   std::string bound_endpoint_address_str = bound_endpoint.address().to_string(ec);
   if (ec) {
@@ -94,14 +276,68 @@ Try<metrics::UDPEndpoint> metrics::ContainerReaderImpl::open() {
         << "address[" << bound_endpoint.address() << "]: " << ec;
     return Try<metrics::UDPEndpoint>(Error(oss.str()));
   }
+  return UDPEndpoint(bound_endpoint_address_str, bound_endpoint.port());
+}
 
-  // Set endpoint (indicates open socket) and start listening AFTER all error conditions are clear
-  actual_endpoint.reset(new UDPEndpoint(bound_endpoint_address_str, bound_endpoint.port()));
-  start_recv();
-  start_limit_reset_timer();
+Try<metrics::UDPEndpoint> metrics::ContainerReaderImpl::open_unix() {
+  const std::string& path = requested_endpoint.host;
+  if (path.size() >= sizeof(((struct sockaddr_un*) NULL)->sun_path)) {
+    std::ostringstream oss;
+    oss << "Reader socket path[" << path << "] is too long";
+    return Try<metrics::UDPEndpoint>(Error(oss.str()));
+  }
 
-  LOG(INFO) << "Reader listening on " << actual_endpoint->string();
-  return *actual_endpoint;
+  if (!remove_stale_socket(path)) {
+    std::ostringstream oss;
+    oss << "Failed to remove stale reader socket at path[" << path << "]";
+    return Try<metrics::UDPEndpoint>(Error(oss.str()));
+  }
+
+  boost::system::error_code ec;
+  unix_endpoint_t bind_endpoint(path);
+  socket.open(bind_endpoint.protocol(), ec);
+  if (ec) {
+    std::ostringstream oss;
+    oss << "Failed to open reader socket at path[" << path << "]: " << ec;
+    return Try<metrics::UDPEndpoint>(Error(oss.str()));
+  }
+  set_cloexec(socket, path, 0);
+
+  socket.bind(bind_endpoint, ec);
+  if (ec) {
+    std::ostringstream oss;
+    oss << "Failed to bind reader socket at path[" << path << "]: " << ec;
+    return Try<metrics::UDPEndpoint>(Error(oss.str()));
+  }
+
+  // The container's processes may run as any user
+  if (chmod(path.c_str(), 0666) != 0) {
+    int errnum = errno;
+    std::ostringstream oss;
+    oss << "Failed to make reader socket at path[" << path << "] writable: "
+        << "errno=" << errnum << " => " << strerror(errnum);
+    return Try<metrics::UDPEndpoint>(Error(oss.str()));
+  }
+  return requested_endpoint;
+}
+
+void metrics::ContainerReaderImpl::open_stream() {
+  stream_listener.reset(new StreamListener(io_service,
+          std::bind(&ContainerReaderImpl::consume_stream, this,
+              std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+          stream_max_connections, stream_buffer_bytes));
+  Try<Nothing> result = actual_endpoint->is_unix()
+    ? stream_listener->open_unix(StreamListener::unix_stream_path(actual_endpoint->host))
+    : stream_listener->open_tcp(boost::asio::ip::tcp::endpoint(
+            boost::asio::ip::address::from_string(actual_endpoint->host), actual_endpoint->port),
+        // Each reader in the group accepts its share of the port's connections
+        reuse_port_group_size > 1);
+  if (result.isError()) {
+    // Datagrams still work, so don't fail the container over this
+    LOG(ERROR) << "Unable to accept streams alongside " << actual_endpoint->string()
+               << ", continuing with datagrams only: " << result.error();
+    stream_listener.reset();
+  }
 }
 
 Try<metrics::UDPEndpoint> metrics::ContainerReaderImpl::endpoint() const {
@@ -115,12 +351,105 @@ Try<metrics::UDPEndpoint> metrics::ContainerReaderImpl::endpoint() const {
 void metrics::ContainerReaderImpl::register_container(
     const mesos::ContainerID& container_id,
     const mesos::ExecutorInfo& executor_info) {
-  registered_containers[container_id] = executor_info;
+  // The caller may be running in a different IO thread from this reader.
+  io_service->dispatch(std::bind(&ContainerReaderImpl::register_container_cb,
+          this, container_id, executor_info));
 }
 
 void metrics::ContainerReaderImpl::unregister_container(
     const mesos::ContainerID& container_id) {
-  registered_containers.erase(container_id);
+  io_service->dispatch(std::bind(&ContainerReaderImpl::unregister_container_cb,
+          this, container_id));
+}
+
+void metrics::ContainerReaderImpl::register_container_cb(
+    const mesos::ContainerID& container_id,
+    const mesos::ExecutorInfo& executor_info) {
+  auto iter = registered_containers.find(container_id);
+  if (iter != registered_containers.end()) {
+    // Re-registration: the container's addresses may have changed
+    remove_container_addresses(&*iter);
+    iter->second = RegisteredContainer(container_id, executor_info, limit_series);
+  } else {
+    iter = registered_containers.insert(std::make_pair(
+            container_id, RegisteredContainer(container_id, executor_info, limit_series))).first;
+  }
+  add_container_addresses(&*iter);
+  update_container_cpus();
+}
+
+void metrics::ContainerReaderImpl::unregister_container_cb(
+    const mesos::ContainerID& container_id) {
+  auto iter = registered_containers.find(container_id);
+  if (iter == registered_containers.end()) {
+    return;
+  }
+  remove_container_addresses(&*iter);
+  registered_containers.erase(iter);
+  update_container_cpus();
+}
+
+void metrics::ContainerReaderImpl::add_container_addresses(
+    const container_entry_t* entry) {
+  const mesos::ContainerInfo& container_info = entry->second.executor_info.container();
+  for (int i = 0; i < container_info.network_infos_size(); ++i) {
+    const mesos::NetworkInfo& network_info = container_info.network_infos(i);
+    for (int j = 0; j < network_info.ip_addresses_size(); ++j) {
+      const std::string& ip_str = network_info.ip_addresses(j).ip_address();
+      boost::system::error_code ec;
+      boost::asio::ip::address ip = boost::asio::ip::address::from_string(ip_str, ec);
+      if (ec) {
+        LOG(WARNING) << "Ignoring unparseable address[" << ip_str << "] for "
+                     << "container[" << entry->first.ShortDebugString() << "]";
+        continue;
+      }
+      const container_entry_t* const* existing =
+        container_addresses.find(ip, 0);
+      if (existing != NULL && *existing != entry) {
+        LOG(WARNING) << "Address[" << ip << "] moved from "
+                     << "container[" << (*existing)->first.ShortDebugString() << "] to "
+                     << "container[" << entry->first.ShortDebugString() << "]";
+      }
+      container_addresses.insert(ip, 0, entry);
+    }
+  }
+}
+
+void metrics::ContainerReaderImpl::remove_container_addresses(
+    const container_entry_t* entry) {
+  const mesos::ContainerInfo& container_info = entry->second.executor_info.container();
+  for (int i = 0; i < container_info.network_infos_size(); ++i) {
+    const mesos::NetworkInfo& network_info = container_info.network_infos(i);
+    for (int j = 0; j < network_info.ip_addresses_size(); ++j) {
+      boost::system::error_code ec;
+      boost::asio::ip::address ip = boost::asio::ip::address::from_string(
+          network_info.ip_addresses(j).ip_address(), ec);
+      if (ec) {
+        continue;
+      }
+      // Only remove the address if it hasn't since been claimed by another container
+      const container_entry_t* const* existing =
+        container_addresses.find(ip, 0);
+      if (existing != NULL && *existing == entry) {
+        container_addresses.erase(ip, 0);
+      }
+    }
+  }
+}
+
+void metrics::ContainerReaderImpl::update_container_cpus() {
+  double cpus = 0;
+  for (const container_entry_t& entry : registered_containers) {
+    const mesos::ExecutorInfo& executor_info = entry.second.executor_info;
+    for (int i = 0; i < executor_info.resources_size(); ++i) {
+      const mesos::Resource& resource = executor_info.resources(i);
+      if (resource.name() == "cpus" && resource.has_scalar()) {
+        cpus += resource.scalar().value();
+      }
+    }
+  }
+  // No containers, or no cpus listed: count as a single cpu
+  container_cpus = (cpus > 0) ? cpus : 1;
 }
 
 void metrics::ContainerReaderImpl::start_limit_reset_timer() {
@@ -141,31 +470,94 @@ void metrics::ContainerReaderImpl::limit_reset_cb(boost::system::error_code ec)
     }
   }
 
-  // Also produce throughput stats while we're here.
+  // The byte/packet limits refill on their own as data arrives. This just produces throughput
+  // stats for the period.
   if (actual_endpoint) {
-    LOG(INFO) << "Throughput from container at port " << actual_endpoint->port <<" (bytes): "
+    LOG(INFO) << "Throughput from container at " << actual_endpoint->string() << " (bytes): "
               << "received=" << received_bytes << ", throttled=" << dropped_bytes;
   } else {
     LOG(INFO) << "Throughput from container at port ?UNKNOWN? (bytes): "
               << "received=" << received_bytes << ", throttled=" << dropped_bytes;
   }
 
+  size_t unpooled_buffers = buffer_pool->take_unpooled_count();
+  if (unpooled_buffers > 0) {
+    LOG(WARNING) << "Writers held onto all " << buffer_pool->allocated() << " pooled receive "
+                 << "buffers, allocated " << unpooled_buffers << " more";
+  }
+
   // Send our own metrics on the data we received and/or dropped
   // Always emit, even if values are zero, just to let upstream know we're listening
+  // These skip the series limit: they're what tell upstream that the limit is being hit.
+  const container_entry_t* entry = reader_container();
   std::string msg = statsd_counter_per_sec(RECEIVED_BYTES_STATSD_LABEL, received_bytes, limit_period_ms);
-  write_message(msg.data(), msg.size());
+  write_container_message(entry, msg.data(), msg.size());
   msg = statsd_counter_per_sec(THROTTLED_BYTES_STATSD_LABEL, dropped_bytes, limit_period_ms);
-  write_message(msg.data(), msg.size());
+  write_container_message(entry, msg.data(), msg.size());
+  if (limit_amount_packets > 0) {
+    msg = statsd_counter_per_sec(THROTTLED_PACKETS_STATSD_LABEL, dropped_packets, limit_period_ms);
+    write_container_message(entry, msg.data(), msg.size());
+  }
+
+  if (recv_batch_size > 1) {
+    // Report how effective batching was over the last period
+    double avg_batch = (recv_wakeups == 0) ? 0 : recv_datagrams / (double) recv_wakeups;
+    LOG(INFO) << "Batched receives from container: "
+              << "wakeups=" << recv_wakeups << ", datagrams=" << recv_datagrams
+              << ", avg_batch=" << avg_batch << ", max_batch=" << recv_batch_max;
+    msg = statsd_gauge(RECV_BATCH_DATAGRAMS_STATSD_LABEL, avg_batch);
+    write_container_message(entry, msg.data(), msg.size());
+  }
+
+  if (ingest_scheduler) {
+    // Report how this reader was served relative to the others sharing its thread
+    msg = statsd_gauge(INGEST_SHARE_STATSD_LABEL, ingest_scheduler->take_share(this));
+    write_container_message(entry, msg.data(), msg.size());
+    msg = statsd_gauge(INGEST_QUEUE_BYTES_STATSD_LABEL, ingest_queue_max_bytes);
+    write_container_message(entry, msg.data(), msg.size());
+  }
+
+  if (stream_listener) {
+    size_t paused = stream_listener->take_paused_count();
+    LOG(INFO) << "Streams from container: "
+              << "connections=" << stream_listener->connection_count()
+              << ", rejected=" << stream_listener->take_rejected_connections()
+              << ", paused=" << paused
+              << ", overlong_bytes=" << stream_listener->take_dropped_bytes();
+    msg = statsd_gauge(STREAM_CONNECTIONS_STATSD_LABEL, stream_listener->connection_count());
+    write_container_message(entry, msg.data(), msg.size());
+    msg = statsd_counter_per_sec(STREAM_PAUSED_STATSD_LABEL, paused, limit_period_ms);
+    write_container_message(entry, msg.data(), msg.size());
+  }
+
+  if (limit_series > 0) {
+    // Report each container's series against its own tags, then age out any series which
+    // weren't sent during the period
+    for (const container_entry_t& container_entry : registered_containers) {
+      write_limit_stats(&container_entry, container_entry.second.series_limiter);
+      container_entry.second.series_limiter.next_period();
+    }
+    if (unregistered_series_limiter.series() > 0 || unregistered_series_limiter.limited() > 0) {
+      write_limit_stats(NULL, unregistered_series_limiter);
+    }
+    unregistered_series_limiter.next_period();
+  }
 
   received_bytes = 0;
   dropped_bytes = 0;
+  dropped_packets = 0;
+  recv_wakeups = 0;
+  recv_datagrams = 0;
+  recv_batch_max = 0;
+  ingest_queue_max_bytes = 0;
   if (!shutdown) {
     start_limit_reset_timer();
   }
 }
 
 void metrics::ContainerReaderImpl::start_recv() {
-  socket.async_receive_from(boost::asio::buffer(socket_buffer.data(), socket_buffer.size()),
+  socket.async_receive_from(
+      boost::asio::buffer(socket_buffer.mutable_data(), socket_buffer.size()),
       sender_endpoint,
       std::bind(&ContainerReaderImpl::recv_cb, this,
           std::placeholders::_1, std::placeholders::_2));
@@ -182,99 +574,416 @@ void metrics::ContainerReaderImpl::recv_cb(
       if (actual_endpoint) {
         LOG(WARNING) << "Error when receiving data from reader socket at "
                      << "dest[" << actual_endpoint->host << ":" << actual_endpoint->port << "] "
-                     << "from source[" << sender_endpoint << "]: " << ec;
+                     << "from source[" << endpoint_string(sender_endpoint) << "]: " << ec;
       } else {
         LOG(WARNING) << "Error when receiving data from reader socket at "
-                     << "dest[???] from source[" << sender_endpoint << "]: " << ec;
+                     << "dest[???] from source[" << endpoint_string(sender_endpoint) << "]: " << ec;
       }
       start_recv();
     }
     return;
   }
 
-  if (received_bytes >= limit_amount_bytes) {
-    // We've hit the limit, drop data and continue.
-    dropped_bytes += bytes_transferred;
-  } else {
-    // Search for newline chars, which indicate multiple statsd entries in a single packet
-    char* next_newline = (char*) memchr(socket_buffer.data(), '\n', bytes_transferred);
-    if (next_newline == NULL) {
-      // Single entry. Pass buffer directly.
-      write_message(socket_buffer.data(), bytes_transferred);
+  process_datagram(socket_buffer.data(), bytes_transferred);
+  renew_socket_buffer();
+  if (!shutdown) {
+    start_recv();
+  }
+}
+
+void metrics::ContainerReaderImpl::renew_socket_buffer() {
+  if (socket_buffer.unique()) {
+    // Typical case: writers didn't keep any lines, so the buffer can be received into again
+    return;
+  }
+  socket_buffer = buffer_pool->acquire();
+#ifdef LINUX_RECVMMSG_AVAILABLE
+  for (size_t i = 0; i < batch_iovecs.size(); ++i) {
+    batch_iovecs[i].iov_base = socket_buffer.mutable_data() + (i * recv_batch_slot_bytes);
+  }
+#endif
+}
+
+void metrics::ContainerReaderImpl::start_recv_batch() {
+  // Wait for the socket to become readable, then drain it ourselves in recv_batch_cb().
+  socket.async_receive(boost::asio::null_buffers(),
+      std::bind(&ContainerReaderImpl::recv_batch_cb, this, std::placeholders::_1));
+}
+
+void metrics::ContainerReaderImpl::recv_batch_cb(boost::system::error_code ec) {
+  if (ec) {
+    if (ec == boost::asio::error::operation_aborted) {
+      // We're being destroyed. Don't look at local state, it may be destroyed already.
+      LOG(INFO) << "Input receive call cancelled due to container teardown: Exiting read loop immediately";
     } else {
-      // Multiple newline-separated entries. Pass each from buffer as separate messages.
-      size_t start_index = 0;
-      for (;;) {
-        size_t newline_offset = (next_newline != NULL)
-          ? next_newline - socket_buffer.data()
-          : bytes_transferred; // no more newlines, use end of buffer
-        //DLOG(INFO) << "newline_offset=" << newline_offset << ", start_index=" << start_index;
-        size_t entry_size = newline_offset - start_index;
-        //DLOG(INFO) << "entry_size " << entry_size << " => copy "
-        //           << "[" << start_index << "," << start_index+entry_size << ") to front of scratch";
-        if (entry_size > 0) { // check/skip empty rows ("\n\n", or "\n" at start/end of pkt)
-          write_message(socket_buffer.data() + start_index, entry_size);
-        }
-        start_index = start_index + entry_size + 1; // pass over newline itself
-        if (start_index >= bytes_transferred) {
-          break; // seeked to end of received data
-        }
-        next_newline =
-          (char*) memchr(socket_buffer.data() + start_index, '\n', bytes_transferred - start_index);
+      if (actual_endpoint) {
+        LOG(WARNING) << "Error when waiting for data from reader socket at "
+                     << "dest[" << actual_endpoint->host << ":" << actual_endpoint->port << "]: " << ec;
+      } else {
+        LOG(WARNING) << "Error when waiting for data from reader socket at dest[???]: " << ec;
       }
+      start_recv_batch();
     }
+    return;
   }
 
-  received_bytes += bytes_transferred;
+  recv_batch();
   if (!shutdown) {
-    start_recv();
+    start_recv_batch();
+  }
+}
+
+size_t metrics::ContainerReaderImpl::recv_batch() {
+#ifdef LINUX_RECVMMSG_AVAILABLE
+  size_t datagram_count = recv_batch_fallback_for_tests ? recv_batch_single() : recv_batch_multi();
+#else
+  size_t datagram_count = recv_batch_single();
+#endif
+  if (datagram_count > 0) {
+    ++recv_wakeups;
+    recv_datagrams += datagram_count;
+    if (datagram_count > recv_batch_max) {
+      recv_batch_max = datagram_count;
+    }
+  }
+  return datagram_count;
+}
+
+#ifdef LINUX_RECVMMSG_AVAILABLE
+size_t metrics::ContainerReaderImpl::recv_batch_multi() {
+  for (struct mmsghdr& msg : batch_msgs) {
+    // Reset fields which are updated by each recvmmsg call
+    msg.msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    msg.msg_hdr.msg_flags = 0;
+    msg.msg_len = 0;
+  }
+  // MSG_TRUNC: report the full size of a datagram which didn't fit, rather than the slot size
+  int result = recvmmsg(socket.native_handle(),
+      batch_msgs.data(), batch_msgs.size(), MSG_DONTWAIT | MSG_TRUNC, NULL);
+  if (result < 0) {
+    int errnum = errno;
+    if (errnum != EAGAIN && errnum != EWOULDBLOCK && errnum != EINTR) {
+      LOG(WARNING) << "Error when receiving batch from reader socket at "
+                   << "requested[" << requested_endpoint.string() << "]: "
+                   << "errno=" << errnum << " => " << strerror(errnum);
+    }
+    return 0;
+  }
+  size_t datagram_count = result;
+  for (size_t i = 0; i < datagram_count; ++i) {
+    const struct mmsghdr& msg = batch_msgs[i];
+    size_t addr_len = std::min((size_t) msg.msg_hdr.msg_namelen, sender_endpoint.capacity());
+    memcpy(sender_endpoint.data(), msg.msg_hdr.msg_name, addr_len);
+    sender_endpoint.resize(addr_len);
+    if (msg.msg_hdr.msg_flags & MSG_TRUNC) {
+      // Datagram didn't fit in its slot. Don't forward a partial statsd payload.
+      LOG(WARNING) << "Dropping " << msg.msg_len << " byte datagram from "
+                   << "source[" << endpoint_string(sender_endpoint) << "] which exceeded "
+                   << params::LISTEN_RECV_BATCH_SLOT_BYTES << "=" << recv_batch_slot_bytes;
+      dropped_bytes += msg.msg_len;
+      ++dropped_packets;
+      continue;
+    }
+    process_datagram((const char*) batch_iovecs[i].iov_base, msg.msg_len);
+  }
+  // Only once the whole batch is done: the other slots are in the same buffer
+  renew_socket_buffer();
+  return datagram_count;
+}
+#endif
+
+size_t metrics::ContainerReaderImpl::recv_batch_single() {
+  // No recvmmsg(): Drain up to recv_batch_size datagrams with non-blocking single receives, until
+  // the socket is empty. Not socket.available(), which is also zero for an empty datagram.
+  size_t datagram_count = 0;
+  for (; datagram_count < recv_batch_size; ++datagram_count) {
+    struct iovec iov;
+    iov.iov_base = socket_buffer.mutable_data();
+    iov.iov_len = recv_batch_slot_bytes;
+    struct msghdr msg_hdr;
+    memset(&msg_hdr, 0, sizeof(struct msghdr));
+    msg_hdr.msg_name = sender_endpoint.data();
+    msg_hdr.msg_namelen = sender_endpoint.capacity();
+    msg_hdr.msg_iov = &iov;
+    msg_hdr.msg_iovlen = 1;
+    // MSG_TRUNC: return the full size of a datagram which didn't fit, rather than the slot size
+    ssize_t result = recvmsg(socket.native_handle(), &msg_hdr, MSG_DONTWAIT | MSG_TRUNC);
+    if (result < 0) {
+      int errnum = errno;
+      if (errnum != EAGAIN && errnum != EWOULDBLOCK && errnum != EINTR) {
+        LOG(WARNING) << "Error when receiving batch from reader socket at "
+                     << "requested[" << requested_endpoint.string() << "]: "
+                     << "errno=" << errnum << " => " << strerror(errnum);
+      }
+      break;
+    }
+    sender_endpoint.resize(std::min((size_t) msg_hdr.msg_namelen, sender_endpoint.capacity()));
+    if (msg_hdr.msg_flags & MSG_TRUNC) {
+      // Datagram didn't fit in its slot. Don't forward a partial statsd payload.
+      LOG(WARNING) << "Dropping " << result << " byte datagram from "
+                   << "source[" << endpoint_string(sender_endpoint) << "] which exceeded "
+                   << params::LISTEN_RECV_BATCH_SLOT_BYTES << "=" << recv_batch_slot_bytes;
+      dropped_bytes += result;
+      ++dropped_packets;
+      continue;
+    }
+    process_datagram(socket_buffer.data(), result);
+    renew_socket_buffer();
+  }
+  return datagram_count;
+}
+
+void metrics::ContainerReaderImpl::start_recv_wait() {
+  // Wait for the socket to become readable, then wait for our turn from the scheduler.
+  socket.async_receive(boost::asio::null_buffers(),
+      std::bind(&ContainerReaderImpl::recv_wait_cb, this, std::placeholders::_1));
+}
+
+void metrics::ContainerReaderImpl::recv_wait_cb(boost::system::error_code ec) {
+  if (ec) {
+    if (ec == boost::asio::error::operation_aborted) {
+      // We're being destroyed. Don't look at local state, it may be destroyed already.
+      LOG(INFO) << "Input receive call cancelled due to container teardown: Exiting read loop immediately";
+    } else {
+      LOG(WARNING) << "Error when waiting for data from reader socket at "
+                   << "requested[" << requested_endpoint.string() << "]: " << ec;
+      start_recv_wait();
+    }
+    return;
+  }
+
+  if (!shutdown) {
+    ingest_scheduler->ready(this);
   }
 }
 
-void metrics::ContainerReaderImpl::write_message(const char* data, size_t size) {
-  DLOG(INFO) << "Received " << size << " byte entry from "
-             << "endpoint[" << sender_endpoint << "] => "
+size_t metrics::ContainerReaderImpl::ingest(size_t budget_bytes, bool& drained) {
+  // received_bytes includes throttled data: it still took a turn to receive
+  size_t start_bytes = received_bytes;
+  drained = false;
+  while (!drained && received_bytes - start_bytes < budget_bytes) {
+    if (recv_batch_size > 1) {
+      // A partial batch means that the socket has been emptied
+      drained = recv_batch() < recv_batch_size;
+    } else {
+      drained = !recv_one();
+    }
+  }
+
+  if (drained) {
+    if (!shutdown) {
+      start_recv_wait();
+    }
+  } else {
+    // Still backlogged after our turn: check how much is waiting in the kernel
+    ingest_queue_max_bytes = std::max(ingest_queue_max_bytes, get_receive_queue_bytes(socket));
+  }
+  return received_bytes - start_bytes;
+}
+
+bool metrics::ContainerReaderImpl::recv_one() {
+  socklen_t addr_len = sender_endpoint.capacity();
+  ssize_t result = recvfrom(socket.native_handle(),
+      socket_buffer.mutable_data(), socket_buffer.size(),
+      MSG_DONTWAIT, sender_endpoint.data(), &addr_len);
+  if (result < 0) {
+    int errnum = errno;
+    if (errnum != EAGAIN && errnum != EWOULDBLOCK && errnum != EINTR) {
+      LOG(WARNING) << "Error when receiving from reader socket at "
+                   << "requested[" << requested_endpoint.string() << "]: "
+                   << "errno=" << errnum << " => " << strerror(errnum);
+    }
+    return false;
+  }
+  sender_endpoint.resize(addr_len);
+  process_datagram(socket_buffer.data(), result);
+  renew_socket_buffer();
+  return true;
+}
+
+bool metrics::ContainerReaderImpl::allow_datagram(size_t size) {
+  TokenBucket::clock_t::time_point now = TokenBucket::clock_t::now();
+  if (!limit_bytes_bucket.allow(size, now)) {
+    return false;
+  }
+  if (limit_amount_packets > 0) {
+    if (!limit_packets_bucket.allow(1, now)) {
+      return false;
+    }
+    limit_packets_bucket.take(1);
+  }
+  limit_bytes_bucket.take(size);
+  return true;
+}
+
+void metrics::ContainerReaderImpl::process_datagram(const char* data, size_t size) {
+  if (!allow_datagram(size)) {
+    // We've hit the limit, drop data and continue.
+    dropped_bytes += size;
+    ++dropped_packets;
+  } else {
+    write_lines(socket_buffer.borrow(data, size));
+  }
+
+  received_bytes += size;
+}
+
+bool metrics::ContainerReaderImpl::consume_stream(
+    const StreamListener::endpoint_t& peer, const char* data, size_t size) {
+  if (!allow_datagram(size)) {
+    // We've hit the limit: the listener holds onto the data and stops reading until we have room
+    return false;
+  }
+  sender_endpoint = generic_endpoint_t(peer.data(), peer.size());
+  // The listener moves any partial line over this data once we return, so writers which keep a
+  // line get their own copy of it
+  write_lines(PacketSlice::wrap(data, size));
+  received_bytes += size;
+  return true;
+}
+
+void metrics::ContainerReaderImpl::write_lines(const PacketSlice& packet) {
+  // Index the separators in the packet once, then walk the newline-separated entries (if any)
+  // and their sections from the index
+  statsd_index.build(packet.data(), packet.size());
+  StatsdIndex::Line line;
+  while (statsd_index.next_line(line)) {
+    if (line.size > 0) { // check/skip empty rows ("\n\n", or "\n" at start/end of pkt)
+      write_message(packet, line);
+    }
+  }
+}
+
+void metrics::ContainerReaderImpl::write_message(
+    const PacketSlice& packet, const StatsdIndex::Line& line) {
+  DLOG(INFO) << "Received " << line.size << " byte entry from "
+             << "endpoint[" << endpoint_string(sender_endpoint) << "] => "
              << registered_containers.size() << " containers";
+  const container_entry_t* entry = find_container();
+  if (limit_series > 0 && !check_series_limit(entry, line)) {
+    return;
+  }
+  write_container_message(entry, packet.borrow(line.data, line.size));
+}
+
+const metrics::ContainerReaderImpl::container_entry_t*
+metrics::ContainerReaderImpl::find_container() const {
   switch (registered_containers.size()) {
     case 0:
       // No containers assigned to this reader, nothing to pair the data with.
-      for (output_writer_ptr_t writer : writers) {
-        writer->write_container_statsd(NULL, NULL, data, size);
-      }
-      break;
+      return NULL;
     case 1:
       // Typical/expected case: One container per UDP port.
+      return &*registered_containers.cbegin();
+    default:
+      // Multiple containers assigned to this port (ip-per-container). Find the container by the
+      // source address of the data.
       {
-        auto container_entry = *registered_containers.cbegin();
-        for (output_writer_ptr_t writer : writers) {
-          writer->write_container_statsd(
-              &container_entry.first, &container_entry.second, data, size);
+        if (!is_ip(sender_endpoint)) {
+          return NULL;
         }
+        udp_endpoint_t source_endpoint = to_udp_endpoint(sender_endpoint);
+        const container_entry_t* const* container_entry =
+          container_addresses.find(source_endpoint.address(), source_endpoint.port());
+        return (container_entry == NULL) ? NULL : *container_entry;
       }
-      break;
-    default:
-      // Multiple containers assigned to this port. Unable to determine which container this
-      // data came from.
-      // FIXME: This is where ip-per-container support would be added, using an ip provided
-      // by the caller.
-      for (output_writer_ptr_t writer : writers) {
-        writer->write_container_statsd(NULL, NULL, data, size);
-      }
-      break;
   }
 }
 
+const metrics::ContainerReaderImpl::container_entry_t*
+metrics::ContainerReaderImpl::reader_container() const {
+  // Unlike a line of data, the reader's own metrics aren't from any one source. They can only be
+  // attributed to a container when it's the only one using this reader.
+  if (registered_containers.size() == 1) {
+    return &*registered_containers.cbegin();
+  }
+  return NULL;
+}
+
+bool metrics::ContainerReaderImpl::check_series_limit(
+    const container_entry_t* entry, const StatsdIndex::Line& line) {
+  CardinalityLimiter& limiter =
+    (entry == NULL) ? unregistered_series_limiter : entry->second.series_limiter;
+  if (limiter.add(line)) {
+    return true;
+  }
+  if (!limit_series_overflow) {
+    return false;
+  }
+
+  // Collapse into the overflow series: keep the value, type and rate, drop the name and any tags.
+  const char* end = line.data + line.size;
+  const char* section = (const char*) memchr(line.data, ':', line.size);
+  if (section == NULL) {
+    return false;
+  }
+  series_overflow_buffer.assign(statsd_name(SERIES_OVERFLOW_STATSD_LABEL));
+  size_t i = 0;
+  while (section < end) {
+    for (; i < line.section_count && line.section(i) <= section; ++i) { }
+    const char* next = (i < line.section_count) ? line.section(i) : end;
+    if (!(*section == '|' && section + 1 < next && section[1] == '#')) {
+      series_overflow_buffer.append(section, next - section);
+    }
+    section = next;
+  }
+  write_container_message(entry, series_overflow_buffer.data(), series_overflow_buffer.size());
+  return false;
+}
+
+void metrics::ContainerReaderImpl::write_container_message(
+    const container_entry_t* entry, const char* data, size_t size) {
+  // Our own messages and rewritten lines aren't in socket_buffer: copied if a writer keeps them
+  write_container_message(entry, PacketSlice::wrap(data, size));
+}
+
+void metrics::ContainerReaderImpl::write_container_message(
+    const container_entry_t* entry, const PacketSlice& line) {
+  if (entry == NULL) {
+    for (const output_writer_ptr_t& writer : writers) {
+      writer->write_container_statsd_slice(NULL, NULL, line);
+    }
+  } else {
+    for (const output_writer_ptr_t& writer : writers) {
+      writer->write_registered_container_statsd_slice(
+          entry->first, entry->second.executor_info, entry->second.tags, line);
+    }
+  }
+}
+
+void metrics::ContainerReaderImpl::write_limit_stats(
+    const container_entry_t* entry, const CardinalityLimiter& limiter) {
+  if (limiter.limited() > 0) {
+    LOG(WARNING) << "Container[" << ((entry == NULL) ? "?UNKNOWN?" : entry->first.value()) << "] "
+                 << "exceeded " << params::CONTAINER_LIMIT_SERIES << "=" << limit_series << ": "
+                 << "~" << (size_t) limiter.estimate() << " series, "
+                 << limiter.limited() << " lines " << (limit_series_overflow ? "collapsed" : "dropped");
+  }
+  std::string msg = statsd_gauge(SERIES_ESTIMATE_STATSD_LABEL, std::round(limiter.estimate()));
+  write_container_message(entry, msg.data(), msg.size());
+  msg = statsd_counter_per_sec(SERIES_LIMITED_STATSD_LABEL, limiter.limited(), limit_period_ms);
+  write_container_message(entry, msg.data(), msg.size());
+}
+
 void metrics::ContainerReaderImpl::shutdown_cb() {
+  if (ingest_scheduler) {
+    ingest_scheduler->remove(this);
+  }
+
   boost::system::error_code ec;
-  udp_endpoint_t bound_endpoint = socket.local_endpoint(ec);
+  generic_endpoint_t bound_endpoint = socket.local_endpoint(ec);
   if (ec) {
     LOG(INFO) << "Destroying reader for requested[" << requested_endpoint.string() << "] -> "
               << "actual[???], " << socket.available() << " socket bytes dropped";
   } else {
     LOG(INFO) << "Destroying reader for requested[" << requested_endpoint.string() << "] -> "
-              << "actual[" << bound_endpoint << "], " << socket.available() << " socket bytes dropped";
+              << "actual[" << endpoint_string(bound_endpoint) << "], "
+              << socket.available() << " socket bytes dropped";
   }
 
+  // Close any stream connections
+  stream_listener.reset();
+
   // Shut down the throttle timer
   limit_reset_timer.cancel(ec);
   if (ec) {
@@ -283,9 +992,13 @@ void metrics::ContainerReaderImpl::shutdown_cb() {
   }
 
   // Flush any remaining data queued in the socket
+  if (recv_batch_size > 1) {
+    while (socket.available() && recv_batch() > 0) { }
+  }
   while (socket.available()) {
     size_t bytes_transferred =
-      socket.receive_from(boost::asio::buffer(socket_buffer.data(), socket_buffer.size()),
+      socket.receive_from(
+          boost::asio::buffer(socket_buffer.mutable_data(), socket_buffer.size()),
           sender_endpoint, 0 /* flags */, ec);
     if (ec) {
       LOG(WARNING) << "Sync receive failed, dropping " << socket.available() << " bytes: " << ec;
@@ -306,4 +1019,9 @@ void metrics::ContainerReaderImpl::shutdown_cb() {
       LOG(ERROR) << "Error on reader socket close: " << ec;
     }
   }
+  if (actual_endpoint && actual_endpoint->is_unix() && unlink(actual_endpoint->host.c_str()) != 0) {
+    int errnum = errno;
+    LOG(WARNING) << "Failed to remove reader socket at path[" << actual_endpoint->host << "]: "
+                 << "errno=" << errnum << " => " << strerror(errnum);
+  }
 }
@@ -1,24 +1,75 @@
 #pragma once
 
+#include <sys/socket.h>
+
 #include <boost/asio.hpp>
 
+#include "cardinality_limiter.hpp"
 #include "mesos_hash.hpp"
 #include "container_reader.hpp"
+#include "ingest_scheduler.hpp"
 #include "output_writer.hpp"
+#include "packet_buffer.hpp"
+#include "params.hpp"
+#include "source_address_map.hpp"
+#include "statsd_index.hpp"
+#include "statsd_tagger.hpp"
+#include "stream_listener.hpp"
+#include "token_bucket.hpp"
 
 namespace metrics {
+  /**
+   * Settings for a ContainerReaderImpl, read from the module parameters. See params.hpp for what
+   * each of them does. Tests may adjust individual fields after construction.
+   */
+  struct ContainerReaderOptions {
+    explicit ContainerReaderOptions(const mesos::Parameters& parameters);
+
+    size_t limit_period_ms;
+    size_t limit_amount_bytes;
+    // 0: the whole period's amount may be received at once
+    size_t limit_burst_bytes;
+    size_t limit_amount_packets;
+    size_t limit_series;
+    bool limit_series_overflow;
+    size_t recv_batch_size;
+    size_t recv_batch_slot_bytes;
+    // The number of readers sharing the port with SO_REUSEPORT, or 1 if the port isn't shared.
+    // Not a module parameter: set by whoever creates the group.
+    size_t reuse_port_group_size;
+    bool reuse_port_cbpf;
+    size_t stream_max_connections;
+    size_t stream_buffer_bytes;
+    // Receive batches with single recvmsg() calls, as when recvmmsg() isn't available
+    bool recv_batch_fallback_for_tests;
+  };
+
   /**
    * The default/prod implementation of ContainerReader.
    * PortWriter is templated out to allow for easy mockery of PortWriter in tests.
+   *
+   * If an IngestScheduler is provided, the reader waits for its turn from the scheduler before
+   * receiving pending data, rather than receiving it as soon as it arrives.
+   *
+   * If the requested endpoint is a unix socket path, the reader listens on a unix datagram socket
+   * at that path instead of a UDP port. The socket file is removed when the reader is destroyed.
+   *
+   * If options.stream_max_connections is non-zero, the reader also accepts newline-framed statsd
+   * over TCP on the same port, or over a unix stream socket next to its unix datagram socket.
+   *
+   * Datagrams are received into pooled buffers, and lines are handed to writers as slices of
+   * those buffers. If a writer keeps a slice past its call, the reader moves on to another buffer
+   * rather than receiving over the kept data.
    */
-  class ContainerReaderImpl : public ContainerReader {
+  class ContainerReaderImpl : public ContainerReader, public IngestScheduler::Source {
    public:
     ContainerReaderImpl(
         const std::shared_ptr<boost::asio::io_service>& io_service,
         const std::vector<output_writer_ptr_t>& writers,
         const UDPEndpoint& requested_endpoint,
-        size_t limit_period_ms,
-        size_t limit_amount_bytes);
+        const ContainerReaderOptions& options,
+        const std::shared_ptr<IngestScheduler>& ingest_scheduler =
+          std::shared_ptr<IngestScheduler>());
     virtual ~ContainerReaderImpl();
 
     Try<UDPEndpoint> open();
@@ -31,32 +82,133 @@ namespace metrics {
 
     void unregister_container(const mesos::ContainerID& container_id);
 
+    size_t ingest(size_t budget_bytes, bool& drained);
+
+    double ingest_weight() const {
+      return container_cpus;
+    }
+
    private:
-    typedef boost::asio::ip::udp::endpoint udp_endpoint_t;
+    typedef boost::asio::generic::datagram_protocol::endpoint generic_endpoint_t;
+    /**
+     * A registered container's info, along with its tags as rendered once at registration, and
+     * the series it has been admitted to send.
+     */
+    struct RegisteredContainer {
+      RegisteredContainer(
+          const mesos::ContainerID& container_id, const mesos::ExecutorInfo& executor_info,
+          size_t limit_series)
+        : executor_info(executor_info),
+          tags(container_id, executor_info),
+          series_limiter(limit_series) { }
+      mesos::ExecutorInfo executor_info;
+      ContainerTags tags;
+      // Not part of the container's identity: updated via the const entries in container_addresses
+      mutable CardinalityLimiter series_limiter;
+    };
+    typedef container_id_map<RegisteredContainer>::value_type container_entry_t;
+
+    Try<UDPEndpoint> open_udp();
+    Try<UDPEndpoint> open_unix();
+    void open_stream();
+    void register_container_cb(
+        const mesos::ContainerID& container_id,
+        const mesos::ExecutorInfo& executor_info);
+    void unregister_container_cb(const mesos::ContainerID& container_id);
+    void add_container_addresses(const container_entry_t* entry);
+    void remove_container_addresses(const container_entry_t* entry);
+    void update_container_cpus();
 
     void start_limit_reset_timer();
     void limit_reset_cb(boost::system::error_code ec);
     void start_recv();
     void recv_cb(boost::system::error_code ec, size_t bytes_transferred);
-    void write_message(const char* data, size_t size);
+    void renew_socket_buffer();
+    void start_recv_batch();
+    void recv_batch_cb(boost::system::error_code ec);
+    size_t recv_batch();
+#ifdef LINUX_RECVMMSG_AVAILABLE
+    size_t recv_batch_multi();
+#endif
+    size_t recv_batch_single();
+    void start_recv_wait();
+    void recv_wait_cb(boost::system::error_code ec);
+    bool recv_one();
+    bool allow_datagram(size_t size);
+    void process_datagram(const char* data, size_t size);
+    bool consume_stream(const StreamListener::endpoint_t& peer, const char* data, size_t size);
+    void write_lines(const PacketSlice& packet);
+    void write_message(const PacketSlice& packet, const StatsdIndex::Line& line);
+    const container_entry_t* find_container() const;
+    const container_entry_t* reader_container() const;
+    bool check_series_limit(const container_entry_t* entry, const StatsdIndex::Line& line);
+    void write_container_message(const container_entry_t* entry, const char* data, size_t size);
+    void write_container_message(const container_entry_t* entry, const PacketSlice& line);
+    void write_limit_stats(const container_entry_t* entry, const CardinalityLimiter& limiter);
     void shutdown_cb();
 
     const std::vector<output_writer_ptr_t> writers;
     const UDPEndpoint requested_endpoint;
     const size_t limit_period_ms;
     const size_t limit_amount_bytes;
+    const size_t recv_batch_size;
+    const size_t recv_batch_slot_bytes;
+    const size_t reuse_port_group_size;
+    const bool reuse_port_cbpf;
+    const size_t limit_series;
+    const bool limit_series_overflow;
+    const size_t limit_amount_packets;
+    const size_t stream_max_connections;
+    const size_t stream_buffer_bytes;
+    const bool recv_batch_fallback_for_tests;
 
     std::shared_ptr<boost::asio::io_service> io_service;
+    const std::shared_ptr<IngestScheduler> ingest_scheduler;
     bool shutdown;
     boost::asio::deadline_timer limit_reset_timer;
-    boost::asio::ip::udp::socket socket;
-    std::vector<char> socket_buffer;
-    udp_endpoint_t sender_endpoint;
+    // UDP or unix datagram, depending on requested_endpoint
+    boost::asio::generic::datagram_protocol::socket socket;
+    // Buffer being received into, from buffer_pool. Replaced with another buffer from the pool
+    // after a receive if any writer kept a slice of it.
+    std::shared_ptr<PacketBufferPool> buffer_pool;
+    PacketSlice socket_buffer;
+    generic_endpoint_t sender_endpoint;
+    // Lines and sections of the packet currently being processed
+    StatsdIndex statsd_index;
+
+    // Container input limits: bytes, and optionally packets. Refilled continuously rather than
+    // reset every limit_period_ms, so that a container which exhausts its budget is throttled to
+    // the refill rate instead of being cut off until the end of the period.
+    TokenBucket limit_bytes_bucket;
+    TokenBucket limit_packets_bucket;
+
+    // Batched receive state, only used when recv_batch_size > 1. The slots in socket_buffer are
+    // each recv_batch_slot_bytes long.
+#ifdef LINUX_RECVMMSG_AVAILABLE
+    std::vector<struct mmsghdr> batch_msgs;
+    std::vector<struct iovec> batch_iovecs;
+    std::vector<struct sockaddr_storage> batch_addrs;
+#endif
 
     std::unique_ptr<UDPEndpoint> actual_endpoint;
-    container_id_map<mesos::ExecutorInfo> registered_containers;
+    std::unique_ptr<StreamListener> stream_listener;
+    container_id_map<RegisteredContainer> registered_containers;
+    // Source address => entry in registered_containers, for when several containers share this
+    // reader. Filled from the network info of each registered container.
+    SourceAddressMap<const container_entry_t*> container_addresses;
+    // The total cpus of the registered containers (or 1), used as the reader's ingest weight
+    double container_cpus;
+    // Series sent by sources which aren't paired with a registered container
+    CardinalityLimiter unregistered_series_limiter;
+    // Scratch space for rewriting limited lines into the overflow series
+    std::string series_overflow_buffer;
 
     size_t received_bytes;
     size_t dropped_bytes;
+    size_t dropped_packets;
+    size_t recv_wakeups;
+    size_t recv_datagrams;
+    size_t recv_batch_max;
+    size_t ingest_queue_max_bytes;
   };
 }
@@ -0,0 +1,66 @@
+#include "hash_ring.hpp"
+
+#include <algorithm>
+
+namespace {
+  uint64_t hash_bytes(const char* data, size_t size, uint64_t hash) {
+    // FNV-1a
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= (uint8_t)data[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  /**
+   * splitmix64 finalizer: spreads the points of similar member names across the whole ring.
+   */
+  inline uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+  }
+
+  bool point_less(const std::pair<uint64_t, size_t>& point, uint64_t hash) {
+    return point.first < hash;
+  }
+}
+
+metrics::HashRing::HashRing(size_t points_per_member)
+  : points_per_member(std::max(points_per_member, (size_t)1)),
+    member_count(0) { }
+
+void metrics::HashRing::set_members(const std::vector<std::string>& members) {
+  member_count = members.size();
+  points.clear();
+  points.reserve(members.size() * points_per_member);
+  for (size_t member = 0; member < members.size(); ++member) {
+    const std::string& name = members[member];
+    uint64_t name_hash = hash_bytes(name.data(), name.size(), 14695981039346656037ULL);
+    for (size_t i = 0; i < points_per_member; ++i) {
+      points.push_back(std::make_pair(mix(name_hash + i), member));
+    }
+  }
+  // Ties (vanishingly unlikely) are broken by name, so that the result doesn't depend on the
+  // order of the members.
+  std::sort(points.begin(), points.end(),
+      [&members](const std::pair<uint64_t, size_t>& a, const std::pair<uint64_t, size_t>& b) {
+        return a.first < b.first || (a.first == b.first && members[a.second] < members[b.second]);
+      });
+}
+
+size_t metrics::HashRing::find(uint64_t hash) const {
+  if (points.empty()) {
+    return 0;
+  }
+  std::vector<std::pair<uint64_t, size_t>>::const_iterator iter =
+    std::lower_bound(points.begin(), points.end(), hash, point_less);
+  if (iter == points.end()) {
+    // wrap around to the start of the ring
+    iter = points.begin();
+  }
+  return iter->second;
+}
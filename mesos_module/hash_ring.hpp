@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace metrics {
+
+  /**
+   * A consistent hash ring which maps hashes to one of a set of named members. Each member is
+   * placed at points_per_member pseudo-random points on the ring, derived from its name, and a
+   * hash belongs to the member at the next point along. As a result the hashes are spread evenly
+   * across the members, and adding or removing one member only moves the hashes which belong to
+   * it (or would now belong to it), regardless of the order the members are listed in.
+   */
+  class HashRing {
+   public:
+    const static size_t DEFAULT_POINTS_PER_MEMBER = 160;
+
+    explicit HashRing(size_t points_per_member = DEFAULT_POINTS_PER_MEMBER);
+
+    /**
+     * Replaces the ring's members. find() returns indexes into this list.
+     */
+    void set_members(const std::vector<std::string>& members);
+
+    /**
+     * Returns the number of members.
+     */
+    size_t size() const {
+      return member_count;
+    }
+
+    /**
+     * Returns the index of the member which the provided hash belongs to, or 0 if the ring is
+     * empty.
+     */
+    size_t find(uint64_t hash) const;
+
+   private:
+    const size_t points_per_member;
+    size_t member_count;
+    // Sorted by position on the ring
+    std::vector<std::pair<uint64_t, size_t>> points;
+  };
+
+}
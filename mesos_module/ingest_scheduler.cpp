@@ -0,0 +1,158 @@
+#include "ingest_scheduler.hpp"
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "sync_util.hpp"
+
+namespace {
+  // How long to wait before trying again when the ingest cap has been reached
+  const size_t LIMITED_RETRY_MS = 10;
+
+  // Keep even tiny weights making progress on each turn
+  const double MIN_WEIGHT = 0.01;
+
+  size_t get_limit_burst(size_t quantum_bytes, size_t limit_bytes_per_sec) {
+    // 100ms worth of data, but always enough for at least one full turn
+    return std::max(quantum_bytes, limit_bytes_per_sec / 10);
+  }
+}
+
+metrics::IngestScheduler::IngestScheduler(
+    const std::shared_ptr<boost::asio::io_service>& io_service,
+    size_t quantum_bytes,
+    size_t limit_bytes_per_sec)
+  : quantum_bytes(std::max(quantum_bytes, (size_t)1)),
+    limited(limit_bytes_per_sec > 0),
+    io_service(io_service),
+    turn_timer(*io_service),
+    turn_pending(false),
+    limit_bucket(limit_bytes_per_sec, limited ? 1000 : 0,
+        get_limit_burst(quantum_bytes, limit_bytes_per_sec)),
+    total_served_bytes(0) {
+  LOG(INFO) << "Ingest scheduler constructed with quantum " << this->quantum_bytes << " bytes, "
+            << "limit " << limit_bytes_per_sec << " bytes/sec";
+}
+
+metrics::IngestScheduler::~IngestScheduler() {
+  LOG(INFO) << "Triggering IngestScheduler shutdown";
+  if (sync_util::dispatch_run(
+          "~IngestScheduler", *io_service, std::bind(&IngestScheduler::shutdown_cb, this))) {
+    LOG(INFO) << "IngestScheduler shutdown succeeded";
+  } else {
+    LOG(ERROR) << "Failed to complete IngestScheduler shutdown";
+  }
+}
+
+void metrics::IngestScheduler::ready(Source* source) {
+  SourceState& state = sources[source];
+  if (state.active) {
+    return;
+  }
+  state.active = true;
+  active.push_back(source);
+  if (!turn_pending) {
+    start_turn_timer(0);
+  }
+}
+
+void metrics::IngestScheduler::remove(Source* source) {
+  auto iter = sources.find(source);
+  if (iter == sources.end()) {
+    return;
+  }
+  if (iter->second.active) {
+    active.erase(std::find(active.begin(), active.end(), source));
+  }
+  sources.erase(iter);
+}
+
+double metrics::IngestScheduler::take_share(const Source* source) {
+  auto iter = sources.find(source);
+  if (iter == sources.end()) {
+    return 0;
+  }
+  SourceState& state = iter->second;
+  size_t period_total = total_served_bytes - state.total_at_last_share;
+  double share = (period_total == 0) ? 0 : state.served_bytes / (double) period_total;
+  state.served_bytes = 0;
+  state.total_at_last_share = total_served_bytes;
+  return share;
+}
+
+void metrics::IngestScheduler::start_turn_timer(size_t delay_ms) {
+  turn_pending = true;
+  turn_timer.expires_from_now(boost::posix_time::milliseconds(delay_ms));
+  turn_timer.async_wait(std::bind(&IngestScheduler::turn_cb, this, std::placeholders::_1));
+}
+
+void metrics::IngestScheduler::turn_cb(boost::system::error_code ec) {
+  if (ec) {
+    if (ec == boost::asio::error::operation_aborted) {
+      // We're being destroyed. Don't look at local state, it may be destroyed already.
+      LOG(INFO) << "Ingest turn timer cancelled due to teardown: Exiting turn loop immediately";
+      return;
+    } else {
+      LOG(ERROR) << "Ingest turn timer returned error. "
+                 << "err='" << ec.message() << "'(" << ec << ")";
+    }
+  }
+  turn_pending = false;
+  if (active.empty()) {
+    return;
+  }
+
+  size_t limit_budget = 0;
+  if (limited) {
+    if (!limit_bucket.allow(1, TokenBucket::clock_t::now())) {
+      // Over the cap: leave the data in the kernel for now
+      start_turn_timer(LIMITED_RETRY_MS);
+      return;
+    }
+    limit_budget = (size_t) limit_bucket.available();
+  }
+
+  Source* source = active.front();
+  active.pop_front();
+  SourceState& state = sources[source];
+  state.deficit += quantum_bytes * std::max(source->ingest_weight(), MIN_WEIGHT);
+  if (state.deficit >= 1) {
+    size_t budget = (size_t) state.deficit;
+    if (limited) {
+      budget = std::min(budget, std::max(limit_budget, (size_t)1));
+    }
+    bool drained = false;
+    size_t received = source->ingest(budget, drained);
+    // Overshooting the budget (by the last datagram) is paid back on the next turn
+    state.deficit -= received;
+    state.served_bytes += received;
+    total_served_bytes += received;
+    if (limited) {
+      limit_bucket.take(received);
+    }
+    if (drained) {
+      // Deficit isn't carried over while idle, otherwise a source could save up for a burst
+      state.active = false;
+      state.deficit = 0;
+    }
+  }
+  if (state.active) {
+    active.push_back(source);
+  }
+
+  if (!active.empty()) {
+    start_turn_timer(0);
+  }
+}
+
+void metrics::IngestScheduler::shutdown_cb() {
+  boost::system::error_code ec;
+  turn_timer.cancel(ec);
+  if (ec) {
+    LOG(ERROR) << "Ingest turn timer cancellation returned error. "
+               << "err='" << ec.message() << "'(" << ec << ")";
+  }
+  active.clear();
+  sources.clear();
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <deque>
+#include <unordered_map>
+
+#include <boost/asio.hpp>
+
+#include "token_bucket.hpp"
+
+namespace metrics {
+
+  /**
+   * An IngestScheduler shares an io thread's receive work between the ContainerReaders which run
+   * on it. Rather than each reader draining its socket as soon as it becomes readable, readers
+   * with pending data queue up here and are polled one turn at a time with deficit round robin:
+   * each turn credits the reader with quantum_bytes * its weight, and the reader may receive that
+   * much before moving to the back of the queue. A reader with a burst of data therefore can't
+   * hold the thread for longer than one turn, and busy readers get throughput in proportion to
+   * their weights. Each turn is a separate handler on the io_service, so writer and timer
+   * handlers are interleaved between turns.
+   *
+   * Optionally, the total ingest across all readers on the thread is capped at
+   * limit_bytes_per_sec. When the cap is reached, data is left in the kernel until the next turn.
+   *
+   * Like the readers, an instance is only used from within its io_service's thread.
+   */
+  class IngestScheduler {
+   public:
+    /**
+     * A reader which is polled by the scheduler.
+     */
+    class Source {
+     public:
+      virtual ~Source() { }
+
+      /**
+       * Receives pending data until at least 'budget_bytes' have been received, or until there's
+       * nothing left to receive. Returns the number of bytes received. When there's nothing left,
+       * sets 'drained' and must call ready() again once more data is pending.
+       */
+      virtual size_t ingest(size_t budget_bytes, bool& drained) = 0;
+
+      /**
+       * Returns this source's share of ingest relative to other busy sources. Must be positive.
+       */
+      virtual double ingest_weight() const = 0;
+    };
+
+    /**
+     * A limit_bytes_per_sec of 0 disables the ingest cap.
+     */
+    IngestScheduler(
+        const std::shared_ptr<boost::asio::io_service>& io_service,
+        size_t quantum_bytes,
+        size_t limit_bytes_per_sec);
+
+    virtual ~IngestScheduler();
+
+    /**
+     * Queues the source for a turn. Called when the source has pending data.
+     */
+    void ready(Source* source);
+
+    /**
+     * Forgets the source. No further calls are made to it after this returns.
+     */
+    void remove(Source* source);
+
+    /**
+     * Returns the fraction of all bytes received by this scheduler's sources which were received
+     * by the provided source, since the last call for that source. Returns 0 if nothing was
+     * received.
+     */
+    double take_share(const Source* source);
+
+    /**
+     * Returns the number of sources currently waiting for a turn.
+     */
+    size_t active_count() const {
+      return active.size();
+    }
+
+   private:
+    struct SourceState {
+      SourceState()
+        : active(false),
+          deficit(0),
+          served_bytes(0),
+          total_at_last_share(0) { }
+      bool active;
+      double deficit;
+      size_t served_bytes;
+      size_t total_at_last_share;
+    };
+
+    void start_turn_timer(size_t delay_ms);
+    void turn_cb(boost::system::error_code ec);
+    void shutdown_cb();
+
+    const size_t quantum_bytes;
+    const bool limited;
+
+    std::shared_ptr<boost::asio::io_service> io_service;
+    boost::asio::deadline_timer turn_timer;
+    bool turn_pending;
+
+    TokenBucket limit_bucket;
+    std::unordered_map<const Source*, SourceState> sources;
+    std::deque<Source*> active;
+    size_t total_served_bytes;
+  };
+
+}
@@ -25,7 +25,18 @@ namespace metrics {
     /**
      * Creates a new PortReader against the provided port which is powered by an internal async
      * scheduler, and which hasn't been open()ed yet.
+     *
+     * If a container_id is provided, it's used to consistently select the async scheduler which
+     * will run the reader. Readers shared across containers should pass NULL.
      */
-    virtual std::shared_ptr<ContainerReader> create_container_reader(size_t port) = 0;
+    virtual std::shared_ptr<ContainerReader> create_container_reader(
+        size_t port, const mesos::ContainerID* container_id) = 0;
+
+    /**
+     * Creates a new ContainerReader which listens on a unix datagram socket at the provided path,
+     * and which hasn't been open()ed yet. The async scheduler is selected as above.
+     */
+    virtual std::shared_ptr<ContainerReader> create_unix_container_reader(
+        const std::string& path, const mesos::ContainerID* container_id) = 0;
   };
 }
@@ -13,6 +13,8 @@
 
 #include "collector_output_writer.hpp"
 #include "container_reader_impl.hpp"
+#include "reuse_port_container_reader.hpp"
+#include "statsd_aggregator.hpp"
 #include "statsd_output_writer.hpp"
 
 namespace {
@@ -67,18 +69,30 @@ metrics::IORunnerImpl::IORunnerImpl() { }
 
 metrics::IORunnerImpl::~IORunnerImpl() {
   // Clean shutdown in a specific order.
-  if (io_service) {
-    writers.clear();
-    io_service->stop();
-    io_service_thread->join();
-    io_service_thread.reset();
-    io_service->reset();
-    io_service.reset();
+  if (!io_services.empty()) {
+    // Destroy writers while all threads are still running, last shard first: the collector writers
+    // on other shards flush their final data into the sender owned by the first shard.
+    for (auto iter = shard_writers.rbegin(); iter != shard_writers.rend(); ++iter) {
+      iter->clear();
+    }
+    ingest_schedulers.clear();
+    io_service_works.clear();
+    for (std::shared_ptr<boost::asio::io_service> io_service : io_services) {
+      io_service->stop();
+    }
+    for (std::shared_ptr<std::thread> io_service_thread : io_service_threads) {
+      io_service_thread->join();
+    }
+    io_service_threads.clear();
+    for (std::shared_ptr<boost::asio::io_service> io_service : io_services) {
+      io_service->reset();
+    }
+    io_services.clear();
   }
 }
 
 void metrics::IORunnerImpl::init(const mesos::Parameters& parameters) {
-  if (io_service) {
+  if (!io_services.empty()) {
     LOG(FATAL) << "IORunner::init() was called twice";
     return;
   }
@@ -89,63 +103,148 @@ void metrics::IORunnerImpl::init(const mesos::Parameters& parameters) {
   listen_host = get_iface_host(params::get_str(
           parameters, params::LISTEN_INTERFACE, params::LISTEN_INTERFACE_DEFAULT));
 
-  container_limit_period_secs = params::get_uint(parameters,
-      params::CONTAINER_LIMIT_PERIOD_SECS, params::CONTAINER_LIMIT_PERIOD_SECS_DEFAULT);
-  container_limit_amount_kbytes = params::get_uint(parameters,
-      params::CONTAINER_LIMIT_AMOUNT_KBYTES, params::CONTAINER_LIMIT_AMOUNT_KBYTES_DEFAULT);
+  reader_options.reset(new ContainerReaderOptions(parameters));
+  listen_port_reuse_sockets = params::get_uint(parameters,
+      params::LISTEN_PORT_REUSE_SOCKETS, params::LISTEN_PORT_REUSE_SOCKETS_DEFAULT);
+
+  size_t io_threads = params::get_uint(parameters, params::IO_THREADS, params::IO_THREADS_DEFAULT);
+  if (io_threads == 0) {
+    LOG(FATAL) << "At least one IO thread is required: " << params::IO_THREADS << " must be non-zero";
+  }
+  for (size_t i = 0; i < io_threads; ++i) {
+    io_services.push_back(
+        std::shared_ptr<boost::asio::io_service>(new boost::asio::io_service));
+  }
 
-  io_service.reset(new boost::asio::io_service);
+  shard_writers.resize(io_threads);
   if (params::get_bool(
           parameters, params::OUTPUT_STATSD_ENABLED, params::OUTPUT_STATSD_ENABLED_DEFAULT)) {
-    output_writer_ptr_t writer = StatsdOutputWriter::create(io_service, parameters);
-    writers.push_back(writer);
+    // Each shard sends its own statsd datagrams: no need to merge them.
+    for (size_t i = 0; i < io_threads; ++i) {
+      shard_writers[i].push_back(StatsdOutputWriter::create(io_services[i], parameters));
+    }
   }
   if (params::get_bool(
           parameters, params::OUTPUT_COLLECTOR_ENABLED, params::OUTPUT_COLLECTOR_ENABLED_DEFAULT)) {
-    output_writer_ptr_t writer = CollectorOutputWriter::create(io_service, parameters);
-    writers.push_back(writer);
+    // Each shard encodes its own blocks, which are then all sent over a single collector session.
+    std::vector<output_writer_ptr_t> writers =
+      CollectorOutputWriter::create_sharded(io_services, parameters);
+    for (size_t i = 0; i < io_threads; ++i) {
+      shard_writers[i].push_back(writers[i]);
+    }
   }
-  if (writers.empty()) {
+  if (shard_writers[0].empty()) {
     LOG(FATAL) << "At least one writer must be enabled in preferences: "
                << params::OUTPUT_STATSD_ENABLED << " or " << params::OUTPUT_COLLECTOR_ENABLED
                << " must be true";
   }
-  // Writers must start before the io thread starts. The writers will configure timers that will
-  // prevent the io thread from exiting immediately.
-  for (output_writer_ptr_t writer : writers) {
-    writer->start();
+  if (params::get_bool(parameters,
+          params::STATSD_AGGREGATION_ENABLED, params::STATSD_AGGREGATION_ENABLED_DEFAULT)) {
+    // Readers pass their data through an aggregator, which forwards to the shard's real writers.
+    for (size_t i = 0; i < io_threads; ++i) {
+      std::vector<output_writer_ptr_t> writers;
+      writers.push_back(StatsdAggregator::create(io_services[i], parameters, shard_writers[i]));
+      shard_writers[i].swap(writers);
+    }
+  }
+  if (params::get_bool(parameters,
+          params::INGEST_SCHEDULER_ENABLED, params::INGEST_SCHEDULER_ENABLED_DEFAULT)) {
+    // The agent-wide limit is split evenly, since each thread only sees its own readers.
+    size_t quantum_bytes = 1024 * params::get_uint(parameters,
+        params::INGEST_QUANTUM_KBYTES, params::INGEST_QUANTUM_KBYTES_DEFAULT);
+    size_t limit_bytes_per_sec = 1024 * params::get_uint(parameters,
+        params::INGEST_LIMIT_KBYTES_PER_SEC, params::INGEST_LIMIT_KBYTES_PER_SEC_DEFAULT);
+    for (size_t i = 0; i < io_threads; ++i) {
+      ingest_schedulers.push_back(std::shared_ptr<IngestScheduler>(new IngestScheduler(
+                  io_services[i], quantum_bytes, limit_bytes_per_sec / io_threads)));
+    }
+  }
+  // Writers must start before the io threads start. The writers will configure timers that will
+  // prevent the io threads from exiting immediately. Each shard also gets an explicit work object,
+  // since the writers on the other shards may not have anything scheduled until data arrives.
+  for (size_t i = 0; i < io_threads; ++i) {
+    for (output_writer_ptr_t writer : shard_writers[i]) {
+      writer->start();
+    }
+    io_service_works.push_back(std::shared_ptr<boost::asio::io_service::work>(
+            new boost::asio::io_service::work(*io_services[i])));
+  }
+  for (size_t i = 0; i < io_threads; ++i) {
+    io_service_threads.push_back(std::shared_ptr<std::thread>(
+            new std::thread(std::bind(&IORunnerImpl::run_io_service, this, i))));
   }
-  io_service_thread.reset(new std::thread(std::bind(&IORunnerImpl::run_io_service, this)));
+  LOG(INFO) << "Started " << io_threads << " IO thread(s)";
 }
 
 void metrics::IORunnerImpl::dispatch(std::function<void()> func) {
-  if (!io_service) {
+  if (io_services.empty()) {
     LOG(FATAL) << "IORunner::init() wasn't called before dispatch()";
     return;
   }
-  io_service->dispatch(func);
+  io_services[0]->dispatch(func);
 }
 
-std::shared_ptr<metrics::ContainerReader> metrics::IORunnerImpl::create_container_reader(size_t port) {
-  if (!io_service) {
+std::shared_ptr<metrics::ContainerReader> metrics::IORunnerImpl::create_container_reader(
+    size_t port, const mesos::ContainerID* container_id) {
+  if (io_services.empty()) {
     LOG(FATAL) << "IORunner::init() wasn't called before create_container_reader()";
     return std::shared_ptr<metrics::ContainerReader>();
   }
+  if (container_id != NULL || listen_port_reuse_sockets <= 1) {
+    return create_reader_impl(UDPEndpoint(listen_host, port), get_shard(container_id), 1);
+  }
+  if (port == 0) {
+    LOG(WARNING) << "Ignoring " << params::LISTEN_PORT_REUSE_SOCKETS << "="
+                 << listen_port_reuse_sockets << ": Port reuse requires a fixed port";
+    return create_reader_impl(UDPEndpoint(listen_host, port), 0, 1);
+  }
+
+  // Spread the sockets across the IO threads, starting with the first.
+  std::vector<std::shared_ptr<ContainerReader>> readers;
+  for (size_t i = 0; i < listen_port_reuse_sockets; ++i) {
+    readers.push_back(
+        create_reader_impl(
+            UDPEndpoint(listen_host, port), i % io_services.size(), listen_port_reuse_sockets));
+  }
+  return std::shared_ptr<ContainerReader>(new ReusePortContainerReader(readers));
+}
+
+std::shared_ptr<metrics::ContainerReader> metrics::IORunnerImpl::create_unix_container_reader(
+    const std::string& path, const mesos::ContainerID* container_id) {
+  if (io_services.empty()) {
+    LOG(FATAL) << "IORunner::init() wasn't called before create_unix_container_reader()";
+    return std::shared_ptr<metrics::ContainerReader>();
+  }
+  return create_reader_impl(UDPEndpoint(path, 0), get_shard(container_id), 1);
+}
+
+std::shared_ptr<metrics::ContainerReader> metrics::IORunnerImpl::create_reader_impl(
+    const UDPEndpoint& endpoint, size_t shard, size_t reuse_port_group_size) {
+  ContainerReaderOptions options(*reader_options);
+  options.reuse_port_group_size = reuse_port_group_size;
   return std::shared_ptr<ContainerReader>(
-      new ContainerReaderImpl(io_service, writers, UDPEndpoint(listen_host, port),
-          container_limit_period_secs * 1000, container_limit_amount_kbytes * 1024));
+      new ContainerReaderImpl(io_services[shard], shard_writers[shard], endpoint, options,
+          ingest_schedulers.empty()
+          ? std::shared_ptr<IngestScheduler>() : ingest_schedulers[shard]));
+}
+
+size_t metrics::IORunnerImpl::get_shard(const mesos::ContainerID* container_id) const {
+  if (container_id == NULL || io_services.size() == 1) {
+    return 0;
+  }
+  return std::hash<std::string>()(container_id->value()) % io_services.size();
 }
 
-void metrics::IORunnerImpl::run_io_service() {
+void metrics::IORunnerImpl::run_io_service(size_t shard) {
 #if defined(LINUX_PRCTL_AVAILABLE) && defined(PR_SET_NAME)
   // Set the thread name to help with any debugging/tracing (uses Linux-specific API)
   prctl(PR_SET_NAME, THREAD_NAME, 0, 0, 0);
 #endif
   try {
-    LOG(INFO) << "Starting io_service";
-    io_service->run();
-    LOG(INFO) << "Exited io_service.run()";
+    LOG(INFO) << "Starting io_service[" << shard << "]";
+    io_services[shard]->run();
+    LOG(INFO) << "Exited io_service[" << shard << "].run()";
   } catch (const std::exception& e) {
-    LOG(ERROR) << "io_service.run() threw exception, exiting: " << e.what();
+    LOG(ERROR) << "io_service[" << shard << "].run() threw exception, exiting: " << e.what();
   }
 }
@@ -4,13 +4,20 @@
 
 #include <boost/asio.hpp>
 
+#include "ingest_scheduler.hpp"
 #include "io_runner.hpp"
 #include "output_writer.hpp"
 
 namespace metrics {
+  struct ContainerReaderOptions;
+
   /**
    * The IORunner runs the async scheduler which powers the OutputWriter and all ContainerReaders,
    * while also acting as a factory for ContainerReaders.
+   *
+   * The IORunner may be configured to run several async schedulers, each in its own thread and
+   * with its own OutputWriters. Each ContainerReader is pinned to one of these by its container id,
+   * so that the data from a given container is only ever handled by a single thread.
    */
   class IORunnerImpl : public IORunner {
    public:
@@ -29,24 +36,45 @@ namespace metrics {
 
     /**
      * Utility function to dispatch the provided method against the enclosed async scheduler.
+     * When running several schedulers, this always uses the first one.
      */
     void dispatch(std::function<void()> func);
 
     /**
      * Creates a new ContainerReader which is powered by an internal async scheduler for the
      * provided port. The returned ContainerReader won't have been open()ed yet.
+     * The scheduler is selected by hashing the container_id, or is the first one if it's NULL.
+     *
+     * If port reuse is configured, readers for a NULL container_id are instead split across
+     * several sockets on the same port, which are spread across the schedulers.
+     */
+    std::shared_ptr<ContainerReader> create_container_reader(
+        size_t port, const mesos::ContainerID* container_id);
+
+    /**
+     * Creates a new ContainerReader which listens on a unix datagram socket at the provided path.
+     * The returned ContainerReader won't have been open()ed yet.
      */
-    std::shared_ptr<ContainerReader> create_container_reader(size_t port);
+    std::shared_ptr<ContainerReader> create_unix_container_reader(
+        const std::string& path, const mesos::ContainerID* container_id);
 
    private:
-    void run_io_service();
+    size_t get_shard(const mesos::ContainerID* container_id) const;
+    std::shared_ptr<ContainerReader> create_reader_impl(
+        const UDPEndpoint& endpoint, size_t shard, size_t reuse_port_group_size);
+    void run_io_service(size_t shard);
 
     std::string listen_host;
-    size_t container_limit_period_secs;
-    size_t container_limit_amount_kbytes;
+    // Common to all readers, read from the parameters once in init()
+    std::unique_ptr<ContainerReaderOptions> reader_options;
+    size_t listen_port_reuse_sockets;
 
-    std::shared_ptr<boost::asio::io_service> io_service;
-    std::vector<output_writer_ptr_t> writers;
-    std::unique_ptr<std::thread> io_service_thread;
+    // One entry per io thread ('shard'), each with its own writers.
+    std::vector<std::shared_ptr<boost::asio::io_service>> io_services;
+    std::vector<std::vector<output_writer_ptr_t>> shard_writers;
+    // Empty unless the ingest scheduler is enabled
+    std::vector<std::shared_ptr<IngestScheduler>> ingest_schedulers;
+    std::vector<std::shared_ptr<boost::asio::io_service::work>> io_service_works;
+    std::vector<std::shared_ptr<std::thread>> io_service_threads;
   };
 }
@@ -3,10 +3,12 @@
 #include <mesos/module/isolator.hpp>
 #include <mesos/slave/containerizer.hpp>
 #include <process/process.hpp>
+#include <stout/os.hpp>
 #include <stout/try.hpp>
 
 #include "container_assigner.hpp"
 #include "module_access_factory.hpp"
+#include "stream_listener.hpp"
 
 
 using mesos::slave::ContainerClass;
@@ -14,17 +16,34 @@ using mesos::slave::ContainerClass;
 namespace {
   const std::string STATSD_ENV_NAME_HOST = "STATSD_UDP_HOST";
   const std::string STATSD_ENV_NAME_PORT = "STATSD_UDP_PORT";
+  const std::string STATSD_ENV_NAME_UNIX_SOCKET = "STATSD_UNIX_SOCKET";
+  const std::string STATSD_ENV_NAME_UNIX_STREAM_SOCKET = "STATSD_UNIX_STREAM_SOCKET";
 
   void set_env(mesos::slave::ContainerLaunchInfo& launch_info, const metrics::UDPEndpoint& endpoint) {
     mesos::Environment* environment = launch_info.mutable_environment();
 
     mesos::Environment::Variable* variable = environment->add_variables();
-    variable->set_name(STATSD_ENV_NAME_HOST);
-    variable->set_value(endpoint.host);
+    if (endpoint.is_unix()) {
+      // No host/port: the container sends to the unix datagram socket at this path. Only used when
+      // the operator has opted into dropping them, see params::LISTEN_UNIX_DROP_UDP_ENV.
+      variable->set_name(STATSD_ENV_NAME_UNIX_SOCKET);
+      variable->set_value(endpoint.host);
+
+      // Only present when stream ingest is enabled and its socket could be opened
+      const std::string stream_path = metrics::StreamListener::unix_stream_path(endpoint.host);
+      if (os::exists(stream_path)) {
+        variable = environment->add_variables();
+        variable->set_name(STATSD_ENV_NAME_UNIX_STREAM_SOCKET);
+        variable->set_value(stream_path);
+      }
+    } else {
+      variable->set_name(STATSD_ENV_NAME_HOST);
+      variable->set_value(endpoint.host);
 
-    variable = environment->add_variables();
-    variable->set_name(STATSD_ENV_NAME_PORT);
-    variable->set_value(std::to_string(endpoint.port));
+      variable = environment->add_variables();
+      variable->set_name(STATSD_ENV_NAME_PORT);
+      variable->set_value(std::to_string(endpoint.port));
+    }
 
     DLOG(INFO) << "Returning environment: " << environment->ShortDebugString();
   }
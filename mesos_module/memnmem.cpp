@@ -1,33 +1,229 @@
 #include "memnmem.h"
 
+#include <stdint.h>
 #include <string.h>
 
-/**
- * Finds the first 'needle' in 'haystack', with explicit buffer sizes for each (\0 ignored).
- * Returns a pointer to the location of 'needle' within 'haystack', or NULL if no match was found.
- */
-const char* memnmem(const char* haystack, size_t haystack_size,
-    const char* needle, size_t needle_size) {
-  if (haystack_size == 0 || needle_size == 0) {
+#include "simd_util.hpp"
+
+namespace {
+  typedef const char* (*memnmem_func_t)(const char*, size_t, const char*, size_t);
+
+  /**
+   * Searches for the first char of needle, then compares the rest at each match.
+   * Requires haystack_size >= needle_size >= 1.
+   */
+  const char* memnmem_scalar(const char* haystack, size_t haystack_size,
+      const char* needle, size_t needle_size) {
+    size_t search_start = 0;
+    const char* haystack_end = haystack + haystack_size;
+    for (;;) {
+      // Search for the first character in needle
+      const char* candidate =
+        (char*) memchr(haystack + search_start, needle[0], haystack_size - search_start);
+      if (candidate == NULL) {
+        return NULL;
+      }
+      if (candidate + needle_size > haystack_end) {
+        return NULL;
+      }
+      // Check whether the following characters also match
+      if (memcmp(&candidate[1], &needle[1], needle_size - 1) == 0) {
+        return candidate;
+      } else {
+        search_start = candidate - haystack + 1;
+      }
+    }
+  }
+
+  /**
+   * Checks a block's candidates, where each set bit in 'mask' is a position matching both the
+   * first and the last char of needle. The chars between them are compared for any needle longer
+   * than two chars.
+   */
+  inline const char* check_candidates(const char* block, uint32_t mask,
+      const char* needle, size_t needle_size) {
+    while (mask != 0) {
+      const char* candidate = block + __builtin_ctz(mask);
+      if (needle_size == 2 || memcmp(candidate + 1, needle + 1, needle_size - 2) == 0) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
     return NULL;
   }
-  size_t search_start = 0;
-  const char* haystack_end = haystack + haystack_size;
-  for (;;) {
-    // Search for the first character in needle
-    const char* candidate =
-      (char*) memchr(haystack + search_start, needle[0], haystack_size - search_start);
-    if (candidate == NULL) {
-      return NULL;
+
+  // The SIMD versions compare a block of candidate positions against the first char of needle, and
+  // the same block shifted by needle_size - 1 against the last char of needle. Only positions which
+  // match both are checked further, so repeats of a single char of the needle (eg the '|'s before
+  // a "|#") don't cost a compare each. The last block is moved back to end at the last candidate,
+  // overlapping positions which were already checked, rather than finishing with a scalar search.
+  // A block without any first char hands off to memchr() to find the next one, as it's faster than
+  // two compares per block across long runs which can't match (eg a long untagged value).
+  // Requires haystack_size >= needle_size >= 2.
+
+  /**
+   * Returns the start of the next block to search after a block at 'i' of 'block_size' candidates
+   * had no first char of needle, or 'candidates' if there are no more first chars to search from.
+   */
+  inline size_t skip_to_first(const char* haystack, size_t candidates, size_t i, size_t block_size,
+      const char* needle) {
+    const char* next = (const char*) memchr(
+        haystack + i + block_size, needle[0], candidates - i - block_size);
+    return (next == NULL) ? candidates : next - haystack;
+  }
+
+#ifdef SIMD_SSE2_AVAILABLE
+  /**
+   * Searches 16 candidates at a time. Requires candidates >= 16. Inlined into both SIMD versions,
+   * so that the AVX2 version doesn't switch to legacy SSE encoding (which is slow after using the
+   * upper halves of the AVX registers).
+   */
+  __attribute__((target("sse2"), always_inline))
+  inline const char* search_16(const char* haystack, size_t candidates,
+      const char* needle, size_t needle_size) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_size - 1]);
+    for (size_t i = 0;; i += 16) {
+      if (i + 16 > candidates) {
+        if (i == candidates) {
+          return NULL;
+        }
+        i = candidates - 16;
+      }
+      __m128i match_first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(haystack + i)), first);
+      if (_mm_movemask_epi8(match_first) == 0) {
+        // the loop moves on by a block: start it at the next first char
+        i = skip_to_first(haystack, candidates, i, 16, needle) - 16;
+        continue;
+      }
+      __m128i block_last = _mm_loadu_si128((const __m128i*)(haystack + i + needle_size - 1));
+      uint32_t mask =
+        _mm_movemask_epi8(_mm_and_si128(match_first, _mm_cmpeq_epi8(block_last, last)));
+      const char* found = check_candidates(haystack + i, mask, needle, needle_size);
+      if (found != NULL || i + 16 == candidates) {
+        return found;
+      }
+    }
+  }
+
+  __attribute__((target("sse2")))
+  const char* memnmem_sse2(const char* haystack, size_t haystack_size,
+      const char* needle, size_t needle_size) {
+    // Number of positions where the needle could start
+    const size_t candidates = haystack_size - needle_size + 1;
+    if (candidates < 16) {
+      return memnmem_scalar(haystack, haystack_size, needle, needle_size);
+    }
+    return search_16(haystack, candidates, needle, needle_size);
+  }
+#endif
+
+#ifdef SIMD_AVX2_AVAILABLE
+  __attribute__((target("avx2")))
+  const char* memnmem_avx2(const char* haystack, size_t haystack_size,
+      const char* needle, size_t needle_size) {
+    // Number of positions where the needle could start
+    const size_t candidates = haystack_size - needle_size + 1;
+    if (candidates < 16) {
+      return memnmem_scalar(haystack, haystack_size, needle, needle_size);
+    }
+    if (candidates < 32) {
+      return search_16(haystack, candidates, needle, needle_size);
     }
-    if (candidate + needle_size > haystack_end) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_size - 1]);
+    for (size_t i = 0;; i += 32) {
+      if (i + 32 > candidates) {
+        if (i == candidates) {
+          return NULL;
+        }
+        i = candidates - 32;
+      }
+      __m256i match_first =
+        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(haystack + i)), first);
+      if (_mm256_movemask_epi8(match_first) == 0) {
+        // the loop moves on by a block: start it at the next first char
+        i = skip_to_first(haystack, candidates, i, 32, needle) - 32;
+        continue;
+      }
+      __m256i block_last = _mm256_loadu_si256((const __m256i*)(haystack + i + needle_size - 1));
+      uint32_t mask = _mm256_movemask_epi8(
+          _mm256_and_si256(match_first, _mm256_cmpeq_epi8(block_last, last)));
+      const char* found = check_candidates(haystack + i, mask, needle, needle_size);
+      if (found != NULL || i + 32 == candidates) {
+        return found;
+      }
+    }
+  }
+#endif
+
+  memnmem_func_t get_func(memnmem_impl_t impl) {
+    switch (impl) {
+      case MEMNMEM_SCALAR:
+        return memnmem_scalar;
+      case MEMNMEM_SSE2:
+#ifdef SIMD_SSE2_AVAILABLE
+        {
+          static const bool supported = metrics::simd_util::has_sse2();
+          return supported ? memnmem_sse2 : NULL;
+        }
+#else
+        return NULL;
+#endif
+      case MEMNMEM_AVX2:
+#ifdef SIMD_AVX2_AVAILABLE
+        {
+          static const bool supported = metrics::simd_util::has_avx2();
+          return supported ? memnmem_avx2 : NULL;
+        }
+#else
+        return NULL;
+#endif
+    }
+    return NULL;
+  }
+
+  memnmem_func_t get_best_func() {
+    memnmem_func_t func = get_func(MEMNMEM_AVX2);
+    if (func == NULL) {
+      func = get_func(MEMNMEM_SSE2);
+    }
+    if (func == NULL) {
+      func = get_func(MEMNMEM_SCALAR);
+    }
+    return func;
+  }
+
+  inline const char* memnmem_dispatch(memnmem_func_t func, const char* haystack,
+      size_t haystack_size, const char* needle, size_t needle_size) {
+    if (needle_size == 0 || haystack_size < needle_size) {
       return NULL;
     }
-    // Check whether the following characters also match
-    if (memcmp(&candidate[1], &needle[1], needle_size - 1) == 0) {
-      return candidate;
-    } else {
-      search_start = candidate - haystack + 1;
+    if (needle_size == 1) {
+      return (const char*) memchr(haystack, needle[0], haystack_size);
     }
+    return func(haystack, haystack_size, needle, needle_size);
   }
 }
+
+/**
+ * Finds the first 'needle' in 'haystack', with explicit buffer sizes for each (\0 ignored).
+ * Returns a pointer to the location of 'needle' within 'haystack', or NULL if no match was found.
+ */
+const char* memnmem(const char* haystack, size_t haystack_size,
+    const char* needle, size_t needle_size) {
+  // Picked once, on the first call
+  static const memnmem_func_t best_func = get_best_func();
+  return memnmem_dispatch(best_func, haystack, haystack_size, needle, needle_size);
+}
+
+bool memnmem_supported(memnmem_impl_t impl) {
+  return get_func(impl) != NULL;
+}
+
+const char* memnmem_with(memnmem_impl_t impl, const char* haystack, size_t haystack_size,
+    const char* needle, size_t needle_size) {
+  memnmem_func_t func = get_func(impl);
+  return (func == NULL)
+    ? NULL : memnmem_dispatch(func, haystack, haystack_size, needle, needle_size);
+}
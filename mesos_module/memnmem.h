@@ -5,6 +5,29 @@
 /**
  * Finds the first 'needle' in 'haystack', with explicit buffer sizes for each (\0 ignored).
  * Returns a pointer to the location of 'needle' within 'haystack', or NULL if no match was found.
+ *
+ * Uses the fastest implementation supported by the CPU: multi-char needles are searched for 16 or
+ * 32 candidate positions at a time with SSE2 or AVX2 where available.
  */
 extern const char* memnmem(const char* haystack, size_t haystack_size,
     const char* needle, size_t needle_size);
+
+/**
+ * The implementations behind memnmem(), for tests and benchmarks.
+ */
+enum memnmem_impl_t {
+  MEMNMEM_SCALAR,
+  MEMNMEM_SSE2,
+  MEMNMEM_AVX2
+};
+
+/**
+ * Returns whether the provided implementation is supported by the CPU.
+ */
+extern bool memnmem_supported(memnmem_impl_t impl);
+
+/**
+ * Same as memnmem(), using the provided implementation. Returns NULL if it isn't supported.
+ */
+extern const char* memnmem_with(memnmem_impl_t impl, const char* haystack, size_t haystack_size,
+    const char* needle, size_t needle_size);
@@ -1,7 +1,9 @@
 #include "metrics_tcp_sender.hpp"
 
+#include <algorithm>
 #include <glog/logging.h>
 
+#include "output_spool.hpp"
 #include "socket_util.hpp"
 #include "sync_util.hpp"
 
@@ -9,13 +11,16 @@ namespace sp = std::placeholders;
 
 #define MAX_RECONNECT_DELAY 60
 #define CONNECT_TIMEOUT_SECS 60
+#define REPLAY_INTERVAL_MS 100
 
 metrics::MetricsTCPSender::MetricsTCPSender(
     std::shared_ptr<boost::asio::io_service> io_service,
     const std::string& session_header,
     const boost::asio::ip::address& ip,
     size_t port,
-    size_t pending_limit)
+    size_t pending_limit,
+    std::shared_ptr<OutputSpool> spool,
+    size_t spool_replay_bytes_per_sec)
   : session_header(session_header),
     send_ip(ip),
     send_port(port),
@@ -24,14 +29,26 @@ metrics::MetricsTCPSender::MetricsTCPSender(
     connect_deadline_timer(*io_service),
     connect_retry_timer(*io_service),
     report_bytes_timer(*io_service),
+    replay_timer(*io_service),
     socket(*io_service),
     socket_state(NOT_STARTED),
+    write_in_flight(false),
     reconnect_delay(1),
     pending_bytes(0),
     sent_bytes(0),
     dropped_bytes(0),
-    failed_bytes(0) {
-  LOG(INFO) << "MetricsTCPSender constructed for " << send_ip << ":" << send_port;
+    failed_bytes(0),
+    write_count(0),
+    spool(spool),
+    // 100ms worth of replay at a time. A rate of 0 doesn't limit the replay.
+    replay_bucket(spool_replay_bytes_per_sec,
+        spool_replay_bytes_per_sec > 0 ? 1000 : 0,
+        spool_replay_bytes_per_sec / 10),
+    replay_pending(false),
+    spooled_bytes(0),
+    replayed_bytes(0) {
+  LOG(INFO) << "MetricsTCPSender constructed for " << send_ip << ":" << send_port
+            << (spool ? " with spool" : "");
 }
 
 metrics::MetricsTCPSender::~MetricsTCPSender() {
@@ -66,24 +83,141 @@ void metrics::MetricsTCPSender::send(buf_ptr_t buf) {
   }
 
   if (socket_state != CONNECTED_DATA_READY) {
+    if (spool_buf(buf)) {
+      return;
+    }
     DLOG(INFO) << "Drop " << buf->size() << " bytes to " << send_ip << ":" << send_port
                << " (pending " << pending_bytes << ") due to state " << to_string(socket_state);
     dropped_bytes += buf->size();
     return;
   } else if (pending_bytes + buf->size() > pending_limit) {
+    if (spool_buf(buf)) {
+      // Catch up once the queue has drained
+      start_replay_timer(REPLAY_INTERVAL_MS);
+      return;
+    }
     DLOG(INFO) << "Drop " << buf->size() << " bytes to " << send_ip << ":" << send_port
                << " (pending " << pending_bytes << ") due to buffer too large";
     dropped_bytes += buf->size();
     return;
   }
 
+  enqueue(buf);
+}
+
+void metrics::MetricsTCPSender::dispatch_send(buf_ptr_t buf) {
+  io_service->dispatch(std::bind(&MetricsTCPSender::send, this, buf));
+}
+
+void metrics::MetricsTCPSender::enqueue(buf_ptr_t buf) {
   pending_bytes += buf->size();
-  DLOG(INFO) << "Send " << buf->size() << " bytes to " << send_ip << ":" << send_port
+  send_queue.push_back(buf);
+  DLOG(INFO) << "Queue " << buf->size() << " bytes to " << send_ip << ":" << send_port
              << " (now pending " << pending_bytes << ")";
-  // Pass buf into send_cb to ensure that it stays in scope until the send has completed:
-  boost::asio::async_write(
-      socket, *buf,
-      std::bind(&MetricsTCPSender::send_cb, this, sp::_1, sp::_2, buf));
+  start_write();
+}
+
+void metrics::MetricsTCPSender::start_write() {
+  if (write_in_flight || send_queue.empty()) {
+    return;
+  }
+
+  // Gather as much of the queue as fits in one writev. The handler holds the buffers until the
+  // write has completed.
+  std::shared_ptr<std::vector<buf_ptr_t>> batch(new std::vector<buf_ptr_t>);
+  std::vector<boost::asio::const_buffer> buffers;
+  size_t write_bytes = 0;
+  while (!send_queue.empty() && batch->size() < MAX_GATHER_BUFFERS) {
+    const buf_ptr_t& buf = send_queue.front();
+    buffers.push_back(boost::asio::buffer(buf->data(), buf->size()));
+    write_bytes += buf->size();
+    batch->push_back(buf);
+    send_queue.pop_front();
+  }
+
+  write_in_flight = true;
+  ++write_count;
+  boost::asio::async_write(socket, buffers,
+      std::bind(&MetricsTCPSender::write_cb, this, sp::_1, sp::_2, batch, write_bytes));
+}
+
+void metrics::MetricsTCPSender::drop_unsent(
+    const std::vector<buf_ptr_t>& batch, size_t bytes_transferred) {
+  // Only the header is written before the connection is ready. It isn't spooled: each new
+  // connection gets its own.
+  bool spoolable = (socket_state == CONNECTED_DATA_READY);
+  size_t offset = 0;
+  for (const buf_ptr_t& buf : batch) {
+    size_t end = offset + buf->size();
+    if (end > bytes_transferred) {
+      // A partially written buffer is spooled whole, to be resent in the next session
+      if (!spoolable || !spool_buf(buf)) {
+        failed_bytes += end - std::max(offset, bytes_transferred);
+      }
+    }
+    offset = end;
+  }
+
+  for (const buf_ptr_t& buf : send_queue) {
+    pending_bytes -= buf->size();
+    if (!spoolable || !spool_buf(buf)) {
+      failed_bytes += buf->size();
+    }
+  }
+  send_queue.clear();
+}
+
+bool metrics::MetricsTCPSender::spool_buf(const buf_ptr_t& buf) {
+  if (!spool || !spool->append(buf->data(), buf->size())) {
+    return false;
+  }
+  spooled_bytes += buf->size();
+  return true;
+}
+
+void metrics::MetricsTCPSender::start_replay_timer(size_t delay_ms) {
+  if (replay_pending) {
+    return;
+  }
+  replay_pending = true;
+  replay_timer.expires_from_now(boost::posix_time::milliseconds(delay_ms));
+  replay_timer.async_wait(std::bind(&MetricsTCPSender::replay_cb, this));
+}
+
+void metrics::MetricsTCPSender::replay_cb() {
+  if (socket_state == SHUTDOWN) {
+    return;
+  }
+  replay_pending = false;
+  if (socket_state != CONNECTED_DATA_READY || !spool) {
+    // Resumed once the next connection is ready
+    return;
+  }
+
+  TokenBucket::clock_t::time_point now = TokenBucket::clock_t::now();
+  const char* data;
+  size_t size;
+  while (spool->front(data, size)) {
+    // Leave half of the pending limit for new data, so that it doesn't get spooled in turn
+    if (pending_bytes > 0 && pending_bytes + size > pending_limit / 2) {
+      break;
+    }
+    if (!replay_bucket.allow(size, now)) {
+      break;
+    }
+    replay_bucket.take(size);
+    buf_ptr_t buf(new ByteBuffer);
+    buf->append(data, size);
+    spool->pop();
+    replayed_bytes += size;
+    enqueue(buf);
+  }
+
+  if (spool->empty()) {
+    DLOG(INFO) << "Spool replay to " << send_ip << ":" << send_port << " complete";
+  } else {
+    start_replay_timer(REPLAY_INTERVAL_MS);
+  }
 }
 
 void metrics::MetricsTCPSender::set_state_schedule_connect() {
@@ -160,51 +294,51 @@ void metrics::MetricsTCPSender::connect_outcome_cb(boost::system::error_code ec)
   socket_state = CONNECTED_DATA_NOT_READY;
   DLOG(INFO) << "Connected to metrics service at " << send_ip << ":" << send_port << ". "
              << "Inserting " << session_header.size() << " byte header data before first packet";
-  buf_ptr_t hdr_buf(new boost::asio::streambuf);
-  std::ostream ostream(hdr_buf.get());
-  ostream << session_header;
-  // Intentionally omit the header message from enforcement of pending_bytes
-  // (Just to keep things a bit simpler)
-  boost::asio::async_write(
-      socket, *hdr_buf,
-      std::bind(&MetricsTCPSender::send_cb, this, sp::_1, sp::_2, hdr_buf));
+  buf_ptr_t hdr_buf(new ByteBuffer);
+  hdr_buf->append(session_header.data(), session_header.size());
+  // The header is always queued, regardless of pending_limit. Nothing else is accepted until it
+  // has been written.
+  enqueue(hdr_buf);
 }
 
-void metrics::MetricsTCPSender::send_cb(
-    boost::system::error_code ec, size_t bytes_transferred, buf_ptr_t keepalive) {
+void metrics::MetricsTCPSender::write_cb(
+    boost::system::error_code ec, size_t bytes_transferred,
+    std::shared_ptr<std::vector<buf_ptr_t>> keepalive, size_t write_bytes) {
   if (socket_state == SHUTDOWN) {
     return;
   }
 
-  keepalive.reset();
+  write_in_flight = false;
+  pending_bytes -= write_bytes;
+  sent_bytes += bytes_transferred;
   if (ec) {
     LOG(WARNING) << "Got error '" << ec.message() << "'(" << ec << ")"
                  << " when sending data to metrics service at " << send_ip << ":" << send_port
                  << " (state " << to_string(socket_state) << ")";
-    pending_bytes = 0;
-    failed_bytes += bytes_transferred;
+    drop_unsent(*keepalive, bytes_transferred);
     socket.close();
     set_state_schedule_connect();
   } else if (!socket.is_open()) {
     LOG(WARNING) << "Socket not open after sending metrics data to " << send_ip << ":" << send_port
                  << " (state " << to_string(socket_state) << ")";
-    pending_bytes = 0;
-    failed_bytes += bytes_transferred;
+    drop_unsent(*keepalive, bytes_transferred);
     set_state_schedule_connect();
   } else {
     if (socket_state == CONNECTED_DATA_NOT_READY) {
       socket_state = CONNECTED_DATA_READY; // we likely just successfully sent the header
       DLOG(INFO) << "Header sent, socket is now " << to_string(socket_state);
+      if (spool && !spool->empty()) {
+        LOG(INFO) << "Replaying " << spool->record_bytes() << " spooled bytes to "
+                  << send_ip << ":" << send_port;
+        start_replay_timer(0);
+      }
     }
-    if (bytes_transferred > pending_bytes) {
-      pending_bytes = 0; //just in case
-    } else {
-      pending_bytes -= bytes_transferred;
-    }
-    sent_bytes += bytes_transferred;
     DLOG(INFO) << "Sent " << bytes_transferred << " bytes "
                << "(now pending " << pending_bytes << ", state " << to_string(socket_state) << ")";
+    start_write();
   }
+  // Release the buffers back to their writers
+  keepalive.reset();
 }
 
 void metrics::MetricsTCPSender::shutdown_cb() {
@@ -228,6 +362,14 @@ void metrics::MetricsTCPSender::shutdown_cb() {
                << "err='" << ec.message() << "'(" << ec << ")";
   }
 
+  replay_timer.cancel(ec);
+  if (ec) {
+    LOG(ERROR) << "Replay timer cancellation returned error. "
+               << "err='" << ec.message() << "'(" << ec << ")";
+  }
+
+  send_queue.clear();
+
   if (socket.is_open()) {
     socket.close(ec);
     if (ec) {
@@ -253,10 +395,21 @@ void metrics::MetricsTCPSender::report_bytes_cb() {
             << "sent=" << sent_bytes << ", "
             << "dropped=" << dropped_bytes << ", "
             << "failed=" << failed_bytes << ", "
-            << "pending=" << pending_bytes
+            << "pending=" << pending_bytes << " in " << send_queue.size() << " queued buffers, "
+            << "writes=" << write_count
             << " (state " << to_string(socket_state) << ")";
+  if (spool) {
+    LOG(INFO) << "TCP Spool (bytes): "
+              << "spooled=" << spooled_bytes << ", "
+              << "replayed=" << replayed_bytes << ", "
+              << "evicted=" << spool->take_evicted_bytes() << ", "
+              << "held=" << spool->record_bytes();
+    spooled_bytes = 0;
+    replayed_bytes = 0;
+  }
   sent_bytes = 0;
   dropped_bytes = 0;
   failed_bytes = 0;
+  write_count = 0;
   start_report_bytes_timer();
 }
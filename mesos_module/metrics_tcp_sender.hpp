@@ -1,19 +1,35 @@
 #pragma once
 
 #include <boost/asio.hpp>
+#include <deque>
 #include <set>
+#include <vector>
 
+#include "byte_buffer.hpp"
 #include "params.hpp"
+#include "token_bucket.hpp"
 
 namespace metrics {
 
+  class OutputSpool;
+
   /**
    * A MetricsTCPSender is the underlying implementation of getting data to a TCP endpoint. It
    * handles keeping the connection alive, and sending any passed data when feasible.
+   *
+   * Sent buffers are appended to an outgoing queue, and at most one write is in flight at a time.
+   * Each write gathers up to MAX_GATHER_BUFFERS queued buffers into a single writev, so a burst of
+   * small sends costs one syscall rather than one each, and data always goes out in send() order.
+   *
+   * If a spool is provided, data which would otherwise be dropped because the endpoint is down
+   * or the pending limit has been reached is written to the spool instead, along with any queued
+   * data which hadn't been written when the connection was lost. Once the session header has been
+   * sent on a new connection, the spooled data is replayed at up to spool_replay_bytes_per_sec,
+   * behind any new data.
    */
   class MetricsTCPSender {
    public:
-    typedef std::shared_ptr<boost::asio::streambuf> buf_ptr_t;
+    typedef std::shared_ptr<ByteBuffer> buf_ptr_t;
 
     /**
      * Sets a limit on how many bytes may be pending on the outgoing socket at a time.
@@ -22,6 +38,12 @@ namespace metrics {
      */
     static const size_t PENDING_LIMIT = 256 * 1024;
 
+    /**
+     * The most buffers which are gathered into a single write. Matches the number of iovecs which
+     * asio passes to each writev.
+     */
+    static const size_t MAX_GATHER_BUFFERS = 64;
+
     /**
      * Creates a MetricsTCPSender which shares the provided io_service for async operations.
      * Additional arguments are exposed here to allow customization in unit tests.
@@ -32,7 +54,9 @@ namespace metrics {
         const std::string& session_header,
         const boost::asio::ip::address& ip,
         size_t port,
-        size_t pending_limit_for_tests = PENDING_LIMIT);
+        size_t pending_limit = PENDING_LIMIT,
+        std::shared_ptr<OutputSpool> spool = std::shared_ptr<OutputSpool>(),
+        size_t spool_replay_bytes_per_sec = 0);
 
     virtual ~MetricsTCPSender();
 
@@ -42,17 +66,33 @@ namespace metrics {
     void start();
 
     /**
-     * Sends data to the current endpoint, or fails silently if the endpoint isn't available.
+     * Queues data to be sent to the current endpoint, or fails silently if the endpoint isn't
+     * available or the queue is over the pending limit.
+     * The buffer is sent as-is without copying, so the caller must not modify it until the
+     * sender has released it (when it's no longer shared).
      * This call should only be performed from within the IO thread.
      */
     void send(buf_ptr_t buf);
 
+    /**
+     * Schedules send() to run against this sender's IO thread. This may be called from any IO
+     * thread, and runs send() immediately if called from this sender's own IO thread.
+     */
+    void dispatch_send(buf_ptr_t buf);
+
    private:
     void set_state_schedule_connect();
     void start_connect();
     void connect_deadline_cb();
     void connect_outcome_cb(boost::system::error_code ec);
-    void send_cb(boost::system::error_code ec, size_t bytes_transferred, buf_ptr_t keepalive);
+    void enqueue(buf_ptr_t buf);
+    void start_write();
+    void write_cb(boost::system::error_code ec, size_t bytes_transferred,
+        std::shared_ptr<std::vector<buf_ptr_t>> keepalive, size_t write_bytes);
+    void drop_unsent(const std::vector<buf_ptr_t>& batch, size_t bytes_transferred);
+    bool spool_buf(const buf_ptr_t& buf);
+    void start_replay_timer(size_t delay_ms);
+    void replay_cb();
     void shutdown_cb();
     void start_report_bytes_timer();
     void report_bytes_cb();
@@ -66,6 +106,7 @@ namespace metrics {
     boost::asio::deadline_timer connect_deadline_timer;
     boost::asio::deadline_timer connect_retry_timer;
     boost::asio::deadline_timer report_bytes_timer;
+    boost::asio::deadline_timer replay_timer;
     boost::asio::ip::tcp::socket socket;
 
     enum SocketState {
@@ -93,7 +134,18 @@ namespace metrics {
     }
     SocketState socket_state;
 
+    // Buffers waiting for the next write. The buffers in the current write are held by its handler.
+    std::deque<buf_ptr_t> send_queue;
+    bool write_in_flight;
+
     size_t reconnect_delay;
-    size_t pending_bytes, sent_bytes, dropped_bytes, failed_bytes;
+    // Bytes queued or in the current write: exact, not an estimate
+    size_t pending_bytes;
+    size_t sent_bytes, dropped_bytes, failed_bytes, write_count;
+
+    std::shared_ptr<OutputSpool> spool;
+    TokenBucket replay_bucket;
+    bool replay_pending;
+    size_t spooled_bytes, replayed_bytes;
   };
 }
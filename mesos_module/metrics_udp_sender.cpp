@@ -1,24 +1,65 @@
 #include "metrics_udp_sender.hpp"
 
+#include <netinet/udp.h>
+
 #include <glog/logging.h>
 
 #include "socket_util.hpp"
 #include "sync_util.hpp"
 
+namespace {
+  // Matches the kernel's limit on segments in a single UDP GSO send
+  const size_t MAX_QUEUED_DATAGRAMS = 64;
+  // Room for several full size datagrams
+  const size_t QUEUE_BUFFER_BYTES = 4 * 65536;
+  // The largest UDP payload which fits in an IPv4 packet, applied to each GSO send as a whole
+  const size_t GSO_MAX_BYTES = 65507;
+  const size_t GSO_CONTROL_BYTES = CMSG_SPACE(sizeof(uint16_t));
+}
+
+metrics::MetricsUDPSender::Destination::Destination(
+    boost::asio::io_service& io_service, const endpoint_t& endpoint)
+  : endpoint(endpoint),
+    socket(io_service),
+    queue_buffer((char*) malloc(QUEUE_BUFFER_BYTES)),
+    queue_used(0),
+#ifdef UDP_SEGMENT
+    gso_enabled(true) {
+#else
+    gso_enabled(false) {
+#endif
+  queued.reserve(MAX_QUEUED_DATAGRAMS);
+}
+
+metrics::MetricsUDPSender::Destination::~Destination() {
+  free(queue_buffer);
+  queue_buffer = NULL;
+}
+
 metrics::MetricsUDPSender::MetricsUDPSender(
     std::shared_ptr<boost::asio::io_service> io_service,
     const std::string& host,
     size_t port,
-    size_t resolve_period_ms)
+    size_t resolve_period_ms,
+    bool fanout/*=false*/)
   : send_host(host),
     send_port(port),
     resolve_period_ms(resolve_period_ms),
+    fanout(fanout),
     io_service(io_service),
     resolve_timer(*io_service),
-    socket(*io_service),
+    resolve_service(new boost::asio::io_service),
+    resolve_work(new boost::asio::io_service::work(*resolve_service)),
     sent_bytes(0),
-    dropped_bytes(0) {
-  LOG(INFO) << "MetricsUDPSender constructed for " << send_host << ":" << send_port;
+    dropped_bytes(0),
+    partial_bytes(0),
+    batch_msgs(MAX_QUEUED_DATAGRAMS),
+    batch_iovs(MAX_QUEUED_DATAGRAMS),
+    batch_runs(MAX_QUEUED_DATAGRAMS),
+    batch_control(MAX_QUEUED_DATAGRAMS * GSO_CONTROL_BYTES, 0) {
+  resolve_thread = std::thread(std::bind(&MetricsUDPSender::run_resolve_service, this));
+  LOG(INFO) << "MetricsUDPSender constructed for " << send_host << ":" << send_port
+            << (fanout ? " (fanout to all addresses)" : "");
   if (resolve_period_ms == 0) {
     LOG(FATAL) << "Invalid " << params::OUTPUT_STATSD_HOST_REFRESH_SECONDS << " value: must be non-zero";
   }
@@ -34,40 +75,206 @@ void metrics::MetricsUDPSender::start() {
   io_service->dispatch(std::bind(&MetricsUDPSender::dest_resolve_cb, this, boost::system::error_code()));
 }
 
-void metrics::MetricsUDPSender::send(const char* bytes, size_t size) {
+void metrics::MetricsUDPSender::send(size_t destination, const char* bytes, size_t size) {
   if (size == 0) {
     //DLOG(INFO) << "Skipping scheduled send of zero bytes";
     return;
   }
 
-  if (!socket.is_open()) {
+  if (destination >= destinations.size()) {
     // Log dropped data for periodic cumulative reporting in the resolve callback
     dropped_bytes += size;
     return;
   }
 
-  DLOG(INFO) << "Send " << size << " bytes to " << send_host << ":" << send_port;
+  // Anything queued before this data goes out first
+  Destination& dest = *destinations[destination];
+  flush(dest);
+
+  DLOG(INFO) << "Send " << size << " bytes to " << dest.endpoint;
+  send_one(dest, bytes, size);
+}
+
+void metrics::MetricsUDPSender::queue(size_t destination, const char* bytes, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  if (destination >= destinations.size()) {
+    // Log dropped data for periodic cumulative reporting in the resolve callback
+    dropped_bytes += size;
+    return;
+  }
+  if (size > QUEUE_BUFFER_BYTES) {
+    send(destination, bytes, size);
+    return;
+  }
+  Destination& dest = *destinations[destination];
+  if (dest.queued.size() >= MAX_QUEUED_DATAGRAMS || dest.queue_used + size > QUEUE_BUFFER_BYTES) {
+    flush(dest);
+  }
+  memcpy(dest.queue_buffer + dest.queue_used, bytes, size);
+  dest.queued.push_back(QueuedDatagram(dest.queue_used, size));
+  dest.queue_used += size;
+}
+
+void metrics::MetricsUDPSender::flush() {
+  for (destination_ptr_t& destination : destinations) {
+    flush(*destination);
+  }
+}
+
+void metrics::MetricsUDPSender::flush(Destination& destination) {
+  if (destination.queued.empty()) {
+    return;
+  }
+  DLOG(INFO) << "Send " << destination.queued.size() << " datagrams "
+             << "(" << destination.queue_used << " bytes) to " << destination.endpoint;
+  send_batch(destination);
+  destination.queued.clear();
+  destination.queue_used = 0;
+}
+
+void metrics::MetricsUDPSender::send_one(Destination& destination, const char* bytes, size_t size) {
   boost::system::error_code ec;
-  size_t sent = socket.send_to(boost::asio::buffer(bytes, size), current_endpoint, 0 /* flags */, ec);
+  size_t sent = destination.socket.send(boost::asio::buffer(bytes, size), 0 /* flags */, ec);
   if (ec) {
-    LOG(ERROR) << "Failed to send " << size << " bytes of data to ["
-               << send_host << ":" << send_port << "] "
-               << "err='" << ec.message() << "'(" << ec << ")";
+    count_send_error(destination, size, ec.value());
+  } else {
+    count_sent(size, sent);
+  }
+}
+
+void metrics::MetricsUDPSender::send_batch(Destination& destination) {
+  const std::vector<QueuedDatagram>& queued = destination.queued;
+  char* queue_buffer = destination.queue_buffer;
+#ifdef LINUX_SENDMMSG_AVAILABLE
+  // Build one message per datagram, except that with GSO each run of equally sized datagrams
+  // becomes a single message. The kernel splits a GSO message back into datagrams of gso_size
+  // bytes, where only the last may be shorter. Queued datagrams are stored back to back, so each
+  // message is a single contiguous iovec either way.
+  size_t msg_count = 0;
+  for (size_t i = 0; i < queued.size(); ++msg_count) {
+    const size_t segment_size = queued[i].size;
+    size_t run = 1, run_bytes = segment_size;
+    if (destination.gso_enabled) {
+      while (i + run < queued.size() && run_bytes + queued[i + run].size <= GSO_MAX_BYTES) {
+        const size_t next_size = queued[i + run].size;
+        if (next_size > segment_size) {
+          break;
+        }
+        run_bytes += next_size;
+        ++run;
+        if (next_size < segment_size) {
+          break;
+        }
+      }
+    }
+
+    struct iovec& iov = batch_iovs[msg_count];
+    iov.iov_base = queue_buffer + queued[i].offset;
+    iov.iov_len = run_bytes;
+    struct mmsghdr& msg = batch_msgs[msg_count];
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_hdr.msg_iov = &iov;
+    msg.msg_hdr.msg_iovlen = 1;
+#ifdef UDP_SEGMENT
+    if (run > 1) {
+      msg.msg_hdr.msg_control = &batch_control[msg_count * GSO_CONTROL_BYTES];
+      msg.msg_hdr.msg_controllen = GSO_CONTROL_BYTES;
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t gso_size = segment_size;
+      memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+    }
+#endif
+    batch_runs[msg_count] = BatchRun(i, run);
+    i += run;
+  }
+
+  size_t next = 0;
+  while (next < msg_count) {
+    int sent = sendmmsg(destination.socket.native_handle(), &batch_msgs[next], msg_count - next, 0);
+    if (sent < 0) {
+      int err = errno;
+      if (err == EINTR) {
+        continue;
+      }
+      // The first remaining message failed. Skip past it and carry on with the rest.
+      const BatchRun& run = batch_runs[next];
+      if (run.count > 1 && (err == EIO || err == EINVAL)) {
+        // GSO isn't supported by the kernel or the outgoing device: send separately from now on.
+        if (destination.gso_enabled) {
+          LOG(WARNING) << "UDP GSO send to [" << destination.endpoint << "] failed, "
+                       << "falling back to separate datagrams: errno=" << err
+                       << " => " << strerror(err);
+          destination.gso_enabled = false;
+        }
+        for (size_t i = run.first; i < run.first + run.count; ++i) {
+          send_one(destination, queue_buffer + queued[i].offset, queued[i].size);
+        }
+      } else {
+        count_send_error(destination, batch_iovs[next].iov_len, err);
+      }
+      ++next;
+      continue;
+    }
+    if (sent == 0) {
+      // Shouldn't happen with a non-empty batch, but avoid spinning if it does
+      for (; next < msg_count; ++next) {
+        dropped_bytes += batch_iovs[next].iov_len;
+      }
+      break;
+    }
+    for (size_t i = next; i < next + sent; ++i) {
+      count_sent(batch_iovs[i].iov_len, batch_msgs[i].msg_len);
+    }
+    next += sent;
   }
-  if (sent != size) {
-    LOG(WARNING) << "Sent size=" << sent << " doesn't match requested size=" << size;
+#else
+  for (const QueuedDatagram& datagram : queued) {
+    send_one(destination, queue_buffer + datagram.offset, datagram.size);
   }
+#endif
+}
+
+void metrics::MetricsUDPSender::count_sent(size_t requested, size_t sent) {
+  sent_bytes += sent;
+  if (sent != requested) {
+    LOG(WARNING) << "Sent size=" << sent << " doesn't match requested size=" << requested;
+    if (sent < requested) {
+      partial_bytes += requested - sent;
+    }
+  }
+}
+
+void metrics::MetricsUDPSender::count_send_error(
+    const Destination& destination, size_t size, int err) {
+  // With a connected socket, this includes ICMP errors (eg ECONNREFUSED) from earlier sends
+  dropped_bytes += size;
+  LOG(ERROR) << "Failed to send " << size << " bytes of data to ["
+             << send_host << ":" << send_port << "] at endpoint[" << destination.endpoint << "] "
+             << "errno=" << err << " => " << strerror(err);
 }
 
 boost::asio::ip::udp::resolver::iterator metrics::MetricsUDPSender::resolve(
     boost::system::error_code& ec) {
-  boost::asio::ip::udp::resolver resolver(*io_service);
+  boost::asio::ip::udp::resolver resolver(*resolve_service);
   return resolver.resolve(boost::asio::ip::udp::resolver::query(send_host, ""), ec);
 }
 
 void metrics::MetricsUDPSender::shutdown() {
   LOG(INFO) << "Asynchronously triggering MetricsUDPSender shutdown for "
             << send_host << ":" << send_port;
+  // Stop the resolver thread first, so that resolve() isn't called again and no further results
+  // are posted. This waits for any lookup which is already in progress. A result posted before
+  // this point is handled ahead of shutdown_cb() below.
+  if (resolve_thread.joinable()) {
+    resolve_work.reset();
+    resolve_service->stop();
+    resolve_thread.join();
+  }
   // Run the shutdown work itself from within the scheduler:
   if (sync_util::dispatch_run(
           "~MetricsUDPSender", *io_service, std::bind(&MetricsUDPSender::shutdown_cb, this))) {
@@ -77,6 +284,10 @@ void metrics::MetricsUDPSender::shutdown() {
   }
 }
 
+void metrics::MetricsUDPSender::run_resolve_service() {
+  resolve_service->run();
+}
+
 void metrics::MetricsUDPSender::start_dest_resolve_timer() {
   resolve_timer.expires_from_now(boost::posix_time::milliseconds(resolve_period_ms));
   resolve_timer.async_wait(std::bind(&MetricsUDPSender::dest_resolve_cb, this, std::placeholders::_1));
@@ -95,11 +306,33 @@ void metrics::MetricsUDPSender::dest_resolve_cb(boost::system::error_code ec) {
   }
 
   // Also produce throughput stats while we're here.
-  LOG(INFO) << "UDP Throughput (bytes): sent=" << sent_bytes << ", dropped=" << dropped_bytes;
+  LOG(INFO) << "UDP Throughput (bytes): sent=" << sent_bytes << ", dropped=" << dropped_bytes
+            << ", partial=" << partial_bytes;
   sent_bytes = 0;
   dropped_bytes = 0;
+  partial_bytes = 0;
 
+  // Look up the host on the resolver thread. Meanwhile data continues to go to the current
+  // endpoint. The timer is restarted once the result is back, so lookups never pile up.
+  resolve_service->post(std::bind(&MetricsUDPSender::resolve_lookup_cb, this));
+}
+
+void metrics::MetricsUDPSender::resolve_lookup_cb() {
+  // Runs on the resolver thread: only resolve() and io_service may be used here.
+  boost::system::error_code ec;
   udp_resolver_t::iterator iter = resolve(ec);
+  std::vector<boost::asio::ip::address> resolved_addresses;
+  if (!ec) {
+    for (; iter != udp_resolver_t::iterator(); ++iter) {
+      resolved_addresses.push_back(iter->endpoint().address());
+    }
+  }
+  io_service->post(
+      std::bind(&MetricsUDPSender::resolve_result_cb, this, ec, resolved_addresses));
+}
+
+void metrics::MetricsUDPSender::resolve_result_cb(
+    boost::system::error_code ec, const std::vector<boost::asio::ip::address>& resolved_addresses) {
   boost::asio::ip::address selected_address;
   if (ec) {
     // dns lookup failed, fall back to parsing the host string as a literal ip
@@ -107,10 +340,10 @@ void metrics::MetricsUDPSender::dest_resolve_cb(boost::system::error_code ec) {
     selected_address = boost::asio::ip::address::from_string(send_host, ec2);
     if (ec2) {
       // using host as-is also failed, give up and try again later
-      if (socket.is_open()) {
+      if (!destinations.empty()) {
         // Log as error: User used to have a working host!
         LOG(ERROR) << "Error when resolving host[" << send_host << "]. "
-                   << "Sending data to old endpoint[" << current_endpoint << "] "
+                   << "Sending data to old endpoint[" << destinations_string() << "] "
                    << "and trying again in " << resolve_period_ms / 1000. << " seconds. "
                    << "err='" << ec.message() << "'(" << ec << "),"
                    << "err2='" << ec2.message() << "'(" << ec2 << ")";
@@ -127,15 +360,15 @@ void metrics::MetricsUDPSender::dest_resolve_cb(boost::system::error_code ec) {
     }
     // parsing the host as a literal ip succeeded. skip random address selection below since we only
     // have a single entry anyway.
-  } else if (iter == udp_resolver_t::iterator()) {
+  } else if (resolved_addresses.empty()) {
     // dns lookup had no results, fall back to parsing the host string as a literal ip
     selected_address = boost::asio::ip::address::from_string(send_host, ec);
     if (ec) {
       // using host as-is also failed, give up and try again later
-      if (socket.is_open()) {
+      if (!destinations.empty()) {
         // Log as error: User used to have a working host!
         LOG(ERROR) << "No results when resolving host[" << send_host << "]. "
-                   << "Sending data to old endpoint[" << current_endpoint << "] "
+                   << "Sending data to old endpoint[" << destinations_string() << "] "
                    << "and trying again in " << resolve_period_ms / 1000. << " seconds. "
                    << "err='" << ec.message() << "'(" << ec << ")";
       } else {
@@ -155,10 +388,8 @@ void metrics::MetricsUDPSender::dest_resolve_cb(boost::system::error_code ec) {
     // the last refresh. since we are performing our own randomization below, detect and normalize
     // any randomized ordering produced by the dns server, only changing our destination endpoint
     // if the list changes beyond superficial reordering.
-    std::multiset<boost::asio::ip::address> sorted_resolved_addresses;
-    for (; iter != udp_resolver_t::iterator(); ++iter) {
-      sorted_resolved_addresses.insert(iter->endpoint().address());
-    }
+    std::multiset<boost::asio::ip::address> sorted_resolved_addresses(
+        resolved_addresses.begin(), resolved_addresses.end());
     if (sorted_resolved_addresses == last_resolved_addresses) {
       LOG(INFO) << "No change in resolved addresses[size=" << sorted_resolved_addresses.size() << "], "
                 << "leaving socket as-is and checking again in "
@@ -167,6 +398,24 @@ void metrics::MetricsUDPSender::dest_resolve_cb(boost::system::error_code ec) {
       return;
     }
 
+    last_resolved_addresses = sorted_resolved_addresses;
+
+    if (fanout) {
+      // list has changed, send to every distinct address in the new list
+      std::set<boost::asio::ip::address> unique_addresses(
+          sorted_resolved_addresses.begin(), sorted_resolved_addresses.end());
+      std::vector<endpoint_t> endpoints;
+      for (const boost::asio::ip::address& address : unique_addresses) {
+        endpoints.push_back(endpoint_t(address, send_port));
+      }
+      LOG(INFO) << "Resolved dest host[" << send_host << "] "
+                << "-> results[size=" << sorted_resolved_addresses.size() << "] "
+                << "-> fanout[size=" << endpoints.size() << "]";
+      update_destinations(endpoints);
+      start_dest_resolve_timer();
+      return;
+    }
+
     // list has changed, switch to a new random entry (redistribute load across new list)
     size_t rand_index;
     {
@@ -185,54 +434,103 @@ void metrics::MetricsUDPSender::dest_resolve_cb(boost::system::error_code ec) {
     LOG(INFO) << "Resolved dest host[" << send_host << "] "
               << "-> results[size=" << sorted_resolved_addresses.size() << "] "
               << "-> selected[" << selected_address << "]";
-    last_resolved_addresses = sorted_resolved_addresses;
   }
 
-  endpoint_t new_endpoint(selected_address, send_port);
-  if (socket.is_open()) {
-    // Before closing the current socket, check that the endpoint has changed.
-    if (new_endpoint == current_endpoint) {
-      DLOG(INFO) << "No change in selected endpoint[" << current_endpoint << "], "
-                 << "leaving socket as-is and checking again in "
-                 << resolve_period_ms / 1000. << " seconds.";
-      start_dest_resolve_timer();
-      return;
+  update_destinations(std::vector<endpoint_t>{endpoint_t(selected_address, send_port)});
+  start_dest_resolve_timer();
+}
+
+void metrics::MetricsUDPSender::update_destinations(const std::vector<endpoint_t>& endpoints) {
+  std::vector<endpoint_t> current_endpoints;
+  for (const destination_ptr_t& destination : destinations) {
+    current_endpoints.push_back(destination->endpoint);
+  }
+  if (endpoints == current_endpoints) {
+    DLOG(INFO) << "No change in selected endpoint[" << destinations_string() << "], "
+               << "leaving socket as-is and checking again in "
+               << resolve_period_ms / 1000. << " seconds.";
+    return;
+  }
+
+  // Data which was meant for the current destinations goes out before they change
+  if (destinations_change_cb) {
+    destinations_change_cb();
+  }
+  flush();
+
+  // Keep the sockets of destinations which are still present, and open the rest. Any others are
+  // closed when old_destinations goes away.
+  std::vector<destination_ptr_t> old_destinations(destinations);
+  std::string old_destinations_string = destinations_string();
+  std::vector<std::string> members;
+  destinations.clear();
+  for (const endpoint_t& endpoint : endpoints) {
+    destination_ptr_t destination;
+    for (const destination_ptr_t& old_destination : old_destinations) {
+      if (old_destination->endpoint == endpoint) {
+        destination = old_destination;
+        break;
+      }
     }
-    // Socket is moing to a new endpoint. Close socket before reopening.
-    socket.close(ec);
-    if (ec) {
-      LOG(ERROR) << "Failed to close writer socket for move from "
-                 << "old_endpoint[" << current_endpoint << "] to "
-                 << "new_endpoint[" << new_endpoint << "] "
-                 << "err='" << ec.message() << "'(" << ec << ")";
+    if (!destination) {
+      destination = open_destination(endpoint);
+      if (!destination) {
+        // Ensure the next refresh tries again, even if the resolved addresses haven't changed
+        last_resolved_addresses.clear();
+        continue;
+      }
     }
+    destinations.push_back(destination);
+    members.push_back(endpoint.address().to_string());
   }
-  socket.open(new_endpoint.protocol(), ec);
+  ring.set_members(members);
+  LOG(INFO) << "Updated dest endpoint[" << old_destinations_string << "] "
+            << "to endpoint[" << destinations_string() << "]";
+}
+
+metrics::MetricsUDPSender::destination_ptr_t metrics::MetricsUDPSender::open_destination(
+    const endpoint_t& endpoint) {
+  boost::system::error_code ec;
+  destination_ptr_t destination(new Destination(*io_service, endpoint));
+  destination->socket.open(endpoint.protocol(), ec);
   if (ec) {
-    LOG(ERROR) << "Failed to open writer socket to endpoint[" << new_endpoint << "] "
+    LOG(ERROR) << "Failed to open writer socket to endpoint[" << endpoint << "] "
                << "err='" << ec.message() << "'(" << ec << ")";
-  } else {
-    LOG(INFO) << "Updated dest endpoint[" << current_endpoint << "] to endpoint[" << new_endpoint << "]";
-    current_endpoint = new_endpoint;
-    set_cloexec(socket, send_host, send_port);
+    return destination_ptr_t();
   }
-  start_dest_resolve_timer();
+  set_cloexec(destination->socket, send_host, send_port);
+  // Connecting fixes the route for all later sends, and lets us hear about ICMP errors.
+  destination->socket.connect(endpoint, ec);
+  if (ec) {
+    LOG(ERROR) << "Failed to connect writer socket to endpoint[" << endpoint << "] "
+               << "err='" << ec.message() << "'(" << ec << ")";
+    return destination_ptr_t();
+  }
+  return destination;
+}
+
+std::string metrics::MetricsUDPSender::destinations_string() const {
+  std::ostringstream oss;
+  for (size_t i = 0; i < destinations.size(); ++i) {
+    if (i != 0) {
+      oss << ",";
+    }
+    oss << destinations[i]->endpoint;
+  }
+  return oss.str();
 }
 
 void metrics::MetricsUDPSender::shutdown_cb() {
   boost::system::error_code ec;
 
+  flush();
+
   resolve_timer.cancel(ec);
   if (ec) {
     LOG(ERROR) << "Resolve timer cancellation returned error. "
                << "err='" << ec.message() << "'(" << ec << ")";
   }
 
-  if (socket.is_open()) {
-    socket.close(ec);
-    if (ec) {
-      LOG(ERROR) << "Error on writer socket close. "
-                 << "err='" << ec.message() << "'(" << ec << ")";
-    }
-  }
+  // closes the sockets
+  destinations.clear();
 }
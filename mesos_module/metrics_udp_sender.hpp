@@ -1,8 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <boost/asio.hpp>
+#include <functional>
 #include <set>
+#include <thread>
+#include <vector>
 
+#include "hash_ring.hpp"
 #include "params.hpp"
 
 namespace metrics {
@@ -11,6 +16,22 @@ namespace metrics {
    * A MetricsUDPSender is the underlying implementation of getting data to a UDP endpoint. It
    * handles periodically refreshing the destination endpoint for changes, along with passing any
    * data to the endpoint.
+   *
+   * The socket is connect()ed to the selected endpoint, so sends skip the per-datagram route
+   * lookup and ICMP errors from the destination (eg nothing listening) are reported back to us.
+   * Datagrams may be queue()d and then sent together by flush(), using a single sendmmsg() call
+   * where available. Runs of equally sized datagrams are further merged into one UDP GSO send
+   * where the kernel supports it.
+   *
+   * DNS lookups run on a separate resolver thread owned by the sender, so a slow or unresponsive
+   * DNS server never holds up the shared io thread. Data keeps going to the last good endpoint
+   * while a lookup is in progress, or if it fails.
+   *
+   * By default, one of the host's resolved addresses is picked at random and receives all data.
+   * In fanout mode, there's a destination (and socket) for every resolved address instead, and
+   * callers pick a destination for each piece of data with route(). Routing uses a consistent
+   * hash ring keyed by address, so a given series keeps going to the same destination, and only
+   * a small share of series move when an address is added or removed.
    */
   class MetricsUDPSender {
    public:
@@ -23,7 +44,8 @@ namespace metrics {
     MetricsUDPSender(std::shared_ptr<boost::asio::io_service> io_service,
         const std::string& host,
         size_t port,
-        size_t resolve_period_ms);
+        size_t resolve_period_ms,
+        bool fanout = false);
 
     virtual ~MetricsUDPSender();
 
@@ -32,43 +54,159 @@ namespace metrics {
      */
     void start();
 
+    /**
+     * Returns the number of destinations which data may currently be routed to. This is always 1
+     * unless fanout mode is enabled and the host resolved to several addresses.
+     * This call should only be performed from within the IO thread.
+     */
+    size_t destination_count() const {
+      return std::max(destinations.size(), (size_t)1);
+    }
+
+    /**
+     * Returns the destination for data with the provided hash, within [0, destination_count()).
+     * This call should only be performed from within the IO thread.
+     */
+    size_t route(uint64_t hash) const {
+      return ring.find(hash);
+    }
+
+    /**
+     * Sets a function which is called from within the IO thread just before the destinations
+     * change, so that the caller may queue() any data it's holding for the current destinations.
+     * An empty function clears it.
+     */
+    void set_destinations_change_cb(std::function<void()> cb) {
+      destinations_change_cb = cb;
+    }
+
     /**
      * Sends data to the current endpoint, or fails silently if the endpoint isn't available.
      * This call should only be performed from within the IO thread.
      */
-    void send(const char* bytes, size_t size);
+    void send(const char* bytes, size_t size) {
+      send(0, bytes, size);
+    }
+
+    /**
+     * Same as send(), for the provided destination.
+     */
+    void send(size_t destination, const char* bytes, size_t size);
+
+    /**
+     * Copies the data to be sent as its own datagram on the next flush(). If the queue is already
+     * full, it's flushed first. This call should only be performed from within the IO thread.
+     */
+    void queue(const char* bytes, size_t size) {
+      queue(0, bytes, size);
+    }
+
+    /**
+     * Same as queue(), for the provided destination.
+     */
+    void queue(size_t destination, const char* bytes, size_t size);
+
+    /**
+     * Sends any queue()d datagrams to their endpoints, or drops them if an endpoint isn't
+     * available. This call should only be performed from within the IO thread.
+     */
+    void flush();
 
    protected:
     typedef boost::asio::ip::udp::resolver udp_resolver_t;
 
     /**
-     * DNS lookup operation. Broken out for easier mocking in tests.
+     * DNS lookup operation. Broken out for easier mocking in tests. This is only called from the
+     * resolver thread, and may block.
      */
     virtual boost::asio::ip::udp::resolver::iterator resolve(boost::system::error_code& ec);
 
     /**
-     * Cancels running timers. Subclasses should call this in their destructor, to avoid the default
-     * resolve() being called in the timespan between ~<Subclass>() and ~MetricsUDPSender().
+     * Stops the resolver thread and cancels running timers. Subclasses should call this in their
+     * destructor, to avoid the default resolve() being called in the timespan between
+     * ~<Subclass>() and ~MetricsUDPSender(). Waits for any lookup which is in progress.
      */
     void shutdown();
 
    private:
     typedef boost::asio::ip::udp::endpoint endpoint_t;
 
+    struct QueuedDatagram {
+      QueuedDatagram(size_t offset, size_t size)
+        : offset(offset), size(size) { }
+      size_t offset;
+      size_t size;
+    };
+
+    // The queue()d datagrams which make up each message in a sendmmsg() batch
+    struct BatchRun {
+      BatchRun()
+        : first(0), count(0) { }
+      BatchRun(size_t first, size_t count)
+        : first(first), count(count) { }
+      size_t first;
+      size_t count;
+    };
+
+    // A resolved address along with its connected socket and queued data
+    struct Destination {
+      Destination(boost::asio::io_service& io_service, const endpoint_t& endpoint);
+      ~Destination();
+
+      const endpoint_t endpoint;
+      boost::asio::ip::udp::socket socket;
+
+      // Datagrams waiting for flush(), stored back to back in queue_buffer
+      char* queue_buffer;
+      size_t queue_used;
+      std::vector<QueuedDatagram> queued;
+
+      // Cleared if the kernel rejects a GSO send, after which datagrams are always sent separately
+      bool gso_enabled;
+    };
+    typedef std::shared_ptr<Destination> destination_ptr_t;
+
+    void flush(Destination& destination);
+    void send_one(Destination& destination, const char* bytes, size_t size);
+    void send_batch(Destination& destination);
+    void count_sent(size_t requested, size_t sent);
+    void count_send_error(const Destination& destination, size_t size, int err);
+
+    void update_destinations(const std::vector<endpoint_t>& endpoints);
+    destination_ptr_t open_destination(const endpoint_t& endpoint);
+    std::string destinations_string() const;
+
+    void run_resolve_service();
     void start_dest_resolve_timer();
     void dest_resolve_cb(boost::system::error_code ec);
+    void resolve_lookup_cb();
+    void resolve_result_cb(boost::system::error_code ec,
+        const std::vector<boost::asio::ip::address>& resolved_addresses);
 
     void shutdown_cb();
 
     const std::string send_host;
     const size_t send_port;
     const size_t resolve_period_ms;
+    const bool fanout;
 
     std::shared_ptr<boost::asio::io_service> io_service;
     boost::asio::deadline_timer resolve_timer;
-    endpoint_t current_endpoint;
+    std::shared_ptr<boost::asio::io_service> resolve_service;
+    std::unique_ptr<boost::asio::io_service::work> resolve_work;
+    std::thread resolve_thread;
     std::multiset<boost::asio::ip::address> last_resolved_addresses;
-    boost::asio::ip::udp::socket socket;
-    size_t sent_bytes, dropped_bytes;
+    size_t sent_bytes, dropped_bytes, partial_bytes;
+
+    // Empty until the host has been resolved. Holds at most one entry unless fanout is enabled.
+    std::vector<destination_ptr_t> destinations;
+    HashRing ring;
+    std::function<void()> destinations_change_cb;
+
+    // Batched send state, sized once for the maximum number of queued datagrams
+    std::vector<struct mmsghdr> batch_msgs;
+    std::vector<struct iovec> batch_iovs;
+    std::vector<BatchRun> batch_runs;
+    std::vector<char> batch_control;
   };
 }
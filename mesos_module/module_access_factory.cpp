@@ -84,6 +84,19 @@ namespace {
         case metrics::params::port_mode::RANGE:
           strategy.reset(new metrics::PortRangeStrategy(io_runner, merged_parameters));
           break;
+        case metrics::params::port_mode::UNIX:
+          if (!metrics::params::get_bool(merged_parameters,
+                  metrics::params::LISTEN_UNIX_DROP_UDP_ENV,
+                  metrics::params::LISTEN_UNIX_DROP_UDP_ENV_DEFAULT)) {
+            // Containers would only get STATSD_UNIX_SOCKET, which existing clients don't look for
+            LOG(WARNING) << "Ignoring " << metrics::params::LISTEN_PORT_MODE << "=" << port_mode_str
+                         << " without " << metrics::params::LISTEN_UNIX_DROP_UDP_ENV << "=true: "
+                         << "Using " << metrics::params::LISTEN_PORT_MODE_EPHEMERAL << " ports";
+            strategy.reset(new metrics::EphemeralPortStrategy(io_runner));
+            break;
+          }
+          strategy.reset(new metrics::UnixSocketStrategy(io_runner, merged_parameters));
+          break;
         case metrics::params::port_mode::UNKNOWN:
           LOG(FATAL) << "Unknown " << metrics::params::LISTEN_PORT_MODE << " config value: "
                      << port_mode_str;
@@ -0,0 +1,400 @@
+#include "output_spool.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <list>
+#include <sstream>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include <glog/logging.h>
+#include <stout/os.hpp>
+#include <stout/path.hpp>
+
+namespace {
+  const char SEGMENT_MAGIC[] = "MSPOOL01";
+  const size_t SEGMENT_MAGIC_SIZE = sizeof(SEGMENT_MAGIC) - 1;
+  const std::string SEGMENT_PREFIX("segment-");
+  // Set on a record's size once it's been popped, so that it isn't recovered again
+  const uint32_t CONSUMED_FLAG = 0x80000000;
+  // Segments per spool when max_bytes is too small for SEGMENT_BYTES segments, so that evicting
+  // one only drops part of the spool
+  const size_t MIN_SEGMENTS = 4;
+
+  size_t get_header_bytes(const std::string& session_header) {
+    return SEGMENT_MAGIC_SIZE + sizeof(uint32_t) + session_header.size();
+  }
+
+  size_t get_segment_bytes(size_t max_bytes, size_t segment_bytes_for_tests) {
+    if (segment_bytes_for_tests != 0) {
+      return std::min(max_bytes, segment_bytes_for_tests);
+    }
+    return std::min(max_bytes / MIN_SEGMENTS, metrics::OutputSpool::SEGMENT_BYTES);
+  }
+
+  std::string segment_filename(size_t seq) {
+    // zero padded so that the files also sort by name
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%020zu", seq);
+    return SEGMENT_PREFIX + buf;
+  }
+
+  bool parse_segment_filename(const std::string& filename, size_t& seq) {
+    if (filename.size() != SEGMENT_PREFIX.size() + 20
+        || filename.compare(0, SEGMENT_PREFIX.size(), SEGMENT_PREFIX) != 0) {
+      return false;
+    }
+    seq = 0;
+    for (size_t i = SEGMENT_PREFIX.size(); i < filename.size(); ++i) {
+      if (filename[i] < '0' || filename[i] > '9') {
+        return false;
+      }
+      seq = seq * 10 + (filename[i] - '0');
+    }
+    return true;
+  }
+
+  std::string errno_string() {
+    return strerror(errno);
+  }
+}
+
+struct metrics::OutputSpool::Segment {
+  Segment(size_t seq, const std::string& path)
+    : seq(seq),
+      path(path),
+      fd(-1),
+      data(NULL),
+      capacity(0),
+      read_offset(0),
+      write_offset(0),
+      records(0),
+      record_bytes(0),
+      sealed(false) { }
+
+  ~Segment() {
+    if (data != NULL) {
+      munmap(data, capacity);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  /**
+   * Returns whether a record of the provided size fits after the current records.
+   */
+  bool fits(size_t size) const {
+    return !sealed && write_offset + sizeof(uint32_t) + size <= capacity;
+  }
+
+  const size_t seq;
+  const std::string path;
+  int fd;
+  char* data;
+  size_t capacity;
+  size_t read_offset;
+  size_t write_offset;
+  size_t records;
+  size_t record_bytes;
+  // Set if the segment's disk space couldn't be reserved: only read from, never appended to
+  bool sealed;
+};
+
+Try<std::shared_ptr<metrics::OutputSpool>> metrics::OutputSpool::create(
+    const std::string& dir,
+    const std::string& session_header,
+    size_t max_bytes,
+    Eviction eviction,
+    size_t segment_bytes_for_tests/*=0*/) {
+  if (get_segment_bytes(max_bytes, segment_bytes_for_tests)
+      <= get_header_bytes(session_header) + sizeof(uint32_t)) {
+    std::ostringstream oss;
+    oss << "Spool size of " << max_bytes << " bytes is too small to hold any records";
+    return Error(oss.str());
+  }
+  if (!os::exists(dir)) {
+    Try<Nothing> result = os::mkdir(dir);
+    if (result.isError()) {
+      return Error("Unable to create spool dir[" + dir + "]: " + result.error());
+    }
+  }
+  std::shared_ptr<OutputSpool> spool(new OutputSpool(
+          dir, session_header, max_bytes, eviction, segment_bytes_for_tests));
+  spool->recover();
+  return spool;
+}
+
+metrics::OutputSpool::OutputSpool(
+    const std::string& dir,
+    const std::string& session_header,
+    size_t max_bytes,
+    Eviction eviction,
+    size_t segment_bytes_for_tests)
+  : dir(dir),
+    session_header(session_header),
+    segment_bytes(get_segment_bytes(max_bytes, segment_bytes_for_tests)),
+    max_segments(std::max(max_bytes / segment_bytes, (size_t)1)),
+    eviction(eviction),
+    next_seq(0),
+    total_record_bytes(0),
+    evicted_bytes(0) { }
+
+metrics::OutputSpool::~OutputSpool() {
+  if (empty() && !segments.empty()) {
+    // A drained segment which was kept for reuse: nothing to recover
+    delete_front();
+  }
+  if (!segments.empty()) {
+    LOG(INFO) << "Leaving " << total_record_bytes << " bytes in " << segments.size()
+              << " spool segments in dir[" << dir << "]";
+  }
+}
+
+bool metrics::OutputSpool::append(const char* data, size_t size) {
+  if (size == 0) {
+    // would look like the end of the segment
+    return true;
+  }
+  if (get_header_bytes(session_header) + sizeof(uint32_t) + size > segment_bytes) {
+    LOG(WARNING) << "Dropping " << size << " byte record: larger than spool segments";
+    return false;
+  }
+  if (segments.empty() || !segments.back()->fits(size)) {
+    if (segments.size() >= max_segments) {
+      if (eviction == DROP_NEWEST) {
+        return false;
+      }
+      evicted_bytes += segments.front()->record_bytes;
+      delete_front();
+    }
+    Try<segment_ptr_t> segment = open_segment(next_seq);
+    if (segment.isError()) {
+      LOG(ERROR) << segment.error();
+      return false;
+    }
+    ++next_seq;
+    segments.push_back(segment.get());
+  }
+
+  Segment& segment = *segments.back();
+  // Write the size last, so that a partially written record is ignored by recover(). A rewound
+  // segment still has older records past this one, so end the segment after it first.
+  uint32_t size32 = size;
+  size_t next_offset = segment.write_offset + sizeof(uint32_t) + size;
+  if (next_offset + sizeof(uint32_t) <= segment.capacity) {
+    memset(segment.data + next_offset, 0, sizeof(uint32_t));
+  }
+  memcpy(segment.data + segment.write_offset + sizeof(uint32_t), data, size);
+  memcpy(segment.data + segment.write_offset, &size32, sizeof(uint32_t));
+  segment.write_offset = next_offset;
+  ++segment.records;
+  segment.record_bytes += size;
+  total_record_bytes += size;
+  return true;
+}
+
+bool metrics::OutputSpool::front(const char*& data, size_t& size) const {
+  if (empty()) {
+    return false;
+  }
+  const Segment& segment = *segments.front();
+  uint32_t size32;
+  memcpy(&size32, segment.data + segment.read_offset, sizeof(uint32_t));
+  data = segment.data + segment.read_offset + sizeof(uint32_t);
+  size = size32;
+  return true;
+}
+
+void metrics::OutputSpool::pop() {
+  if (empty()) {
+    return;
+  }
+  Segment& segment = *segments.front();
+  uint32_t size32;
+  memcpy(&size32, segment.data + segment.read_offset, sizeof(uint32_t));
+  uint32_t consumed32 = size32 | CONSUMED_FLAG;
+  memcpy(segment.data + segment.read_offset, &consumed32, sizeof(uint32_t));
+  segment.read_offset += sizeof(uint32_t) + size32;
+  --segment.records;
+  segment.record_bytes -= size32;
+  total_record_bytes -= size32;
+  if (segment.records == 0) {
+    if (segments.size() == 1 && !segment.sealed) {
+      // Fully read, but still being appended to: start over rather than replacing the file
+      rewind_front();
+    } else {
+      delete_front();
+    }
+  }
+}
+
+bool metrics::OutputSpool::empty() const {
+  // The last segment is kept when it's drained, so it may have no records
+  return segments.empty() || segments.front()->records == 0;
+}
+
+size_t metrics::OutputSpool::take_evicted_bytes() {
+  size_t ret = evicted_bytes;
+  evicted_bytes = 0;
+  return ret;
+}
+
+void metrics::OutputSpool::recover() {
+  Try<std::list<std::string>> files = os::ls(dir);
+  if (files.isError()) {
+    LOG(ERROR) << "Unable to list content of spool dir[" << dir << "]: " << files.error();
+    return;
+  }
+  std::vector<std::pair<size_t, std::string>> found;
+  for (const std::string& filename : files.get()) {
+    size_t seq;
+    if (parse_segment_filename(filename, seq)) {
+      found.push_back(std::make_pair(seq, path::join(dir, filename)));
+    }
+  }
+  std::sort(found.begin(), found.end());
+
+  for (const std::pair<size_t, std::string>& entry : found) {
+    next_seq = entry.first + 1;
+    Try<segment_ptr_t> segment = recover_segment(entry.first, entry.second);
+    if (segment.isError()) {
+      LOG(WARNING) << "Discarding spool segment[" << entry.second << "]: " << segment.error();
+      unlink(entry.second.c_str());
+      continue;
+    }
+    segments.push_back(segment.get());
+    total_record_bytes += segment.get()->record_bytes;
+  }
+  // The size limit may have been lowered since the segments were written
+  while (segments.size() > max_segments) {
+    evicted_bytes += segments.front()->record_bytes;
+    delete_front();
+  }
+  if (!segments.empty()) {
+    LOG(INFO) << "Recovered " << total_record_bytes << " bytes in " << segments.size()
+              << " spool segments from dir[" << dir << "]";
+  }
+}
+
+Try<metrics::OutputSpool::segment_ptr_t> metrics::OutputSpool::recover_segment(
+    size_t seq, const std::string& path) {
+  segment_ptr_t segment(new Segment(seq, path));
+  segment->fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (segment->fd < 0) {
+    return Error("Unable to open: " + errno_string());
+  }
+  struct stat st;
+  if (fstat(segment->fd, &st) != 0) {
+    return Error("Unable to stat: " + errno_string());
+  }
+  size_t header_bytes = get_header_bytes(session_header);
+  if ((size_t)st.st_size < header_bytes) {
+    return Error("Too small");
+  }
+  segment->capacity = st.st_size;
+  void* data = mmap(NULL, segment->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+  if (data == MAP_FAILED) {
+    return Error("Unable to map: " + errno_string());
+  }
+  segment->data = (char*) data;
+
+  uint32_t header_size;
+  memcpy(&header_size, segment->data + SEGMENT_MAGIC_SIZE, sizeof(uint32_t));
+  if (memcmp(segment->data, SEGMENT_MAGIC, SEGMENT_MAGIC_SIZE) != 0
+      || header_size != session_header.size()
+      || memcmp(segment->data + SEGMENT_MAGIC_SIZE + sizeof(uint32_t),
+          session_header.data(), session_header.size()) != 0) {
+    return Error("Written with a different format or codec");
+  }
+
+  segment->read_offset = header_bytes;
+  segment->write_offset = header_bytes;
+  while (segment->write_offset + sizeof(uint32_t) <= segment->capacity) {
+    uint32_t size32;
+    memcpy(&size32, segment->data + segment->write_offset, sizeof(uint32_t));
+    bool consumed = (size32 & CONSUMED_FLAG) != 0;
+    size32 &= ~CONSUMED_FLAG;
+    if (size32 == 0 || !segment->fits(size32)) {
+      break;
+    }
+    segment->write_offset += sizeof(uint32_t) + size32;
+    if (consumed) {
+      // Records are popped in order: skip past any which were already read
+      if (segment->records == 0) {
+        segment->read_offset = segment->write_offset;
+      }
+      continue;
+    }
+    ++segment->records;
+    segment->record_bytes += size32;
+  }
+  if (segment->records == 0) {
+    return Error("No records");
+  }
+  // The file may be sparse if it was written by an older version. Appending into a hole with no
+  // space left on the disk would fault on the mapping, so only append if its space is reserved.
+  int err = posix_fallocate(segment->fd, 0, segment->capacity);
+  if (err != 0) {
+    LOG(WARNING) << "Unable to reserve space for recovered spool segment[" << path << "], "
+                 << "not appending to it: " << strerror(err);
+    segment->sealed = true;
+  }
+  // A record which was being appended when the process exited has a size of zero, and is
+  // overwritten by the next append.
+  return segment;
+}
+
+Try<metrics::OutputSpool::segment_ptr_t> metrics::OutputSpool::open_segment(size_t seq) {
+  std::string path = path::join(dir, segment_filename(seq));
+  segment_ptr_t segment(new Segment(seq, path));
+  segment->fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (segment->fd < 0) {
+    return Error("Unable to create spool segment[" + path + "]: " + errno_string());
+  }
+  // Reserve the segment's disk space up front. Writing a page of the mapping which has no disk
+  // space behind it raises SIGBUS, so a full disk must be found here rather than in append().
+  int err = posix_fallocate(segment->fd, 0, segment_bytes);
+  if (err != 0) {
+    unlink(path.c_str());
+    return Error("Unable to allocate spool segment[" + path + "]: " + strerror(err));
+  }
+  void* data = mmap(NULL, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+  if (data == MAP_FAILED) {
+    std::string err = errno_string();
+    unlink(path.c_str());
+    return Error("Unable to map spool segment[" + path + "]: " + err);
+  }
+  segment->data = (char*) data;
+  segment->capacity = segment_bytes;
+
+  uint32_t header_size = session_header.size();
+  memcpy(segment->data, SEGMENT_MAGIC, SEGMENT_MAGIC_SIZE);
+  memcpy(segment->data + SEGMENT_MAGIC_SIZE, &header_size, sizeof(uint32_t));
+  memcpy(segment->data + SEGMENT_MAGIC_SIZE + sizeof(uint32_t),
+      session_header.data(), session_header.size());
+  segment->read_offset = get_header_bytes(session_header);
+  segment->write_offset = segment->read_offset;
+  return segment;
+}
+
+void metrics::OutputSpool::rewind_front() {
+  Segment& segment = *segments.front();
+  segment.read_offset = get_header_bytes(session_header);
+  segment.write_offset = segment.read_offset;
+  // Leave no records for recover() to find, as the popped ones are overwritten by later appends
+  memset(segment.data + segment.write_offset, 0, sizeof(uint32_t));
+}
+
+void metrics::OutputSpool::delete_front() {
+  segment_ptr_t segment = segments.front();
+  segments.pop_front();
+  total_record_bytes -= segment->record_bytes;
+  if (unlink(segment->path.c_str()) != 0) {
+    LOG(ERROR) << "Unable to delete spool segment[" << segment->path << "]: " << errno_string();
+  }
+}
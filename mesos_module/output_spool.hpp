@@ -0,0 +1,129 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#include <stout/try.hpp>
+
+namespace metrics {
+
+  /**
+   * An OutputSpool holds collector output while the collector can't accept it, so that it can be
+   * replayed once the collector is back. Records are appended to segment files in a directory.
+   * Each segment is memory-mapped, so an append is a memcpy into the current segment. A segment's
+   * disk space is reserved when it's created, so a full disk fails the append instead of faulting
+   * on the mapping. A segment is deleted once all of its records have been read back, except for
+   * the last one, which is rewound and reused so that a spool that's drained as fast as it's
+   * filled doesn't create and delete a file every few records. The spool is capped at max_bytes
+   * of segments: when it's full, either the oldest segment is evicted to make room, or new
+   * records are rejected.
+   *
+   * Segments left behind by a previous process are recovered when the spool is created, as long
+   * as they were written with the same session header (ie the same codec).
+   *
+   * Segment file format:
+   *   "MSPOOL01" <uint32 header_size> <header>
+   *   <uint32 record_size> <record>
+   *   <uint32 record_size> <record>
+   *   ...
+   *   <uint32 0> or the end of the file
+   * The top bit of a record_size is set once the record has been popped.
+   *
+   * Like the sender which uses it, an instance is only used from within a single thread.
+   */
+  class OutputSpool {
+   public:
+    enum Eviction {
+      // Delete the oldest segment to make room for new records
+      DROP_OLDEST,
+      // Reject new records until there's room for them
+      DROP_NEWEST
+    };
+
+    /**
+     * The size of each segment file, unless max_bytes is too small to hold several of them.
+     */
+    const static size_t SEGMENT_BYTES = 4 * 1024 * 1024;
+
+    /**
+     * Creates the directory if needed, and recovers any segments which it already contains.
+     */
+    static Try<std::shared_ptr<OutputSpool>> create(
+        const std::string& dir,
+        const std::string& session_header,
+        size_t max_bytes,
+        Eviction eviction,
+        size_t segment_bytes_for_tests = 0);
+
+    /**
+     * Unmaps the segments. Their files are left for a later spool to recover.
+     */
+    virtual ~OutputSpool();
+
+    /**
+     * Appends a copy of the record, evicting older records if needed. Returns false if the record
+     * was rejected.
+     */
+    bool append(const char* data, size_t size);
+
+    /**
+     * Points to the oldest record, or returns false if the spool is empty. The record remains
+     * valid until the next call to pop() or append().
+     */
+    bool front(const char*& data, size_t& size) const;
+
+    /**
+     * Removes the oldest record. Deletes its segment if it was the last record in it, or rewinds
+     * the segment if it's also the one being appended to.
+     */
+    void pop();
+
+    /**
+     * Returns whether the spool has no records.
+     */
+    bool empty() const;
+
+    /**
+     * Returns the total size of the records in the spool.
+     */
+    size_t record_bytes() const {
+      return total_record_bytes;
+    }
+
+    /**
+     * Returns the size of the records which were evicted since the last call.
+     */
+    size_t take_evicted_bytes();
+
+   private:
+    struct Segment;
+    typedef std::shared_ptr<Segment> segment_ptr_t;
+
+    OutputSpool(
+        const std::string& dir,
+        const std::string& session_header,
+        size_t max_bytes,
+        Eviction eviction,
+        size_t segment_bytes_for_tests);
+
+    void recover();
+    Try<segment_ptr_t> recover_segment(size_t seq, const std::string& path);
+    Try<segment_ptr_t> open_segment(size_t seq);
+    void rewind_front();
+    void delete_front();
+
+    const std::string dir;
+    const std::string session_header;
+    const size_t segment_bytes;
+    const size_t max_segments;
+    const Eviction eviction;
+
+    // Oldest first. Records are read from the front segment, and appended to the back segment.
+    std::deque<segment_ptr_t> segments;
+    size_t next_seq;
+    size_t total_record_bytes;
+    size_t evicted_bytes;
+  };
+
+}
@@ -3,8 +3,12 @@
 #include <mesos/mesos.pb.h>
 #include <process/future.hpp>
 
+#include "packet_buffer.hpp"
+
 namespace metrics {
 
+  class ContainerTags;
+
   /**
    * An OutputWriter accepts data from one or more ContainerReaders, then tags and forwards it to an
    * external endpoint of some kind.
@@ -18,6 +22,15 @@ namespace metrics {
      */
     virtual void start() = 0;
 
+    /**
+     * Returns whether the writer's destination reads a gauge value with a leading sign as a change
+     * to the gauge rather than as its new value, as statsd does. Writers which parse each value
+     * into a datapoint of their own should return false.
+     */
+    virtual bool relative_signed_gauges() const {
+      return true;
+    }
+
     /**
      * Outputs the provided data associated with the given container information, or NULL
      * container information if none is available.
@@ -25,6 +38,41 @@ namespace metrics {
     virtual void write_container_statsd(
         const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
         const char* data, size_t size) = 0;
+
+    /**
+     * Outputs the provided data associated with a registered container, along with that
+     * container's tags as they were rendered when it was registered. Writers which annotate their
+     * output with container tags may use these rather than rendering tags for every message.
+     */
+    virtual void write_registered_container_statsd(
+        const mesos::ContainerID& container_id, const mesos::ExecutorInfo& executor_info,
+        const ContainerTags& /*container_tags*/, const char* data, size_t size) {
+      write_container_statsd(&container_id, &executor_info, data, size);
+    }
+
+    /**
+     * Outputs a line as a slice of the reader's packet buffer. The slice itself is only valid for
+     * the duration of the call, but a writer which queues or batches lines may keep a copy of it
+     * rather than copying the data. The reader won't receive into the buffer again until every
+     * copy has been destroyed. Writers which consume the data during the call needn't override
+     * this.
+     */
+    virtual void write_container_statsd_slice(
+        const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
+        const PacketSlice& line) {
+      write_container_statsd(container_id, executor_info, line.data(), line.size());
+    }
+
+    /**
+     * Outputs a line from a registered container as a slice of the reader's packet buffer, see
+     * write_container_statsd_slice().
+     */
+    virtual void write_registered_container_statsd_slice(
+        const mesos::ContainerID& container_id, const mesos::ExecutorInfo& executor_info,
+        const ContainerTags& container_tags, const PacketSlice& line) {
+      write_registered_container_statsd(
+          container_id, executor_info, container_tags, line.data(), line.size());
+    }
   };
 
   typedef std::shared_ptr<OutputWriter> output_writer_ptr_t;
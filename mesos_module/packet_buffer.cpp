@@ -0,0 +1,177 @@
+#include "packet_buffer.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+namespace {
+  inline uint64_t free_head_value(uint64_t tag, uint32_t index_plus_one) {
+    return (tag << 32) | index_plus_one;
+  }
+  inline uint64_t free_head_tag(uint64_t head) {
+    return head >> 32;
+  }
+  inline uint32_t free_head_index_plus_one(uint64_t head) {
+    return (uint32_t) head;
+  }
+}
+
+metrics::PacketBuffer::PacketBuffer(size_t capacity, uint32_t index)
+  : data(new char[capacity]),
+    capacity(capacity),
+    index(index),
+    refs(0),
+    next_free(0) { }
+
+metrics::PacketSlice metrics::PacketSlice::wrap(const char* data, size_t size) {
+  return PacketSlice(NULL, false, data, size);
+}
+
+metrics::PacketSlice::PacketSlice()
+  : buffer(NULL), owned(false), data_(NULL), size_(0) { }
+
+metrics::PacketSlice::PacketSlice(
+    PacketBuffer* buffer, bool owned, const char* data, size_t size)
+  : buffer(buffer), owned(owned), data_(data), size_(size) { }
+
+metrics::PacketSlice::PacketSlice(const PacketSlice& other)
+  : buffer(other.buffer), owned(true), data_(other.data_), size_(other.size_) {
+  if (buffer != NULL) {
+    buffer->refs.fetch_add(1, std::memory_order_relaxed);
+  } else if (size_ > 0) {
+    // Wrapped data: it may be gone once the call which wrapped it returns, so keep our own copy
+    buffer = new PacketBuffer(size_, PacketBuffer::UNPOOLED);
+    buffer->refs.store(1, std::memory_order_relaxed);
+    memcpy(buffer->data.get(), other.data_, size_);
+    data_ = buffer->data.get();
+  } else {
+    owned = false;
+  }
+}
+
+metrics::PacketSlice::PacketSlice(PacketSlice&& other)
+  : PacketSlice() {
+  if (other.owned) {
+    swap(other);
+  } else {
+    // Nothing to steal from a borrowed or wrapped slice
+    PacketSlice copy(other);
+    swap(copy);
+  }
+}
+
+metrics::PacketSlice& metrics::PacketSlice::operator=(PacketSlice other) {
+  swap(other);
+  return *this;
+}
+
+metrics::PacketSlice::~PacketSlice() {
+  if (owned && buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    PacketBufferPool::release(buffer);
+  }
+}
+
+metrics::PacketSlice metrics::PacketSlice::borrow(const char* data, size_t size) const {
+  return PacketSlice(buffer, false, data, size);
+}
+
+bool metrics::PacketSlice::unique() const {
+  return buffer != NULL && buffer->refs.load(std::memory_order_acquire) == 1;
+}
+
+void metrics::PacketSlice::swap(PacketSlice& other) {
+  std::swap(buffer, other.buffer);
+  std::swap(owned, other.owned);
+  std::swap(data_, other.data_);
+  std::swap(size_, other.size_);
+}
+
+std::shared_ptr<metrics::PacketBufferPool> metrics::PacketBufferPool::create(
+    size_t buffer_bytes, size_t max_buffers) {
+  // The constructor is private, so make_shared() isn't available
+  return std::shared_ptr<PacketBufferPool>(new PacketBufferPool(buffer_bytes, max_buffers));
+}
+
+metrics::PacketBufferPool::PacketBufferPool(size_t buffer_bytes, size_t max_buffers)
+  : buffer_bytes_(buffer_bytes),
+    // Indexes must leave room for UNPOOLED, and for the +1 in the free list head
+    max_buffers(std::min(max_buffers, (size_t) PacketBuffer::UNPOOLED - 1)),
+    buffers(new PacketBuffer*[this->max_buffers]),
+    allocated_count(0),
+    free_head(0),
+    unpooled_count(0) { }
+
+metrics::PacketBufferPool::~PacketBufferPool() {
+  // Any buffers in use would have kept us alive, so everything that was created is free
+  size_t count = allocated();
+  for (size_t i = 0; i < count; ++i) {
+    delete buffers[i];
+  }
+}
+
+metrics::PacketSlice metrics::PacketBufferPool::acquire() {
+  PacketBuffer* buffer = pop_free();
+  if (buffer == NULL) {
+    size_t index = allocated_count.load(std::memory_order_relaxed);
+    while (index < max_buffers
+        && !allocated_count.compare_exchange_weak(index, index + 1, std::memory_order_relaxed)) { }
+    if (index < max_buffers) {
+      buffer = new PacketBuffer(buffer_bytes_, index);
+      buffers[index] = buffer;
+    } else {
+      // Everything is in use, most likely by a consumer which is holding onto slices
+      buffer = new PacketBuffer(buffer_bytes_, PacketBuffer::UNPOOLED);
+      unpooled_count.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  buffer->refs.store(1, std::memory_order_relaxed);
+  buffer->pool = shared_from_this();
+  return PacketSlice(buffer, true, buffer->data.get(), buffer->capacity);
+}
+
+size_t metrics::PacketBufferPool::allocated() const {
+  return std::min(allocated_count.load(std::memory_order_acquire), max_buffers);
+}
+
+size_t metrics::PacketBufferPool::take_unpooled_count() {
+  return unpooled_count.exchange(0, std::memory_order_relaxed);
+}
+
+void metrics::PacketBufferPool::release(PacketBuffer* buffer) {
+  // Don't hold the pool from within its own free list. This may be the pool's last reference, in
+  // which case the pool (and the buffer) are deleted once we're done here.
+  std::shared_ptr<PacketBufferPool> pool = std::move(buffer->pool);
+  if (!pool || buffer->index == PacketBuffer::UNPOOLED) {
+    delete buffer;
+    return;
+  }
+  pool->push_free(buffer);
+}
+
+void metrics::PacketBufferPool::push_free(PacketBuffer* buffer) {
+  uint64_t head = free_head.load(std::memory_order_relaxed);
+  uint64_t new_head;
+  do {
+    buffer->next_free.store(free_head_index_plus_one(head), std::memory_order_relaxed);
+    new_head = free_head_value(free_head_tag(head) + 1, buffer->index + 1);
+  } while (!free_head.compare_exchange_weak(
+          head, new_head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+metrics::PacketBuffer* metrics::PacketBufferPool::pop_free() {
+  uint64_t head = free_head.load(std::memory_order_acquire);
+  PacketBuffer* buffer;
+  uint64_t new_head;
+  do {
+    uint32_t index_plus_one = free_head_index_plus_one(head);
+    if (index_plus_one == 0) {
+      return NULL;
+    }
+    buffer = buffers[index_plus_one - 1];
+    // If another thread pops this buffer first, this may be stale, but then the tag has changed
+    // and the compare-swap fails
+    new_head = free_head_value(
+        free_head_tag(head) + 1, buffer->next_free.load(std::memory_order_relaxed));
+  } while (!free_head.compare_exchange_weak(
+          head, new_head, std::memory_order_acquire, std::memory_order_acquire));
+  return buffer;
+}
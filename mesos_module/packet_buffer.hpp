@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace metrics {
+
+  class PacketBufferPool;
+
+  /**
+   * A fixed-size slab of received data, along with a count of the PacketSlices which refer to it.
+   * Only handled through PacketBufferPool and PacketSlice.
+   */
+  struct PacketBuffer {
+    // Index value for buffers which are deleted rather than returned to a pool
+    static const uint32_t UNPOOLED = UINT32_MAX;
+
+    PacketBuffer(size_t capacity, uint32_t index);
+
+    const std::unique_ptr<char[]> data;
+    const size_t capacity;
+    // Position within the pool's buffers, or UNPOOLED
+    const uint32_t index;
+    std::atomic<uint32_t> refs;
+    // While in the pool's free list: index + 1 of the next free buffer, or 0 at the end
+    std::atomic<uint32_t> next_free;
+    // Set while the buffer is in use, so that the pool outlives any slices of its buffers
+    std::shared_ptr<PacketBufferPool> pool;
+  };
+
+  /**
+   * A PacketSlice is a range of bytes within a PacketBuffer, holding a reference to the buffer.
+   * The buffer is only reused once every slice of it has been destroyed, so slices may be kept,
+   * queued, or handed to other threads without copying the data.
+   *
+   * A slice may also be "borrowed", or may wrap data which isn't in a PacketBuffer at all. These
+   * are only valid for as long as their source, which is typically the duration of a call.
+   * Copying either kind gives a regular slice: a borrowed slice's copy takes its own reference to
+   * the buffer, while a wrapped slice's copy gets its own (unpooled) buffer holding the data. This
+   * way, a consumer which just reads the data during a call never touches the reference count,
+   * while a consumer which keeps a copy is always safe.
+   */
+  class PacketSlice {
+   public:
+    /**
+     * Returns a slice of data which isn't in a PacketBuffer. The data must remain valid for as long
+     * as the returned slice (or any slices borrowed from it) is used.
+     */
+    static PacketSlice wrap(const char* data, size_t size);
+
+    PacketSlice();
+    PacketSlice(const PacketSlice& other);
+    PacketSlice(PacketSlice&& other);
+    PacketSlice& operator=(PacketSlice other);
+    ~PacketSlice();
+
+    const char* data() const {
+      return data_;
+    }
+    size_t size() const {
+      return size_;
+    }
+    bool empty() const {
+      return size_ == 0;
+    }
+
+    /**
+     * Returns a slice of a range within this slice, without taking a reference to the buffer. The
+     * returned slice is only valid while this slice is. To keep it past that, keep a copy of it:
+     * the returned slice itself stays borrowed, even when assigned to another slice.
+     */
+    PacketSlice borrow(const char* data, size_t size) const;
+
+    /**
+     * Returns whether this is a slice of a PacketBuffer which no other slice refers to. In that
+     * case the buffer may be written to via mutable_data().
+     */
+    bool unique() const;
+
+    char* mutable_data() const {
+      return const_cast<char*>(data_);
+    }
+
+    void swap(PacketSlice& other);
+
+   private:
+    friend class PacketBufferPool;
+
+    PacketSlice(PacketBuffer* buffer, bool owned, const char* data, size_t size);
+
+    PacketBuffer* buffer;
+    // Whether this slice holds one of the buffer's refs, false when borrowed
+    bool owned;
+    const char* data_;
+    size_t size_;
+  };
+
+  /**
+   * A PacketBufferPool hands out PacketBuffers of a fixed size, and takes them back once the last
+   * slice of a buffer has been destroyed. Returned buffers are kept in a lock-free free list, so a
+   * buffer may be released by any thread without blocking the thread receiving into the next one.
+   *
+   * Up to max_buffers are created as needed and then reused. Any buffers acquired past that are
+   * deleted once released, so that a consumer which holds onto slices doesn't grow the pool
+   * without bound.
+   *
+   * Buffers in use keep the pool alive, so the pool may be dropped by its owner at any time.
+   */
+  class PacketBufferPool : public std::enable_shared_from_this<PacketBufferPool> {
+   public:
+    static std::shared_ptr<PacketBufferPool> create(size_t buffer_bytes, size_t max_buffers);
+
+    virtual ~PacketBufferPool();
+
+    /**
+     * Returns a slice covering all of a free buffer, with the only reference to it.
+     */
+    PacketSlice acquire();
+
+    size_t buffer_bytes() const {
+      return buffer_bytes_;
+    }
+
+    /**
+     * Returns the number of pooled buffers created so far, at most max_buffers.
+     */
+    size_t allocated() const;
+
+    /**
+     * Returns the number of unpooled buffers acquired since the last call.
+     */
+    size_t take_unpooled_count();
+
+   private:
+    friend class PacketSlice;
+
+    PacketBufferPool(size_t buffer_bytes, size_t max_buffers);
+
+    /**
+     * Recycles or deletes the provided buffer once its last slice is gone.
+     */
+    static void release(PacketBuffer* buffer);
+
+    void push_free(PacketBuffer* buffer);
+    PacketBuffer* pop_free();
+
+    const size_t buffer_bytes_;
+    const size_t max_buffers;
+    // Buffers created so far, by index. Each entry is written once before its buffer is used.
+    const std::unique_ptr<PacketBuffer*[]> buffers;
+    std::atomic<size_t> allocated_count;
+    // The free list's head: a tag in the upper 32 bits, and the index + 1 of the first free buffer
+    // (or 0 if empty) in the lower 32 bits. The tag changes with every update, so that a head
+    // which was popped and pushed back in the meantime doesn't look unchanged to a compare-swap.
+    std::atomic<uint64_t> free_head;
+    std::atomic<size_t> unpooled_count;
+  };
+}
@@ -45,6 +45,8 @@ metrics::params::port_mode::Value metrics::params::to_port_mode(const std::strin
     return port_mode::EPHEMERAL;
   } else if (param == LISTEN_PORT_MODE_RANGE) {
     return port_mode::RANGE;
+  } else if (param == LISTEN_PORT_MODE_UNIX) {
+    return port_mode::UNIX;
   }
   return port_mode::UNKNOWN;
 }
@@ -11,7 +11,7 @@ namespace metrics {
      */
 
     namespace port_mode {
-      enum Value { UNKNOWN, SINGLE, EPHEMERAL, RANGE };
+      enum Value { UNKNOWN, SINGLE, EPHEMERAL, RANGE, UNIX };
     }
     port_mode::Value to_port_mode(const std::string& param);
 
@@ -34,6 +34,42 @@ namespace metrics {
     const std::string CONTAINER_LIMIT_PERIOD_SECS = "container_limit_period_secs";
     const size_t CONTAINER_LIMIT_PERIOD_SECS_DEFAULT = 60;
 
+    // The number of bytes a container may send at once after being idle. The container's byte
+    // budget refills continuously at container_limit_amount_kbytes per container_limit_period_secs,
+    // up to this amount. 0 uses container_limit_amount_kbytes.
+    const std::string CONTAINER_LIMIT_BURST_KBYTES = "container_limit_burst_kbytes";
+    const size_t CONTAINER_LIMIT_BURST_KBYTES_DEFAULT = 0;
+
+    // The number of datagrams that can be sent from a single container over
+    // container_limit_period_secs, refilled continuously like the byte limit. Limits containers
+    // which send many tiny packets. 0 disables the packet limit.
+    const std::string CONTAINER_LIMIT_AMOUNT_PACKETS = "container_limit_amount_packets";
+    const size_t CONTAINER_LIMIT_AMOUNT_PACKETS_DEFAULT = 0;
+
+    // The number of distinct series (name, type and tags) that can be sent from a single container.
+    // Series beyond the first N are dropped, while the first N keep flowing for as long as they're
+    // sent at least once per limit period. New series are only admitted in place of ones which
+    // stopped being sent. Prevents a single container from flooding upstream with unique names or
+    // tag values. 0 disables the limit.
+    const std::string CONTAINER_LIMIT_SERIES = "container_limit_series";
+    const size_t CONTAINER_LIMIT_SERIES_DEFAULT = 0;
+
+    // Whether series beyond container_limit_series are collapsed into a single untagged
+    // 'dcos.metrics.module.container_series_overflow' series rather than dropped outright.
+    const std::string CONTAINER_LIMIT_SERIES_OVERFLOW = "container_limit_series_overflow";
+    const bool CONTAINER_LIMIT_SERIES_OVERFLOW_DEFAULT = false;
+
+    // The maximum number of datagrams to drain from a container's socket each time it becomes
+    // readable. Values greater than 1 enable batched receives (via recvmmsg() where available),
+    // which reduces per-packet wakeups on busy agents. 1 receives a single datagram per wakeup.
+    const std::string LISTEN_RECV_BATCH_SIZE = "listen_recv_batch_size";
+    const size_t LISTEN_RECV_BATCH_SIZE_DEFAULT = 1;
+
+    // The size of each preallocated receive buffer when batched receives are enabled. Each reader
+    // allocates listen_recv_batch_size buffers of this size. Datagrams larger than this are dropped.
+    const std::string LISTEN_RECV_BATCH_SLOT_BYTES = "listen_recv_batch_slot_bytes";
+    const size_t LISTEN_RECV_BATCH_SLOT_BYTES_DEFAULT = 9216; // jumbo frame MTU, rounded up
+
     // The host to listen on. Should stay with "localhost" except in ip-per-container environments.
     const std::string LISTEN_INTERFACE = "listen_interface";
     const std::string LISTEN_INTERFACE_DEFAULT = "lo";
@@ -47,6 +83,18 @@ namespace metrics {
     const std::string LISTEN_PORT = "listen_port";
     const size_t LISTEN_PORT_DEFAULT = 0;
 
+    // The number of sockets to open against listen_port in single-port mode. Values greater than 1
+    // open that many sockets on the same port with SO_REUSEPORT, each served by a different IO
+    // thread (see io_threads), so that the kernel spreads incoming packets across them.
+    const std::string LISTEN_PORT_REUSE_SOCKETS = "listen_port_reuse_sockets";
+    const size_t LISTEN_PORT_REUSE_SOCKETS_DEFAULT = 1;
+
+    // Whether to pick among the above sockets by source address (via SO_ATTACH_REUSEPORT_CBPF),
+    // rather than the kernel's default flow hash. Keeps each container on a single socket.
+    // Only supported when listening on an IPv4 address: IPv6 sockets keep the default flow hash.
+    const std::string LISTEN_PORT_REUSE_CBPF = "listen_port_reuse_cbpf";
+    const bool LISTEN_PORT_REUSE_CBPF_DEFAULT = false;
+
     // Listens to ports in the OS-defined ephemeral port range which are then dynamically assigned to containers.
     // See /proc/sys/net/ipv4/ip_local_port_range and/or sysctl's net.ipv4.ip_local_port_range.
     const std::string LISTEN_PORT_MODE_EPHEMERAL = "ephemeral";
@@ -59,9 +107,84 @@ namespace metrics {
     const std::string LISTEN_PORT_END = "listen_port_end";
     const size_t LISTEN_PORT_END_DEFAULT = 0;
 
+    // Listens on a unix datagram socket per container, rather than a UDP port. The socket's path is
+    // passed to the container in STATSD_UNIX_SOCKET, instead of STATSD_UDP_HOST/STATSD_UDP_PORT.
+    // Sockets are created in listen_unix_dir. Containers with their own image rootfs only see the
+    // socket if that directory is also mounted into them at the same path, eg via a default
+    // container volume in the agent's --default_container_info.
+    const std::string LISTEN_PORT_MODE_UNIX = "unix";
+    const std::string LISTEN_UNIX_DIR = "listen_unix_dir";
+    // Kept short: socket paths are limited to 107 characters
+    const std::string LISTEN_UNIX_DIR_DEFAULT = "/var/run/mesos/statsd/";
+
+    // Must be enabled along with the unix port mode, acknowledging that containers no longer get
+    // STATSD_UDP_HOST/STATSD_UDP_PORT: clients which only read those stop emitting until they
+    // support STATSD_UNIX_SOCKET. Otherwise the unix mode is ignored in favor of ephemeral ports.
+    const std::string LISTEN_UNIX_DROP_UDP_ENV = "listen_unix_drop_udp_env";
+    const bool LISTEN_UNIX_DROP_UDP_ENV_DEFAULT = false;
+
+    // The maximum number of stream connections to accept per reader, in addition to its datagrams.
+    // Streams carry newline-separated statsd, and aren't subject to datagram size limits or loss:
+    // when a container is over its byte limit, its connections stop being read until it has room.
+    // TCP streams are accepted on the same host and port as UDP. In unix mode, stream connections
+    // are accepted at the STATSD_UNIX_SOCKET path with a '.stream' suffix, which is passed to the
+    // container in STATSD_UNIX_STREAM_SOCKET. 0 disables stream ingest.
+    const std::string LISTEN_STREAM_MAX_CONNECTIONS = "listen_stream_max_connections";
+    const size_t LISTEN_STREAM_MAX_CONNECTIONS_DEFAULT = 0;
+
+    // The size of each stream connection's read buffer. Lines longer than this are dropped.
+    const std::string LISTEN_STREAM_BUFFER_BYTES = "listen_stream_buffer_bytes";
+    const size_t LISTEN_STREAM_BUFFER_BYTES_DEFAULT = 65536;
+
     // Default to ephemeral unless/until ip-per-container becomes common.
     const std::string LISTEN_PORT_MODE_DEFAULT = LISTEN_PORT_MODE_EPHEMERAL;
 
+    // The number of IO threads to run. Each thread runs its own async scheduler with its own set of
+    // output writers, and each container's reader is pinned to one thread by its container id.
+    // Collector output from all threads is merged into a single session on the first thread.
+    const std::string IO_THREADS = "io_threads";
+    const size_t IO_THREADS_DEFAULT = 1;
+
+    // Whether to share each IO thread between its containers' readers with a fair-share
+    // scheduler. Busy readers take turns receiving data, in proportion to their containers' cpus,
+    // rather than each draining its socket as soon as data arrives.
+    const std::string INGEST_SCHEDULER_ENABLED = "ingest_scheduler_enabled";
+    const bool INGEST_SCHEDULER_ENABLED_DEFAULT = false;
+
+    // The amount of data a reader may receive per turn, for each of its container's cpus.
+    const std::string INGEST_QUANTUM_KBYTES = "ingest_quantum_kbytes";
+    const size_t INGEST_QUANTUM_KBYTES_DEFAULT = 64;
+
+    // The maximum rate of data received across all containers on the agent, split evenly across
+    // the IO threads. Data beyond this rate is left in the containers' socket buffers.
+    // 0 disables the limit. Only used when ingest_scheduler_enabled is true.
+    const std::string INGEST_LIMIT_KBYTES_PER_SEC = "ingest_limit_kbytes_per_sec";
+    const size_t INGEST_LIMIT_KBYTES_PER_SEC_DEFAULT = 0;
+
+    /**
+     * StatsD aggregation settings
+     */
+
+    // Whether to aggregate container statsd data before it's passed to the outputs. Each series
+    // (container, name, type and tags) is then sent once per period, rather than once per line.
+    // See statsd_aggregator.hpp for how each statsd type is aggregated.
+    const std::string STATSD_AGGREGATION_ENABLED = "statsd_aggregation_enabled";
+    const bool STATSD_AGGREGATION_ENABLED_DEFAULT = false;
+
+    // The period in seconds over which each series is aggregated.
+    const std::string STATSD_AGGREGATION_PERIOD_SECS = "statsd_aggregation_period_secs";
+    const size_t STATSD_AGGREGATION_PERIOD_SECS_DEFAULT = 10;
+
+    // The number of distinct series to aggregate per IO thread before flushing them early.
+    const std::string STATSD_AGGREGATION_MAX_SERIES = "statsd_aggregation_max_series";
+    const size_t STATSD_AGGREGATION_MAX_SERIES_DEFAULT = 100000;
+
+    // The percentiles to estimate for each aggregated timer ('ms') and histogram ('h'), as a
+    // comma-separated list. Each is sent as '<name>.p<percentile>', eg 'latency.p99' or
+    // 'latency.p99_9'. Empty to only send the count, sum, min, max and average.
+    const std::string STATSD_AGGREGATION_PERCENTILES = "statsd_aggregation_percentiles";
+    const std::string STATSD_AGGREGATION_PERCENTILES_DEFAULT = "50,90,99";
+
     /**
      * Collector output settings
      */
@@ -90,6 +213,34 @@ namespace metrics {
     const std::string OUTPUT_COLLECTOR_CHUNK_TIMEOUT_SECONDS = "output_collector_chunk_timeout_seconds";
     const int OUTPUT_COLLECTOR_CHUNK_TIMEOUT_SECONDS_DEFAULT = 10;
 
+    // The avro codec to compress each block with: "null" or "deflate". Other codecs from the avro
+    // spec aren't offered, as the collector's avro reader can't decode them.
+    const std::string OUTPUT_COLLECTOR_CODEC = "output_collector_codec";
+    const std::string OUTPUT_COLLECTOR_CODEC_DEFAULT = "null";
+
+    // The compression level to use with the codec, or 0 to use the codec's default level.
+    // deflate: 1-9 (default 6).
+    const std::string OUTPUT_COLLECTOR_CODEC_LEVEL = "output_collector_codec_level";
+    const size_t OUTPUT_COLLECTOR_CODEC_LEVEL_DEFAULT = 0;
+
+    // The most collector output to hold on disk while the collector is unavailable or falling
+    // behind, to be sent once it catches up. Stored under 'state_path_dir'. 0 to disable, in which
+    // case that output is dropped.
+    const std::string OUTPUT_COLLECTOR_SPOOL_MAX_BYTES = "output_collector_spool_max_bytes";
+    const size_t OUTPUT_COLLECTOR_SPOOL_MAX_BYTES_DEFAULT = 0;
+
+    // What to do with new output when the spool is full: evict the oldest spooled output, or drop
+    // the new output.
+    const std::string OUTPUT_COLLECTOR_SPOOL_EVICTION = "output_collector_spool_eviction";
+    const std::string OUTPUT_COLLECTOR_SPOOL_EVICTION_DROP_OLDEST = "drop_oldest";
+    const std::string OUTPUT_COLLECTOR_SPOOL_EVICTION_DROP_NEWEST = "drop_newest";
+    const std::string OUTPUT_COLLECTOR_SPOOL_EVICTION_DEFAULT = OUTPUT_COLLECTOR_SPOOL_EVICTION_DROP_OLDEST;
+
+    // The rate at which spooled output is sent once the collector is reachable again, alongside
+    // any new output.
+    const std::string OUTPUT_COLLECTOR_SPOOL_REPLAY_BYTES_PER_SEC = "output_collector_spool_replay_bytes_per_sec";
+    const size_t OUTPUT_COLLECTOR_SPOOL_REPLAY_BYTES_PER_SEC_DEFAULT = 1024 * 1024;
+
     /**
      * StatsD output settings
      */
@@ -107,6 +258,11 @@ namespace metrics {
     const std::string OUTPUT_STATSD_HOST_REFRESH_SECONDS = "output_statsd_host_refresh_seconds";
     const size_t OUTPUT_STATSD_HOST_REFRESH_SECONDS_DEFAULT = 60;
 
+    // Whether to send to all of the host's A records, instead of a random one. Each series is
+    // routed to one of them by consistent hashing, so that it always reaches the same server.
+    const std::string OUTPUT_STATSD_HOST_FANOUT = "output_statsd_host_fanout";
+    const bool OUTPUT_STATSD_HOST_FANOUT_DEFAULT = false;
+
     // The UDP port to send to.
     const std::string OUTPUT_STATSD_PORT = "output_statsd_port";
     const size_t OUTPUT_STATSD_PORT_DEFAULT = 8125;
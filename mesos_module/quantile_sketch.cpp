@@ -0,0 +1,175 @@
+#include "quantile_sketch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <glog/logging.h>
+
+const double metrics::QuantileSketch::DEFAULT_RELATIVE_ACCURACY = 0.01;
+
+metrics::QuantileSketch::QuantileSketch(
+    double relative_accuracy/*=0.01*/, size_t max_bins/*=2048*/)
+  : gamma((1 + relative_accuracy) / (1 - relative_accuracy)),
+    multiplier(1 / std::log(gamma)),
+    // anything smaller is counted as zero: keeps bin indexes well within an int32
+    min_indexable(std::numeric_limits<double>::min() * gamma),
+    max_bins(std::max(max_bins, (size_t)1)),
+    zero_count(0),
+    count_(0),
+    sum_(0),
+    min_(0),
+    max_(0) {
+  if (!(relative_accuracy > 0 && relative_accuracy < 1)) {
+    LOG(FATAL) << "Quantile sketch accuracy must be within (0, 1), got " << relative_accuracy;
+  }
+}
+
+void metrics::QuantileSketch::add(double value, double weight/*=1*/) {
+  if (!std::isfinite(value) || !(weight > 0)) {
+    return;
+  }
+  if (value > min_indexable) {
+    positive.add(index(value), weight, max_bins);
+  } else if (value < -min_indexable) {
+    negative.add(index(-value), weight, max_bins);
+  } else {
+    zero_count += weight;
+  }
+
+  if (count_ == 0) {
+    min_ = value;
+    max_ = value;
+  } else {
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+  count_ += weight;
+  sum_ += value * weight;
+}
+
+void metrics::QuantileSketch::merge(const QuantileSketch& other) {
+  if (other.multiplier != multiplier) {
+    LOG(FATAL) << "Can't merge quantile sketches with different accuracies";
+  }
+  if (other.empty()) {
+    return;
+  }
+  positive.merge(other.positive, max_bins);
+  negative.merge(other.negative, max_bins);
+  zero_count += other.zero_count;
+
+  if (count_ == 0) {
+    min_ = other.min_;
+    max_ = other.max_;
+  } else {
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+double metrics::QuantileSketch::quantile(double q) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  if (q <= 0) {
+    return min_;
+  }
+  if (q >= 1) {
+    return max_;
+  }
+
+  // Walk the bins in order of value: most negative first, then zero, then positive.
+  double rank = q * (count_ - 1);
+  double seen = 0;
+  double ret = max_;
+  bool found = false;
+  for (size_t i = negative.counts.size(); i-- > 0 && !found;) {
+    seen += negative.counts[i];
+    if (seen > rank) {
+      ret = -value(negative.offset + (int32_t)i);
+      found = true;
+    }
+  }
+  if (!found) {
+    seen += zero_count;
+    if (seen > rank) {
+      ret = 0;
+      found = true;
+    }
+  }
+  for (size_t i = 0; i < positive.counts.size() && !found; ++i) {
+    seen += positive.counts[i];
+    if (seen > rank) {
+      ret = value(positive.offset + (int32_t)i);
+      found = true;
+    }
+  }
+  // A bin's value may fall slightly outside of what was actually added
+  return std::max(min_, std::min(max_, ret));
+}
+
+void metrics::QuantileSketch::clear() {
+  positive.counts.clear();
+  negative.counts.clear();
+  zero_count = 0;
+  count_ = 0;
+  sum_ = 0;
+  min_ = 0;
+  max_ = 0;
+}
+
+int32_t metrics::QuantileSketch::index(double abs_value) const {
+  return (int32_t)std::ceil(std::log(abs_value) * multiplier);
+}
+
+double metrics::QuantileSketch::value(int32_t index) const {
+  // The midpoint of the bin (gamma^(index-1), gamma^index], in terms of relative error
+  return 2 * std::exp(index / multiplier) / (gamma + 1);
+}
+
+void metrics::QuantileSketch::Store::add(int32_t index, double weight, size_t max_bins) {
+  if (counts.empty()) {
+    offset = index;
+    counts.push_back(weight);
+    return;
+  }
+
+  int64_t high = (int64_t)offset + counts.size() - 1;
+  if (index < offset) {
+    if (high - index + 1 > (int64_t)max_bins) {
+      // Too wide: count the value in the lowest bin that can be kept instead
+      index = (int32_t)(high - max_bins + 1);
+    }
+    counts.insert(counts.begin(), offset - index, 0.);
+    offset = index;
+  } else if (index > high) {
+    if ((int64_t)index - offset + 1 > (int64_t)max_bins) {
+      // Too wide: merge the lowest bins into the new lowest bin
+      int64_t low = (int64_t)index - max_bins + 1;
+      size_t merged_bins = (size_t)std::min(low - offset, (int64_t)counts.size());
+      double merged = 0;
+      for (size_t i = 0; i < merged_bins; ++i) {
+        merged += counts[i];
+      }
+      counts.erase(counts.begin(), counts.begin() + merged_bins);
+      offset = (int32_t)low;
+      if (counts.empty()) {
+        counts.push_back(0);
+      }
+      counts[0] += merged;
+    }
+    counts.resize(index - offset + 1, 0.);
+  }
+  counts[index - offset] += weight;
+}
+
+void metrics::QuantileSketch::Store::merge(const Store& other, size_t max_bins) {
+  for (size_t i = 0; i < other.counts.size(); ++i) {
+    if (other.counts[i] != 0) {
+      add(other.offset + (int32_t)i, other.counts[i], max_bins);
+    }
+  }
+}
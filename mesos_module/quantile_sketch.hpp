@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace metrics {
+
+  /**
+   * A mergeable summary of a distribution of values, from which quantiles can be estimated to
+   * within a fixed relative error (a DDSketch). Values are counted in logarithmically sized bins,
+   * so memory depends on the range of the values rather than on how many were added.
+   *
+   * If a sign's values would need more than max_bins bins, the bins closest to zero are merged,
+   * trading accuracy for the smallest values in order to keep the largest ones (eg tail latencies)
+   * accurate.
+   */
+  class QuantileSketch {
+   public:
+    const static double DEFAULT_RELATIVE_ACCURACY;
+    const static size_t DEFAULT_MAX_BINS = 2048;
+
+    explicit QuantileSketch(
+        double relative_accuracy = DEFAULT_RELATIVE_ACCURACY, size_t max_bins = DEFAULT_MAX_BINS);
+
+    /**
+     * Adds a value to the sketch, counted 'weight' times (eg 1 / sample rate).
+     */
+    void add(double value, double weight = 1);
+
+    /**
+     * Adds the content of another sketch to this one. Both must have the same relative accuracy.
+     */
+    void merge(const QuantileSketch& other);
+
+    /**
+     * Returns an estimate of the value at the provided quantile, from 0 (the minimum) to 1 (the
+     * maximum), or 0 if the sketch is empty.
+     */
+    double quantile(double q) const;
+
+    double count() const {
+      return count_;
+    }
+    double sum() const {
+      return sum_;
+    }
+    double min() const {
+      return min_;
+    }
+    double max() const {
+      return max_;
+    }
+    bool empty() const {
+      return count_ == 0;
+    }
+
+    /**
+     * Returns the number of bins currently allocated for positive and negative values.
+     */
+    size_t bin_count() const {
+      return positive.counts.size() + negative.counts.size();
+    }
+
+    /**
+     * Empties the sketch, keeping its allocated bins for reuse.
+     */
+    void clear();
+
+   private:
+    /**
+     * A contiguous range of bins, starting at bin index 'offset'.
+     */
+    struct Store {
+      Store()
+        : offset(0) { }
+
+      void add(int32_t index, double weight, size_t max_bins);
+      void merge(const Store& other, size_t max_bins);
+
+      std::vector<double> counts;
+      int32_t offset;
+    };
+
+    int32_t index(double abs_value) const;
+    double value(int32_t index) const;
+
+    double gamma;
+    double multiplier; // 1 / log(gamma)
+    double min_indexable;
+    size_t max_bins;
+
+    Store positive, negative;
+    double zero_count;
+    double count_, sum_, min_, max_;
+  };
+
+}
@@ -0,0 +1,58 @@
+#include "reuse_port_container_reader.hpp"
+
+#include <glog/logging.h>
+
+metrics::ReusePortContainerReader::ReusePortContainerReader(
+    const std::vector<std::shared_ptr<ContainerReader>>& readers)
+  : readers(readers) {
+  if (readers.empty()) {
+    LOG(FATAL) << "ReusePortContainerReader requires at least one reader";
+  }
+}
+
+metrics::ReusePortContainerReader::~ReusePortContainerReader() { }
+
+Try<metrics::UDPEndpoint> metrics::ReusePortContainerReader::open() {
+  Try<UDPEndpoint> first_endpoint = readers[0]->open();
+  if (first_endpoint.isError()) {
+    return first_endpoint;
+  }
+  for (size_t i = 1; i < readers.size(); ++i) {
+    Try<UDPEndpoint> endpoint = readers[i]->open();
+    if (endpoint.isError()) {
+      std::ostringstream oss;
+      oss << "Failed to open shared socket " << i + 1 << " of " << readers.size()
+          << " at port[" << first_endpoint.get().port << "]: " << endpoint.error();
+      return Try<UDPEndpoint>(Error(oss.str()));
+    }
+    if (endpoint.get().port != first_endpoint.get().port) {
+      std::ostringstream oss;
+      oss << "Shared socket " << i + 1 << " of " << readers.size()
+          << " opened at port[" << endpoint.get().port << "], "
+          << "expected port[" << first_endpoint.get().port << "]";
+      return Try<UDPEndpoint>(Error(oss.str()));
+    }
+  }
+  LOG(INFO) << "Opened " << readers.size() << " shared sockets "
+            << "at endpoint[" << first_endpoint.get().string() << "]";
+  return first_endpoint;
+}
+
+Try<metrics::UDPEndpoint> metrics::ReusePortContainerReader::endpoint() const {
+  return readers[0]->endpoint();
+}
+
+void metrics::ReusePortContainerReader::register_container(
+    const mesos::ContainerID& container_id,
+    const mesos::ExecutorInfo& executor_info) {
+  for (std::shared_ptr<ContainerReader> reader : readers) {
+    reader->register_container(container_id, executor_info);
+  }
+}
+
+void metrics::ReusePortContainerReader::unregister_container(
+    const mesos::ContainerID& container_id) {
+  for (std::shared_ptr<ContainerReader> reader : readers) {
+    reader->unregister_container(container_id);
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "container_reader.hpp"
+
+namespace metrics {
+  /**
+   * A ReusePortContainerReader presents several ContainerReaders which all listen on the same port
+   * (via SO_REUSEPORT) as a single ContainerReader. The kernel spreads incoming packets across the
+   * underlying sockets, which may each be served by a different IO thread.
+   *
+   * Container registrations are applied to every underlying reader, since any of them may receive
+   * data from any registered container.
+   */
+  class ReusePortContainerReader : public ContainerReader {
+   public:
+    /**
+     * Creates an instance which wraps the provided readers. The readers must not have been
+     * open()ed yet, and must all be configured against the same non-zero port.
+     */
+    ReusePortContainerReader(const std::vector<std::shared_ptr<ContainerReader>>& readers);
+
+    virtual ~ReusePortContainerReader();
+
+    Try<UDPEndpoint> open();
+
+    Try<UDPEndpoint> endpoint() const;
+
+    void register_container(
+        const mesos::ContainerID& container_id,
+        const mesos::ExecutorInfo& executor_info);
+
+    void unregister_container(const mesos::ContainerID& container_id);
+
+   private:
+    const std::vector<std::shared_ptr<ContainerReader>> readers;
+  };
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+// Functions using these are built with a target attribute and only called after a runtime check
+#define SIMD_SSE2_AVAILABLE
+// Older GCCs only declare the AVX2 intrinsics when the whole file is built with -mavx2
+#if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define SIMD_AVX2_AVAILABLE
+#endif
+#endif
+
+namespace metrics {
+  namespace simd_util {
+    /**
+     * Returns whether the CPU supports SSE2 (always true on x86_64).
+     */
+    inline bool has_sse2() {
+#ifdef SIMD_SSE2_AVAILABLE
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2");
+#else
+      return false;
+#endif
+    }
+
+    /**
+     * Returns whether the CPU supports AVX2.
+     */
+    inline bool has_avx2() {
+#ifdef SIMD_AVX2_AVAILABLE
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+    }
+  }
+}
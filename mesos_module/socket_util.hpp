@@ -1,5 +1,15 @@
 #pragma once
 
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+#include <linux/filter.h>
+#endif
+#ifdef SO_MEMINFO
+#include <linux/sock_diag.h>
+#endif
+
 #include <glog/logging.h>
 
 namespace metrics {
@@ -20,4 +30,95 @@ namespace metrics {
                  << host << ":" << port << ": errno=" << errnum << " => " << strerror(errnum);
     }
   }
+
+  /**
+   * Sets "SO_REUSEPORT" on the provided UDP or TCP socket, allowing several sockets to bind the
+   * same port. Must be called before bind(). Returns false if the option couldn't be set.
+   */
+  template <typename Socket, typename Host>
+  bool set_reuseport(Socket& socket, const Host& host, size_t port) {
+#ifdef SO_REUSEPORT
+    int enable = 1;
+    if (setsockopt(socket.native_handle(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+      int errnum = errno;
+      LOG(ERROR) << "Failed to set SO_REUSEPORT on socket for "
+                 << host << ":" << port << ": errno=" << errnum << " => " << strerror(errnum);
+      return false;
+    }
+    return true;
+#else
+    LOG(ERROR) << "SO_REUSEPORT isn't supported on this system, unable to share "
+               << host << ":" << port;
+    return false;
+#endif
+  }
+
+  /**
+   * Attaches a classic BPF program to the SO_REUSEPORT group of the provided IPv4 UDP socket,
+   * which selects the socket at index (source address % group_size). This keeps each sender on a
+   * single socket, rather than relying on the kernel's default flow hash. Returns false if the
+   * program couldn't be attached, in which case the kernel's default selection remains in effect.
+   */
+  template <typename Socket, typename Host>
+  bool attach_reuseport_cbpf(Socket& socket, size_t group_size, const Host& host, size_t port) {
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    struct sock_filter code[] = {
+      // A = IPv4 source address (relative to the network header)
+      { BPF_LD | BPF_W | BPF_ABS, 0, 0, (__u32)(SKF_NET_OFF + 12) },
+      // A = A % group_size
+      { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (__u32)group_size },
+      // return A: the index of the socket within the group
+      { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+    if (setsockopt(socket.native_handle(),
+            SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+      int errnum = errno;
+      LOG(WARNING) << "Failed to attach SO_REUSEPORT BPF program to socket for "
+                   << host << ":" << port << ": errno=" << errnum << " => " << strerror(errnum);
+      return false;
+    }
+    return true;
+#else
+    (void)group_size;
+    LOG(WARNING) << "SO_ATTACH_REUSEPORT_CBPF isn't supported on this system, "
+                 << "using default socket selection for " << host << ":" << port;
+    return false;
+#endif
+  }
+
+  /**
+   * Returns the amount of kernel memory used by data waiting to be received on the provided
+   * socket, including per-packet overhead. Returns 0 if this isn't supported on this system.
+   */
+  template <typename Socket>
+  size_t get_receive_queue_bytes(Socket& socket) {
+#ifdef SO_MEMINFO
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t len = sizeof(meminfo);
+    if (getsockopt(socket.native_handle(), SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0
+        && len > SK_MEMINFO_RMEM_ALLOC * sizeof(uint32_t)) {
+      return meminfo[SK_MEMINFO_RMEM_ALLOC];
+    }
+#else
+    (void)socket;
+#endif
+    return 0;
+  }
+
+  /**
+   * Removes a unix socket left behind at the provided path, eg by a reader from before an agent
+   * restart. Anything other than a socket is left alone. Returns false if it couldn't be removed.
+   */
+  inline bool remove_stale_socket(const std::string& path) {
+    struct stat path_stat;
+    if (lstat(path.c_str(), &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)
+        && unlink(path.c_str()) != 0) {
+      int errnum = errno;
+      LOG(ERROR) << "Failed to remove stale socket at path[" << path << "]: "
+                 << "errno=" << errnum << " => " << strerror(errnum);
+      return false;
+    }
+    return true;
+  }
 }
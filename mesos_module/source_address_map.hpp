@@ -0,0 +1,200 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+namespace metrics {
+
+  /**
+   * A flat open-addressing hash table which maps a source address (and optionally a source port)
+   * to a value. This is used for attributing incoming datagrams to containers when several
+   * containers share a single listen port, and is looked up once per received datagram, so lookups
+   * involve no allocations or string comparisons.
+   *
+   * Entries registered with port 0 match any source port from that address. Entries registered
+   * with a non-zero port take precedence over port 0 entries for the same address.
+   */
+  template <typename V>
+  class SourceAddressMap {
+   public:
+    SourceAddressMap(size_t initial_capacity = 64)
+      : slots(round_up_pow2(initial_capacity < 8 ? 8 : initial_capacity)),
+        count(0),
+        port_count(0) { }
+
+    /**
+     * Adds or replaces the value for the provided address/port.
+     * Returns true if a new entry was added, or false if an existing entry was replaced.
+     */
+    bool insert(const boost::asio::ip::address& addr, size_t port, const V& value) {
+      // Keep load <= 50% so that probe sequences stay short.
+      if (2 * (count + 1) > slots.size()) {
+        rehash(2 * slots.size());
+      }
+      Key key = to_key(addr, port);
+      size_t i = find_slot(key);
+      if (slots[i].used) {
+        slots[i].value = value;
+        return false;
+      }
+      slots[i].key = key;
+      slots[i].value = value;
+      slots[i].used = true;
+      ++count;
+      if (key.port != 0) {
+        ++port_count;
+      }
+      return true;
+    }
+
+    /**
+     * Removes the entry for the provided address/port.
+     * Returns true if an entry was removed, or false if it wasn't found.
+     */
+    bool erase(const boost::asio::ip::address& addr, size_t port) {
+      Key key = to_key(addr, port);
+      size_t i = find_slot(key);
+      if (!slots[i].used) {
+        return false;
+      }
+      slots[i].used = false;
+      --count;
+      if (key.port != 0) {
+        --port_count;
+      }
+      // Backward-shift deletion: move any following entries in this probe sequence into the
+      // freed slot, so that lookups never need tombstones.
+      const size_t mask = slots.size() - 1;
+      for (size_t j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask) {
+        size_t home = hash(slots[j].key) & mask;
+        // Move j into i if its home slot isn't within the (cyclic) range (i, j]
+        if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+          slots[i] = slots[j];
+          slots[j].used = false;
+          i = j;
+        }
+      }
+      return true;
+    }
+
+    /**
+     * Returns the value for the provided address/port, falling back to the value registered for
+     * the address with port 0. Returns NULL if neither was found.
+     */
+    const V* find(const boost::asio::ip::address& addr, size_t port) const {
+      if (count == 0) {
+        return NULL;
+      }
+      Key key = to_key(addr, port);
+      if (port_count != 0 && key.port != 0) {
+        size_t i = find_slot(key);
+        if (slots[i].used) {
+          return &slots[i].value;
+        }
+      }
+      key.port = 0;
+      size_t i = find_slot(key);
+      return slots[i].used ? &slots[i].value : NULL;
+    }
+
+    size_t size() const {
+      return count;
+    }
+
+    bool empty() const {
+      return count == 0;
+    }
+
+    void clear() {
+      for (Slot& slot : slots) {
+        slot.used = false;
+      }
+      count = 0;
+      port_count = 0;
+    }
+
+   private:
+    struct Key {
+      // IPv4 addresses are stored in their IPv4-mapped IPv6 form.
+      uint64_t hi, lo;
+      uint16_t port;
+
+      bool operator==(const Key& other) const {
+        return lo == other.lo && hi == other.hi && port == other.port;
+      }
+    };
+
+    struct Slot {
+      Slot() : used(false) { }
+      Key key;
+      V value;
+      bool used;
+    };
+
+    static size_t round_up_pow2(size_t val) {
+      size_t ret = 1;
+      while (ret < val) {
+        ret <<= 1;
+      }
+      return ret;
+    }
+
+    static Key to_key(const boost::asio::ip::address& addr, size_t port) {
+      Key key;
+      key.port = (uint16_t)port;
+      if (addr.is_v4()) {
+        key.hi = 0;
+        key.lo = 0x0000ffff00000000ULL | (uint64_t)addr.to_v4().to_ulong();
+      } else {
+        boost::asio::ip::address_v6::bytes_type bytes = addr.to_v6().to_bytes();
+        key.hi = 0;
+        key.lo = 0;
+        for (size_t i = 0; i < 8; ++i) {
+          key.hi = (key.hi << 8) | bytes[i];
+          key.lo = (key.lo << 8) | bytes[i + 8];
+        }
+      }
+      return key;
+    }
+
+    static size_t hash(const Key& key) {
+      // 64-bit finalizer from MurmurHash3
+      uint64_t h = key.hi ^ (key.lo * 0x9e3779b97f4a7c15ULL) ^ key.port;
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      h ^= h >> 33;
+      return (size_t)h;
+    }
+
+    /**
+     * Returns the index of the slot holding the key, or of the empty slot where it would go.
+     */
+    size_t find_slot(const Key& key) const {
+      const size_t mask = slots.size() - 1;
+      size_t i = hash(key) & mask;
+      while (slots[i].used && !(slots[i].key == key)) {
+        i = (i + 1) & mask;
+      }
+      return i;
+    }
+
+    void rehash(size_t capacity) {
+      std::vector<Slot> old_slots(capacity);
+      old_slots.swap(slots);
+      for (const Slot& slot : old_slots) {
+        if (slot.used) {
+          slots[find_slot(slot.key)] = slot;
+        }
+      }
+    }
+
+    std::vector<Slot> slots;
+    size_t count;
+    size_t port_count;
+  };
+}
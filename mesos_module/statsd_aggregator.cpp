@@ -0,0 +1,591 @@
+#include "statsd_aggregator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <inttypes.h>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+
+#include <glog/logging.h>
+
+#include "statsd_tagger.hpp"
+#include "strntod.h"
+#include "sync_util.hpp"
+
+namespace {
+  const size_t MIN_TABLE_SIZE = 1024; // must be a power of two
+
+  /**
+   * splitmix64 finalizer. The series keys are interned pointers, which only differ in a few bits.
+   */
+  inline uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+  }
+
+  /**
+   * Interned strings with the same content share a pointer, except for empty strings which may not.
+   */
+  inline uint64_t str_key(const metrics::InternedString& str) {
+    return str.empty() ? 0 : (uint64_t)(uintptr_t)str.data();
+  }
+  inline bool same_str(const metrics::InternedString& a, const metrics::InternedString& b) {
+    return str_key(a) == str_key(b);
+  }
+
+  bool tag_less(const std::pair<const char*, size_t>& a, const std::pair<const char*, size_t>& b) {
+    int cmp = memcmp(a.first, b.first, std::min(a.second, b.second));
+    return (cmp == 0) ? a.second < b.second : cmp < 0;
+  }
+
+  /**
+   * Writes integers as-is, otherwise the shortest of %.15g or %.17g which parses back to the same
+   * value, so that values aren't rounded on their way through and don't pick up noise digits.
+   */
+  void format_value(double value, bool plus_sign, char* buf, size_t buf_size) {
+    if (value == (double)(int64_t)value && value > -9007199254740992. && value < 9007199254740992.) {
+      // Typical for counters: no need to check the round trip
+      snprintf(buf, buf_size, plus_sign ? "%+" PRId64 : "%" PRId64, (int64_t)value);
+      return;
+    }
+    snprintf(buf, buf_size, plus_sign ? "%+.15g" : "%.15g", value);
+    double parsed;
+    if (!strntod(buf, strlen(buf), &parsed) || parsed != value) {
+      snprintf(buf, buf_size, plus_sign ? "%+.17g" : "%.17g", value);
+    }
+  }
+
+  std::vector<double> parse_percentiles(const std::string& str) {
+    std::vector<double> percentiles;
+    std::istringstream iss(str);
+    std::string token;
+    while (std::getline(iss, token, ',')) {
+      if (token.empty()) {
+        continue;
+      }
+      double percentile;
+      if (!strntod(token.data(), token.size(), &percentile)
+          || !(percentile > 0 && percentile <= 100)) {
+        LOG(FATAL) << "Invalid percentile '" << token << "' in "
+                   << metrics::params::STATSD_AGGREGATION_PERCENTILES << "=" << str
+                   << ": must be within (0, 100]";
+      }
+      percentiles.push_back(percentile);
+    }
+    return percentiles;
+  }
+
+  /**
+   * 95 => ".p95", 99.9 => ".p99_9"
+   */
+  std::string percentile_suffix(double percentile) {
+    std::ostringstream oss;
+    oss << ".p" << percentile;
+    std::string suffix = oss.str();
+    std::replace(suffix.begin() + 1, suffix.end(), '.', '_');
+    return suffix;
+  }
+}
+
+metrics::output_writer_ptr_t metrics::StatsdAggregator::create(
+    std::shared_ptr<boost::asio::io_service> io_service,
+    const mesos::Parameters& parameters,
+    const std::vector<output_writer_ptr_t>& writers) {
+  size_t period_secs = params::get_uint(parameters,
+      params::STATSD_AGGREGATION_PERIOD_SECS, params::STATSD_AGGREGATION_PERIOD_SECS_DEFAULT);
+  if (period_secs == 0) {
+    LOG(FATAL) << params::STATSD_AGGREGATION_PERIOD_SECS << " must be non-zero";
+  }
+  size_t max_series = params::get_uint(parameters,
+      params::STATSD_AGGREGATION_MAX_SERIES, params::STATSD_AGGREGATION_MAX_SERIES_DEFAULT);
+  if (max_series == 0) {
+    LOG(FATAL) << params::STATSD_AGGREGATION_MAX_SERIES << " must be non-zero";
+  }
+  std::vector<double> percentiles = parse_percentiles(params::get_str(parameters,
+          params::STATSD_AGGREGATION_PERCENTILES, params::STATSD_AGGREGATION_PERCENTILES_DEFAULT));
+  return output_writer_ptr_t(
+      new StatsdAggregator(io_service, writers, 1000 * period_secs, max_series, percentiles));
+}
+
+metrics::StatsdAggregator::StatsdAggregator(
+    std::shared_ptr<boost::asio::io_service> io_service,
+    const std::vector<output_writer_ptr_t>& writers,
+    size_t flush_period_ms,
+    size_t max_series,
+    const std::vector<double>& percentiles/*=std::vector<double>()*/)
+  : writers(writers),
+    flush_period_ms(flush_period_ms),
+    max_series(max_series),
+    percentiles(percentiles),
+    io_service(io_service),
+    flush_timer(*io_service),
+    containers(1), // entry 0: no container
+    last_container(0),
+    table(MIN_TABLE_SIZE),
+    // slots start at generation 0: never valid
+    generation(1),
+    sketches_used(0) {
+  for (double percentile : percentiles) {
+    percentile_suffixes.push_back(percentile_suffix(percentile));
+  }
+}
+
+metrics::StatsdAggregator::~StatsdAggregator() {
+  LOG(INFO) << "Asynchronously triggering StatsdAggregator shutdown";
+  // Flush any remaining data to the writers before they're destroyed along with us
+  if (sync_util::dispatch_run(
+          "~StatsdAggregator", *io_service, std::bind(&StatsdAggregator::shutdown_cb, this))) {
+    LOG(INFO) << "StatsdAggregator shutdown succeeded";
+  } else {
+    LOG(ERROR) << "Failed to complete StatsdAggregator shutdown";
+  }
+}
+
+void metrics::StatsdAggregator::start() {
+  LOG(INFO) << "StatsdAggregator starting work, flushing every " << flush_period_ms << "ms";
+  for (output_writer_ptr_t writer : writers) {
+    writer->start();
+  }
+  start_flush_timer();
+}
+
+void metrics::StatsdAggregator::write_container_statsd(
+    const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
+    const char* data, size_t size) {
+  if (!aggregate(container_id, executor_info, NULL, data, size)) {
+    for (output_writer_ptr_t writer : writers) {
+      writer->write_container_statsd(container_id, executor_info, data, size);
+    }
+  }
+}
+
+void metrics::StatsdAggregator::write_registered_container_statsd(
+    const mesos::ContainerID& container_id, const mesos::ExecutorInfo& executor_info,
+    const ContainerTags& container_tags, const char* data, size_t size) {
+  if (!aggregate(&container_id, &executor_info, &container_tags, data, size)) {
+    for (output_writer_ptr_t writer : writers) {
+      writer->write_registered_container_statsd(
+          container_id, executor_info, container_tags, data, size);
+    }
+  }
+}
+
+void metrics::StatsdAggregator::flush() {
+  for (const Series& s : series) {
+    write_series(s);
+  }
+  // Start over. The table's slots are invalidated by the generation bump.
+  series.clear();
+  sketches_used = 0;
+  ++generation;
+  strings.reset();
+  containers.resize(1);
+  container_indexes.clear();
+  last_container = 0;
+}
+
+bool metrics::StatsdAggregator::aggregate(const mesos::ContainerID* container_id,
+    const mesos::ExecutorInfo* executor_info, const ContainerTags* container_tags,
+    const char* data, size_t size) {
+  Sample sample;
+  if (!parse(data, size, sample)) {
+    return false;
+  }
+  if (!add(get_container(container_id, executor_info, container_tags), sample)) {
+    // Too many series: Start a new period. The sample's strings were released by the flush.
+    flush();
+    parse(data, size, sample);
+    add(get_container(container_id, executor_info, container_tags), sample);
+  }
+  return true;
+}
+
+size_t metrics::StatsdAggregator::get_container(const mesos::ContainerID* container_id,
+    const mesos::ExecutorInfo* executor_info, const ContainerTags* container_tags) {
+  if (container_id == NULL || executor_info == NULL) {
+    return 0;
+  }
+  // Consecutive lines are almost always from the same container
+  size_t idx = last_container;
+  if (idx == 0 || containers[idx].container_id.value() != container_id->value()) {
+    auto iter = container_indexes.find(*container_id);
+    if (iter == container_indexes.end()) {
+      idx = containers.size();
+      containers.push_back(Container());
+      containers[idx].container_id = *container_id;
+      containers[idx].executor_info = *executor_info;
+      container_indexes[*container_id] = idx;
+    } else {
+      idx = iter->second;
+    }
+    last_container = idx;
+  }
+  if (container_tags != NULL && !containers[idx].container_tags) {
+    containers[idx].container_tags.reset(new ContainerTags(*container_tags));
+  }
+  return idx;
+}
+
+bool metrics::StatsdAggregator::parse(const char* data, size_t size, Sample& sample) {
+  // Expected input format: name:val|type[|@rate][|#tag1:val1,tag2:val2]
+  const char* end = data + size;
+  const char* type_start = (const char*)memchr(data, '|', size);
+  if (type_start == NULL) {
+    return false;
+  }
+  const char* name_end = (const char*)memchr(data, ':', type_start - data);
+  if (name_end == NULL || name_end == data || name_end + 1 == type_start) {
+    return false;
+  }
+  const char* value_start = name_end + 1;
+  size_t value_len = type_start - value_start;
+
+  ++type_start;
+  const char* type_end = (const char*)memchr(type_start, '|', end - type_start);
+  if (type_end == NULL) {
+    type_end = end;
+  }
+  switch (type_end - type_start) {
+    case 1:
+      switch (*type_start) {
+        case 'c':
+          sample.type = COUNTER;
+          break;
+        case 'g':
+          sample.type = GAUGE;
+          break;
+        case 's':
+          sample.type = SET;
+          break;
+        case 'h':
+          sample.type = HISTOGRAM;
+          break;
+        default:
+          return false;
+      }
+      break;
+    case 2:
+      if (type_start[0] != 'm' || type_start[1] != 's') {
+        return false;
+      }
+      sample.type = TIMER;
+      break;
+    default:
+      return false;
+  }
+
+  // Any following sections: only sample rates and tags are understood
+  sample.rate = 1;
+  const char* tags_start = NULL;
+  size_t tags_len = 0;
+  for (const char* section_start = type_end; section_start < end;) {
+    ++section_start; // skip '|'
+    const char* section_end = (const char*)memchr(section_start, '|', end - section_start);
+    if (section_end == NULL) {
+      section_end = end;
+    }
+    if (section_start == section_end) {
+      return false;
+    }
+    switch (*section_start) {
+      case '@':
+        if (!strntod(section_start + 1, section_end - section_start - 1, &sample.rate)
+            || !(sample.rate > 0 && sample.rate <= 1)) {
+          return false;
+        }
+        break;
+      case '#':
+        if (tags_start != NULL) {
+          return false;
+        }
+        tags_start = section_start + 1;
+        tags_len = section_end - tags_start;
+        break;
+      default:
+        return false;
+    }
+    section_start = section_end;
+  }
+
+  sample.relative = false;
+  sample.value = 0;
+  if (memchr(value_start, ':', value_len) != NULL) {
+    // Several packed values (name:1:2|h): leave these as-is
+    return false;
+  }
+  if (sample.type == SET) {
+    sample.member = strings.intern(value_start, value_len);
+  } else {
+    if (!strntod(value_start, value_len, &sample.value) || !std::isfinite(sample.value)) {
+      return false;
+    }
+    sample.member = InternedString();
+    sample.relative = (sample.type == GAUGE && (*value_start == '+' || *value_start == '-'));
+  }
+  sample.name = strings.intern(data, name_end - data);
+  sample.tags = canonical_tags(tags_start, tags_len);
+  return true;
+}
+
+metrics::InternedString metrics::StatsdAggregator::canonical_tags(const char* data, size_t size) {
+  if (size == 0) {
+    return InternedString();
+  }
+  tag_scratch.clear();
+  const char* end = data + size;
+  bool sorted = true;
+  for (const char* tag_start = data;;) {
+    const char* tag_end = (const char*)memchr(tag_start, ',', end - tag_start);
+    if (tag_end == NULL) {
+      tag_end = end;
+    }
+    std::pair<const char*, size_t> tag(tag_start, tag_end - tag_start);
+    if (!tag_scratch.empty() && tag_less(tag, tag_scratch.back())) {
+      sorted = false;
+    }
+    tag_scratch.push_back(tag);
+    if (tag_end == end) {
+      break;
+    }
+    tag_start = tag_end + 1;
+  }
+  if (sorted) {
+    // Typical case: Emitters use a consistent tag order
+    return strings.intern(data, size);
+  }
+  std::sort(tag_scratch.begin(), tag_scratch.end(), tag_less);
+  str_scratch.clear();
+  for (const std::pair<const char*, size_t>& tag : tag_scratch) {
+    if (!str_scratch.empty()) {
+      str_scratch.push_back(',');
+    }
+    str_scratch.append(tag.first, tag.second);
+  }
+  return strings.intern(str_scratch);
+}
+
+bool metrics::StatsdAggregator::add(size_t container, const Sample& sample) {
+  Series key;
+  key.container = container;
+  key.type = sample.type;
+  key.name = sample.name;
+  key.tags = sample.tags;
+  key.member = sample.member;
+  key.value = 0;
+  key.gauge_absolute = false;
+  key.samples = 0;
+  key.count = 0;
+  key.min = 0;
+  key.max = 0;
+  key.sketch = 0;
+  Series* series_ptr = find_or_add_series(key);
+  if (series_ptr == NULL) {
+    return false;
+  }
+  Series& s = *series_ptr;
+
+  switch (sample.type) {
+    case COUNTER:
+      s.value += sample.value / sample.rate;
+      break;
+    case GAUGE:
+      if (sample.relative) {
+        s.value += sample.value;
+      } else {
+        s.value = sample.value;
+        s.gauge_absolute = true;
+      }
+      break;
+    case SET:
+      // The member is part of the key: nothing else to track
+      break;
+    case TIMER:
+    case HISTOGRAM:
+      if (s.samples == 0) {
+        s.min = sample.value;
+        s.max = sample.value;
+        if (!percentiles.empty()) {
+          if (sketches_used == sketches.size()) {
+            sketches.push_back(QuantileSketch());
+          } else {
+            sketches[sketches_used].clear();
+          }
+          s.sketch = sketches_used++;
+        }
+      } else {
+        s.min = std::min(s.min, sample.value);
+        s.max = std::max(s.max, sample.value);
+      }
+      ++s.samples;
+      s.count += 1 / sample.rate;
+      s.value += sample.value;
+      if (!percentiles.empty()) {
+        sketches[s.sketch].add(sample.value, 1 / sample.rate);
+      }
+      break;
+  }
+  return true;
+}
+
+metrics::StatsdAggregator::Series* metrics::StatsdAggregator::find_or_add_series(
+    const Series& key) {
+  if ((series.size() + 1) * 2 > table.size()) {
+    grow_table();
+  }
+
+  uint64_t hash = mix(((uint64_t)key.container << 3) ^ key.type);
+  hash = mix(hash ^ str_key(key.name));
+  hash = mix(hash ^ str_key(key.tags));
+  hash = mix(hash ^ str_key(key.member));
+
+  size_t mask = table.size() - 1;
+  for (size_t idx = hash & mask;; idx = (idx + 1) & mask) {
+    Slot& slot = table[idx];
+    if (slot.generation != generation) {
+      // empty slot: new series
+      if (series.size() >= max_series) {
+        return NULL;
+      }
+      slot.hash = hash;
+      slot.generation = generation;
+      slot.series = series.size();
+      series.push_back(key);
+      return &series.back();
+    }
+    if (slot.hash == hash) {
+      Series& s = series[slot.series];
+      if (s.container == key.container && s.type == key.type && same_str(s.name, key.name)
+          && same_str(s.tags, key.tags) && same_str(s.member, key.member)) {
+        return &s;
+      }
+    }
+  }
+}
+
+void metrics::StatsdAggregator::grow_table() {
+  std::vector<Slot> old_table(table.size() * 2);
+  old_table.swap(table);
+  size_t mask = table.size() - 1;
+  for (const Slot& old_slot : old_table) {
+    if (old_slot.generation != generation) {
+      continue;
+    }
+    size_t idx = old_slot.hash & mask;
+    while (table[idx].generation == generation) {
+      idx = (idx + 1) & mask;
+    }
+    table[idx] = old_slot;
+  }
+}
+
+void metrics::StatsdAggregator::write_series(const Series& s) {
+  char value[32];
+  switch (s.type) {
+    case COUNTER:
+      format_value(s.value, false, value, sizeof(value));
+      write_series_line(s, "", value, "c");
+      break;
+    case GAUGE:
+      if (s.gauge_absolute && s.value < 0) {
+        // A leading '-' would be read as a delta by statsd, which requires zeroing the gauge
+        // first. Other writers would just see an extra 0 value.
+        write_series_line(s, "", "0", "g", true /* relative_gauge_writers_only */);
+      }
+      // Without an absolute value, the deltas must still be sent as a delta
+      format_value(s.value, !s.gauge_absolute, value, sizeof(value));
+      write_series_line(s, "", value, "g");
+      break;
+    case SET:
+      str_scratch.assign(s.member.data(), s.member.size());
+      write_series_line(s, "", str_scratch.c_str(), "s");
+      break;
+    case TIMER:
+    case HISTOGRAM:
+      format_value(s.count, false, value, sizeof(value));
+      write_series_line(s, ".count", value, "g");
+      format_value(s.value, false, value, sizeof(value));
+      write_series_line(s, ".sum", value, "g");
+      format_value(s.min, false, value, sizeof(value));
+      write_series_line(s, ".min", value, "g");
+      format_value(s.max, false, value, sizeof(value));
+      write_series_line(s, ".max", value, "g");
+      format_value(s.value / s.samples, false, value, sizeof(value));
+      write_series_line(s, ".avg", value, "g");
+      for (size_t i = 0; i < percentiles.size(); ++i) {
+        format_value(sketches[s.sketch].quantile(percentiles[i] / 100), false, value, sizeof(value));
+        write_series_line(s, percentile_suffixes[i].c_str(), value, "g");
+      }
+      break;
+  }
+}
+
+void metrics::StatsdAggregator::write_series_line(const Series& s, const char* suffix,
+    const char* value, const char* type, bool relative_gauge_writers_only/*=false*/) {
+  std::string& line = line_scratch;
+  line.assign(s.name.data(), s.name.size());
+  line.append(suffix);
+  line.push_back(':');
+  line.append(value);
+  line.push_back('|');
+  line.append(type);
+  if (!s.tags.empty()) {
+    line.append("|#");
+    line.append(s.tags.data(), s.tags.size());
+  }
+  write_line(s.container, line.data(), line.size(), relative_gauge_writers_only);
+}
+
+void metrics::StatsdAggregator::write_line(size_t container, const char* data, size_t size,
+    bool relative_gauge_writers_only/*=false*/) {
+  const Container& c = containers[container];
+  for (output_writer_ptr_t writer : writers) {
+    if (relative_gauge_writers_only && !writer->relative_signed_gauges()) {
+      continue;
+    }
+    if (container == 0) {
+      writer->write_container_statsd(NULL, NULL, data, size);
+    } else if (c.container_tags) {
+      writer->write_registered_container_statsd(
+          c.container_id, c.executor_info, *c.container_tags, data, size);
+    } else {
+      writer->write_container_statsd(&c.container_id, &c.executor_info, data, size);
+    }
+  }
+}
+
+void metrics::StatsdAggregator::start_flush_timer() {
+  flush_timer.expires_from_now(boost::posix_time::milliseconds(flush_period_ms));
+  flush_timer.async_wait(std::bind(&StatsdAggregator::flush_cb, this, std::placeholders::_1));
+}
+
+void metrics::StatsdAggregator::flush_cb(boost::system::error_code ec) {
+  if (ec) {
+    if (ec == boost::asio::error::operation_aborted) {
+      // We're being destroyed. Don't look at local state, it may be destroyed already.
+      LOG(INFO) << "Aggregation flush timer cancelled due to teardown: Exiting timer loop immediately";
+      return;
+    } else {
+      LOG(ERROR) << "Aggregation flush timer returned error. "
+                 << "err='" << ec.message() << "'(" << ec << ")";
+    }
+  }
+
+  flush();
+  start_flush_timer();
+}
+
+void metrics::StatsdAggregator::shutdown_cb() {
+  flush();
+
+  boost::system::error_code ec;
+  flush_timer.cancel(ec);
+  if (ec) {
+    LOG(ERROR) << "Aggregation flush timer cancellation returned error. "
+               << "err='" << ec.message() << "'(" << ec << ")";
+  }
+}
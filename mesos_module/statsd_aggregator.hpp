@@ -0,0 +1,176 @@
+#pragma once
+
+#include <boost/asio.hpp>
+
+#include "mesos_hash.hpp"
+#include "output_writer.hpp"
+#include "params.hpp"
+#include "quantile_sketch.hpp"
+#include "string_interner.hpp"
+
+namespace metrics {
+
+  class ContainerTags;
+
+  /**
+   * A StatsdAggregator sits between the ContainerReaders and the real OutputWriters, and folds the
+   * statsd data for each series into a single value per flush period:
+   * - Counters ('c') are summed, after scaling each value by its sample rate.
+   * - Gauges ('g') keep their last value. Relative updates ("+N"/"-N") are applied to that value,
+   *   or are summed and sent as a single relative update if no absolute value was received.
+   * - Sets ('s') keep one copy of each distinct member.
+   * - Timers ('ms') and histograms ('h') are summarized into '<name>.count', '.sum', '.min', '.max'
+   *   and '.avg' gauges, along with a '.pNN' gauge for each configured percentile. Percentiles
+   *   are estimated from a QuantileSketch of the series' values.
+   * A series is identified by its container, metric name, type, and custom datadog tags, where the
+   * tags may be given in any order. Anything else, such as unknown types, extra sections, or
+   * malformed lines, is passed through to the writers unchanged.
+   *
+   * Like the writers it wraps, an instance is only used from within its io_service's thread.
+   */
+  class StatsdAggregator : public OutputWriter {
+   public:
+    /**
+     * Returns a StatsdAggregator which wraps the provided writers, configured by the provided
+     * parameters.
+     */
+    static output_writer_ptr_t create(
+        std::shared_ptr<boost::asio::io_service> io_service,
+        const mesos::Parameters& parameters,
+        const std::vector<output_writer_ptr_t>& writers);
+
+    /**
+     * Use create(). This is meant for access by tests.
+     * Data is flushed every flush_period_ms, or early if it would exceed max_series distinct
+     * series. Percentiles are from 0 to 100.
+     */
+    StatsdAggregator(
+        std::shared_ptr<boost::asio::io_service> io_service,
+        const std::vector<output_writer_ptr_t>& writers,
+        size_t flush_period_ms,
+        size_t max_series,
+        const std::vector<double>& percentiles = std::vector<double>());
+
+    virtual ~StatsdAggregator();
+
+    /**
+     * Starts the wrapped writers, and the internal timer for flushing aggregated data.
+     */
+    void start();
+
+    void write_container_statsd(
+        const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
+        const char* data, size_t size);
+
+    void write_registered_container_statsd(
+        const mesos::ContainerID& container_id, const mesos::ExecutorInfo& executor_info,
+        const ContainerTags& container_tags, const char* data, size_t size);
+
+    /**
+     * Sends one statsd line (or for timers, a line per summary value) for each series to the
+     * wrapped writers, then starts a new period.
+     */
+    void flush();
+
+    /**
+     * Returns the number of series accumulated since the last flush.
+     */
+    size_t series_count() const {
+      return series.size();
+    }
+
+   private:
+    /**
+     * The source of one or more series. Entry 0 is reserved for data without a container.
+     * container_tags is only set for registered containers.
+     */
+    struct Container {
+      mesos::ContainerID container_id;
+      mesos::ExecutorInfo executor_info;
+      std::shared_ptr<ContainerTags> container_tags;
+    };
+
+    enum Type { COUNTER, GAUGE, SET, TIMER, HISTOGRAM };
+
+    struct Series {
+      uint32_t container;
+      Type type;
+      InternedString name;
+      InternedString tags; // canonical (sorted) datadog tags, without the leading "|#"
+      InternedString member; // SET only
+      double value; // COUNTER: sum, GAUGE: last value or sum of deltas, TIMER/HISTOGRAM: sum
+      bool gauge_absolute; // GAUGE only: whether 'value' was set by an absolute update
+      // TIMER/HISTOGRAM only:
+      size_t samples;
+      double count; // samples scaled by their sample rates
+      double min, max;
+      uint32_t sketch; // index into 'sketches', if percentiles are enabled
+    };
+
+    /**
+     * A single parsed statsd line, before it's assigned to a container.
+     */
+    struct Sample {
+      Type type;
+      InternedString name, tags, member;
+      double value, rate;
+      bool relative;
+    };
+
+    struct Slot {
+      Slot()
+        : hash(0), generation(0), series(0) { }
+
+      uint64_t hash;
+      uint32_t generation;
+      uint32_t series;
+    };
+
+    bool aggregate(const mesos::ContainerID* container_id,
+        const mesos::ExecutorInfo* executor_info, const ContainerTags* container_tags,
+        const char* data, size_t size);
+    size_t get_container(const mesos::ContainerID* container_id,
+        const mesos::ExecutorInfo* executor_info, const ContainerTags* container_tags);
+    bool parse(const char* data, size_t size, Sample& sample);
+    InternedString canonical_tags(const char* data, size_t size);
+    bool add(size_t container, const Sample& sample);
+    Series* find_or_add_series(const Series& key);
+    void grow_table();
+    void write_series(const Series& series);
+    void write_series_line(const Series& series, const char* suffix, const char* value,
+        const char* type, bool relative_gauge_writers_only = false);
+    void write_line(size_t container, const char* data, size_t size,
+        bool relative_gauge_writers_only = false);
+
+    void start_flush_timer();
+    void flush_cb(boost::system::error_code ec);
+    void shutdown_cb();
+
+    const std::vector<output_writer_ptr_t> writers;
+    const size_t flush_period_ms;
+    const size_t max_series;
+    const std::vector<double> percentiles;
+    std::vector<std::string> percentile_suffixes;
+
+    std::shared_ptr<boost::asio::io_service> io_service;
+    boost::asio::deadline_timer flush_timer;
+
+    std::vector<Container> containers;
+    container_id_map<size_t> container_indexes;
+    size_t last_container;
+
+    StringInterner strings;
+    std::vector<Series> series;
+    std::vector<Slot> table; // open addressing into 'series', sized to a power of two
+    uint32_t generation;
+    // Sketches for TIMER/HISTOGRAM series, reused across periods to keep their bins allocated
+    std::vector<QuantileSketch> sketches;
+    size_t sketches_used;
+
+    // Scratch space reused across calls
+    std::vector<std::pair<const char*, size_t>> tag_scratch;
+    std::string str_scratch;
+    std::string line_scratch;
+  };
+
+}
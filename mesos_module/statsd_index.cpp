@@ -0,0 +1,252 @@
+#include "statsd_index.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+#include "simd_util.hpp"
+
+#define BLOCK_BYTES 64
+
+namespace {
+  /**
+   * Makes room for a full block of offsets plus slack for append_mask(), so that the scans can
+   * append without checking.
+   */
+  inline uint32_t* reserve_block(std::vector<uint32_t>& offsets, size_t count) {
+    if (offsets.size() < count + BLOCK_BYTES + 4) {
+      offsets.resize(std::max(offsets.size() * 2, count + BLOCK_BYTES + 4));
+    }
+    return offsets.data() + count;
+  }
+
+  /**
+   * Appends the offsets of the set bits in a block's mask, returning the new count. Offsets are
+   * written four at a time regardless of how many bits are left, which avoids a mispredicted
+   * branch per bit. Anything written past the last bit is overwritten by the next block.
+   */
+  inline size_t append_mask(
+      std::vector<uint32_t>& offsets, size_t count, uint32_t block_offset, uint64_t mask) {
+    uint32_t* out = reserve_block(offsets, count);
+    size_t bits = __builtin_popcountll(mask);
+    // a guard bit keeps ctz defined once the mask runs out
+    const uint64_t guard = 1ULL << 63;
+    for (size_t i = 0; i < bits; i += 4) {
+      out[i] = block_offset + __builtin_ctzll(mask | guard);
+      mask &= mask - 1;
+      out[i + 1] = block_offset + __builtin_ctzll(mask | guard);
+      mask &= mask - 1;
+      out[i + 2] = block_offset + __builtin_ctzll(mask | guard);
+      mask &= mask - 1;
+      out[i + 3] = block_offset + __builtin_ctzll(mask | guard);
+      mask &= mask - 1;
+    }
+    return count + bits;
+  }
+
+  /**
+   * Output of a scan: newlines and '|'s are kept apart, so that each line's end is found directly
+   * rather than by stepping over the '|'s before it.
+   */
+  struct Scan {
+    Scan(std::vector<uint32_t>& newlines, std::vector<uint32_t>& sections)
+      : newlines(newlines), sections(sections), newline_count(0), section_count(0) { }
+
+    void append(uint32_t block_offset, uint64_t newline_mask, uint64_t section_mask) {
+      if (newline_mask != 0) {
+        newline_count = append_mask(newlines, newline_count, block_offset, newline_mask);
+      }
+      if (section_mask != 0) {
+        section_count = append_mask(sections, section_count, block_offset, section_mask);
+      }
+    }
+
+    std::vector<uint32_t>& newlines;
+    std::vector<uint32_t>& sections;
+    size_t newline_count;
+    size_t section_count;
+  };
+
+  void scan_scalar(const char* data, size_t start, size_t size, Scan& scan) {
+    for (size_t block = start; block < size; block += BLOCK_BYTES) {
+      size_t block_size = std::min((size_t)BLOCK_BYTES, size - block);
+      uint64_t newline_mask = 0, section_mask = 0;
+      for (size_t i = 0; i < block_size; ++i) {
+        switch (data[block + i]) {
+          case '\n':
+            newline_mask |= 1ULL << i;
+            break;
+          case '|':
+            section_mask |= 1ULL << i;
+            break;
+        }
+      }
+      scan.append(block, newline_mask, section_mask);
+    }
+  }
+
+  /**
+   * Finds the end of the line at 'start' with memchr(), along with the offsets of its '|'s, which
+   * are written to the start of 'sections'. Lines only have a few '|'s, so stepping between them
+   * is cheaper than comparing every byte.
+   */
+  size_t scan_line_memchr(const char* data, size_t start, size_t size,
+      std::vector<uint32_t>& sections, size_t& section_count) {
+    const char* end = (const char*) memchr(data + start, '\n', size - start);
+    if (end == NULL) {
+      end = data + size;
+    }
+    section_count = 0;
+    const char* section = (const char*) memchr(data + start, '|', end - data - start);
+    while (section != NULL) {
+      *reserve_block(sections, section_count) = section - data;
+      ++section_count;
+      section = (const char*) memchr(section + 1, '|', end - section - 1);
+    }
+    return end - data;
+  }
+
+#ifdef SIMD_SSE2_AVAILABLE
+  __attribute__((target("sse2")))
+  void scan_sse2(const char* data, size_t size, Scan& scan) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i pipe = _mm_set1_epi8('|');
+    size_t block = 0;
+    for (; block + BLOCK_BYTES <= size; block += BLOCK_BYTES) {
+      uint64_t newline_mask = 0, section_mask = 0;
+      for (size_t i = 0; i < BLOCK_BYTES; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + block + i));
+        newline_mask |=
+          (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)) << i;
+        section_mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pipe)) << i;
+      }
+      scan.append(block, newline_mask, section_mask);
+    }
+    scan_scalar(data, block, size, scan);
+  }
+#endif
+
+#ifdef SIMD_AVX2_AVAILABLE
+  __attribute__((target("avx2")))
+  void scan_avx2(const char* data, size_t size, Scan& scan) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i pipe = _mm256_set1_epi8('|');
+    size_t block = 0;
+    for (; block + BLOCK_BYTES <= size; block += BLOCK_BYTES) {
+      uint64_t newline_mask = 0, section_mask = 0;
+      for (size_t i = 0; i < BLOCK_BYTES; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(data + block + i));
+        newline_mask |=
+          (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline)) << i;
+        section_mask |=
+          (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, pipe)) << i;
+      }
+      scan.append(block, newline_mask, section_mask);
+    }
+    scan_scalar(data, block, size, scan);
+  }
+#endif
+}
+
+metrics::StatsdIndex::Impl metrics::StatsdIndex::best_impl() {
+  // SSE2 isn't picked: it's slower than MEMCHR
+  if (supported(AVX2)) {
+    return AVX2;
+  }
+  return MEMCHR;
+}
+
+bool metrics::StatsdIndex::supported(Impl impl) {
+  switch (impl) {
+    case SCALAR:
+    case MEMCHR:
+      return true;
+    case SSE2:
+      return simd_util::has_sse2();
+    case AVX2:
+      return simd_util::has_avx2();
+  }
+  return false;
+}
+
+const char* metrics::StatsdIndex::impl_name(Impl impl) {
+  switch (impl) {
+    case SCALAR:
+      return "scalar";
+    case MEMCHR:
+      return "memchr";
+    case SSE2:
+      return "sse2";
+    case AVX2:
+      return "avx2";
+  }
+  return "unknown";
+}
+
+metrics::StatsdIndex::StatsdIndex(Impl impl)
+  : impl(supported(impl) ? impl : SCALAR),
+    packet(NULL),
+    packet_size(0),
+    newline_count(0),
+    section_count(0),
+    line_start(0),
+    line_newline(0),
+    line_section(0) { }
+
+void metrics::StatsdIndex::build(const char* data, size_t size) {
+  packet = data;
+  packet_size = size;
+  line_start = 0;
+  line_newline = 0;
+  line_section = 0;
+  Scan scan(newlines, sections);
+  switch (impl) {
+#ifdef SIMD_AVX2_AVAILABLE
+    case AVX2:
+      scan_avx2(data, size, scan);
+      break;
+#endif
+#ifdef SIMD_SSE2_AVAILABLE
+    case SSE2:
+      scan_sse2(data, size, scan);
+      break;
+#endif
+    case MEMCHR:
+      // each line is scanned by next_line()
+      break;
+    default:
+      scan_scalar(data, 0, size, scan);
+      break;
+  }
+  newline_count = scan.newline_count;
+  section_count = scan.section_count;
+}
+
+bool metrics::StatsdIndex::next_line(Line& line) {
+  if (line_start >= packet_size) {
+    return false;
+  }
+  size_t line_end;
+  size_t first_section;
+  if (impl == MEMCHR) {
+    line_end = scan_line_memchr(packet, line_start, packet_size, sections, section_count);
+    first_section = 0;
+    line_section = section_count;
+  } else {
+    line_end = (line_newline < newline_count) ? newlines[line_newline] : packet_size;
+    first_section = line_section;
+    while (line_section < section_count && sections[line_section] < line_end) {
+      ++line_section;
+    }
+  }
+
+  line.data = packet + line_start;
+  line.size = line_end - line_start;
+  line.sections = sections.data() + first_section;
+  line.section_count = line_section - first_section;
+  line.packet = packet;
+
+  // Pass over the newline itself
+  line_start = line_end + 1;
+  ++line_newline;
+  return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace metrics {
+
+  /**
+   * A StatsdIndex finds the newlines and the '|' section separators of a statsd packet in a single
+   * pass, and records their offsets in order. Lines and their sections can then be walked from the
+   * offsets, rather than searching each line with memchr() for every separator.
+   *
+   * The scan is vectorized where the CPU allows: each 64 byte block is compared against both chars
+   * at once with AVX2, giving a bitmask of their positions in the block. Other CPUs skip the up
+   * front scan, and instead find each line's chars with memchr() as the line is read: that beats
+   * indexing the packet with SSE2. The implementation is picked at runtime.
+   *
+   * Only the separators which every line has a few of are indexed. The ':' ending the name is left
+   * to a short memchr() over the name, since tag sections are full of other ':'s which would just
+   * need to be skipped. Likewise '#' only matters as the first byte of a section.
+   *
+   * The offsets buffers are kept across packets, so an instance should be reused.
+   */
+  class StatsdIndex {
+   public:
+    enum Impl {
+      SCALAR,
+      MEMCHR,
+      SSE2,
+      AVX2
+    };
+
+    /**
+     * Returns the fastest implementation supported by this CPU: AVX2 if available, or MEMCHR.
+     */
+    static Impl best_impl();
+
+    /**
+     * Returns whether the provided implementation is supported by this CPU.
+     */
+    static bool supported(Impl impl);
+
+    /**
+     * Returns a short name for the provided implementation, for logging.
+     */
+    static const char* impl_name(Impl impl);
+
+    /**
+     * A single line within an indexed packet, along with the offsets of its '|' chars.
+     */
+    struct Line {
+      const char* data;
+      size_t size;
+
+      // Offsets from the start of the packet, in order
+      const uint32_t* sections;
+      size_t section_count;
+      const char* packet;
+
+      const char* section(size_t i) const {
+        return packet + sections[i];
+      }
+    };
+
+    explicit StatsdIndex(Impl impl = best_impl());
+
+    /**
+     * Indexes the provided packet, replacing any previous packet. The packet must remain valid
+     * while its lines are being read.
+     */
+    void build(const char* data, size_t size);
+
+    /**
+     * Fills in the next line of the packet, or returns false once all lines have been returned.
+     * Empty lines between newlines are included, but a newline at the end of the packet isn't
+     * followed by another line.
+     */
+    bool next_line(Line& line);
+
+   private:
+    const Impl impl;
+
+    const char* packet;
+    size_t packet_size;
+
+    // Offsets of newlines and of '|' chars, in order. Only the first newline_count and
+    // section_count entries are valid. Grown as needed, never shrunk. With MEMCHR, only the
+    // sections of the current line are kept.
+    std::vector<uint32_t> newlines;
+    std::vector<uint32_t> sections;
+    size_t newline_count;
+    size_t section_count;
+
+    // Position of next_line() within the packet, newlines, and sections
+    size_t line_start;
+    size_t line_newline;
+    size_t line_section;
+  };
+
+}
@@ -4,6 +4,7 @@
 
 #include "metrics_udp_sender.hpp"
 #include "statsd_tagger.hpp"
+#include "statsd_util.hpp"
 #include "sync_util.hpp"
 
 #define UDP_MAX_PACKET_BYTES 65536 /* UDP size limit in IPv4 (may be larger in IPv6) */
@@ -34,10 +35,16 @@ metrics::output_writer_ptr_t metrics::StatsdOutputWriter::create(
           params::get_str(parameters, params::OUTPUT_STATSD_HOST, params::OUTPUT_STATSD_HOST_DEFAULT),
           params::get_uint(parameters, params::OUTPUT_STATSD_PORT, params::OUTPUT_STATSD_PORT_DEFAULT),
           1000 * params::get_uint(parameters,
-              params::OUTPUT_STATSD_HOST_REFRESH_SECONDS, params::OUTPUT_STATSD_HOST_REFRESH_SECONDS_DEFAULT)));
+              params::OUTPUT_STATSD_HOST_REFRESH_SECONDS, params::OUTPUT_STATSD_HOST_REFRESH_SECONDS_DEFAULT),
+          params::get_bool(parameters,
+              params::OUTPUT_STATSD_HOST_FANOUT, params::OUTPUT_STATSD_HOST_FANOUT_DEFAULT)));
   return metrics::output_writer_ptr_t(new metrics::StatsdOutputWriter(io_service, parameters, sender));
 }
 
+metrics::StatsdOutputWriter::Chunk::Chunk()
+  : buffer(UDP_MAX_PACKET_BYTES),
+    used(0) { }
+
 metrics::StatsdOutputWriter::StatsdOutputWriter(
     std::shared_ptr<boost::asio::io_service> io_service,
     const mesos::Parameters& parameters,
@@ -48,9 +55,10 @@ metrics::StatsdOutputWriter::StatsdOutputWriter(
     chunk_timeout_ms(chunk_timeout_ms_for_tests),
     io_service(io_service),
     flush_timer(*io_service),
-    output_buffer((char*) malloc(UDP_MAX_PACKET_BYTES)),
-    chunk_used(0),
+    chunks(1),
     sender(sender) {
+  // Before the sender's destinations change, hand over any chunks which were meant for them
+  sender->set_destinations_change_cb(std::bind(&StatsdOutputWriter::queue_chunks, this));
   std::string annotation_mode_str = params::get_str(parameters,
       params::OUTPUT_STATSD_ANNOTATION_MODE, params::OUTPUT_STATSD_ANNOTATION_MODE_DEFAULT);
   switch (params::to_annotation_mode(annotation_mode_str)) {
@@ -92,59 +100,112 @@ void metrics::StatsdOutputWriter::start() {
 void metrics::StatsdOutputWriter::write_container_statsd(
     const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
     const char* in_data, size_t in_size) {
-  size_t needed_size =
-    tagger->calculate_size(container_id, executor_info, in_data, in_size);
+  if (container_id == NULL || executor_info == NULL) {
+    write_tagged(NULL, in_data, in_size);
+  } else {
+    // Caller didn't provide pre-rendered tags. Render them for this message.
+    ContainerTags container_tags(*container_id, *executor_info);
+    write_tagged(&container_tags, in_data, in_size);
+  }
+}
+
+void metrics::StatsdOutputWriter::write_registered_container_statsd(
+    const mesos::ContainerID& /*container_id*/, const mesos::ExecutorInfo& /*executor_info*/,
+    const ContainerTags& container_tags, const char* in_data, size_t in_size) {
+  write_tagged(&container_tags, in_data, in_size);
+}
+
+void metrics::StatsdOutputWriter::write_tagged(
+    const ContainerTags* container_tags, const char* in_data, size_t in_size) {
+  size_t needed_size = tagger->calculate_size(container_tags, in_data, in_size);
 
   if (needed_size > UDP_MAX_PACKET_BYTES) {
     // the buffer's just too small, period. send untagged data directly, skipping the buffer.
     // this shouldn't happen in practice.
-    sender->send(in_data, in_size);
+    size_t destination = (sender->destination_count() > 1)
+      ? sender->route(statsd_series_hash(in_data, in_size)) : 0;
+    sender->send(destination, in_data, in_size);
     return;
   }
 
+  // with several destinations, tag the data up front to find out which one its series goes to.
+  // the tagged data is then copied into that destination's chunk.
+  const char* tagged_data = NULL;
+  size_t destination = 0;
+  if (sender->destination_count() > 1) {
+    route_buffer.resize(UDP_MAX_PACKET_BYTES);
+    tagger->tag_copy(container_tags, in_data, in_size, route_buffer.data());
+    tagged_data = route_buffer.data();
+    destination = sender->route(statsd_series_hash(tagged_data, needed_size));
+  }
+  if (destination >= chunks.size()) {
+    chunks.resize(destination + 1);
+  }
+  Chunk& chunk = chunks[destination];
+  char* output_buffer = chunk.buffer.data();
+
   // chunking disabled
   if (!chunking) {
     // tag and send the data immediately
-    tagger->tag_copy(container_id, executor_info, in_data, in_size, output_buffer);
-    sender->send(output_buffer, needed_size);
+    copy_tagged(container_tags, in_data, in_size, tagged_data, needed_size, output_buffer);
+    sender->send(destination, output_buffer, needed_size);
     return;
   }
 
   // starting a new chunk
-  if (chunk_used == 0) {
-    tagger->tag_copy(container_id, executor_info, in_data, in_size, output_buffer);
+  if (chunk.used == 0) {
+    copy_tagged(container_tags, in_data, in_size, tagged_data, needed_size, output_buffer);
     if (needed_size < chunk_capacity) {
       // add the tagged data directly to the start of the chunk (no preceding newline)
-      chunk_used = needed_size;
+      chunk.used = needed_size;
     } else {
-      // too big for a chunk, tag and send immediately
-      sender->send(output_buffer, needed_size);
+      // too big for a chunk, tag and queue it as-is
+      sender->queue(destination, output_buffer, needed_size);
     }
     return;
   }
 
   // appending to existing chunk
-  if (needed_size + 1 < chunk_capacity - chunk_used) {//include newline char
+  if (needed_size + 1 < chunk_capacity - chunk.used) {//include newline char
     // the data fits in the current chunk. append the data and exit
-    output_buffer[chunk_used] = '\n';
-    ++chunk_used;
-    tagger->tag_copy(container_id, executor_info, in_data, in_size,
-        output_buffer + chunk_used);
-    chunk_used += needed_size;
+    output_buffer[chunk.used] = '\n';
+    ++chunk.used;
+    copy_tagged(container_tags, in_data, in_size, tagged_data, needed_size,
+        output_buffer + chunk.used);
+    chunk.used += needed_size;
     return;
   }
 
-  // the space needed exceeds the current chunk. send the current buffer before continuing.
-  sender->send(output_buffer, chunk_used);
-  chunk_used = 0;
+  // the space needed exceeds the current chunk. queue the current buffer before continuing. full
+  // chunks are sent together with the rest of this flush cycle's output.
+  sender->queue(destination, output_buffer, chunk.used);
+  chunk.used = 0;
 
-  tagger->tag_copy(container_id, executor_info, in_data, in_size, output_buffer);
+  copy_tagged(container_tags, in_data, in_size, tagged_data, needed_size, output_buffer);
   if (needed_size < chunk_capacity) {
     // add the tagged data directly to the start of the chunk (no preceding newline)
-    chunk_used = needed_size;
+    chunk.used = needed_size;
+  } else {
+    // still too big for a chunk, tag and queue it as-is
+    sender->queue(destination, output_buffer, needed_size);
+  }
+}
+
+void metrics::StatsdOutputWriter::copy_tagged(
+    const ContainerTags* container_tags, const char* in_data, size_t in_size,
+    const char* tagged_data, size_t tagged_size, char* out_data) {
+  if (tagged_data != NULL) {
+    memcpy(out_data, tagged_data, tagged_size);
   } else {
-    // still too big for a chunk, tag and send immediately
-    sender->send(output_buffer, needed_size);
+    tagger->tag_copy(container_tags, in_data, in_size, out_data);
+  }
+}
+
+void metrics::StatsdOutputWriter::queue_chunks() {
+  for (size_t destination = 0; destination < chunks.size(); ++destination) {
+    Chunk& chunk = chunks[destination];
+    sender->queue(destination, chunk.buffer.data(), chunk.used);
+    chunk.used = 0;
   }
 }
 
@@ -166,8 +227,9 @@ void metrics::StatsdOutputWriter::chunk_flush_cb(boost::system::error_code ec) {
     }
   }
 
-  sender->send(output_buffer, chunk_used);
-  chunk_used = 0;
+  // send everything queued since the last flush, along with the partial chunks
+  queue_chunks();
+  sender->flush();
 
   start_chunk_flush_timer();
 }
@@ -185,6 +247,6 @@ void metrics::StatsdOutputWriter::shutdown_cb() {
                << "err='" << ec.message() << "'(" << ec << ")";
   }
 
-  free(output_buffer);
-  output_buffer = NULL;
+  sender->set_destinations_change_cb(std::function<void()>());
+  chunks.clear();
 }
@@ -7,13 +7,18 @@
 
 namespace metrics {
 
+  class ContainerTags;
   class MetricsUDPSender;
   class StatsdTagger;
 
   /**
    * A StatsdOutputWriter accepts data from one or more ContainerReaders, then tags and forwards it
    * to an external statsd endpoint. The data may be buffered into chunks before being sent out --
-   * statsd supports separating multiple metrics by newlines.
+   * statsd supports separating multiple metrics by newlines. When chunking, the chunks filled
+   * during each flush period are queued in the sender and sent out together at the end of the
+   * period, so a busy period costs a handful of syscalls rather than one per chunk.
+   * If the sender fans out to several destinations, each line is routed by the hash of its
+   * (tagged) series, and each destination gets its own chunk.
    * In practice, there is one singleton StatsdOutputWriter instance per mesos-slave.
    */
   class StatsdOutputWriter : public OutputWriter {
@@ -59,9 +64,26 @@ namespace metrics {
         const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
         const char* data, size_t size);
 
+    /**
+     * Same as write_container_statsd(), except the container's pre-rendered tags are used as-is.
+     */
+    void write_registered_container_statsd(
+        const mesos::ContainerID& container_id, const mesos::ExecutorInfo& executor_info,
+        const ContainerTags& container_tags, const char* data, size_t size);
+
     void write_resource_usage(const process::Future<mesos::ResourceUsage>& usage);
 
    private:
+    struct Chunk {
+      Chunk();
+      std::vector<char> buffer;
+      size_t used;
+    };
+
+    void write_tagged(const ContainerTags* container_tags, const char* in_data, size_t in_size);
+    void copy_tagged(const ContainerTags* container_tags, const char* in_data, size_t in_size,
+        const char* tagged_data, size_t tagged_size, char* out_data);
+    void queue_chunks();
     void start_chunk_flush_timer();
     void chunk_flush_cb(boost::system::error_code ec);
 
@@ -73,8 +95,10 @@ namespace metrics {
 
     std::shared_ptr<boost::asio::io_service> io_service;
     boost::asio::deadline_timer flush_timer;
-    char* output_buffer;
-    size_t chunk_used;
+    // One per destination
+    std::vector<Chunk> chunks;
+    // Holds tagged data while picking its destination
+    std::vector<char> route_buffer;
 
     std::shared_ptr<MetricsUDPSender> sender;
     std::shared_ptr<StatsdTagger> tagger;
@@ -17,20 +17,6 @@ namespace {
 
 // ---
 
-size_t metrics::NullTagger::calculate_size(
-    const mesos::ContainerID* /*container_id*/, const mesos::ExecutorInfo* /*executor_info*/,
-    const char* /*in_data*/, size_t in_size) {
-  return in_size;
-}
-
-void metrics::NullTagger::tag_copy(
-    const mesos::ContainerID* /*container_id*/, const mesos::ExecutorInfo* /*executor_info*/,
-    const char* in_data, size_t in_size, char* out_data) {
-  memcpy(out_data, in_data, in_size);
-}
-
-// ---
-
 namespace {
   const char KEY_PREFIX_DELIMITER = '.';
   const char KEY_PREFIX_DELIMITER_REPLACEMENT = '_';
@@ -45,127 +31,110 @@ namespace {
       last_found = cur_found;
     }
   }
+
+  void append_key_prefix_elem(std::string& out, const std::string& elem) {
+    size_t out_offset = out.size();
+    out.append(elem);
+    replace_all((char*)out.data() + out_offset, elem.size(),
+        KEY_PREFIX_DELIMITER, KEY_PREFIX_DELIMITER_REPLACEMENT);
+    out.push_back(KEY_PREFIX_DELIMITER);
+  }
+
+  const std::string DATADOG_TAG_PREFIX("|#");
+  const std::string DATADOG_TAG_DIVIDER(",");
+  const std::string DATADOG_TAG_KEY_VALUE_SEPARATOR(":");
+
+  void append_datadog_tag(std::string& out, const std::string& key, const std::string& value) {
+    if (!out.empty()) {
+      out.append(DATADOG_TAG_DIVIDER);
+    }
+    out.append(key);
+    out.append(DATADOG_TAG_KEY_VALUE_SEPARATOR);
+    out.append(value);
+  }
+}
+
+metrics::ContainerTags::ContainerTags(
+    const mesos::ContainerID& container_id, const mesos::ExecutorInfo& executor_info) {
+  // fid.eid.cid.
+  append_key_prefix_elem(key_prefix_, executor_info.framework_id().value());
+  append_key_prefix_elem(key_prefix_, executor_info.executor_id().value());
+  append_key_prefix_elem(key_prefix_, container_id.value());
+
+  // framework_id:<fid>,executor_id:<eid>,container_id:<cid>
+  append_datadog_tag(datadog_tags_, FRAMEWORK_ID_DATADOG_KEY, executor_info.framework_id().value());
+  append_datadog_tag(datadog_tags_, EXECUTOR_ID_DATADOG_KEY, executor_info.executor_id().value());
+  append_datadog_tag(datadog_tags_, CONTAINER_ID_DATADOG_KEY, container_id.value());
 }
 
+// ---
+
+size_t metrics::NullTagger::calculate_size(
+    const ContainerTags* /*container_tags*/, const char* /*in_data*/, size_t in_size) {
+  return in_size;
+}
+
+void metrics::NullTagger::tag_copy(
+    const ContainerTags* /*container_tags*/, const char* in_data, size_t in_size, char* out_data) {
+  memcpy(out_data, in_data, in_size);
+}
+
+// ---
+
 size_t metrics::KeyPrefixTagger::calculate_size(
-    const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-    const char* /*in_data*/, size_t in_size) {
-  if (container_id == NULL || executor_info == NULL) {
+    const ContainerTags* container_tags, const char* /*in_data*/, size_t in_size) {
+  if (container_tags == NULL) {
     // unknown.in_data
     return UNKNOWN_CONTAINER_TAG.size() + 1 + in_size;
   } else {
     // fid.eid.cid.in_data
-    return executor_info->framework_id().value().size() + 1
-      + executor_info->executor_id().value().size() + 1
-      + container_id->value().size() + 1
-      + in_size;
+    return container_tags->key_prefix().size() + in_size;
   }
 }
 
 void metrics::KeyPrefixTagger::tag_copy(
-    const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-    const char* in_data, size_t in_size, char* out_data) {
-  size_t out_offset = 0, elem_size = 0;
-  if (container_id == NULL || executor_info == NULL) {
+    const ContainerTags* container_tags, const char* in_data, size_t in_size, char* out_data) {
+  size_t out_offset = 0;
+  if (container_tags == NULL) {
     // unknown.in_data
     out_offset = UNKNOWN_CONTAINER_TAG.size();
     memcpy(out_data, UNKNOWN_CONTAINER_TAG.data(), out_offset);
     out_data[out_offset] = KEY_PREFIX_DELIMITER;
     ++out_offset;
-    memcpy(out_data + out_offset, in_data, in_size);
   } else {
-    // fid.eid.cid.in_data (with .'s within ids converted to _'s)
-
-    // fid.
-    elem_size = executor_info->framework_id().value().size();
-    memcpy(out_data, executor_info->framework_id().value().data(), elem_size);
-    replace_all(out_data + out_offset, elem_size,
-        KEY_PREFIX_DELIMITER, KEY_PREFIX_DELIMITER_REPLACEMENT);
-    out_offset += elem_size;
-    out_data[out_offset] = KEY_PREFIX_DELIMITER;
-    ++out_offset;
-
-    // eid.
-    elem_size = executor_info->executor_id().value().size();
-    memcpy(out_data + out_offset, executor_info->executor_id().value().data(), elem_size);
-    replace_all(out_data + out_offset, elem_size,
-        KEY_PREFIX_DELIMITER, KEY_PREFIX_DELIMITER_REPLACEMENT);
-    out_offset += elem_size;
-    out_data[out_offset] = KEY_PREFIX_DELIMITER;
-    ++out_offset;
-
-    // cid.
-    elem_size = container_id->value().size();
-    memcpy(out_data + out_offset, container_id->value().data(), elem_size);
-    replace_all(out_data + out_offset, elem_size,
-        KEY_PREFIX_DELIMITER, KEY_PREFIX_DELIMITER_REPLACEMENT);
-    out_offset += elem_size;
-    out_data[out_offset] = KEY_PREFIX_DELIMITER;
-    ++out_offset;
-
-    // in_data
-    memcpy(out_data + out_offset, in_data, in_size);
+    // fid.eid.cid.in_data (prefix was already sanitized when rendered)
+    out_offset = container_tags->key_prefix().size();
+    memcpy(out_data, container_tags->key_prefix().data(), out_offset);
   }
+  memcpy(out_data + out_offset, in_data, in_size);
 }
 
 // ---
 
-namespace {
-  const std::string DATADOG_TAG_PREFIX("|#");
-  const std::string DATADOG_TAG_DIVIDER(",");
-  const std::string DATADOG_TAG_KEY_VALUE_SEPARATOR(":");
-}
-
 metrics::DatadogTagger::DatadogTagger()
   : tag_mode(TagMode::NONE),
     tag_insert_index(0) { }
 
 size_t metrics::DatadogTagger::calculate_size(
-    const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-    const char* in_data, size_t in_size) {
+    const ContainerTags* container_tags, const char* in_data, size_t in_size) {
   calculate_tag_section(in_data, in_size);
 
-  if (container_id == NULL || executor_info == NULL) {
-    switch (tag_mode) {
-      case TagMode::FIRST_TAG:
-        // data|#unknown
-        return in_size + DATADOG_TAG_PREFIX.size() + UNKNOWN_CONTAINER_TAG.size();
-
-      case TagMode::APPEND_TAG_NO_DELIM:
-        // dataunknown
-        return in_size + UNKNOWN_CONTAINER_TAG.size();
-
-      case TagMode::APPEND_TAG:
-        // data,unknown
-        return in_size + DATADOG_TAG_DIVIDER.size() + UNKNOWN_CONTAINER_TAG.size();
-
-      case TagMode::NONE:
-        return 0;// shouldn't happen
-    }
-  }
-
-  // lets assume that the compiler optimizes this a bunch:
-  size_t common_suffix_len =
-    FRAMEWORK_ID_DATADOG_KEY.size() // fid
-    + DATADOG_TAG_KEY_VALUE_SEPARATOR.size() + executor_info->framework_id().value().size() // :<fid>
-
-    + DATADOG_TAG_DIVIDER.size() + EXECUTOR_ID_DATADOG_KEY.size() // ,eid
-    + DATADOG_TAG_KEY_VALUE_SEPARATOR.size() + executor_info->executor_id().value().size() // :<eid>
-
-    + DATADOG_TAG_DIVIDER.size() + CONTAINER_ID_DATADOG_KEY.size() // ,cid
-    + DATADOG_TAG_KEY_VALUE_SEPARATOR.size() + container_id->value().size(); // :<cid>
+  // unknown, or fid:<fid>,eid:<eid>,cid:<cid>
+  const size_t tags_len = (container_tags == NULL)
+    ? UNKNOWN_CONTAINER_TAG.size()
+    : container_tags->datadog_tags().size();
   switch (tag_mode) {
     case TagMode::FIRST_TAG:
-      // data|#[fid:<fid>,eid:<eid>,cid:<cid>]
-      return in_size + DATADOG_TAG_PREFIX.size() + common_suffix_len;
+      // data|#[tags]
+      return in_size + DATADOG_TAG_PREFIX.size() + tags_len;
 
     case TagMode::APPEND_TAG_NO_DELIM:
-      // data[fid:<fid>,eid:<eid>,cid:<cid>]
-      return in_size + common_suffix_len;
+      // data[tags]
+      return in_size + tags_len;
 
     case TagMode::APPEND_TAG:
-      // data,[fid:<fid>,eid:<eid>,cid:<cid>]
-      return in_size + DATADOG_TAG_DIVIDER.size() + common_suffix_len; // :<cid>
+      // data,[tags]
+      return in_size + DATADOG_TAG_DIVIDER.size() + tags_len;
 
     case TagMode::NONE:
       return 0;// shouldn't happen
@@ -174,8 +143,7 @@ size_t metrics::DatadogTagger::calculate_size(
 }
 
 void metrics::DatadogTagger::tag_copy(
-    const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-    const char* in_data, size_t in_size, char* out_data) {
+    const ContainerTags* container_tags, const char* in_data, size_t in_size, char* out_data) {
   if (tag_mode == TagMode::NONE) {
     // calculate_size wasn't called first!
     return;
@@ -187,17 +155,8 @@ void metrics::DatadogTagger::tag_copy(
   memcpy(out_data, in_data, tag_insert_index);
 
   // insert tags at tag_insert_index
-  size_t inserted_size = 0;
-  if (container_id == NULL || executor_info == NULL) {
-    inserted_size += append_tag(out_data + tag_insert_index + inserted_size, UNKNOWN_CONTAINER_TAG);
-  } else {
-    inserted_size += append_tag(out_data + tag_insert_index + inserted_size,
-        FRAMEWORK_ID_DATADOG_KEY, executor_info->framework_id().value());
-    inserted_size += append_tag(out_data + tag_insert_index + inserted_size,
-        EXECUTOR_ID_DATADOG_KEY, executor_info->executor_id().value());
-    inserted_size += append_tag(out_data + tag_insert_index + inserted_size,
-        CONTAINER_ID_DATADOG_KEY, container_id->value());
-  }
+  size_t inserted_size = append_tags(out_data + tag_insert_index,
+      (container_tags == NULL) ? UNKNOWN_CONTAINER_TAG : container_tags->datadog_tags());
 
   // copy [tag_insert_index,in_size)
   memcpy(out_data + tag_insert_index + inserted_size, in_data + tag_insert_index,
@@ -255,66 +214,28 @@ void metrics::DatadogTagger::calculate_tag_section(const char* in_data, const si
 }
 
 
-size_t metrics::DatadogTagger::append_tag(char* out_data, const std::string& tag) {
-  size_t added = 0;
-  switch (tag_mode) {
-    case TagMode::FIRST_TAG:
-      // <buffer>|#tag
-      memcpy(out_data, DATADOG_TAG_PREFIX.data(), DATADOG_TAG_PREFIX.size());
-      added = DATADOG_TAG_PREFIX.size();
-      tag_mode = APPEND_TAG;
-      break;
-    case TagMode::APPEND_TAG:
-      // <buffer>,tag
-      memcpy(out_data, DATADOG_TAG_DIVIDER.data(), DATADOG_TAG_DIVIDER.size());
-      added = DATADOG_TAG_DIVIDER.size();
-      break;
-    case TagMode::APPEND_TAG_NO_DELIM:
-      // <buffer>tag
-      tag_mode = APPEND_TAG;
-      break;
-    case TagMode::NONE:
-      return 0;// shouldn't happen
-  }
-
-  memcpy(out_data + added, tag.data(), tag.size());
-  added += tag.size();
-
-  return added;
-}
-
-size_t metrics::DatadogTagger::append_tag(
-    char* out_data, const std::string& tag_key, const std::string& tag_value) {
+size_t metrics::DatadogTagger::append_tags(char* out_data, const std::string& tags) {
   size_t added = 0;
   switch (tag_mode) {
     case TagMode::FIRST_TAG:
-      // <buffer>|#key:value
+      // <buffer>|#tags
       memcpy(out_data, DATADOG_TAG_PREFIX.data(), DATADOG_TAG_PREFIX.size());
       added = DATADOG_TAG_PREFIX.size();
-      tag_mode = APPEND_TAG;
       break;
     case TagMode::APPEND_TAG:
-      // <buffer>,key:value
+      // <buffer>,tags
       memcpy(out_data, DATADOG_TAG_DIVIDER.data(), DATADOG_TAG_DIVIDER.size());
       added = DATADOG_TAG_DIVIDER.size();
       break;
     case TagMode::APPEND_TAG_NO_DELIM:
-      // <buffer>key:value
-      tag_mode = APPEND_TAG;
+      // <buffer>tags
       break;
     case TagMode::NONE:
       return 0;// shouldn't happen
   }
 
-  memcpy(out_data + added, tag_key.data(), tag_key.size());
-  added += tag_key.size();
-
-  memcpy(out_data + added,
-      DATADOG_TAG_KEY_VALUE_SEPARATOR.data(), DATADOG_TAG_KEY_VALUE_SEPARATOR.size());
-  added += DATADOG_TAG_KEY_VALUE_SEPARATOR.size();
-
-  memcpy(out_data + added, tag_value.data(), tag_value.size());
-  added += tag_value.size();
+  memcpy(out_data + added, tags.data(), tags.size());
+  added += tags.size();
 
   return added;
 }
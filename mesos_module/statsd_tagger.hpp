@@ -5,41 +5,64 @@
 #include <mesos/mesos.pb.h>
 
 namespace metrics {
+  /**
+   * The tags for a single container, rendered up-front in each of the supported output formats.
+   * These are built once when a container is registered, so that tagging a line of data only
+   * involves copying the pre-rendered bytes.
+   */
+  class ContainerTags {
+   public:
+    ContainerTags(const mesos::ContainerID& container_id, const mesos::ExecutorInfo& executor_info);
+
+    /**
+     * fid.eid.cid. (with .'s within ids converted to _'s)
+     */
+    const std::string& key_prefix() const {
+      return key_prefix_;
+    }
+
+    /**
+     * framework_id:<fid>,executor_id:<eid>,container_id:<cid>
+     */
+    const std::string& datadog_tags() const {
+      return datadog_tags_;
+    }
+
+   private:
+    std::string key_prefix_;
+    std::string datadog_tags_;
+  };
+
   class StatsdTagger {
    public:
     /**
      * Returns the required size for a tagged version of the provided data.
+     * container_tags may be NULL if no container information is available.
      */
     virtual size_t calculate_size(
-        const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-        const char* in_data, const size_t in_size) = 0;
+        const ContainerTags* container_tags, const char* in_data, const size_t in_size) = 0;
     /**
      * Copies a tagged version of the provided data into 'out_data', which MUST be at least the size
      * returned by a previous call to calculate_size().
      */
     virtual void tag_copy(
-        const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-        const char* in_data, size_t in_size, char* out_data) = 0;
+        const ContainerTags* container_tags, const char* in_data, size_t in_size, char* out_data) = 0;
   };
 
   class NullTagger : public StatsdTagger {
    public:
     size_t calculate_size(
-        const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-        const char* in_data, const size_t in_size);
+        const ContainerTags* container_tags, const char* in_data, const size_t in_size);
     void tag_copy(
-        const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-        const char* in_data, size_t in_size, char* out_data);
+        const ContainerTags* container_tags, const char* in_data, size_t in_size, char* out_data);
   };
 
   class KeyPrefixTagger : public StatsdTagger {
    public:
     size_t calculate_size(
-        const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-        const char* in_data, const size_t in_size);
+        const ContainerTags* container_tags, const char* in_data, const size_t in_size);
     void tag_copy(
-        const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-        const char* in_data, size_t in_size, char* out_data);
+        const ContainerTags* container_tags, const char* in_data, size_t in_size, char* out_data);
   };
 
   class DatadogTagger : public StatsdTagger {
@@ -47,11 +70,9 @@ namespace metrics {
     DatadogTagger();
 
     size_t calculate_size(
-        const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-        const char* in_data, const size_t in_size);
+        const ContainerTags* container_tags, const char* in_data, const size_t in_size);
     void tag_copy(
-        const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
-        const char* in_data, size_t in_size, char* out_data);
+        const ContainerTags* container_tags, const char* in_data, size_t in_size, char* out_data);
 
    private:
     enum TagMode {
@@ -62,8 +83,7 @@ namespace metrics {
     };
 
     void calculate_tag_section(const char* in_data, const size_t in_size);
-    size_t append_tag(char* out_data, const std::string& tag);
-    size_t append_tag(char* out_data, const std::string& tag_key, const std::string& tag_value);
+    size_t append_tags(char* out_data, const std::string& tags);
 
     TagMode tag_mode;
     size_t tag_insert_index;
@@ -1,7 +1,85 @@
 #include "statsd_util.hpp"
 
+#include <stdint.h>
+#include <string.h>
+
 #define MODULE_STATSD_PREFIX "dcos.metrics.module."
 
+namespace {
+  uint64_t hash_bytes(const char* data, size_t size) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= (uint8_t)data[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  /**
+   * splitmix64 finalizer: FNV alone doesn't mix well enough for users of a subset of the hash's
+   * bits, such as HyperLogLog registers.
+   */
+  inline uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+  }
+
+  /**
+   * Order-independent hash of comma-separated datadog tags.
+   */
+  uint64_t hash_tags(const char* data, size_t size) {
+    uint64_t sum = 0;
+    const char* end = data + size;
+    for (const char* tag_start = data;;) {
+      const char* tag_end = (const char*)memchr(tag_start, ',', end - tag_start);
+      if (tag_end == NULL) {
+        tag_end = end;
+      }
+      sum += mix(hash_bytes(tag_start, tag_end - tag_start));
+      if (tag_end == end) {
+        return sum;
+      }
+      tag_start = tag_end + 1;
+    }
+  }
+
+  /**
+   * Hashes a statsd line given the end of its name and the '|' starting its first section. Each
+   * following '|' (or the end of the line) is found by next_section(from), where 'from' is just
+   * after the previous '|'.
+   * Expected input format: name[:val][|type][|@rate][|#tag1:val1,tag2:val2]
+   */
+  template <typename NextSection>
+  uint64_t hash_sections(const char* data, const char* end,
+      const char* name_end, const char* section_start, NextSection next_section) {
+    uint64_t hash = mix(hash_bytes(data, name_end - data));
+
+    // the type is the first section, then look for tags in any of the others
+    bool first = true;
+    while (section_start < end) {
+      const char* section_end = next_section(section_start + 1);
+      ++section_start; // skip '|'
+      if (first) {
+        hash = mix(hash ^ hash_bytes(section_start, section_end - section_start));
+        first = false;
+      } else if (section_start < section_end && *section_start == '#') {
+        hash = mix(hash + hash_tags(section_start + 1, section_end - section_start - 1));
+      }
+      section_start = section_end;
+    }
+    return (hash == 0) ? 1 : hash;
+  }
+}
+
+std::string metrics::statsd_name(const std::string& label) {
+  return MODULE_STATSD_PREFIX + label;
+}
+
 std::string metrics::statsd_counter_per_sec(const std::string& label, size_t value, size_t period_ms) {
   std::ostringstream oss;
   if (period_ms == 0) {
@@ -13,3 +91,41 @@ std::string metrics::statsd_counter_per_sec(const std::string& label, size_t val
   }
   return oss.str();
 }
+
+std::string metrics::statsd_gauge(const std::string& label, double value) {
+  std::ostringstream oss;
+  oss << MODULE_STATSD_PREFIX << label << ':' << value << "|g";
+  return oss.str();
+}
+
+uint64_t metrics::statsd_series_hash(const char* data, size_t size) {
+  const char* end = data + size;
+  const char* section_start = (const char*)memchr(data, '|', size);
+  if (section_start == NULL) {
+    section_start = end;
+  }
+  const char* name_end = (const char*)memchr(data, ':', section_start - data);
+  if (name_end == NULL) {
+    name_end = section_start;
+  }
+  return hash_sections(data, end, name_end, section_start,
+      [end](const char* from) {
+        const char* section_end = (const char*)memchr(from, '|', end - from);
+        return (section_end == NULL) ? end : section_end;
+      });
+}
+
+uint64_t metrics::statsd_series_hash(const StatsdIndex::Line& line) {
+  // Same as above, but walking the line's sections rather than searching for them
+  const char* end = line.data + line.size;
+  size_t i = 0;
+  const char* section_start = (line.section_count > 0) ? line.section(0) : end;
+  const char* name_end = (const char*)memchr(line.data, ':', section_start - line.data);
+  if (name_end == NULL) {
+    name_end = section_start;
+  }
+  return hash_sections(line.data, end, name_end, section_start,
+      [&line, &i, end](const char* /*from*/) {
+        return (++i < line.section_count) ? line.section(i) : end;
+      });
+}
@@ -1,11 +1,35 @@
 #pragma once
 
 #include <sstream>
+#include <stdint.h>
+
+#include "statsd_index.hpp"
 
 namespace metrics {
+  /**
+   * Returns the full statsd metric name for the provided label, as used by the functions below.
+   */
+  std::string statsd_name(const std::string& label);
+
   /**
    * Returns a statsd-formatted metric which has converted the provided 'value' counted over 'period_ms' into
    * a per-second value.
    */
   std::string statsd_counter_per_sec(const std::string& label, size_t value, size_t period_ms);
+
+  /**
+   * Returns a statsd-formatted gauge metric with the provided value.
+   */
+  std::string statsd_gauge(const std::string& label, double value);
+
+  /**
+   * Returns a hash of the series (name, type, and tags in any order) of the provided statsd line.
+   * Never returns zero.
+   */
+  uint64_t statsd_series_hash(const char* data, size_t size);
+
+  /**
+   * Same as above, for a line which has already been indexed.
+   */
+  uint64_t statsd_series_hash(const StatsdIndex::Line& line);
 }
@@ -0,0 +1,289 @@
+#include "stream_listener.hpp"
+
+#include <sstream>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <glog/logging.h>
+
+#include "socket_util.hpp"
+
+#define RETRY_MS 50 /* wait before offering paused lines again */
+
+namespace metrics {
+  /**
+   * A connection's socket and its read buffer. Bytes [0, filled) of the buffer hold data which
+   * hasn't been consumed yet, of which [0, scanned) are known to contain no newlines.
+   */
+  class StreamListener::Connection {
+   public:
+    Connection(boost::asio::io_service& io_service)
+      : socket(io_service),
+        retry_timer(io_service),
+        filled(0),
+        scanned(0),
+        discarding(false),
+        eof(false) { }
+
+    boost::asio::generic::stream_protocol::socket socket;
+    endpoint_t peer;
+    boost::asio::deadline_timer retry_timer;
+    std::vector<char> buffer;
+    size_t filled;
+    size_t scanned;
+    // Whether an overlong line is being dropped up to its next newline
+    bool discarding;
+    // Whether the peer has finished sending
+    bool eof;
+  };
+}
+
+metrics::StreamListener::StreamListener(
+    const std::shared_ptr<boost::asio::io_service>& io_service,
+    consumer_t consumer,
+    size_t max_connections,
+    size_t buffer_bytes)
+  : io_service(io_service),
+    consumer(consumer),
+    max_connections(max_connections),
+    buffer_bytes(buffer_bytes),
+    acceptor(*io_service),
+    paused_count(0),
+    dropped_bytes(0),
+    rejected_connections(0) { }
+
+metrics::StreamListener::~StreamListener() {
+  boost::system::error_code ec;
+  if (acceptor.is_open()) {
+    acceptor.close(ec);
+    if (ec) {
+      LOG(ERROR) << "Error on stream listener close: " << ec;
+    }
+  }
+  for (connection_ptr_t conn : connections) {
+    conn->retry_timer.cancel(ec);
+    conn->socket.close(ec);
+  }
+  connections.clear();
+  if (!unix_path.empty() && unlink(unix_path.c_str()) != 0) {
+    int errnum = errno;
+    LOG(WARNING) << "Failed to remove stream socket at path[" << unix_path << "]: "
+                 << "errno=" << errnum << " => " << strerror(errnum);
+  }
+}
+
+Try<Nothing> metrics::StreamListener::open_tcp(
+    const boost::asio::ip::tcp::endpoint& endpoint, bool reuse_port/*=false*/) {
+  std::ostringstream oss;
+  oss << endpoint;
+  return open(endpoint, oss.str(), reuse_port);
+}
+
+Try<Nothing> metrics::StreamListener::open_unix(const std::string& path) {
+  if (path.size() >= sizeof(((struct sockaddr_un*) NULL)->sun_path)) {
+    return Error("Stream socket path[" + path + "] is too long");
+  }
+  if (!remove_stale_socket(path)) {
+    return Error("Failed to remove stale stream socket at path[" + path + "]");
+  }
+  Try<Nothing> result = open(boost::asio::local::stream_protocol::endpoint(path), path, false);
+  if (result.isError()) {
+    return result;
+  }
+  unix_path = path;
+
+  // The container's processes may run as any user
+  if (chmod(path.c_str(), 0666) != 0) {
+    int errnum = errno;
+    std::ostringstream oss;
+    oss << "Failed to make stream socket at path[" << path << "] writable: "
+        << "errno=" << errnum << " => " << strerror(errnum);
+    return Error(oss.str());
+  }
+  return Nothing();
+}
+
+size_t metrics::StreamListener::take_paused_count() {
+  size_t ret = paused_count;
+  paused_count = 0;
+  return ret;
+}
+
+size_t metrics::StreamListener::take_dropped_bytes() {
+  size_t ret = dropped_bytes;
+  dropped_bytes = 0;
+  return ret;
+}
+
+size_t metrics::StreamListener::take_rejected_connections() {
+  size_t ret = rejected_connections;
+  rejected_connections = 0;
+  return ret;
+}
+
+Try<Nothing> metrics::StreamListener::open(
+    const endpoint_t& endpoint, const std::string& desc, bool reuse_port) {
+  boost::system::error_code ec;
+  acceptor.open(endpoint.protocol(), ec);
+  if (ec) {
+    std::ostringstream oss;
+    oss << "Failed to open stream socket at endpoint[" << desc << "]: " << ec;
+    return Error(oss.str());
+  }
+  set_cloexec(acceptor, desc, 0);
+  // Allow rebinding the port while connections from before a restart are still in TIME_WAIT
+  acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
+  if (reuse_port && !set_reuseport(acceptor, desc, 0)) {
+    return Error("Failed to enable port reuse on stream socket at endpoint[" + desc + "]");
+  }
+
+  acceptor.bind(endpoint, ec);
+  if (ec) {
+    std::ostringstream oss;
+    oss << "Failed to bind stream socket at endpoint[" << desc << "]: " << ec;
+    return Error(oss.str());
+  }
+  acceptor.listen(boost::asio::socket_base::max_connections, ec);
+  if (ec) {
+    std::ostringstream oss;
+    oss << "Failed to listen on stream socket at endpoint[" << desc << "]: " << ec;
+    return Error(oss.str());
+  }
+
+  start_accept();
+  LOG(INFO) << "Stream listener accepting on " << desc
+            << " (max " << max_connections << " connections)";
+  return Nothing();
+}
+
+void metrics::StreamListener::start_accept() {
+  connection_ptr_t conn(new Connection(*io_service));
+  acceptor.async_accept(conn->socket, conn->peer,
+      std::bind(&StreamListener::accept_cb, this, conn, std::placeholders::_1));
+}
+
+void metrics::StreamListener::accept_cb(connection_ptr_t conn, boost::system::error_code ec) {
+  if (ec) {
+    if (ec == boost::asio::error::operation_aborted) {
+      // We're being destroyed. Don't look at local state, it may be destroyed already.
+      return;
+    }
+    LOG(WARNING) << "Error when accepting stream connection: " << ec;
+    start_accept();
+    return;
+  }
+
+  if (connections.size() >= max_connections) {
+    ++rejected_connections;
+    conn->socket.close(ec);
+  } else {
+    set_cloexec(conn->socket, "stream connection", 0);
+    conn->buffer.resize(buffer_bytes);
+    connections.insert(conn);
+    start_read(conn);
+  }
+  start_accept();
+}
+
+void metrics::StreamListener::start_read(connection_ptr_t conn) {
+  conn->socket.async_read_some(
+      boost::asio::buffer(conn->buffer.data() + conn->filled, conn->buffer.size() - conn->filled),
+      std::bind(&StreamListener::read_cb, this, conn,
+          std::placeholders::_1, std::placeholders::_2));
+}
+
+void metrics::StreamListener::read_cb(
+    connection_ptr_t conn, boost::system::error_code ec, size_t bytes_transferred) {
+  if (ec == boost::asio::error::operation_aborted) {
+    // We're being destroyed. Don't look at local state, it may be destroyed already.
+    return;
+  }
+  if (ec) {
+    if (ec != boost::asio::error::eof) {
+      LOG(WARNING) << "Error when reading from stream connection: " << ec;
+    }
+    // Pass along anything left over, which may include a final line without a newline.
+    conn->eof = true;
+    if (offer_lines(conn)) {
+      close(conn);
+    }
+    return;
+  }
+
+  conn->filled += bytes_transferred;
+  if (offer_lines(conn)) {
+    start_read(conn);
+  }
+}
+
+void metrics::StreamListener::retry_cb(connection_ptr_t conn, boost::system::error_code ec) {
+  if (ec) {
+    // Cancelled: we're being destroyed. Don't look at local state, it may be destroyed already.
+    return;
+  }
+  if (!offer_lines(conn)) {
+    return;
+  }
+  if (conn->eof) {
+    close(conn);
+  } else {
+    start_read(conn);
+  }
+}
+
+bool metrics::StreamListener::offer_lines(connection_ptr_t conn) {
+  char* data = conn->buffer.data();
+
+  if (conn->discarding) {
+    char* newline = (char*) memchr(data, '\n', conn->filled);
+    size_t discard = (newline == NULL) ? conn->filled : newline - data + 1;
+    dropped_bytes += discard;
+    memmove(data, data + discard, conn->filled - discard);
+    conn->filled -= discard;
+    conn->scanned = 0;
+    conn->discarding = (newline == NULL);
+  }
+
+  // Hand off everything up to the last newline. The bytes before 'scanned' are a partial line.
+  char* last_newline = (char*) memrchr(
+      data + conn->scanned, '\n', conn->filled - conn->scanned);
+  size_t lines_size, consumed_size;
+  if (last_newline != NULL) {
+    lines_size = last_newline - data;
+    consumed_size = lines_size + 1;
+  } else if (conn->eof) {
+    lines_size = consumed_size = conn->filled;
+  } else {
+    lines_size = consumed_size = 0;
+  }
+  if (lines_size > 0 && !consumer(conn->peer, data, lines_size)) {
+    // Leave the lines in place and stop reading until they've been accepted
+    ++paused_count;
+    conn->retry_timer.expires_from_now(boost::posix_time::milliseconds(RETRY_MS));
+    conn->retry_timer.async_wait(
+        std::bind(&StreamListener::retry_cb, this, conn, std::placeholders::_1));
+    return false;
+  }
+
+  // Move the trailing partial line (if any) to the front. This is the only copy of its data.
+  conn->filled -= consumed_size;
+  memmove(data, data + consumed_size, conn->filled);
+  conn->scanned = conn->filled;
+  if (conn->filled == conn->buffer.size()) {
+    // The partial line fills the whole buffer: drop it along with the rest of the line
+    LOG(WARNING) << "Dropping stream line which exceeded " << buffer_bytes << " bytes";
+    dropped_bytes += conn->filled;
+    conn->filled = 0;
+    conn->scanned = 0;
+    conn->discarding = true;
+  }
+  return true;
+}
+
+void metrics::StreamListener::close(connection_ptr_t conn) {
+  boost::system::error_code ec;
+  conn->retry_timer.cancel(ec);
+  conn->socket.close(ec);
+  connections.erase(conn);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <unordered_set>
+
+#include <boost/asio.hpp>
+#include <stout/try.hpp>
+
+namespace metrics {
+
+  /**
+   * A StreamListener accepts newline-framed statsd over TCP or a unix stream socket, for a reader
+   * which otherwise only receives datagrams. Each connection reads into its own fixed buffer.
+   * Complete lines are handed to the consumer in place, and only a trailing partial line is moved
+   * to the front of the buffer before the next read. Lines which don't fit in the buffer are
+   * dropped.
+   *
+   * When the consumer can't take a connection's lines yet (eg the container is over its byte
+   * limit), the connection stops reading and offers the same lines again later. Meanwhile further
+   * data waits in the kernel, so the sender is slowed down by flow control instead of losing data.
+   * The number of open connections is capped: connections beyond the cap are closed on accept.
+   *
+   * Like the reader which owns it, an instance is only used from within its io_service's thread.
+   */
+  class StreamListener {
+   public:
+    typedef boost::asio::generic::stream_protocol::endpoint endpoint_t;
+
+    /**
+     * Called with one or more complete newline-separated lines from the peer, without the final
+     * newline. Returns false if the lines can't be accepted yet, in which case the same lines are
+     * offered again after a short delay.
+     */
+    typedef std::function<bool(const endpoint_t& peer, const char* data, size_t size)> consumer_t;
+
+    /**
+     * Returns the path of the stream socket which accompanies a unix datagram socket.
+     */
+    static std::string unix_stream_path(const std::string& datagram_path) {
+      return datagram_path + ".stream";
+    }
+
+    StreamListener(
+        const std::shared_ptr<boost::asio::io_service>& io_service,
+        consumer_t consumer,
+        size_t max_connections,
+        size_t buffer_bytes);
+
+    /**
+     * Must be called within the io_service's thread. Closes the listener and all connections.
+     */
+    virtual ~StreamListener();
+
+    /**
+     * Starts accepting connections on the provided TCP endpoint. If reuse_port is set, other
+     * listeners may also bind the endpoint, and the kernel spreads new connections across them.
+     */
+    Try<Nothing> open_tcp(const boost::asio::ip::tcp::endpoint& endpoint, bool reuse_port = false);
+
+    /**
+     * Starts accepting connections on a unix stream socket at the provided path, replacing any
+     * stale socket at that path. The socket file is removed when the listener is destroyed.
+     */
+    Try<Nothing> open_unix(const std::string& path);
+
+    /**
+     * Returns the number of open connections.
+     */
+    size_t connection_count() const {
+      return connections.size();
+    }
+
+    /**
+     * Returns the number of times that a connection was paused since the last call.
+     */
+    size_t take_paused_count();
+
+    /**
+     * Returns the number of bytes dropped in overlong lines since the last call.
+     */
+    size_t take_dropped_bytes();
+
+    /**
+     * Returns the number of connections which were closed on accept since the last call.
+     */
+    size_t take_rejected_connections();
+
+   private:
+    class Connection;
+    typedef std::shared_ptr<Connection> connection_ptr_t;
+
+    Try<Nothing> open(const endpoint_t& endpoint, const std::string& desc, bool reuse_port);
+    void start_accept();
+    void accept_cb(connection_ptr_t conn, boost::system::error_code ec);
+    void start_read(connection_ptr_t conn);
+    void read_cb(connection_ptr_t conn, boost::system::error_code ec, size_t bytes_transferred);
+    void retry_cb(connection_ptr_t conn, boost::system::error_code ec);
+    bool offer_lines(connection_ptr_t conn);
+    void close(connection_ptr_t conn);
+
+    std::shared_ptr<boost::asio::io_service> io_service;
+    const consumer_t consumer;
+    const size_t max_connections;
+    const size_t buffer_bytes;
+
+    boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol> acceptor;
+    std::string unix_path;
+    std::unordered_set<connection_ptr_t> connections;
+
+    size_t paused_count;
+    size_t dropped_bytes;
+    size_t rejected_connections;
+  };
+
+}
@@ -0,0 +1,113 @@
+#include "string_interner.hpp"
+
+#include <string.h>
+
+namespace {
+  const size_t MIN_TABLE_SIZE = 1024; // must be a power of two
+
+  /**
+   * FNV-1a: fast enough for short metric names, and good enough for a linear probing table.
+   */
+  uint64_t hash_bytes(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= (uint8_t)data[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+}
+
+bool metrics::operator==(const InternedString& a, const InternedString& b) {
+  return a.size() == b.size()
+    && (a.data() == b.data() || memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+bool metrics::operator==(const InternedString& a, const std::string& b) {
+  return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+std::ostream& metrics::operator<<(std::ostream& out, const InternedString& str) {
+  return out.write(str.data(), str.size());
+}
+
+metrics::StringInterner::StringInterner(size_t chunk_size/*=64*1024*/)
+  : chunk_size(chunk_size),
+    chunk_idx(0),
+    chunk_used(0),
+    table(MIN_TABLE_SIZE),
+    count(0),
+    // slots start at generation 0: never valid
+    generation(1) { }
+
+metrics::InternedString metrics::StringInterner::intern(const char* data, size_t size) {
+  if (size == 0) {
+    return InternedString();
+  }
+  if ((count + 1) * 2 > table.size()) {
+    grow_table();
+  }
+
+  uint64_t hash = hash_bytes(data, size);
+  size_t mask = table.size() - 1;
+  for (size_t idx = hash & mask;; idx = (idx + 1) & mask) {
+    Slot& slot = table[idx];
+    if (slot.generation != generation) {
+      // empty slot: string isn't interned yet
+      char* copy = allocate(size);
+      memcpy(copy, data, size);
+      slot.str = InternedString(copy, size);
+      slot.hash = hash;
+      slot.generation = generation;
+      ++count;
+      return slot.str;
+    }
+    if (slot.hash == hash && slot.str.size() == size && memcmp(slot.str.data(), data, size) == 0) {
+      return slot.str;
+    }
+  }
+}
+
+void metrics::StringInterner::reset() {
+  chunk_idx = 0;
+  chunk_used = 0;
+  oversize.clear();
+  count = 0;
+  ++generation;
+}
+
+char* metrics::StringInterner::allocate(size_t size) {
+  if (size > chunk_size / 4) {
+    // don't waste the remainder of a chunk on a rare large string
+    oversize.emplace_back(new char[size]);
+    return oversize.back().get();
+  }
+  if (chunk_used + size > chunk_size || chunks.empty()) {
+    if (!chunks.empty()) {
+      ++chunk_idx;
+    }
+    if (chunk_idx == chunks.size()) {
+      chunks.emplace_back(new char[chunk_size]);
+    }
+    chunk_used = 0;
+  }
+  char* ret = chunks[chunk_idx].get() + chunk_used;
+  chunk_used += size;
+  return ret;
+}
+
+void metrics::StringInterner::grow_table() {
+  std::vector<Slot> old_table(table.size() * 2);
+  old_table.swap(table);
+  size_t mask = table.size() - 1;
+  for (const Slot& old_slot : old_table) {
+    if (old_slot.generation != generation) {
+      continue;
+    }
+    size_t idx = old_slot.hash & mask;
+    while (table[idx].generation == generation) {
+      idx = (idx + 1) & mask;
+    }
+    table[idx] = old_slot;
+  }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace metrics {
+
+  /**
+   * A reference to a string held by a StringInterner. Only valid until the StringInterner is
+   * reset() or destroyed.
+   */
+  class InternedString {
+   public:
+    InternedString()
+      : ptr(""), len(0) { }
+    InternedString(const char* data, size_t size)
+      : ptr(data), len(size) { }
+
+    const char* data() const {
+      return ptr;
+    }
+    size_t size() const {
+      return len;
+    }
+    bool empty() const {
+      return len == 0;
+    }
+    std::string str() const {
+      return std::string(ptr, len);
+    }
+
+   private:
+    const char* ptr;
+    size_t len;
+  };
+
+  bool operator==(const InternedString& a, const InternedString& b);
+  bool operator==(const InternedString& a, const std::string& b);
+  inline bool operator==(const std::string& a, const InternedString& b) {
+    return b == a;
+  }
+  inline bool operator!=(const InternedString& a, const InternedString& b) {
+    return !(a == b);
+  }
+  inline bool operator!=(const InternedString& a, const std::string& b) {
+    return !(a == b);
+  }
+  inline bool operator!=(const std::string& a, const InternedString& b) {
+    return !(b == a);
+  }
+  std::ostream& operator<<(std::ostream& out, const InternedString& str);
+
+  /**
+   * Holds a single copy of each distinct string added via intern(), for building a batch of
+   * metrics without a heap allocation per string. Strings are packed into large chunks which are
+   * kept across reset()s, and the lookup table is invalidated by bumping a generation counter, so
+   * releasing a batch doesn't depend on how many strings it had.
+   */
+  class StringInterner {
+   public:
+    explicit StringInterner(size_t chunk_size = 64 * 1024);
+
+    /**
+     * Returns a reference to an interned copy of the provided string, adding it if needed.
+     */
+    InternedString intern(const char* data, size_t size);
+    InternedString intern(const std::string& str) {
+      return intern(str.data(), str.size());
+    }
+
+    /**
+     * Returns the number of distinct strings currently held.
+     */
+    size_t size() const {
+      return count;
+    }
+
+    /**
+     * Invalidates all InternedStrings returned so far, keeping allocated chunks for reuse.
+     */
+    void reset();
+
+   private:
+    struct Slot {
+      Slot()
+        : hash(0), generation(0) { }
+
+      InternedString str;
+      uint64_t hash;
+      uint64_t generation;
+    };
+
+    char* allocate(size_t size);
+    void grow_table();
+
+    const size_t chunk_size;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunk_idx, chunk_used;
+    // strings which didn't fit in a chunk: freed on reset()
+    std::vector<std::unique_ptr<char[]>> oversize;
+
+    std::vector<Slot> table;
+    size_t count;
+    uint64_t generation;
+  };
+}
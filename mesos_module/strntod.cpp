@@ -0,0 +1,112 @@
+#include "strntod.h"
+
+#include <errno.h>
+#include <locale.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace {
+  /**
+   * Every power of ten which is exactly representable as a double.
+   */
+  const double EXACT_POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  const size_t EXACT_POW10_MAX = sizeof(EXACT_POW10) / sizeof(EXACT_POW10[0]) - 1;
+
+  /**
+   * The largest integer below which every integer is exactly representable as a double.
+   */
+  const uint64_t EXACT_MANTISSA_MAX = 1ULL << 53;
+
+  /**
+   * Values shorter than this are copied to the stack for strtod().
+   */
+  const size_t STACK_BUF_SIZE = 64;
+
+  locale_t c_locale() {
+    static locale_t locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+    return locale;
+  }
+
+  inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  /**
+   * Handles plain decimal values ("[+-]digits[.digits]") spanning all of 'str', which covers
+   * nearly all statsd values. When the digits fit in a double's mantissa and the number of
+   * fractional digits is within the exactly representable powers of ten, a single IEEE division
+   * gives the correctly rounded result, which is exactly what strtod() returns (Clinger's fast
+   * path). Returns false if the value needs the full parser.
+   */
+  bool parse_simple(const char* str, size_t size, double* out) {
+    const char* pos = str;
+    const char* end = str + size;
+    bool negative = false;
+    if (pos != end && (*pos == '-' || *pos == '+')) {
+      negative = (*pos == '-');
+      ++pos;
+    }
+
+    uint64_t mantissa = 0;
+    size_t digits = 0;
+    for (; pos != end && is_digit(*pos); ++pos, ++digits) {
+      mantissa = mantissa * 10 + (*pos - '0');
+      if (mantissa >= EXACT_MANTISSA_MAX) {
+        return false;
+      }
+    }
+    size_t frac_digits = 0;
+    if (pos != end && *pos == '.') {
+      ++pos;
+      for (; pos != end && is_digit(*pos); ++pos, ++frac_digits) {
+        mantissa = mantissa * 10 + (*pos - '0');
+        if (mantissa >= EXACT_MANTISSA_MAX) {
+          return false;
+        }
+      }
+    }
+    if (pos != end || digits + frac_digits == 0 || frac_digits > EXACT_POW10_MAX) {
+      // trailing data (eg exponent, hex, garbage), no digits, or too precise
+      return false;
+    }
+
+    double val = (double)mantissa / EXACT_POW10[frac_digits];
+    *out = negative ? -val : val;
+    return true;
+  }
+
+  bool parse_strtod(const char* str, size_t size, double* out) {
+    // strtod() requires a \0-terminated string. Avoid allocating for anything of a sane length.
+    char stack_buf[STACK_BUF_SIZE];
+    std::string heap_buf;
+    const char* cstr;
+    if (size < STACK_BUF_SIZE) {
+      memcpy(stack_buf, str, size);
+      stack_buf[size] = '\0';
+      cstr = stack_buf;
+    } else {
+      heap_buf.assign(str, size);
+      cstr = heap_buf.c_str();
+    }
+
+    int saved_errno = errno;
+    errno = 0;
+    char* parse_end;
+    double val = strtod_l(cstr, &parse_end, c_locale());
+    bool valid = (parse_end != cstr && errno != ERANGE);
+    errno = saved_errno;
+
+    if (valid) {
+      *out = val;
+    }
+    return valid;
+  }
+}
+
+bool strntod(const char* str, size_t size, double* out) {
+  return parse_simple(str, size, out) || parse_strtod(str, size, out);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Parses a double from the start of 'str', reading at most 'size' bytes (\0 not required).
+ * Produces the same result as std::stod() against the same bytes in the "C" locale: leading
+ * whitespace is skipped, and parsing stops at the first character which isn't part of the number.
+ * The decimal point is always '.', regardless of the current locale.
+ * Returns false if no number was found or if the value was out of range, leaving 'out' unchanged.
+ */
+extern bool strntod(const char* str, size_t size, double* out);
@@ -0,0 +1,125 @@
+#include <chrono>
+#include <random>
+#include <sstream>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "avro_codec.hpp"
+#include "avro_encoder.hpp"
+#include "byte_buffer.hpp"
+
+/**
+ * Compares compression ratio against CPU cost for each collector codec and level, against blocks
+ * built from statsd traffic resembling what a busy agent would see: several containers emitting
+ * counters, gauges and timers with a limited set of names, some of them with datadog tags.
+ * Not run as part of the unit tests: timings depend heavily on the host.
+ */
+
+namespace {
+  const size_t CONTAINER_COUNT = 8;
+  const size_t BLOCK_COUNT = 50;
+  const size_t MIN_BENCH_MS = 500;
+
+  const std::string METRIC_NAMES[] = {
+    "http.requests.count", "http.requests.errors", "http.response_time",
+    "jvm.heap.used", "jvm.heap.committed", "jvm.gc.pause", "db.pool.active",
+    "db.query.latency", "cache.hits", "cache.misses", "queue.depth", "queue.consumer.lag" };
+  const std::string METRIC_TYPES[] = { "c", "c", "ms", "g", "g", "ms", "g", "ms", "c", "c", "g", "g" };
+  const size_t METRIC_NAME_COUNT = sizeof(METRIC_NAMES) / sizeof(METRIC_NAMES[0]);
+
+  /**
+   * Returns a series of metric maps, each holding 'datapoints' datapoints (ie one chunk).
+   */
+  std::vector<metrics::avro_metrics_map_t> build_blocks(size_t datapoints) {
+    std::mt19937 rand(datapoints);
+    std::vector<mesos::ContainerID> cids(CONTAINER_COUNT);
+    std::vector<mesos::ExecutorInfo> eis(CONTAINER_COUNT);
+    for (size_t i = 0; i < CONTAINER_COUNT; ++i) {
+      cids[i].set_value("9f1e3d5b-7a2c-11e6-8b4d-0242ac11000" + std::to_string(i));
+      eis[i].mutable_framework_id()->set_value("5c8f2a3e-1d4b-4f6a-9e7c-0b2d4f6a8c0e-0001");
+      eis[i].mutable_executor_id()->set_value("app-" + std::to_string(i) + ".7a2c11e6");
+    }
+
+    std::vector<metrics::avro_metrics_map_t> blocks(BLOCK_COUNT);
+    for (metrics::avro_metrics_map_t& map : blocks) {
+      for (size_t i = 0; i < datapoints; ++i) {
+        size_t container = rand() % CONTAINER_COUNT;
+        size_t metric = rand() % METRIC_NAME_COUNT;
+        std::ostringstream oss;
+        oss << METRIC_NAMES[metric] << ":";
+        if (METRIC_TYPES[metric] == "c") {
+          oss << (rand() % 10 + 1);
+        } else {
+          oss << (rand() % 100000) / 100.;
+        }
+        oss << "|" << METRIC_TYPES[metric];
+        if (rand() % 4 == 0) {
+          oss << "|#endpoint:/api/v1/resource" << (rand() % 5) << ",status:" << (200 + rand() % 3);
+        }
+        std::string line = oss.str();
+        metrics::AvroEncoder::statsd_to_map(
+            &cids[container], &eis[container], line.data(), line.size(), map);
+      }
+    }
+    return blocks;
+  }
+
+  void run_bench(const std::vector<metrics::avro_metrics_map_t>& blocks, size_t datapoints,
+      const std::string& codec_name, size_t level) {
+    Try<std::shared_ptr<metrics::AvroCodec>> codec = metrics::AvroCodec::create(codec_name, level);
+    ASSERT_FALSE(codec.isError()) << codec.error();
+
+    size_t raw_bytes = 0;
+    metrics::ByteBuffer buf;
+    for (const metrics::avro_metrics_map_t& map : blocks) {
+      metrics::AvroEncoder::encode_metrics_block(map, buf);
+      raw_bytes += buf.size();
+    }
+
+    size_t encoded_blocks = 0, encoded_bytes = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed;
+    do {
+      for (const metrics::avro_metrics_map_t& map : blocks) {
+        metrics::AvroEncoder::encode_metrics_block(map, buf, codec.get().get());
+        encoded_bytes += buf.size();
+      }
+      encoded_blocks += blocks.size();
+      elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(MIN_BENCH_MS));
+
+    size_t passes = encoded_blocks / blocks.size();
+    printf("BENCH %-10s level=%-2zu datapoints=%-5zu raw=%7zuB/block out=%7zuB/block"
+        " ratio=%5.2fx %8.1f us/block\n",
+        codec_name.c_str(), level, datapoints, raw_bytes / blocks.size(),
+        encoded_bytes / encoded_blocks, (double)raw_bytes * passes / encoded_bytes,
+        1e6 * elapsed.count() / encoded_blocks);
+  }
+
+  void run_all_codecs(size_t datapoints) {
+    const std::vector<metrics::avro_metrics_map_t> blocks = build_blocks(datapoints);
+    run_bench(blocks, datapoints, metrics::AvroCodec::NULL_CODEC, 0);
+    for (size_t level : { 1, 6, 9 }) {
+      run_bench(blocks, datapoints, metrics::AvroCodec::DEFLATE_CODEC, level);
+    }
+  }
+}
+
+TEST(AvroCodecBench, chunk_100) {
+  run_all_codecs(100);
+}
+
+TEST(AvroCodecBench, chunk_1k) {
+  run_all_codecs(1000);
+}
+
+TEST(AvroCodecBench, chunk_10k) {
+  run_all_codecs(10000);
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
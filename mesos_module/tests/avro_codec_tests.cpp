@@ -0,0 +1,158 @@
+#include <string.h>
+#include <zlib.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "avro_codec.hpp"
+#include "avro_encoder.hpp"
+#include "byte_buffer.hpp"
+
+namespace {
+  std::string str(const metrics::ByteBuffer& buf) {
+    return std::string(buf.data(), buf.size());
+  }
+
+  std::string inflate_raw(const std::string& in, size_t max_out_size) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    EXPECT_EQ(Z_OK, inflateInit2(&stream, -15));
+    std::string out(max_out_size + 1, '\0');
+    stream.next_in = (Bytef*)in.data();
+    stream.avail_in = in.size();
+    stream.next_out = (Bytef*)&out[0];
+    stream.avail_out = out.size();
+    EXPECT_EQ(Z_STREAM_END, inflate(&stream, Z_FINISH));
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    return out;
+  }
+
+  int64_t decode_long(const std::string& data, size_t& pos) {
+    uint64_t n = 0;
+    for (size_t shift = 0; pos < data.size(); shift += 7) {
+      uint8_t b = data[pos++];
+      n |= (uint64_t)(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) {
+        break;
+      }
+    }
+    return (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+  }
+
+  metrics::avro_metrics_map_t build_map() {
+    metrics::avro_metrics_map_t map;
+    mesos::ContainerID cid;
+    cid.set_value("cid");
+    mesos::ExecutorInfo ei;
+    ei.mutable_framework_id()->set_value("fid");
+    ei.mutable_executor_id()->set_value("eid");
+    for (size_t i = 0; i < 200; ++i) {
+      std::string line = "some.repetitive.metric.name." + std::to_string(i % 10) + ":1|c";
+      metrics::AvroEncoder::statsd_to_map(&cid, &ei, line.data(), line.size(), map);
+    }
+    std::string tagged("tagged.metric:2|g|#tag1:val1,tag2:val2");
+    metrics::AvroEncoder::statsd_to_map(&cid, &ei, tagged.data(), tagged.size(), map);
+    return map;
+  }
+}
+
+TEST(AvroCodecTests, create_null) {
+  Try<std::shared_ptr<metrics::AvroCodec>> codec =
+    metrics::AvroCodec::create(metrics::AvroCodec::NULL_CODEC, 0);
+  ASSERT_FALSE(codec.isError()) << codec.error();
+  EXPECT_FALSE((bool)codec.get());
+}
+
+TEST(AvroCodecTests, create_errors) {
+  EXPECT_TRUE(metrics::AvroCodec::create("lzma", 0).isError());
+  EXPECT_TRUE(metrics::AvroCodec::create("", 0).isError());
+  EXPECT_TRUE(metrics::AvroCodec::create(metrics::AvroCodec::DEFLATE_CODEC, 10).isError());
+  // not supported by the collector's avro reader
+  EXPECT_TRUE(metrics::AvroCodec::create("zstandard", 0).isError());
+}
+
+TEST(AvroCodecTests, deflate_round_trip) {
+  for (size_t level = 0; level <= 9; ++level) {
+    Try<std::shared_ptr<metrics::AvroCodec>> codec =
+      metrics::AvroCodec::create(metrics::AvroCodec::DEFLATE_CODEC, level);
+    ASSERT_FALSE(codec.isError()) << codec.error();
+    ASSERT_TRUE((bool)codec.get());
+    EXPECT_EQ(metrics::AvroCodec::DEFLATE_CODEC, codec.get()->name());
+
+    // Compress a few different blocks with the same codec to exercise reuse.
+    for (size_t size : { 0, 1, 100, 100000 }) {
+      std::string data;
+      for (size_t i = 0; i < size; ++i) {
+        data.push_back("metric.name:1|c\n"[i % 16]);
+      }
+      metrics::ByteBuffer buf;
+      buf.append(data.data(), data.size());
+      ASSERT_TRUE(codec.get()->compress(buf, 20));
+      if (size >= 100) {
+        EXPECT_LT(buf.size(), data.size());
+      }
+      EXPECT_EQ(data, inflate_raw(str(buf), data.size()));
+
+      // headroom was reserved:
+      const char* data_before = buf.data();
+      buf.prepend("hdr", 3);
+      EXPECT_EQ(data_before, buf.data() + 3);
+    }
+  }
+}
+
+TEST(AvroCodecTests, header_advertises_codec) {
+  const std::string null_header = metrics::AvroEncoder::header();
+  EXPECT_EQ(null_header, metrics::AvroEncoder::header(metrics::AvroCodec::NULL_CODEC));
+  EXPECT_NE(std::string::npos, null_header.find("avro.codec\x08null"));
+
+  const std::string deflate_header =
+    metrics::AvroEncoder::header(metrics::AvroCodec::DEFLATE_CODEC);
+  EXPECT_NE(std::string::npos, deflate_header.find("avro.codec\x0e" "deflate"));
+  EXPECT_EQ(std::string::npos, deflate_header.find("avro.codec\x08null"));
+}
+
+TEST(AvroCodecTests, encode_deflate_block) {
+  const metrics::avro_metrics_map_t map = build_map();
+
+  metrics::ByteBuffer null_buf;
+  metrics::AvroEncoder::encode_metrics_block(map, null_buf);
+  const std::string null_block = str(null_buf);
+
+  Try<std::shared_ptr<metrics::AvroCodec>> codec =
+    metrics::AvroCodec::create(metrics::AvroCodec::DEFLATE_CODEC, 0);
+  ASSERT_FALSE(codec.isError()) << codec.error();
+  metrics::ByteBuffer deflate_buf;
+  metrics::AvroEncoder::encode_metrics_block(map, deflate_buf, codec.get().get());
+  const std::string deflate_block = str(deflate_buf);
+  EXPECT_LT(deflate_block.size(), null_block.size() / 4);
+
+  // null block: [count][size][data][sync]
+  size_t null_pos = 0;
+  int64_t null_count = decode_long(null_block, null_pos);
+  int64_t null_size = decode_long(null_block, null_pos);
+  ASSERT_EQ(null_block.size(), null_pos + null_size + 16);
+
+  // deflate block: [count][compressed size][compressed data][sync]
+  size_t deflate_pos = 0;
+  EXPECT_EQ(null_count, decode_long(deflate_block, deflate_pos));
+  int64_t deflate_size = decode_long(deflate_block, deflate_pos);
+  ASSERT_EQ(deflate_block.size(), deflate_pos + deflate_size + 16);
+  EXPECT_EQ(null_block.substr(null_pos, null_size),
+      inflate_raw(deflate_block.substr(deflate_pos, deflate_size), null_size));
+  // same sync bytes:
+  EXPECT_EQ(null_block.substr(null_block.size() - 16),
+      deflate_block.substr(deflate_block.size() - 16));
+
+  // nothing to encode: nothing compressed
+  metrics::AvroEncoder::encode_metrics_block(
+      metrics::avro_metrics_map_t(), deflate_buf, codec.get().get());
+  EXPECT_TRUE(deflate_buf.empty());
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -4,8 +4,11 @@
 #include <avro/Compiler.hh>
 #include <avro/DataFile.hh>
 
+#include "avro_codec.hpp"
 #include "avro_encoder.hpp"
+#include "byte_buffer.hpp"
 #include "metrics_schema_json.hpp"
+#include "metrics_schema_struct.hpp"
 
 namespace {
   const std::string UNKNOWN("unknown_container");
@@ -40,22 +43,42 @@ namespace {
     return ret;
   }
 
+  /**
+   * Returns a copy of the provided list whose strings are held by the provided map.
+   */
+  metrics::MetricList to_list(
+      metrics::avro_metrics_map_t& map, const metrics_schema::MetricList& list) {
+    metrics::MetricList ret;
+    ret.topic = map.strings.intern(list.topic);
+    for (const metrics_schema::Tag& tag : list.tags) {
+      ret.tags.emplace_back();
+      ret.tags.back().key = map.strings.intern(tag.key);
+      ret.tags.back().value = map.strings.intern(tag.value);
+    }
+    for (const metrics_schema::Datapoint& d : list.datapoints) {
+      ret.datapoints.emplace_back();
+      ret.datapoints.back().name = map.strings.intern(d.name);
+      ret.datapoints.back().time_ms = d.time_ms;
+      ret.datapoints.back().value = d.value;
+    }
+    return ret;
+  }
   inline metrics::avro_metrics_map_t to_map(
       const metrics_schema::MetricList& list) {
     metrics::avro_metrics_map_t map;
-    map[container_id(list.topic)].without_custom_tags = list;
+    map[container_id(list.topic)].without_custom_tags = to_list(map, list);
     return map;
   }
-  inline metrics::avro_metrics_map_t merge(
-      const metrics::avro_metrics_map_t& a,
-      const metrics::avro_metrics_map_t& b) {
-    metrics::avro_metrics_map_t ret;
-    ret.insert(a.begin(), a.end());
-    ret.insert(b.begin(), b.end());
-    return ret;
+  inline metrics::avro_metrics_map_t to_map(
+      const metrics_schema::MetricList& a,
+      const metrics_schema::MetricList& b) {
+    metrics::avro_metrics_map_t map;
+    map[container_id(a.topic)].without_custom_tags = to_list(map, a);
+    map[container_id(b.topic)].without_custom_tags = to_list(map, b);
+    return map;
   }
 
-  bool check_datapoint(const metrics_schema::MetricList& list,
+  bool check_datapoint(const metrics::MetricList& list,
       double val, const std::string& name) {
     if (list.topic != UNKNOWN) {
       LOG(INFO) << "expected topic " << UNKNOWN << ", got " << list.topic;
@@ -130,7 +153,7 @@ namespace {
       return false;
     }
 
-    const metrics_schema::MetricList& list = cm.with_custom_tags.back();
+    const metrics::MetricList& list = cm.with_custom_tags.back();
     if (!check_datapoint(list, val, name)) {
       return false;
     }
@@ -141,7 +164,7 @@ namespace {
     }
     for (size_t i = 0; i < tags.size(); ++i) {
       const tag_t& expect_tag = tags[i];
-      const metrics_schema::Tag& got_tag = list.tags[i];
+      const metrics::Tag& got_tag = list.tags[i];
       if (expect_tag.first != got_tag.key) {
         LOG(INFO) << "for tag " << i << ", "
                   << "expected key " << expect_tag.first << " (size " << expect_tag.first.size()
@@ -172,7 +195,7 @@ namespace {
       return false;
     }
 
-    const metrics_schema::MetricList& list = cm.without_custom_tags;
+    const metrics::MetricList& list = cm.without_custom_tags;
     if (!check_datapoint(list, val, name)) {
       return false;
     }
@@ -185,16 +208,20 @@ namespace {
   }
 
 
-  bool eq(const std::string& key, const std::string& val, const metrics_schema::Tag& tag) {
+  bool eq(const std::string& key, const std::string& val, const metrics::Tag& tag) {
     return key == tag.key && val == tag.value;
   }
-  bool eq(const std::string& name, double val, const metrics_schema::Datapoint& d) {
+  bool eq(const std::string& name, double val, const metrics::Datapoint& d) {
     return name == d.name && val == d.value;
   }
-  bool eq(const std::string& name, double val, int64_t time_ms, const metrics_schema::Datapoint& d) {
+  bool eq(const std::string& name, double val, int64_t time_ms, const metrics::Datapoint& d) {
     return eq(name, val, d) && time_ms == d.time_ms;
   }
-  bool eq(const metrics_schema::MetricList& a, const metrics_schema::MetricList& b) {
+  /**
+   * Compares MetricLists of either metrics::MetricList or metrics_schema::MetricList.
+   */
+  template <typename ListA, typename ListB>
+  bool eq(const ListA& a, const ListB& b) {
     if (a.topic != b.topic) {
       LOG(INFO) << "topic " << a.topic << " != " << b.topic;
       return false;
@@ -234,14 +261,14 @@ namespace {
     return true;
   }
 
-  void print_schema(const metrics_schema::MetricList& m) {
+  void print_schema(const metrics::MetricList& m) {
     LOG(INFO) << "topic " << m.topic;
     LOG(INFO) << "tags: ";
-    for (const metrics_schema::Tag& t : m.tags) {
+    for (const metrics::Tag& t : m.tags) {
       LOG(INFO) << "  " << t.key << "=" << t.value;
     }
     LOG(INFO) << "points: ";
-    for (const metrics_schema::Datapoint& d : m.datapoints) {
+    for (const metrics::Datapoint& d : m.datapoints) {
       LOG(INFO) << "  " << d.name << "=" << d.value << " @ " << d.time_ms;
     }
   }
@@ -294,7 +321,7 @@ TEST_F(AvroEncoderTests, header) {
 
 TEST_F(AvroEncoderTests, encode_empty_metrics) {
   metrics::avro_metrics_map_t map;
-  map[container_id("hello")].without_custom_tags = metrics_schema::MetricList();
+  map[container_id("hello")].without_custom_tags = metrics::MetricList();
   std::ostringstream oss;
   metrics::AvroEncoder::encode_metrics_block(map, oss);
   EXPECT_EQ(0, oss.str().size());
@@ -370,25 +397,99 @@ TEST_F(AvroEncoderTests, encode_one_metric_list) {
   EXPECT_FALSE(avro_reader.read(flist));
 }
 
+TEST_F(AvroEncoderTests, encode_reused_buffer) {
+  metrics_schema::MetricList small = metric_list("small");
+  small.datapoints.push_back(datapoint("pt1", 5, 3.8));
+
+  // large enough for multi-byte block header values
+  metrics_schema::MetricList large = metric_list("large");
+  for (size_t i = 0; i < 1000; ++i) {
+    large.datapoints.push_back(datapoint("pt" + std::to_string(i), i, i * 1.5));
+  }
+  large.tags.push_back(tag("k1", "v1"));
+
+  metrics::ByteBuffer buf;
+  metrics::AvroEncoder::encode_metrics_block(to_map(small), buf);
+  {
+    std::ostringstream oss;
+    metrics::AvroEncoder::encode_metrics_block(to_map(small), oss);
+    EXPECT_EQ(oss.str(), std::string(buf.data(), buf.size()));
+  }
+
+  metrics::AvroEncoder::encode_metrics_block(metrics::avro_metrics_map_t(), buf);
+  EXPECT_TRUE(buf.empty());
+
+  std::string tmppath = write_tmp();
+  {
+    std::ofstream ofs(tmppath, std::ios::binary);
+    ofs << metrics::AvroEncoder::header(); // actual file must start with header
+    metrics::AvroEncoder::encode_metrics_block(to_map(large), buf);
+    ofs.write(buf.data(), buf.size());
+    metrics::AvroEncoder::encode_metrics_block(to_map(small), buf);
+    ofs.write(buf.data(), buf.size());
+  }
+
+  avro::DataFileReader<metrics_schema::MetricList> avro_reader(tmppath.data());
+  metrics_schema::MetricList flist;
+  EXPECT_TRUE(avro_reader.read(flist));
+  EXPECT_TRUE(eq(large, flist));
+  EXPECT_TRUE(avro_reader.read(flist));
+  EXPECT_TRUE(eq(small, flist));
+  EXPECT_FALSE(avro_reader.read(flist));
+}
+
+TEST_F(AvroEncoderTests, encode_deflate_blocks) {
+  metrics_schema::MetricList lista = metric_list("lista");
+  metrics_schema::MetricList listb = metric_list("listb");
+  for (size_t i = 0; i < 100; ++i) {
+    lista.datapoints.push_back(datapoint("repeated.name", i, i * 1.5));
+    listb.datapoints.push_back(datapoint("other.repeated.name", i, i * 2.5));
+  }
+  listb.tags.push_back(tag("k1", "v1"));
+
+  Try<std::shared_ptr<metrics::AvroCodec>> codec =
+    metrics::AvroCodec::create(metrics::AvroCodec::DEFLATE_CODEC, 0);
+  ASSERT_FALSE(codec.isError()) << codec.error();
+
+  std::string tmppath = write_tmp();
+  {
+    std::ofstream ofs(tmppath, std::ios::binary);
+    ofs << metrics::AvroEncoder::header(metrics::AvroCodec::DEFLATE_CODEC);
+    metrics::ByteBuffer buf;
+    metrics::AvroEncoder::encode_metrics_block(to_map(lista), buf, codec.get().get());
+    ofs.write(buf.data(), buf.size());
+    metrics::AvroEncoder::encode_metrics_block(to_map(listb), buf, codec.get().get());
+    ofs.write(buf.data(), buf.size());
+  }
+
+  avro::DataFileReader<metrics_schema::MetricList> avro_reader(tmppath.data());
+  metrics_schema::MetricList flist;
+  EXPECT_TRUE(avro_reader.read(flist));
+  EXPECT_TRUE(eq(lista, flist));
+  EXPECT_TRUE(avro_reader.read(flist));
+  EXPECT_TRUE(eq(listb, flist));
+  EXPECT_FALSE(avro_reader.read(flist));
+}
+
 TEST_F(AvroEncoderTests, encode_many_metrics) {
   metrics::avro_metrics_map_t map;
-  map[container_id("empty")].without_custom_tags = metric_list("empty_topic");
+  map[container_id("empty")].without_custom_tags = to_list(map, metric_list("empty_topic"));
 
   metrics_schema::MetricList list = metric_list("one_metric");
   list.datapoints.push_back(datapoint("pt1", 5, 3.8));
-  map[container_id("one")].without_custom_tags = list;
+  map[container_id("one")].without_custom_tags = to_list(map, list);
 
   list = metric_list("tags_only");
   list.tags.push_back(tag("k1", "v1"));
   list.tags.push_back(tag("k2", "v2"));
   list.tags.push_back(tag("k3", "v3"));
-  map[container_id("tags")].without_custom_tags = list;
+  map[container_id("tags")].without_custom_tags = to_list(map, list);
 
   list = metric_list("many_metrics");
   list.datapoints.push_back(datapoint("pt1", 5, 3.8));
   list.datapoints.push_back(datapoint("pt2", 5, 3.8));
   list.datapoints.push_back(datapoint("pt3", 5, 3.8));
-  map[container_id("many")].without_custom_tags = list;
+  map[container_id("many")].without_custom_tags = to_list(map, list);
 
   list = metric_list("zzztagged_metrics");
   list.datapoints.push_back(datapoint("pt1", 5, 3.8));
@@ -397,7 +498,7 @@ TEST_F(AvroEncoderTests, encode_many_metrics) {
   list.tags.push_back(tag("k1", "v1"));
   list.tags.push_back(tag("k2", "v2"));
   list.tags.push_back(tag("k3", "v3"));
-  map[container_id("many_tagged")].without_custom_tags = list;
+  map[container_id("many_tagged")].without_custom_tags = to_list(map, list);
 
   list = metric_list("tagged_container_stats");
   list.datapoints.push_back(datapoint("cpt1", 5, 3.8));
@@ -406,7 +507,7 @@ TEST_F(AvroEncoderTests, encode_many_metrics) {
   list.tags.push_back(tag("ck1", "v1"));
   list.tags.push_back(tag("ck2", "v2"));
   list.tags.push_back(tag("ck3", "v3"));
-  map[container_id("more_tagged")].without_custom_tags = list;
+  map[container_id("more_tagged")].without_custom_tags = to_list(map, list);
 
   {
     std::ostringstream oss;
@@ -484,13 +585,13 @@ TEST_F(AvroEncoderTests, encode_many_blocks) {
   {
     std::ofstream ofs(tmppath, std::ios::binary);
     ofs << metrics::AvroEncoder::header(); // actual file must start with header
-    metrics::AvroEncoder::encode_metrics_block(merge(to_map(empty),to_map(topic)), ofs);
+    metrics::AvroEncoder::encode_metrics_block(to_map(empty, topic), ofs);
     metrics::AvroEncoder::encode_metrics_block(to_map(one), ofs);
     metrics::AvroEncoder::encode_metrics_block(metrics::avro_metrics_map_t(), ofs);
     metrics::AvroEncoder::encode_metrics_block(to_map(tags), ofs);
     metrics::AvroEncoder::encode_metrics_block(to_map(empty), ofs);
     metrics::AvroEncoder::encode_metrics_block(to_map(untagged), ofs);
-    metrics::AvroEncoder::encode_metrics_block(merge(to_map(taggeda),to_map(taggedb)), ofs);
+    metrics::AvroEncoder::encode_metrics_block(to_map(taggeda, taggedb), ofs);
     metrics::AvroEncoder::encode_metrics_block(to_map(taggedc), ofs);
   }
 
@@ -518,7 +619,7 @@ TEST_F(AvroEncoderTests, map_no_info) {
   metrics::avro_metrics_map_t map;
   metrics::AvroEncoder::statsd_to_map(NULL, NULL, "hello", 5, map);
   EXPECT_EQ(1, map.size());
-  const metrics_schema::MetricList& list = map[container_id(UNKNOWN)].without_custom_tags;
+  const metrics::MetricList& list = map[container_id(UNKNOWN)].without_custom_tags;
   EXPECT_EQ(UNKNOWN, list.topic);
   EXPECT_EQ(1, list.datapoints.size());
   EXPECT_EQ("hello", list.datapoints[0].name);
@@ -533,7 +634,7 @@ TEST_F(AvroEncoderTests, map_with_info) {
   metrics::avro_metrics_map_t map;
   metrics::AvroEncoder::statsd_to_map(&cid, &einfo, "hello", 5, map);
   EXPECT_EQ(1, map.size());
-  const metrics_schema::MetricList& list = map[container_id("cid")].without_custom_tags;
+  const metrics::MetricList& list = map[container_id("cid")].without_custom_tags;
   EXPECT_EQ("fid", list.topic);
   EXPECT_EQ(1, list.datapoints.size());
   EXPECT_EQ("hello", list.datapoints[0].name);
@@ -549,17 +650,17 @@ TEST_F(AvroEncoderTests, statsd_merge) {
   mesos::ContainerID cid = container_id("cid");
 
   metrics::avro_metrics_map_t map;
-  metrics_schema::MetricList& preinit_list = map[cid].without_custom_tags;
-  preinit_list.topic = "testt";
-  metrics_schema::Tag tag;
-  tag.key = "testk";
-  tag.value = "valuek";
+  metrics::MetricList& preinit_list = map[cid].without_custom_tags;
+  preinit_list.topic = map.strings.intern("testt");
+  metrics::Tag tag;
+  tag.key = map.strings.intern("testk");
+  tag.value = map.strings.intern("valuek");
   preinit_list.tags.push_back(tag);
-  tag.key = "container_id";
-  tag.value = "testc";
+  tag.key = map.strings.intern("container_id");
+  tag.value = map.strings.intern("testc");
   preinit_list.tags.push_back(tag);
-  metrics_schema::Datapoint d;
-  d.name = "testn";
+  metrics::Datapoint d;
+  d.name = map.strings.intern("testn");
   d.value = 10.3;
   d.time_ms = 123;
   preinit_list.datapoints.push_back(d);
@@ -664,7 +765,7 @@ TEST_F(AvroEncoderTests, statsd_parse_mixed_vals) {
   // UNKNOWN
 
   metrics::ContainerMetrics& cm = map[container_id(UNKNOWN)];
-  metrics_schema::MetricList& list = cm.without_custom_tags;
+  metrics::MetricList& list = cm.without_custom_tags;
   EXPECT_EQ(UNKNOWN, list.topic);
   EXPECT_EQ(0, list.tags.size());
   EXPECT_EQ(3, list.datapoints.size());
@@ -672,26 +773,21 @@ TEST_F(AvroEncoderTests, statsd_parse_mixed_vals) {
   EXPECT_TRUE(eq("v2", 2, list.datapoints[1]));
   EXPECT_TRUE(eq("v3", 3, list.datapoints[2]));
 
-  EXPECT_EQ(4, cm.with_custom_tags.size());
+  EXPECT_EQ(3, cm.with_custom_tags.size()); // ta:va lists merged
   list = cm.with_custom_tags[0];
   EXPECT_EQ(UNKNOWN, list.topic);
   EXPECT_EQ(1, list.tags.size());
   EXPECT_TRUE(eq("ta", "va", list.tags[0]));
-  EXPECT_EQ(1, list.datapoints.size());
+  EXPECT_EQ(2, list.datapoints.size());
   EXPECT_TRUE(eq("v10", 10, list.datapoints[0]));
+  EXPECT_TRUE(eq("v11", 11, list.datapoints[1]));
   list = cm.with_custom_tags[1];
   EXPECT_EQ(UNKNOWN, list.topic);
   EXPECT_EQ(1, list.tags.size());
-  EXPECT_TRUE(eq("ta", "va", list.tags[0]));
-  EXPECT_EQ(1, list.datapoints.size());
-  EXPECT_TRUE(eq("v11", 11, list.datapoints[0]));
-  list = cm.with_custom_tags[2];
-  EXPECT_EQ(UNKNOWN, list.topic);
-  EXPECT_EQ(1, list.tags.size());
   EXPECT_TRUE(eq("tb", "vb", list.tags[0]));
   EXPECT_EQ(1, list.datapoints.size());
   EXPECT_TRUE(eq("v12", 12, list.datapoints[0]));
-  list = cm.with_custom_tags[3];
+  list = cm.with_custom_tags[2];
   EXPECT_EQ(UNKNOWN, list.topic);
   EXPECT_EQ(2, list.tags.size());
   EXPECT_TRUE(eq("tb", "vb", list.tags[0]));
@@ -713,7 +809,7 @@ TEST_F(AvroEncoderTests, statsd_parse_mixed_vals) {
   EXPECT_TRUE(eq("v2", 2, list.datapoints[1]));
   EXPECT_TRUE(eq("v3", 3, list.datapoints[2]));
 
-  EXPECT_EQ(4, cm.with_custom_tags.size());
+  EXPECT_EQ(3, cm.with_custom_tags.size()); // ta:va lists merged
   list = cm.with_custom_tags[0];
   EXPECT_EQ("fid1", list.topic);
   EXPECT_EQ(4, list.tags.size());
@@ -721,27 +817,19 @@ TEST_F(AvroEncoderTests, statsd_parse_mixed_vals) {
   EXPECT_TRUE(eq("executor_id", "eid1", list.tags[1]));
   EXPECT_TRUE(eq("container_id", "cid1", list.tags[2]));
   EXPECT_TRUE(eq("ta", "va", list.tags[3]));
-  EXPECT_EQ(1, list.datapoints.size());
+  EXPECT_EQ(2, list.datapoints.size());
   EXPECT_TRUE(eq("v10", 10, list.datapoints[0]));
+  EXPECT_TRUE(eq("v11", 11, list.datapoints[1]));
   list = cm.with_custom_tags[1];
   EXPECT_EQ("fid1", list.topic);
   EXPECT_EQ(4, list.tags.size());
   EXPECT_TRUE(eq("framework_id", "fid1", list.tags[0]));
   EXPECT_TRUE(eq("executor_id", "eid1", list.tags[1]));
   EXPECT_TRUE(eq("container_id", "cid1", list.tags[2]));
-  EXPECT_TRUE(eq("ta", "va", list.tags[3]));
-  EXPECT_EQ(1, list.datapoints.size());
-  EXPECT_TRUE(eq("v11", 11, list.datapoints[0]));
-  list = cm.with_custom_tags[2];
-  EXPECT_EQ("fid1", list.topic);
-  EXPECT_EQ(4, list.tags.size());
-  EXPECT_TRUE(eq("framework_id", "fid1", list.tags[0]));
-  EXPECT_TRUE(eq("executor_id", "eid1", list.tags[1]));
-  EXPECT_TRUE(eq("container_id", "cid1", list.tags[2]));
   EXPECT_TRUE(eq("tb", "vb", list.tags[3]));
   EXPECT_EQ(1, list.datapoints.size());
   EXPECT_TRUE(eq("v12", 12, list.datapoints[0]));
-  list = cm.with_custom_tags[3];
+  list = cm.with_custom_tags[2];
   EXPECT_EQ("fid1", list.topic);
   EXPECT_EQ(5, list.tags.size());
   EXPECT_TRUE(eq("framework_id", "fid1", list.tags[0]));
@@ -766,7 +854,7 @@ TEST_F(AvroEncoderTests, statsd_parse_mixed_vals) {
   EXPECT_TRUE(eq("v2", 2, list.datapoints[1]));
   EXPECT_TRUE(eq("v3", 3, list.datapoints[2]));
 
-  EXPECT_EQ(4, cm.with_custom_tags.size());
+  EXPECT_EQ(3, cm.with_custom_tags.size()); // ta:va lists merged
   list = cm.with_custom_tags[0];
   EXPECT_EQ("fid1", list.topic);
   EXPECT_EQ(4, list.tags.size());
@@ -774,27 +862,19 @@ TEST_F(AvroEncoderTests, statsd_parse_mixed_vals) {
   EXPECT_TRUE(eq("executor_id", "eid1", list.tags[1]));
   EXPECT_TRUE(eq("container_id", "cid2", list.tags[2]));
   EXPECT_TRUE(eq("ta", "va", list.tags[3]));
-  EXPECT_EQ(1, list.datapoints.size());
+  EXPECT_EQ(2, list.datapoints.size());
   EXPECT_TRUE(eq("v10", 10, list.datapoints[0]));
+  EXPECT_TRUE(eq("v11", 11, list.datapoints[1]));
   list = cm.with_custom_tags[1];
   EXPECT_EQ("fid1", list.topic);
   EXPECT_EQ(4, list.tags.size());
   EXPECT_TRUE(eq("framework_id", "fid1", list.tags[0]));
   EXPECT_TRUE(eq("executor_id", "eid1", list.tags[1]));
   EXPECT_TRUE(eq("container_id", "cid2", list.tags[2]));
-  EXPECT_TRUE(eq("ta", "va", list.tags[3]));
-  EXPECT_EQ(1, list.datapoints.size());
-  EXPECT_TRUE(eq("v11", 11, list.datapoints[0]));
-  list = cm.with_custom_tags[2];
-  EXPECT_EQ("fid1", list.topic);
-  EXPECT_EQ(4, list.tags.size());
-  EXPECT_TRUE(eq("framework_id", "fid1", list.tags[0]));
-  EXPECT_TRUE(eq("executor_id", "eid1", list.tags[1]));
-  EXPECT_TRUE(eq("container_id", "cid2", list.tags[2]));
   EXPECT_TRUE(eq("tb", "vb", list.tags[3]));
   EXPECT_EQ(1, list.datapoints.size());
   EXPECT_TRUE(eq("v12", 12, list.datapoints[0]));
-  list = cm.with_custom_tags[3];
+  list = cm.with_custom_tags[2];
   EXPECT_EQ("fid1", list.topic);
   EXPECT_EQ(5, list.tags.size());
   EXPECT_TRUE(eq("framework_id", "fid1", list.tags[0]));
@@ -819,7 +899,7 @@ TEST_F(AvroEncoderTests, statsd_parse_mixed_vals) {
   EXPECT_TRUE(eq("v2", 2, list.datapoints[1]));
   EXPECT_TRUE(eq("v3", 3, list.datapoints[2]));
 
-  EXPECT_EQ(4, cm.with_custom_tags.size());
+  EXPECT_EQ(3, cm.with_custom_tags.size()); // ta:va lists merged
   list = cm.with_custom_tags[0];
   EXPECT_EQ("fid2", list.topic);
   EXPECT_EQ(4, list.tags.size());
@@ -827,27 +907,19 @@ TEST_F(AvroEncoderTests, statsd_parse_mixed_vals) {
   EXPECT_TRUE(eq("executor_id", "eid2", list.tags[1]));
   EXPECT_TRUE(eq("container_id", "cid3", list.tags[2]));
   EXPECT_TRUE(eq("ta", "va", list.tags[3]));
-  EXPECT_EQ(1, list.datapoints.size());
+  EXPECT_EQ(2, list.datapoints.size());
   EXPECT_TRUE(eq("v10", 10, list.datapoints[0]));
+  EXPECT_TRUE(eq("v11", 11, list.datapoints[1]));
   list = cm.with_custom_tags[1];
   EXPECT_EQ("fid2", list.topic);
   EXPECT_EQ(4, list.tags.size());
   EXPECT_TRUE(eq("framework_id", "fid2", list.tags[0]));
   EXPECT_TRUE(eq("executor_id", "eid2", list.tags[1]));
   EXPECT_TRUE(eq("container_id", "cid3", list.tags[2]));
-  EXPECT_TRUE(eq("ta", "va", list.tags[3]));
-  EXPECT_EQ(1, list.datapoints.size());
-  EXPECT_TRUE(eq("v11", 11, list.datapoints[0]));
-  list = cm.with_custom_tags[2];
-  EXPECT_EQ("fid2", list.topic);
-  EXPECT_EQ(4, list.tags.size());
-  EXPECT_TRUE(eq("framework_id", "fid2", list.tags[0]));
-  EXPECT_TRUE(eq("executor_id", "eid2", list.tags[1]));
-  EXPECT_TRUE(eq("container_id", "cid3", list.tags[2]));
   EXPECT_TRUE(eq("tb", "vb", list.tags[3]));
   EXPECT_EQ(1, list.datapoints.size());
   EXPECT_TRUE(eq("v12", 12, list.datapoints[0]));
-  list = cm.with_custom_tags[3];
+  list = cm.with_custom_tags[2];
   EXPECT_EQ("fid2", list.topic);
   EXPECT_EQ(5, list.tags.size());
   EXPECT_TRUE(eq("framework_id", "fid2", list.tags[0]));
@@ -870,6 +942,98 @@ TEST_F(AvroEncoderTests, statsd_parse_mixed_vals) {
   }
 }
 
+TEST_F(AvroEncoderTests, statsd_merge_custom_tags) {
+  std::vector<std::string> lines = {
+    "a:1|#x:1,y:2",
+    "b:2|#y:2,x:1", // same set, different order
+    "c:3|#x:1",
+    "d:4|#x:1,y:3",
+    "e:5|g|#x:1,y:2|@0.5",
+    "f:6|#x:1,x:1", // same tags, different count
+    "g:7|#x:1|#y:2", // tags split across sections
+    "h:8|#x:1,y:2,y:2",
+    "i:9|#x:1,x:1" };
+
+  mesos::ContainerID cid = container_id("cid");
+  mesos::ExecutorInfo einfo = exec_info("fid", "eid");
+  metrics::avro_metrics_map_t map;
+  for (const std::string& line : lines) {
+    EXPECT_EQ(1, metrics::AvroEncoder::statsd_to_map(&cid, &einfo, line.data(), line.size(), map));
+  }
+  // same tags in another container: not merged with the above
+  mesos::ContainerID cid2 = container_id("cid2");
+  EXPECT_EQ(1, metrics::AvroEncoder::statsd_to_map(
+          &cid2, &einfo, lines[0].data(), lines[0].size(), map));
+  EXPECT_EQ(2, map.size());
+
+  const metrics::ContainerMetrics& cm = map[cid];
+  EXPECT_TRUE(metrics::AvroEncoder::empty(cm.without_custom_tags));
+  ASSERT_EQ(5, cm.with_custom_tags.size());
+
+  // tags are kept in the order of the first datapoint which had them
+  const metrics::MetricList* list = &cm.with_custom_tags[0];
+  EXPECT_EQ("fid", list->topic);
+  ASSERT_EQ(5, list->tags.size());
+  EXPECT_TRUE(eq("framework_id", "fid", list->tags[0]));
+  EXPECT_TRUE(eq("executor_id", "eid", list->tags[1]));
+  EXPECT_TRUE(eq("container_id", "cid", list->tags[2]));
+  EXPECT_TRUE(eq("x", "1", list->tags[3]));
+  EXPECT_TRUE(eq("y", "2", list->tags[4]));
+  ASSERT_EQ(4, list->datapoints.size());
+  EXPECT_TRUE(eq("a", 1, list->datapoints[0]));
+  EXPECT_TRUE(eq("b", 2, list->datapoints[1]));
+  EXPECT_TRUE(eq("e", 5, list->datapoints[2]));
+  EXPECT_TRUE(eq("g", 7, list->datapoints[3]));
+
+  list = &cm.with_custom_tags[1];
+  ASSERT_EQ(4, list->tags.size());
+  EXPECT_TRUE(eq("x", "1", list->tags[3]));
+  ASSERT_EQ(1, list->datapoints.size());
+  EXPECT_TRUE(eq("c", 3, list->datapoints[0]));
+
+  list = &cm.with_custom_tags[2];
+  ASSERT_EQ(5, list->tags.size());
+  EXPECT_TRUE(eq("x", "1", list->tags[3]));
+  EXPECT_TRUE(eq("y", "3", list->tags[4]));
+  ASSERT_EQ(1, list->datapoints.size());
+  EXPECT_TRUE(eq("d", 4, list->datapoints[0]));
+
+  list = &cm.with_custom_tags[3];
+  ASSERT_EQ(5, list->tags.size());
+  EXPECT_TRUE(eq("x", "1", list->tags[3]));
+  EXPECT_TRUE(eq("x", "1", list->tags[4]));
+  ASSERT_EQ(2, list->datapoints.size());
+  EXPECT_TRUE(eq("f", 6, list->datapoints[0]));
+  EXPECT_TRUE(eq("i", 9, list->datapoints[1]));
+
+  list = &cm.with_custom_tags[4];
+  ASSERT_EQ(6, list->tags.size());
+  ASSERT_EQ(1, list->datapoints.size());
+  EXPECT_TRUE(eq("h", 8, list->datapoints[0]));
+
+  const metrics::ContainerMetrics& cm2 = map[cid2];
+  ASSERT_EQ(1, cm2.with_custom_tags.size());
+  EXPECT_TRUE(eq("container_id", "cid2", cm2.with_custom_tags[0].tags[2]));
+  ASSERT_EQ(1, cm2.with_custom_tags[0].datapoints.size());
+
+  // the merged lists are what's encoded
+  std::string tmppath = write_tmp();
+  {
+    std::ofstream ofs(tmppath, std::ios::binary);
+    ofs << metrics::AvroEncoder::header(); // actual file must start with header
+    metrics::AvroEncoder::encode_metrics_block(map, ofs);
+  }
+  avro::DataFileReader<metrics_schema::MetricList> avro_reader(tmppath.data());
+  metrics_schema::MetricList flist;
+  for (const metrics::MetricList& list : cm.with_custom_tags) {
+    EXPECT_TRUE(avro_reader.read(flist));
+    EXPECT_TRUE(eq(list, flist));
+  }
+  EXPECT_TRUE(avro_reader.read(flist));
+  EXPECT_TRUE(eq(cm2.with_custom_tags[0], flist));
+  EXPECT_FALSE(avro_reader.read(flist));
+}
+
 TEST_F(AvroEncoderTests, statsd_parse_single) {
   std::string
     empty_1tag("|#tag:val"),
@@ -1002,20 +1166,21 @@ TEST_F(AvroEncoderTests, statsd_parse_single) {
 }
 
 TEST_F(AvroEncoderTests, check_empty) {
-  metrics_schema::MetricList list;
+  metrics::StringInterner strings;
+  metrics::MetricList list;
   EXPECT_TRUE(metrics::AvroEncoder::empty(list));
 
-  list.topic = "hi";
+  list.topic = strings.intern("hi");
   EXPECT_FALSE(metrics::AvroEncoder::empty(list));
-  list.topic.clear();
+  list.topic = metrics::InternedString();
   EXPECT_TRUE(metrics::AvroEncoder::empty(list));
 
-  list.tags.push_back(metrics_schema::Tag());
+  list.tags.push_back(metrics::Tag());
   EXPECT_FALSE(metrics::AvroEncoder::empty(list));
   list.tags.clear();
   EXPECT_TRUE(metrics::AvroEncoder::empty(list));
 
-  list.datapoints.push_back(metrics_schema::Datapoint());
+  list.datapoints.push_back(metrics::Datapoint());
   EXPECT_FALSE(metrics::AvroEncoder::empty(list));
   list.datapoints.clear();
   EXPECT_TRUE(metrics::AvroEncoder::empty(list));
@@ -0,0 +1,82 @@
+#include <string.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "byte_buffer.hpp"
+
+namespace {
+  std::string str(const metrics::ByteBuffer& buf) {
+    return std::string(buf.data(), buf.size());
+  }
+}
+
+TEST(ByteBufferTests, append_grows) {
+  metrics::ByteBuffer buf;
+  EXPECT_TRUE(buf.empty());
+  EXPECT_EQ("", str(buf));
+
+  std::string expect;
+  for (size_t i = 0; i < 10000; ++i) {
+    std::string val = std::to_string(i);
+    buf.append(val.data(), val.size());
+    expect += val;
+  }
+  EXPECT_FALSE(buf.empty());
+  EXPECT_EQ(expect, str(buf));
+}
+
+TEST(ByteBufferTests, prepare_commit_uncommit) {
+  metrics::ByteBuffer buf;
+  uint8_t* out = buf.prepare(5);
+  EXPECT_LE(5, buf.tail_size());
+  memcpy(out, "hello", 5);
+  buf.commit(5);
+  EXPECT_EQ("hello", str(buf));
+
+  buf.uncommit(2);
+  EXPECT_EQ("hel", str(buf));
+  buf.append("p", 1);
+  EXPECT_EQ("help", str(buf));
+}
+
+TEST(ByteBufferTests, prepend_within_headroom) {
+  metrics::ByteBuffer buf(4);
+  buf.append("world", 5);
+  const char* data_before = buf.data();
+  buf.prepend("hi, ", 4);
+  EXPECT_EQ("hi, world", str(buf));
+  // data wasn't moved:
+  EXPECT_EQ(data_before, buf.data() + 4);
+}
+
+TEST(ByteBufferTests, prepend_beyond_headroom) {
+  metrics::ByteBuffer buf(2);
+  buf.append("world", 5);
+  buf.prepend("hello ", 6);
+  EXPECT_EQ("hello world", str(buf));
+  buf.prepend(">", 1);
+  EXPECT_EQ(">hello world", str(buf));
+}
+
+TEST(ByteBufferTests, reset_keeps_capacity) {
+  metrics::ByteBuffer buf;
+  std::string big(100000, 'x');
+  buf.append(big.data(), big.size());
+  size_t capacity = buf.capacity();
+  EXPECT_LE(big.size(), capacity);
+
+  buf.reset(20);
+  EXPECT_TRUE(buf.empty());
+  EXPECT_EQ(capacity, buf.capacity());
+  buf.append("data", 4);
+  buf.prepend("hdr", 3);
+  EXPECT_EQ("hdrdata", str(buf));
+  EXPECT_EQ(capacity, buf.capacity());
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
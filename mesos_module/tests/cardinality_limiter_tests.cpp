@@ -0,0 +1,102 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "cardinality_limiter.hpp"
+
+namespace {
+  bool add(metrics::CardinalityLimiter& limiter, const std::string& line) {
+    return limiter.add(line.data(), line.size());
+  }
+}
+
+TEST(CardinalityLimiterTests, limit) {
+  metrics::CardinalityLimiter limiter(3);
+  EXPECT_TRUE(add(limiter, "a:1|c"));
+  EXPECT_TRUE(add(limiter, "b:1|c"));
+  EXPECT_TRUE(add(limiter, "a:1|g"));
+  EXPECT_EQ(3, limiter.series());
+  EXPECT_EQ(0, limiter.limited());
+
+  EXPECT_FALSE(add(limiter, "c:1|c"));
+  EXPECT_FALSE(add(limiter, "a:1|c|#x:1"));
+  // known series keep flowing
+  EXPECT_TRUE(add(limiter, "a:5|c|@0.1"));
+  EXPECT_TRUE(add(limiter, "b:5|c"));
+  EXPECT_FALSE(add(limiter, "c:2|c"));
+  EXPECT_EQ(3, limiter.series());
+  EXPECT_EQ(3, limiter.limited());
+  EXPECT_NEAR(5, limiter.estimate(), 0.1);
+
+  // known series are kept across periods, new ones are still refused
+  limiter.next_period();
+  EXPECT_EQ(3, limiter.series());
+  EXPECT_EQ(0, limiter.limited());
+  EXPECT_EQ(0, limiter.estimate());
+  EXPECT_FALSE(add(limiter, "c:1|c"));
+  EXPECT_TRUE(add(limiter, "a:1|c"));
+  EXPECT_TRUE(add(limiter, "b:1|c"));
+  EXPECT_EQ(1, limiter.limited());
+
+  // "a:1|g" wasn't sent during the last period: its room goes to a new series
+  limiter.next_period();
+  EXPECT_EQ(2, limiter.series());
+  EXPECT_TRUE(add(limiter, "c:1|c"));
+  EXPECT_FALSE(add(limiter, "d:1|c"));
+  EXPECT_FALSE(add(limiter, "a:1|g"));
+  EXPECT_TRUE(add(limiter, "a:1|c"));
+  EXPECT_TRUE(add(limiter, "b:1|c"));
+  EXPECT_EQ(3, limiter.series());
+
+  // a period with nothing sent forgets everything that was seen before it
+  limiter.next_period();
+  limiter.next_period();
+  EXPECT_EQ(0, limiter.series());
+  EXPECT_TRUE(add(limiter, "d:1|c"));
+}
+
+TEST(CardinalityLimiterTests, zero_limit) {
+  metrics::CardinalityLimiter limiter(0);
+  EXPECT_FALSE(add(limiter, "a:1|c"));
+  EXPECT_FALSE(add(limiter, "a:1|c"));
+  EXPECT_EQ(0, limiter.series());
+  EXPECT_EQ(2, limiter.limited());
+  EXPECT_NEAR(1, limiter.estimate(), 0.1);
+}
+
+TEST(CardinalityLimiterTests, many_series) {
+  metrics::CardinalityLimiter limiter(20000);
+  for (size_t round = 0; round < 2; ++round) {
+    for (size_t i = 0; i < 50000; ++i) {
+      std::string line = "series" + std::to_string(i) + ":1|c|#round:" + std::to_string(round);
+      EXPECT_EQ(round == 0 && i < 20000, add(limiter, line)) << line;
+    }
+    EXPECT_EQ(20000, limiter.series());
+
+    // ~3% standard error
+    double estimate = limiter.estimate();
+    LOG(INFO) << "Estimate for 50000 series: " << estimate;
+    EXPECT_NEAR(50000 * (round + 1), estimate, 50000 * (round + 1) * 0.1);
+  }
+
+  // the round 0 series were all seen in the last period, then none of them in the one after
+  limiter.next_period();
+  EXPECT_EQ(20000, limiter.series());
+  EXPECT_FALSE(add(limiter, "series0:1|c"));
+  limiter.next_period();
+  EXPECT_EQ(0, limiter.series());
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_TRUE(add(limiter, "series" + std::to_string(i) + ":1|c"));
+  }
+  // small range is nearly exact
+  EXPECT_NEAR(100, limiter.estimate(), 5);
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,4 +1,5 @@
 #include <glog/logging.h>
+#include <stout/os.hpp>
 
 #include <thread>
 
@@ -125,12 +126,12 @@ TEST_F(ContainerAssignerStategyTests, single_port) {
   EXPECT_CALL(*mock_runner, dispatch(_)).WillRepeatedly(Invoke(execute));
 
   // Registration of ci1/ei1 fails
-  EXPECT_CALL(*mock_runner, create_container_reader(create_port)).WillOnce(Return(mock_reader1));
+  EXPECT_CALL(*mock_runner, create_container_reader(create_port, _)).WillOnce(Return(mock_reader1));
   EXPECT_CALL(*mock_reader1, open()).WillOnce(Return(Try<metrics::UDPEndpoint>(Error("test fail"))));
   EXPECT_TRUE(strategy.register_container(ci1, ei1).isError());
 
   // Registration of ci1/ei1 creates reader and succeeds
-  EXPECT_CALL(*mock_runner, create_container_reader(create_port)).WillOnce(Return(mock_reader1));
+  EXPECT_CALL(*mock_runner, create_container_reader(create_port, _)).WillOnce(Return(mock_reader1));
   EXPECT_CALL(*mock_reader1, open()).WillOnce(Return(try_endpoint("ignored", 0)));
   EXPECT_CALL(*mock_reader1, register_container(ContainerIdMatch(ci1), ExecInfoMatch(ei1)));
   EXPECT_CALL(*mock_reader1, endpoint()).WillOnce(Return(try_endpoint(host1, port1)));
@@ -195,12 +196,12 @@ TEST_F(ContainerAssignerStategyTests, ephemeral_port) {
   EXPECT_CALL(*mock_runner, dispatch(_)).WillRepeatedly(Invoke(execute));
 
   // Registration of ci1/ei1 fails
-  EXPECT_CALL(*mock_runner, create_container_reader(0)).WillOnce(Return(mock_reader1));
+  EXPECT_CALL(*mock_runner, create_container_reader(0, _)).WillOnce(Return(mock_reader1));
   EXPECT_CALL(*mock_reader1, open()).WillOnce(Return(Try<metrics::UDPEndpoint>(Error("test fail"))));
   EXPECT_TRUE(strategy.register_container(ci1, ei1).isError());
 
   // Registration of ci1/ei1 creates reader and succeeds
-  EXPECT_CALL(*mock_runner, create_container_reader(0)).WillOnce(Return(mock_reader1));
+  EXPECT_CALL(*mock_runner, create_container_reader(0, _)).WillOnce(Return(mock_reader1));
   EXPECT_CALL(*mock_reader1, open()).WillOnce(Return(try_endpoint(host1, port1)));
   EXPECT_CALL(*mock_reader1, register_container(ContainerIdMatch(ci1), ExecInfoMatch(ei1)));
   Try<metrics::UDPEndpoint> endpt = strategy.register_container(ci1, ei1);
@@ -208,7 +209,7 @@ TEST_F(ContainerAssignerStategyTests, ephemeral_port) {
   EXPECT_EQ(port1, endpt.get().port);
 
   // Registration of ci2/ei2 creates a new separate reader
-  EXPECT_CALL(*mock_runner, create_container_reader(0)).WillOnce(Return(mock_reader2));
+  EXPECT_CALL(*mock_runner, create_container_reader(0, _)).WillOnce(Return(mock_reader2));
   EXPECT_CALL(*mock_reader2, open()).WillOnce(Return(try_endpoint(host2, port2)));
   EXPECT_CALL(*mock_reader2, register_container(ContainerIdMatch(ci2), ExecInfoMatch(ei2)));
   endpt = strategy.register_container(ci2, ei2);
@@ -229,12 +230,12 @@ TEST_F(ContainerAssignerStategyTests, ephemeral_port) {
   strategy.unregister_container(ci1);
 
   // Insertion of ci3/ei3 fails to get endpoint
-  EXPECT_CALL(*mock_runner, create_container_reader(port1)).WillOnce(Return(mock_reader1));
+  EXPECT_CALL(*mock_runner, create_container_reader(port1, _)).WillOnce(Return(mock_reader1));
   EXPECT_CALL(*mock_reader1, open()).WillOnce(Return(Try<metrics::UDPEndpoint>(Error("test fail"))));
   strategy.insert_container(ci3, ei3, metrics::UDPEndpoint("ignored", port1));
 
   // Insert ci3/ei3 succeeds
-  EXPECT_CALL(*mock_runner, create_container_reader(port2)).WillOnce(Return(mock_reader2));
+  EXPECT_CALL(*mock_runner, create_container_reader(port2, _)).WillOnce(Return(mock_reader2));
   EXPECT_CALL(*mock_reader2, open()).WillOnce(Return(try_endpoint("ignored", 1231231)));
   EXPECT_CALL(*mock_reader2, register_container(ContainerIdMatch(ci3), ExecInfoMatch(ei3)));
   strategy.insert_container(ci3, ei3, metrics::UDPEndpoint(host2, port2));
@@ -318,12 +319,12 @@ TEST_F(ContainerAssignerStategyTests, port_range) {
   EXPECT_CALL(*mock_runner, dispatch(_)).WillRepeatedly(Invoke(execute));
 
   // Registration of ci1/ei1 fails
-  EXPECT_CALL(*mock_runner, create_container_reader(port1)).WillOnce(Return(mock_reader1));
+  EXPECT_CALL(*mock_runner, create_container_reader(port1, _)).WillOnce(Return(mock_reader1));
   EXPECT_CALL(*mock_reader1, open()).WillOnce(Return(Try<metrics::UDPEndpoint>(Error("test fail"))));
   EXPECT_TRUE(strategy.register_container(ci1, ei1).isError());
 
   // Registration of ci1/ei1 succeeds (against same port; it was put back after the fail)
-  EXPECT_CALL(*mock_runner, create_container_reader(port1)).WillOnce(Return(mock_reader1));
+  EXPECT_CALL(*mock_runner, create_container_reader(port1, _)).WillOnce(Return(mock_reader1));
   EXPECT_CALL(*mock_reader1, open()).WillOnce(Return(try_endpoint(host1, port1)));
   EXPECT_CALL(*mock_reader1, register_container(ContainerIdMatch(ci1), ExecInfoMatch(ei1)));
   Try<metrics::UDPEndpoint> endpt = strategy.register_container(ci1, ei1);
@@ -331,7 +332,7 @@ TEST_F(ContainerAssignerStategyTests, port_range) {
   EXPECT_EQ(port1, endpt.get().port);
 
   // Registration of ci2/ei2 creates a new separate reader against the next port in the pool
-  EXPECT_CALL(*mock_runner, create_container_reader(port2)).WillOnce(Return(mock_reader2));
+  EXPECT_CALL(*mock_runner, create_container_reader(port2, _)).WillOnce(Return(mock_reader2));
   EXPECT_CALL(*mock_reader2, open()).WillOnce(Return(try_endpoint(host2, port2)));
   EXPECT_CALL(*mock_reader2, register_container(ContainerIdMatch(ci2), ExecInfoMatch(ei2)));
   endpt = strategy.register_container(ci2, ei2);
@@ -352,13 +353,13 @@ TEST_F(ContainerAssignerStategyTests, port_range) {
   strategy.unregister_container(ci1);
 
   // Then re-register ci1/ei1, which gets port2 this time since port1 couldn't be freed
-  EXPECT_CALL(*mock_runner, create_container_reader(port2)).WillOnce(Return(mock_reader1));
+  EXPECT_CALL(*mock_runner, create_container_reader(port2, _)).WillOnce(Return(mock_reader1));
   EXPECT_CALL(*mock_reader1, open()).WillOnce(Return(try_endpoint(host1, port2)));
   EXPECT_CALL(*mock_reader1, register_container(ContainerIdMatch(ci1), ExecInfoMatch(ei1)));
   strategy.register_container(ci1, ei1);
 
   // And re-register ci2/ei2, which now gets port3
-  EXPECT_CALL(*mock_runner, create_container_reader(port3)).WillOnce(Return(mock_reader2));
+  EXPECT_CALL(*mock_runner, create_container_reader(port3, _)).WillOnce(Return(mock_reader2));
   EXPECT_CALL(*mock_reader2, open()).WillOnce(Return(try_endpoint(host2, port3)));
   EXPECT_CALL(*mock_reader2, register_container(ContainerIdMatch(ci2), ExecInfoMatch(ei2)));
   strategy.register_container(ci2, ei2);
@@ -371,12 +372,12 @@ TEST_F(ContainerAssignerStategyTests, port_range) {
   strategy.unregister_container(ci2);
 
   // port3 fails to open. port3 should be returned to the pool before the call exits w/o registering
-  EXPECT_CALL(*mock_runner, create_container_reader(port3)).WillOnce(Return(mock_reader2));
+  EXPECT_CALL(*mock_runner, create_container_reader(port3, _)).WillOnce(Return(mock_reader2));
   EXPECT_CALL(*mock_reader2, open()).WillOnce(Return(Try<metrics::UDPEndpoint>(Error("test fail"))));
   strategy.insert_container(ci3, ei3, metrics::UDPEndpoint("ignored", port3));
 
   // Finally, try again and get port3 successfully this time
-  EXPECT_CALL(*mock_runner, create_container_reader(port3)).WillOnce(Return(mock_reader2));
+  EXPECT_CALL(*mock_runner, create_container_reader(port3, _)).WillOnce(Return(mock_reader2));
   EXPECT_CALL(*mock_reader2, open()).WillOnce(Return(try_endpoint("ignored", 1231231)));
   EXPECT_CALL(*mock_reader2, register_container(ContainerIdMatch(ci3), ExecInfoMatch(ei3)));
   strategy.insert_container(ci3, ei3, metrics::UDPEndpoint("ignored", port3));
@@ -389,6 +390,71 @@ TEST_F(ContainerAssignerStategyTests, port_range) {
   strategy.unregister_container(ci3);
 }
 
+// ---
+
+TEST_F(ContainerAssignerStategyTests, unix_socket) {
+  const std::string root_dir =
+    "/tmp/container_assigner_strategy_tests-" + std::to_string(getpid()) + "/";
+  mesos::Parameters params;
+  mesos::Parameter* param = params.add_parameter();
+  param->set_key(metrics::params::LISTEN_UNIX_DIR);
+  // nested: ensure that the strategy creates the dir
+  param->set_value(root_dir + "sockets");
+
+  metrics::UnixSocketStrategy strategy(mock_runner, params);
+  mesos::ContainerID ci1 = container_id("cid1"),
+    ci2 = container_id("cid2"),
+    ci3 = container_id("cid3");
+  mesos::ExecutorInfo ei1 = exec_info("fid1", "eid1"),
+    ei2 = exec_info("fid2", "eid2"),
+    ei3 = exec_info("fid3", "eid3");
+  const std::string path1(root_dir + "sockets/cid1.sock"), path2(root_dir + "sockets/cid2.sock");
+
+  // Registration of ci1/ei1 fails
+  EXPECT_CALL(*mock_runner, create_unix_container_reader(path1, _)).WillOnce(Return(mock_reader1));
+  EXPECT_CALL(*mock_reader1, open()).WillOnce(Return(Try<metrics::UDPEndpoint>(Error("test fail"))));
+  EXPECT_TRUE(strategy.register_container(ci1, ei1).isError());
+  EXPECT_TRUE(os::exists(root_dir + "sockets"));
+
+  // Registration of ci1/ei1 creates reader and succeeds
+  EXPECT_CALL(*mock_runner, create_unix_container_reader(path1, _)).WillOnce(Return(mock_reader1));
+  EXPECT_CALL(*mock_reader1, open()).WillOnce(Return(try_endpoint(path1, 0)));
+  EXPECT_CALL(*mock_reader1, register_container(ContainerIdMatch(ci1), ExecInfoMatch(ei1)));
+  Try<metrics::UDPEndpoint> endpt = strategy.register_container(ci1, ei1);
+  EXPECT_EQ(path1, endpt.get().host);
+  EXPECT_EQ(0, endpt.get().port);
+
+  // Registration of ci1/ei1 again reuses the reader
+  EXPECT_CALL(*mock_reader1, endpoint()).WillOnce(Return(try_endpoint(path1, 0)));
+  endpt = strategy.register_container(ci1, ei1);
+  EXPECT_EQ(path1, endpt.get().host);
+
+  // Registration of ci2/ei2 creates a new separate reader
+  EXPECT_CALL(*mock_runner, create_unix_container_reader(path2, _)).WillOnce(Return(mock_reader2));
+  EXPECT_CALL(*mock_reader2, open()).WillOnce(Return(try_endpoint(path2, 0)));
+  EXPECT_CALL(*mock_reader2, register_container(ContainerIdMatch(ci2), ExecInfoMatch(ei2)));
+  endpt = strategy.register_container(ci2, ei2);
+  EXPECT_EQ(path2, endpt.get().host);
+
+  // Unregister ci1 and ci2, then again with no reader access
+  strategy.unregister_container(ci1);
+  strategy.unregister_container(ci2);
+  strategy.unregister_container(ci2);
+
+  // Insertion of a UDP endpoint is skipped
+  strategy.insert_container(ci3, ei3, metrics::UDPEndpoint("host1", 1234));
+
+  // Insert ci3/ei3 at its recovered path succeeds
+  EXPECT_CALL(*mock_runner, create_unix_container_reader("/recovered.sock", _))
+    .WillOnce(Return(mock_reader2));
+  EXPECT_CALL(*mock_reader2, open()).WillOnce(Return(try_endpoint("/recovered.sock", 0)));
+  EXPECT_CALL(*mock_reader2, register_container(ContainerIdMatch(ci3), ExecInfoMatch(ei3)));
+  strategy.insert_container(ci3, ei3, metrics::UDPEndpoint("/recovered.sock", 0));
+  strategy.unregister_container(ci3);
+
+  EXPECT_FALSE(os::rmdir(root_dir).isError());
+}
+
 int main(int argc, char **argv) {
   ::google::InitGoogleLogging(argv[0]);
   FLAGS_logtostderr = 1;
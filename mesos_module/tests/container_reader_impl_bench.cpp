@@ -0,0 +1,169 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "container_reader_impl.hpp"
+#include "sync_util.hpp"
+
+/**
+ * Compares single-datagram receives against batched receives in ContainerReaderImpl, and loopback
+ * UDP against unix datagram sockets. Not run as part of the unit tests: timings depend heavily on
+ * the host.
+ */
+
+namespace {
+  const size_t PACKET_COUNT = 200000;
+  const size_t LINES_PER_PACKET = 3;
+  const size_t IDLE_TIMEOUT_MS = 1000;
+
+  class CountingOutputWriter : public metrics::OutputWriter {
+   public:
+    CountingOutputWriter() : lines(0) { }
+    void start() { }
+    void write_container_statsd(
+        const mesos::ContainerID* /*container_id*/, const mesos::ExecutorInfo* /*executor_info*/,
+        const char* /*data*/, size_t /*size*/) {
+      ++lines;
+    }
+    std::atomic<size_t> lines;
+  };
+
+  class ServiceThread {
+   public:
+    ServiceThread()
+      : svc_(new boost::asio::io_service),
+        work(new boost::asio::io_service::work(*svc_)),
+        svc_thread(std::bind(&ServiceThread::run_svc, this)) { }
+
+    std::shared_ptr<boost::asio::io_service> svc() {
+      return svc_;
+    }
+
+    void join() {
+      work.reset();
+      svc_->stop();
+      svc_thread.join();
+    }
+
+   private:
+    void run_svc() {
+      svc_->run();
+    }
+
+    std::shared_ptr<boost::asio::io_service> svc_;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::thread svc_thread;
+  };
+
+  void noop() { }
+
+  template <typename Protocol>
+  void send_packets(const typename Protocol::endpoint& dest) {
+    // Skip TestUDPWriteSocket: it logs every packet.
+    boost::asio::io_service svc;
+    typename Protocol::socket socket(svc);
+    socket.open(dest.protocol());
+    const std::string pkt("bench.counter:1|c\nbench.gauge:3.5|g|#tag:val\nbench.timer:12|ms|@0.5");
+    for (size_t i = 0; i < PACKET_COUNT; ++i) {
+      socket.send_to(boost::asio::buffer(pkt), dest);
+    }
+  }
+
+  void send_udp_packets(size_t port) {
+    send_packets<boost::asio::ip::udp>(boost::asio::ip::udp::endpoint(
+            boost::asio::ip::address::from_string("127.0.0.1"), port));
+  }
+
+  void send_unix_packets(const std::string& path) {
+    // Unlike UDP, sends block while the reader's queue is full rather than being dropped
+    send_packets<boost::asio::local::datagram_protocol>(
+        boost::asio::local::datagram_protocol::endpoint(path));
+  }
+
+  void run_bench(const std::string& desc, size_t batch_size, bool unix_socket = false) {
+    std::shared_ptr<CountingOutputWriter> counter(new CountingOutputWriter);
+    std::vector<metrics::output_writer_ptr_t> writers;
+    writers.push_back(counter);
+
+    ServiceThread thread;
+    std::chrono::steady_clock::time_point start, end;
+    {
+      metrics::ContainerReaderOptions options((mesos::Parameters()));
+      options.limit_period_ms = 60000;
+      options.limit_amount_bytes = PACKET_COUNT * 1024; // effectively unlimited
+      options.recv_batch_size = batch_size;
+      metrics::ContainerReaderImpl reader(thread.svc(), writers,
+          unix_socket
+          ? metrics::UDPEndpoint("/tmp/container_reader_impl_bench.sock", 0)
+          : metrics::UDPEndpoint("127.0.0.1", 0),
+          options);
+      Try<metrics::UDPEndpoint> result = reader.open();
+      ASSERT_FALSE(result.isError()) << result.error();
+
+      start = std::chrono::steady_clock::now();
+      std::function<void()> send = unix_socket
+        ? std::function<void()>(std::bind(&send_unix_packets, result.get().host))
+        : std::function<void()>(std::bind(&send_udp_packets, result.get().port));
+      std::thread sender(send);
+
+      // Wait until the reader has gone idle for a while after the sender has finished.
+      size_t last_lines = 0;
+      std::chrono::steady_clock::time_point last_progress = start;
+      for (;;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        size_t lines = counter->lines;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (lines != last_lines) {
+          last_lines = lines;
+          last_progress = now;
+          end = now;
+        } else if (lines >= PACKET_COUNT * LINES_PER_PACKET
+            || now - last_progress > std::chrono::milliseconds(IDLE_TIMEOUT_MS)) {
+          break;
+        }
+      }
+      sender.join();
+      metrics::sync_util::dispatch_run("flush", *thread.svc(), &noop);
+    }
+    thread.join();
+
+    double secs = std::chrono::duration<double>(end - start).count();
+    size_t pkts_recvd = counter->lines / LINES_PER_PACKET;
+    printf("BENCH %-12s batch=%-3zu sent=%zu received=%zu (%.1f%%) in %.3fs: %.0f pkts/sec\n",
+        desc.c_str(), batch_size, PACKET_COUNT, pkts_recvd,
+        100. * pkts_recvd / PACKET_COUNT, secs, pkts_recvd / secs);
+  }
+}
+
+TEST(ContainerReaderImplBench, single_datagram_recv) {
+  run_bench("single", 1);
+}
+
+TEST(ContainerReaderImplBench, batched_recv_8) {
+  run_bench("batched", 8);
+}
+
+TEST(ContainerReaderImplBench, batched_recv_32) {
+  run_bench("batched", 32);
+}
+
+TEST(ContainerReaderImplBench, batched_recv_128) {
+  run_bench("batched", 128);
+}
+
+TEST(ContainerReaderImplBench, unix_single_datagram_recv) {
+  run_bench("unix single", 1, true);
+}
+
+TEST(ContainerReaderImplBench, unix_batched_recv_32) {
+  run_bench("unix batched", 32, true);
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
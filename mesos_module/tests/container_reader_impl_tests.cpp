@@ -1,5 +1,6 @@
 #include <initializer_list>
 #include <thread>
+#include <sys/stat.h>
 
 #include <glog/logging.h>
 #include <gtest/gtest.h>
@@ -148,6 +149,34 @@ namespace {
     std::atomic_bool shutdown;
   };
 
+  /**
+   * Keeps a copy of each line's slice, like a writer which queues lines rather than copying them.
+   */
+  class SliceKeepingWriter : public metrics::OutputWriter {
+   public:
+    void start() { }
+    void write_container_statsd(
+        const mesos::ContainerID* /*container_id*/, const mesos::ExecutorInfo* /*executor_info*/,
+        const char* /*data*/, size_t /*size*/) {
+      ADD_FAILURE() << "Lines should be written as slices";
+    }
+    void write_container_statsd_slice(
+        const mesos::ContainerID* /*container_id*/, const mesos::ExecutorInfo* /*executor_info*/,
+        const metrics::PacketSlice& line) {
+      lines.push_back(line);
+    }
+
+    std::vector<metrics::PacketSlice> lines;
+  };
+
+  metrics::ContainerReaderOptions reader_options(
+      size_t limit_period_ms, size_t limit_amount_bytes) {
+    metrics::ContainerReaderOptions options((mesos::Parameters()));
+    options.limit_period_ms = limit_period_ms;
+    options.limit_amount_bytes = limit_amount_bytes;
+    return options;
+  }
+
   void flush_service_queue_with_noop() {
     LOG(INFO) << "async queue flushed";
   }
@@ -159,7 +188,8 @@ TEST(ContainerReaderImplTests, one_line) {
   ServiceThread thread;
   {
     metrics::ContainerReaderImpl reader(
-        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), 1000, 1024);
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(1000, 1024));
 
     Try<metrics::UDPEndpoint> result = reader.open();
     EXPECT_FALSE(result.isError()) << result.error();
@@ -185,7 +215,8 @@ TEST(ContainerReaderImplTests, one_line_throttled) {
   ServiceThread thread;
   {
     metrics::ContainerReaderImpl reader(
-        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), 500, 0);
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(500, 0));
 
     Try<metrics::UDPEndpoint> result = reader.open();
     EXPECT_FALSE(result.isError()) << result.error();
@@ -211,6 +242,41 @@ TEST(ContainerReaderImplTests, one_line_throttled) {
         Record(throttled_none_statsd_msg, NULL, NULL)});
 }
 
+TEST(ContainerReaderImplTests, one_line_packets_throttled) {
+  Record hello("hello", NULL, NULL), hey("hey", NULL, NULL), hi("hi", NULL, NULL);
+
+  ServiceThread thread;
+  {
+    // 2 packets per 500ms: refills at one packet per 250ms
+    metrics::ContainerReaderOptions options = reader_options(500, 1024);
+    options.limit_amount_packets = 2;
+    metrics::ContainerReaderImpl reader(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options);
+
+    Try<metrics::UDPEndpoint> result = reader.open();
+    EXPECT_FALSE(result.isError()) << result.error();
+    size_t reader_port = result.get().port;
+
+    TestUDPWriteSocket test_writer;
+    test_writer.connect(reader_port);
+
+    test_writer.write(hello.str);
+    test_writer.write(hey.str);
+    test_writer.write(hi.str);
+
+    usleep(750000); // sleep long enough for one flush to occur
+
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+  }
+  thread.join();
+
+  thread.expect_contains({
+        hello, hey,
+        Record(received_some_statsd_msg, NULL, NULL),
+        Record("dcos.metrics.module.container_throttled_bytes_per_sec:4|g", NULL, NULL),
+        Record("dcos.metrics.module.container_throttled_packets_per_sec:2|g", NULL, NULL)});
+}
+
 TEST(ContainerReaderImplTests, multiline) {
   Record hello("hello", NULL, NULL), hey("hey", NULL, NULL), hi("hi", NULL, NULL);
   std::string multi(hello.str + "\n" + hey.str + "\n\n" + hi.str);
@@ -218,7 +284,8 @@ TEST(ContainerReaderImplTests, multiline) {
   ServiceThread thread;
   {
     metrics::ContainerReaderImpl reader(
-        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), 500, 1024);
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(500, 1024));
 
     Try<metrics::UDPEndpoint> result = reader.open();
     EXPECT_FALSE(result.isError()) << result.error();
@@ -243,7 +310,8 @@ TEST(ContainerReaderImplTests, multiline_leading_ending_newlines) {
   ServiceThread thread;
   {
     metrics::ContainerReaderImpl reader(
-        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), 500, 1024);
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(500, 1024));
 
     Try<metrics::UDPEndpoint> result = reader.open();
     EXPECT_FALSE(result.isError()) << result.error();
@@ -267,7 +335,8 @@ TEST(ContainerReaderImplTests, zero_registered_containers) {
   ServiceThread thread;
   {
     metrics::ContainerReaderImpl reader(
-        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), 500, 1024);
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(500, 1024));
 
     Try<metrics::UDPEndpoint> result = reader.open();
     EXPECT_FALSE(result.isError()) << result.error();
@@ -298,7 +367,8 @@ TEST(ContainerReaderImplTests, one_registered_container) {
   ServiceThread thread;
   {
     metrics::ContainerReaderImpl reader(
-        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), 500, 1024);
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(500, 1024));
 
     reader.register_container(container_id, exec_info);
 
@@ -331,7 +401,8 @@ TEST(ContainerReaderImplTests, one_registered_container_throttled) {
   ServiceThread thread;
   {
     metrics::ContainerReaderImpl reader(
-        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), 500, 0);
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(500, 0));
 
     reader.register_container(container_id, exec_info);
 
@@ -371,7 +442,8 @@ TEST(ContainerReaderImplTests, one_registered_container_multiline_leading_ending
   ServiceThread thread;
   {
     metrics::ContainerReaderImpl reader(
-        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), 500, 1024);
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(500, 1024));
 
     reader.register_container(container_id, exec_info);
 
@@ -397,7 +469,8 @@ TEST(ContainerReaderImplTests, multi_registered_containers) {
   ServiceThread thread;
   {
     metrics::ContainerReaderImpl reader(
-        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), 500, 1024);
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(500, 1024));
 
     mesos::ContainerID container_id;
     container_id.set_value("a");
@@ -423,6 +496,582 @@ TEST(ContainerReaderImplTests, multi_registered_containers) {
   thread.expect_contains({hello, hey, hi});
 }
 
+TEST(ContainerReaderImplTests, multi_registered_containers_by_source_address) {
+  mesos::ContainerID container_a, container_b;
+  container_a.set_value("a");
+  container_b.set_value("b");
+  mesos::ExecutorInfo exec_info_a, exec_info_b;
+  exec_info_a.mutable_container()->add_network_infos()->add_ip_addresses()->set_ip_address("127.0.0.1");
+  exec_info_b.mutable_container()->add_network_infos()->add_ip_addresses()->set_ip_address("10.1.2.3");
+  Record hello("hello", &container_a, &exec_info_a), hey("hey", &container_a, &exec_info_a),
+    hi("hi", NULL, NULL);
+
+  ServiceThread thread;
+  {
+    metrics::ContainerReaderImpl reader(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(500, 1024));
+
+    reader.register_container(container_a, exec_info_a);
+    reader.register_container(container_b, exec_info_b);
+
+    Try<metrics::UDPEndpoint> result = reader.open();
+    EXPECT_FALSE(result.isError()) << result.error();
+    size_t reader_port = result.get().port;
+
+    TestUDPWriteSocket test_writer;
+    test_writer.connect(reader_port);
+
+    test_writer.write(hello.str);
+    test_writer.write(hey.str);
+
+    usleep(750000); // sleep long enough for one flush to occur
+
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+
+    // Once the container is gone, its address no longer maps to it.
+    reader.unregister_container(container_a);
+    reader.register_container(container_a, mesos::ExecutorInfo());
+    test_writer.write(hi.str);
+
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+  }
+  thread.join();
+
+  // The reader's own metrics cover both containers, so they aren't tagged with either of them
+  thread.expect_contains({hello, hey, hi,
+        Record("dcos.metrics.module.container_received_bytes_per_sec:16|g", NULL, NULL),
+        Record(throttled_none_statsd_msg, NULL, NULL)});
+}
+
+TEST(ContainerReaderImplTests, batched_one_line) {
+  Record hello("hello", NULL, NULL), hey("hey", NULL, NULL), hi("hi", NULL, NULL);
+
+  ServiceThread thread;
+  {
+    metrics::ContainerReaderOptions options = reader_options(1000, 1024);
+    options.recv_batch_size = 4;
+    options.recv_batch_slot_bytes = 1024;
+    metrics::ContainerReaderImpl reader(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options);
+
+    Try<metrics::UDPEndpoint> result = reader.open();
+    EXPECT_FALSE(result.isError()) << result.error();
+    size_t reader_port = result.get().port;
+
+    TestUDPWriteSocket test_writer;
+    test_writer.connect(reader_port);
+
+    test_writer.write(hello.str);
+    test_writer.write(hey.str);
+    test_writer.write(hi.str);
+
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+  }
+  thread.join();
+
+  thread.expect_contains({hello, hey, hi});
+}
+
+TEST(ContainerReaderImplTests, batched_more_datagrams_than_batch) {
+  mesos::ContainerID container_id;
+  container_id.set_value("a");
+  mesos::ExecutorInfo exec_info;
+  Record hello("hello", &container_id, &exec_info),
+    hey("hey", &container_id, &exec_info),
+    hi("hi", &container_id, &exec_info),
+    howdy("howdy", &container_id, &exec_info),
+    yo("yo", &container_id, &exec_info);
+  std::string multi("\n" + hey.str + "\n\n" + hi.str + "\n");
+
+  ServiceThread thread;
+  {
+    metrics::ContainerReaderOptions options = reader_options(1000, 1024);
+    options.recv_batch_size = 2;
+    options.recv_batch_slot_bytes = 1024;
+    metrics::ContainerReaderImpl reader(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options);
+
+    reader.register_container(container_id, exec_info);
+
+    Try<metrics::UDPEndpoint> result = reader.open();
+    EXPECT_FALSE(result.isError()) << result.error();
+    size_t reader_port = result.get().port;
+
+    TestUDPWriteSocket test_writer;
+    test_writer.connect(reader_port);
+
+    test_writer.write(hello.str);
+    test_writer.write(multi);
+    test_writer.write(howdy.str);
+    test_writer.write(yo.str);
+
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+  }
+  thread.join();
+
+  thread.expect_contains({hello, hey, hi, howdy, yo});
+}
+
+TEST(ContainerReaderImplTests, batched_oversized_datagram_dropped) {
+  Record hello("hello", NULL, NULL), hi("hi", NULL, NULL);
+
+  // recvmmsg(), then the single recvmsg() fallback
+  for (bool fallback : {false, true}) {
+    SCOPED_TRACE(fallback ? "fallback" : "recvmmsg");
+    ServiceThread thread;
+    {
+      metrics::ContainerReaderOptions options = reader_options(500, 1024);
+      options.recv_batch_size = 4;
+      options.recv_batch_slot_bytes = 8;
+      options.recv_batch_fallback_for_tests = fallback;
+      metrics::ContainerReaderImpl reader(
+          thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options);
+
+      Try<metrics::UDPEndpoint> result = reader.open();
+      EXPECT_FALSE(result.isError()) << result.error();
+      size_t reader_port = result.get().port;
+
+      TestUDPWriteSocket test_writer;
+      test_writer.connect(reader_port);
+
+      test_writer.write(hello.str);
+      test_writer.write("toolongforslot");
+      test_writer.write(hi.str);
+
+      usleep(750000); // sleep long enough for one flush to occur
+
+      metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    }
+    thread.join();
+
+    // The dropped datagram counts its full 14 bytes, not the 8 which fit in its slot
+    thread.expect_contains({hello, hi,
+          Record("dcos.metrics.module.container_received_bytes_per_sec:14|g", NULL, NULL),
+          Record("dcos.metrics.module.container_throttled_bytes_per_sec:28|g", NULL, NULL),
+          Record("dcos.metrics.module.container_recv_batch_datagrams_per_wakeup:3|g", NULL, NULL)});
+  }
+}
+
+TEST(ContainerReaderImplTests, batched_empty_datagram) {
+  Record hello("hello", NULL, NULL), hi("hi", NULL, NULL);
+
+  for (bool fallback : {false, true}) {
+    SCOPED_TRACE(fallback ? "fallback" : "recvmmsg");
+    ServiceThread thread;
+    {
+      metrics::ContainerReaderOptions options = reader_options(1000, 1024);
+      options.recv_batch_size = 4;
+      options.recv_batch_slot_bytes = 1024;
+      options.recv_batch_fallback_for_tests = fallback;
+      metrics::ContainerReaderImpl reader(
+          thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options);
+
+      Try<metrics::UDPEndpoint> result = reader.open();
+      EXPECT_FALSE(result.isError()) << result.error();
+      size_t reader_port = result.get().port;
+
+      TestUDPWriteSocket test_writer;
+      test_writer.connect(reader_port);
+
+      // An empty datagram is skipped, rather than stalling the ones behind it
+      test_writer.write("");
+      test_writer.write(hello.str);
+      test_writer.write(hi.str);
+
+      metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    }
+    thread.join();
+
+    thread.expect_contains({hello, hi});
+  }
+}
+
+TEST(ContainerReaderImplTests, reuse_port_shared_socket) {
+  mesos::ContainerID container_id;
+  container_id.set_value("a");
+  mesos::ExecutorInfo exec_info;
+  Record hello("hello", &container_id, &exec_info),
+    hey("hey", &container_id, &exec_info),
+    hi("hi", &container_id, &exec_info);
+
+  ServiceThread thread;
+  {
+    metrics::ContainerReaderOptions options = reader_options(1000, 1024);
+    options.recv_batch_slot_bytes = 1024;
+    options.reuse_port_group_size = 2;
+    options.reuse_port_cbpf = true;
+    metrics::ContainerReaderImpl reader1(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options);
+    reader1.register_container(container_id, exec_info);
+    Try<metrics::UDPEndpoint> result1 = reader1.open();
+    EXPECT_FALSE(result1.isError()) << result1.error();
+    size_t reader_port = result1.get().port;
+
+    metrics::ContainerReaderImpl reader2(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", reader_port), options);
+    reader2.register_container(container_id, exec_info);
+    Try<metrics::UDPEndpoint> result2 = reader2.open();
+    EXPECT_FALSE(result2.isError()) << result2.error();
+    EXPECT_EQ(reader_port, result2.get().port);
+
+    // Separate source ports: data may arrive at either reader
+    TestUDPWriteSocket test_writer1, test_writer2, test_writer3;
+    test_writer1.connect(reader_port);
+    test_writer2.connect(reader_port);
+    test_writer3.connect(reader_port);
+
+    test_writer1.write(hello.str);
+    test_writer2.write(hey.str);
+    test_writer3.write(hi.str);
+
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+  }
+  thread.join();
+
+  thread.expect_contains({hello, hey, hi});
+}
+
+TEST(ContainerReaderImplTests, reuse_port_disabled_conflicts) {
+  ServiceThread thread;
+  {
+    metrics::ContainerReaderImpl reader1(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0),
+        reader_options(1000, 1024));
+    Try<metrics::UDPEndpoint> result1 = reader1.open();
+    EXPECT_FALSE(result1.isError()) << result1.error();
+
+    metrics::ContainerReaderImpl reader2(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", result1.get().port),
+        reader_options(1000, 1024));
+    Try<metrics::UDPEndpoint> result2 = reader2.open();
+    EXPECT_TRUE(result2.isError());
+  }
+  thread.join();
+
+  thread.expect_contains({});
+}
+
+TEST(ContainerReaderImplTests, series_limited) {
+  mesos::ContainerID container_id;
+  container_id.set_value("a");
+  mesos::ExecutorInfo exec_info;
+  Record a("a:1|c", &container_id, &exec_info),
+    b("b:1|c|#x:1,y:2", &container_id, &exec_info),
+    a2("a:2|c", &container_id, &exec_info),
+    b2("b:2|c|#y:2,x:1", &container_id, &exec_info);
+
+  ServiceThread thread;
+  {
+    metrics::ContainerReaderOptions options = reader_options(500, 1024);
+    options.limit_series = 2;
+    metrics::ContainerReaderImpl reader(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options);
+
+    reader.register_container(container_id, exec_info);
+
+    Try<metrics::UDPEndpoint> result = reader.open();
+    EXPECT_FALSE(result.isError()) << result.error();
+    size_t reader_port = result.get().port;
+
+    TestUDPWriteSocket test_writer;
+    test_writer.connect(reader_port);
+
+    // 53 bytes in total: 106 bytes/sec over the 500ms period
+    test_writer.write(a.str);
+    test_writer.write(b.str);
+    test_writer.write("c:1|c");
+    test_writer.write("b:1|c|#x:1");
+    test_writer.write(a2.str);
+    test_writer.write(b2.str);
+
+    usleep(750000); // sleep long enough for one flush to occur
+
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+  }
+  thread.join();
+
+  thread.expect_contains({
+        a, b, a2, b2,
+        Record("dcos.metrics.module.container_received_bytes_per_sec:106|g",
+            &container_id, &exec_info),
+        Record(throttled_none_statsd_msg, &container_id, &exec_info),
+        Record("dcos.metrics.module.container_series_estimate:4|g", &container_id, &exec_info),
+        Record("dcos.metrics.module.container_series_limited_per_sec:4|g",
+            &container_id, &exec_info)});
+}
+
+TEST(ContainerReaderImplTests, series_limited_overflow) {
+  Record a("a:1|c", NULL, NULL),
+    overflow_c("dcos.metrics.module.container_series_overflow:3|c|@0.5", NULL, NULL),
+    overflow_d("dcos.metrics.module.container_series_overflow:4|ms", NULL, NULL),
+    a2("a:2|c", NULL, NULL);
+
+  ServiceThread thread;
+  {
+    metrics::ContainerReaderOptions options = reader_options(10000, 1024);
+    options.limit_series = 1;
+    options.limit_series_overflow = true;
+    metrics::ContainerReaderImpl reader(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options);
+
+    Try<metrics::UDPEndpoint> result = reader.open();
+    EXPECT_FALSE(result.isError()) << result.error();
+    size_t reader_port = result.get().port;
+
+    TestUDPWriteSocket test_writer;
+    test_writer.connect(reader_port);
+
+    test_writer.write(a.str);
+    test_writer.write("c:3|c|@0.5|#x:1");
+    test_writer.write("d:4|ms|#x:1,y:2");
+    test_writer.write("nocolon");
+    test_writer.write(a2.str);
+
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+  }
+  thread.join();
+
+  thread.expect_contains({a, overflow_c, overflow_d, a2});
+}
+
+TEST(ContainerReaderImplTests, ingest_scheduler) {
+  mesos::ContainerID container_id;
+  container_id.set_value("a");
+  mesos::ExecutorInfo exec_info;
+  mesos::Resource* cpus = exec_info.add_resources();
+  cpus->set_name("cpus");
+  cpus->mutable_scalar()->set_value(2);
+  Record hello("hello", &container_id, &exec_info),
+    hey("hey", &container_id, &exec_info),
+    hi("hi", NULL, NULL),
+    multi1("multi1", NULL, NULL),
+    multi2("multi2", NULL, NULL);
+
+  ServiceThread thread;
+  {
+    // quantum smaller than each datagram: one datagram per turn
+    std::shared_ptr<metrics::IngestScheduler> scheduler(
+        new metrics::IngestScheduler(thread.svc(), 1, 0));
+    metrics::ContainerReaderOptions options = reader_options(10000, 1024);
+    metrics::ContainerReaderImpl reader1(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options, scheduler);
+    options.recv_batch_size = 4;
+    metrics::ContainerReaderImpl reader2(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options, scheduler);
+
+    EXPECT_EQ(1, reader1.ingest_weight());
+    reader1.register_container(container_id, exec_info);
+
+    Try<metrics::UDPEndpoint> result1 = reader1.open();
+    EXPECT_FALSE(result1.isError()) << result1.error();
+    Try<metrics::UDPEndpoint> result2 = reader2.open();
+    EXPECT_FALSE(result2.isError()) << result2.error();
+
+    TestUDPWriteSocket test_writer1, test_writer2;
+    test_writer1.connect(result1.get().port);
+    test_writer2.connect(result2.get().port);
+
+    test_writer1.write(hello.str);
+    test_writer2.write(hi.str);
+    test_writer1.write(hey.str);
+    test_writer2.write(multi1.str + "\n" + multi2.str);
+
+    usleep(100000);
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+
+    EXPECT_EQ(2, reader1.ingest_weight());
+    EXPECT_EQ(1, reader2.ingest_weight());
+  }
+  thread.join();
+
+  thread.expect_contains({hello, hey, hi, multi1, multi2});
+}
+
+TEST(ContainerReaderImplTests, unix_socket) {
+  mesos::ContainerID container_id;
+  container_id.set_value("a");
+  mesos::ExecutorInfo exec_info;
+  Record hello("hello", &container_id, &exec_info),
+    hey("hey", &container_id, &exec_info),
+    multi1("multi1", &container_id, &exec_info),
+    multi2("multi2", &container_id, &exec_info);
+  const std::string path = "/tmp/container_reader_impl_tests-" + std::to_string(getpid()) + ".sock";
+
+  boost::asio::io_service svc;
+  {
+    // A socket left behind by an earlier reader is replaced
+    boost::asio::local::datagram_protocol::socket stale_socket(
+        svc, boost::asio::local::datagram_protocol::endpoint(path));
+  }
+  struct stat path_stat;
+  EXPECT_EQ(0, stat(path.c_str(), &path_stat));
+
+  ServiceThread thread;
+  {
+    metrics::ContainerReaderOptions options = reader_options(500, 1024);
+    options.recv_batch_size = 4;
+    metrics::ContainerReaderImpl reader(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint(path, 0), options);
+
+    reader.register_container(container_id, exec_info);
+
+    Try<metrics::UDPEndpoint> result = reader.open();
+    EXPECT_FALSE(result.isError()) << result.error();
+    EXPECT_EQ(path, result.get().host);
+    EXPECT_EQ(0, result.get().port);
+    EXPECT_TRUE(result.get().is_unix());
+
+    // Unbound sender, like most statsd clients
+    boost::asio::local::datagram_protocol::socket test_writer(svc);
+    test_writer.open();
+    boost::asio::local::datagram_protocol::endpoint dest(path);
+    test_writer.send_to(boost::asio::buffer(hello.str), dest);
+    test_writer.send_to(boost::asio::buffer(hey.str), dest);
+    test_writer.send_to(boost::asio::buffer(multi1.str + "\n" + multi2.str), dest);
+
+    usleep(100000);
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+  }
+  thread.join();
+
+  thread.expect_contains({hello, hey, multi1, multi2});
+  // Removed along with the reader
+  EXPECT_NE(0, stat(path.c_str(), &path_stat));
+}
+
+TEST(ContainerReaderImplTests, stream_tcp) {
+  mesos::ContainerID container_id;
+  container_id.set_value("a");
+  mesos::ExecutorInfo exec_info;
+  Record hello("hello", &container_id, &exec_info),
+    hey("hey", &container_id, &exec_info),
+    hi("hi", &container_id, &exec_info);
+
+  ServiceThread thread;
+  {
+    metrics::ContainerReaderOptions options = reader_options(500, 1024);
+    options.stream_max_connections = 2;
+    metrics::ContainerReaderImpl reader(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options);
+
+    reader.register_container(container_id, exec_info);
+
+    Try<metrics::UDPEndpoint> result = reader.open();
+    EXPECT_FALSE(result.isError()) << result.error();
+
+    // TCP on the same port as UDP, with a line split across writes
+    boost::asio::io_service svc;
+    boost::asio::ip::tcp::socket test_writer(svc);
+    test_writer.connect(boost::asio::ip::tcp::endpoint(
+            boost::asio::ip::address::from_string("127.0.0.1"), result.get().port));
+    boost::asio::write(test_writer, boost::asio::buffer(hello.str + "\nh"));
+    usleep(10000);
+    boost::asio::write(test_writer, boost::asio::buffer("ey\n" + hi.str + "\n"));
+    test_writer.close();
+
+    usleep(100000);
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+  }
+  thread.join();
+
+  thread.expect_contains({hello, hey, hi});
+}
+
+TEST(ContainerReaderImplTests, stream_tcp_reuse_port) {
+  mesos::ContainerID container_a, container_b;
+  container_a.set_value("a");
+  container_b.set_value("b");
+  mesos::ExecutorInfo exec_info;
+
+  ServiceThread thread;
+  {
+    metrics::ContainerReaderOptions options = reader_options(500, 1024);
+    options.reuse_port_group_size = 2;
+    options.stream_max_connections = 2;
+    metrics::ContainerReaderImpl reader1(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", 0), options);
+    reader1.register_container(container_a, exec_info);
+    Try<metrics::UDPEndpoint> result1 = reader1.open();
+    EXPECT_FALSE(result1.isError()) << result1.error();
+
+    metrics::ContainerReaderImpl reader2(
+        thread.svc(), thread.mocks(), metrics::UDPEndpoint("127.0.0.1", result1.get().port),
+        options);
+    reader2.register_container(container_b, exec_info);
+    Try<metrics::UDPEndpoint> result2 = reader2.open();
+    EXPECT_FALSE(result2.isError()) << result2.error();
+
+    // Streams are accepted on the shared port by both readers
+    boost::asio::io_service svc;
+    boost::asio::ip::tcp::socket test_writer(svc);
+    test_writer.connect(boost::asio::ip::tcp::endpoint(
+            boost::asio::ip::address::from_string("127.0.0.1"), result1.get().port));
+    test_writer.close();
+
+    usleep(750000); // sleep long enough for one flush to occur
+
+    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+  }
+  thread.join();
+
+  // Each reader reports on its own stream listener. The second reader's listener failed to open
+  // when only the first one could bind the port.
+  const std::string
+    connections_msg("dcos.metrics.module.container_stream_connections:0|g"),
+    paused_msg("dcos.metrics.module.container_stream_paused_per_sec:0|g");
+  thread.expect_contains({
+        Record(received_none_statsd_msg, &container_a, &exec_info),
+        Record(throttled_none_statsd_msg, &container_a, &exec_info),
+        Record(connections_msg, &container_a, &exec_info),
+        Record(paused_msg, &container_a, &exec_info),
+        Record(received_none_statsd_msg, &container_b, &exec_info),
+        Record(throttled_none_statsd_msg, &container_b, &exec_info),
+        Record(connections_msg, &container_b, &exec_info),
+        Record(paused_msg, &container_b, &exec_info)});
+}
+
+TEST(ContainerReaderImplTests, kept_slices) {
+  for (size_t recv_batch_size : {1, 4}) {
+    ServiceThread thread;
+    std::shared_ptr<SliceKeepingWriter> writer(new SliceKeepingWriter);
+    std::vector<std::string> expected;
+    {
+      metrics::ContainerReaderOptions options = reader_options(1000, 1024 * 1024);
+      options.recv_batch_size = recv_batch_size;
+      options.recv_batch_slot_bytes = 1024;
+      metrics::ContainerReaderImpl reader(
+          thread.svc(), {writer}, metrics::UDPEndpoint("127.0.0.1", 0), options);
+
+      Try<metrics::UDPEndpoint> result = reader.open();
+      EXPECT_FALSE(result.isError()) << result.error();
+
+      TestUDPWriteSocket test_writer;
+      test_writer.connect(result.get().port);
+
+      // More datagrams than the reader keeps pooled buffers for
+      for (size_t i = 0; i < 20; ++i) {
+        std::ostringstream a, b;
+        a << "a" << i;
+        b << "b" << i;
+        test_writer.write(a.str() + "\n" + b.str());
+        expected.push_back(a.str());
+        expected.push_back(b.str());
+        // Let the reader receive each one before sending the next
+        metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+      }
+    }
+    thread.join();
+
+    // The kept lines weren't received over, and outlive the reader
+    ASSERT_EQ(expected.size(), writer->lines.size()) << "recv_batch_size=" << recv_batch_size;
+    for (size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i], std::string(writer->lines[i].data(), writer->lines[i].size()))
+        << "recv_batch_size=" << recv_batch_size;
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   ::google::InitGoogleLogging(argv[0]);
   // avoid non-threadsafe logging code for these tests
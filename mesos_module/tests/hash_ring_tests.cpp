@@ -0,0 +1,126 @@
+#include <random>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "hash_ring.hpp"
+
+namespace {
+  std::vector<std::string> members(size_t count) {
+    std::vector<std::string> out;
+    for (size_t i = 0; i < count; ++i) {
+      out.push_back("10.0.0." + std::to_string(i + 1));
+    }
+    return out;
+  }
+
+  std::vector<uint64_t> random_hashes(size_t count) {
+    std::mt19937_64 engine(1234);
+    std::vector<uint64_t> out;
+    for (size_t i = 0; i < count; ++i) {
+      out.push_back(engine());
+    }
+    return out;
+  }
+
+  /**
+   * Returns the name of the member assigned to each hash.
+   */
+  std::vector<std::string> assign(
+      const std::vector<std::string>& names, const std::vector<uint64_t>& hashes) {
+    metrics::HashRing ring;
+    ring.set_members(names);
+    std::vector<std::string> out;
+    for (uint64_t hash : hashes) {
+      out.push_back(names[ring.find(hash)]);
+    }
+    return out;
+  }
+
+  size_t count_moved(const std::vector<std::string>& a, const std::vector<std::string>& b) {
+    size_t moved = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+      if (a[i] != b[i]) {
+        ++moved;
+      }
+    }
+    return moved;
+  }
+}
+
+TEST(HashRingTests, empty_and_single) {
+  metrics::HashRing ring;
+  EXPECT_EQ(0, ring.size());
+  EXPECT_EQ(0, ring.find(0));
+  EXPECT_EQ(0, ring.find(12345));
+
+  ring.set_members(members(1));
+  EXPECT_EQ(1, ring.size());
+  for (uint64_t hash : random_hashes(1000)) {
+    EXPECT_EQ(0, ring.find(hash));
+  }
+  EXPECT_EQ(0, ring.find(0));
+  EXPECT_EQ(0, ring.find(UINT64_MAX));
+}
+
+TEST(HashRingTests, balanced) {
+  std::vector<uint64_t> hashes = random_hashes(100000);
+  for (size_t count : {2, 3, 5, 8}) {
+    metrics::HashRing ring;
+    ring.set_members(members(count));
+    std::vector<size_t> per_member(count, 0);
+    for (uint64_t hash : hashes) {
+      size_t member = ring.find(hash);
+      ASSERT_GT(count, member);
+      ++per_member[member];
+    }
+    double expected = hashes.size() / (double) count;
+    for (size_t i = 0; i < count; ++i) {
+      EXPECT_NEAR(expected, per_member[i], expected * 0.2) << "member " << i << " of " << count;
+    }
+  }
+}
+
+TEST(HashRingTests, member_order_ignored) {
+  std::vector<uint64_t> hashes = random_hashes(10000);
+  std::vector<std::string> names = members(5);
+  std::vector<std::string> reversed(names.rbegin(), names.rend());
+  EXPECT_EQ(assign(names, hashes), assign(reversed, hashes));
+}
+
+TEST(HashRingTests, membership_change_moves_few) {
+  std::vector<uint64_t> hashes = random_hashes(100000);
+  std::vector<std::string> five = members(5);
+  std::vector<std::string> before = assign(five, hashes);
+
+  // removing a member only moves the hashes which were on it
+  std::vector<std::string> four(five);
+  four.erase(four.begin() + 2);
+  std::vector<std::string> removed = assign(four, hashes);
+  size_t on_removed = 0;
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    if (before[i] == five[2]) {
+      ++on_removed;
+    } else {
+      EXPECT_EQ(before[i], removed[i]);
+    }
+  }
+  EXPECT_EQ(on_removed, count_moved(before, removed));
+  EXPECT_NEAR(hashes.size() / 5., on_removed, hashes.size() * 0.05);
+
+  // adding a member only moves hashes onto it: about a sixth of them
+  std::vector<std::string> six = members(6);
+  std::vector<std::string> added = assign(six, hashes);
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    if (before[i] != added[i]) {
+      EXPECT_EQ(six[5], added[i]);
+    }
+  }
+  EXPECT_NEAR(hashes.size() / 6., count_moved(before, added), hashes.size() * 0.05);
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,267 @@
+#include <chrono>
+#include <thread>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "ingest_scheduler.hpp"
+#include "sync_util.hpp"
+
+namespace {
+  struct Turn {
+    Turn(size_t source, size_t budget, size_t received)
+      : source(source), budget(budget), received(received) { }
+    size_t source;
+    size_t budget;
+    size_t received;
+  };
+
+  /**
+   * A source with a fixed backlog of equally sized datagrams, which logs each of its turns.
+   */
+  class FakeSource : public metrics::IngestScheduler::Source {
+   public:
+    FakeSource(size_t id, double weight, size_t datagrams, size_t datagram_bytes,
+        std::vector<Turn>& turns)
+      : id(id), weight(weight), pending(datagrams), datagram_bytes(datagram_bytes), turns(turns) { }
+
+    size_t ingest(size_t budget_bytes, bool& drained) {
+      size_t received = 0;
+      while (received < budget_bytes && pending > 0) {
+        received += datagram_bytes;
+        --pending;
+      }
+      drained = (pending == 0);
+      turns.push_back(Turn(id, budget_bytes, received));
+      return received;
+    }
+
+    double ingest_weight() const {
+      return weight;
+    }
+
+    const size_t id;
+    const double weight;
+    size_t pending;
+    const size_t datagram_bytes;
+    std::vector<Turn>& turns;
+  };
+
+  class ServiceThread {
+   public:
+    ServiceThread()
+      : svc_(new boost::asio::io_service),
+        work(new boost::asio::io_service::work(*svc_)),
+        svc_thread(std::bind(&ServiceThread::run_svc, this)) { }
+
+    std::shared_ptr<boost::asio::io_service> svc() {
+      return svc_;
+    }
+
+    void run(std::function<void()> func) {
+      EXPECT_TRUE(metrics::sync_util::dispatch_run("run", *svc_, func));
+    }
+
+    /**
+     * Waits for all the provided sources to be drained.
+     */
+    void wait_drained(const std::vector<FakeSource*>& sources, size_t timeout_ms = 5000) {
+      for (size_t waited_ms = 0; waited_ms < timeout_ms; waited_ms += 5) {
+        std::shared_ptr<bool> drained = metrics::sync_util::dispatch_get<
+          boost::asio::io_service, bool>("check", *svc_, [&sources]() {
+              for (FakeSource* source : sources) {
+                if (source->pending > 0) {
+                  return false;
+                }
+              }
+              return true;
+            });
+        if (drained && *drained) {
+          return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+      ADD_FAILURE() << "Timed out waiting for sources to drain";
+    }
+
+    void join() {
+      work.reset();
+      svc_->stop();
+      svc_thread.join();
+    }
+
+   private:
+    void run_svc() {
+      svc_->run();
+    }
+
+    std::shared_ptr<boost::asio::io_service> svc_;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::thread svc_thread;
+  };
+}
+
+TEST(IngestSchedulerTests, weighted_shares) {
+  std::vector<Turn> turns;
+  FakeSource a(0, 1, 1000, 1000, turns), b(1, 2, 1000, 1000, turns), c(2, 1, 1000, 1000, turns);
+  std::vector<FakeSource*> sources{&a, &b, &c};
+
+  ServiceThread thread;
+  std::shared_ptr<metrics::IngestScheduler> scheduler(
+      new metrics::IngestScheduler(thread.svc(), 10000, 0));
+  thread.run([&]() {
+        scheduler->ready(&a);
+        scheduler->ready(&b);
+        scheduler->ready(&c);
+      });
+  thread.wait_drained(sources);
+
+  // Every turn gets the quantum times the weight
+  for (size_t i = 0; i < turns.size(); ++i) {
+    EXPECT_EQ(10000 * sources[turns[i].source]->weight, turns[i].budget) << "turn " << i;
+  }
+
+  // Round robin while all three are busy, with b receiving twice as much as the others. b is
+  // drained by its 50th turn.
+  ASSERT_LE(150, turns.size());
+  std::vector<size_t> bytes(3, 0);
+  for (size_t i = 0; i < 150; ++i) {
+    EXPECT_EQ(i % 3, turns[i].source) << "turn " << i;
+    bytes[turns[i].source] += turns[i].received;
+  }
+  EXPECT_EQ(500000, bytes[0]);
+  EXPECT_EQ(1000000, bytes[1]);
+  EXPECT_EQ(500000, bytes[2]);
+
+  // All drained: equal shares of the total
+  thread.run([&]() {
+        EXPECT_NEAR(1 / 3., scheduler->take_share(&a), 0.001);
+        EXPECT_NEAR(1 / 3., scheduler->take_share(&b), 0.001);
+        EXPECT_EQ(0, scheduler->take_share(&a));
+        EXPECT_EQ(0, scheduler->active_count());
+      });
+
+  scheduler.reset();
+  thread.join();
+}
+
+TEST(IngestSchedulerTests, light_source_not_starved) {
+  std::vector<Turn> turns;
+  FakeSource heavy(0, 1, 100000, 1000, turns), light(1, 1, 5, 1000, turns);
+  std::vector<FakeSource*> sources{&heavy, &light};
+
+  ServiceThread thread;
+  std::shared_ptr<metrics::IngestScheduler> scheduler(
+      new metrics::IngestScheduler(thread.svc(), 16000, 0));
+  thread.run([&]() {
+        scheduler->ready(&heavy);
+        scheduler->ready(&light);
+      });
+  thread.wait_drained(sources);
+
+  // The heavy source gets one turn, then the light one is drained in its first turn
+  ASSERT_LE(2, turns.size());
+  EXPECT_EQ(0, turns[0].source);
+  EXPECT_EQ(16000, turns[0].received);
+  EXPECT_EQ(1, turns[1].source);
+  EXPECT_EQ(5000, turns[1].received);
+  for (size_t i = 2; i < turns.size(); ++i) {
+    EXPECT_EQ(0, turns[i].source);
+  }
+
+  scheduler.reset();
+  thread.join();
+}
+
+TEST(IngestSchedulerTests, overshoot_repaid) {
+  std::vector<Turn> turns;
+  // big datagrams are larger than the quantum
+  FakeSource big(0, 1, 10, 1500, turns), small(1, 1, 30, 500, turns);
+  std::vector<FakeSource*> sources{&big, &small};
+
+  ServiceThread thread;
+  std::shared_ptr<metrics::IngestScheduler> scheduler(
+      new metrics::IngestScheduler(thread.svc(), 1000, 0));
+  thread.run([&]() {
+        scheduler->ready(&big);
+        scheduler->ready(&small);
+      });
+  thread.wait_drained(sources);
+
+  // Big datagrams take the deficit negative, so big sits out a turn every so often
+  size_t big_bytes = 0, small_bytes = 0;
+  for (const Turn& turn : turns) {
+    (turn.source == 0 ? big_bytes : small_bytes) += turn.received;
+    if (big_bytes == 15000) {
+      break;
+    }
+  }
+  // both were busy throughout: equal bytes, within a quantum plus the largest datagram
+  EXPECT_EQ(15000, big_bytes);
+  EXPECT_NEAR(15000, small_bytes, 2500);
+
+  scheduler.reset();
+  thread.join();
+}
+
+TEST(IngestSchedulerTests, limit) {
+  std::vector<Turn> turns;
+  FakeSource a(0, 1, 200, 1000, turns), b(1, 1, 200, 1000, turns);
+  std::vector<FakeSource*> sources{&a, &b};
+
+  ServiceThread thread;
+  // 1MB/s with a 100KB burst: 400KB takes ~300ms
+  std::shared_ptr<metrics::IngestScheduler> scheduler(
+      new metrics::IngestScheduler(thread.svc(), 16000, 1000000));
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  thread.run([&]() {
+        scheduler->ready(&a);
+        scheduler->ready(&b);
+      });
+  thread.wait_drained(sources);
+  double elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  LOG(INFO) << "Took " << elapsed_ms << "ms";
+  EXPECT_LE(250, elapsed_ms);
+  EXPECT_GE(2000, elapsed_ms);
+
+  // still taking turns
+  for (size_t i = 0; i < turns.size(); ++i) {
+    EXPECT_EQ(i % 2, turns[i].source) << "turn " << i;
+    EXPECT_GE(16000, turns[i].budget);
+  }
+
+  scheduler.reset();
+  thread.join();
+}
+
+TEST(IngestSchedulerTests, remove) {
+  std::vector<Turn> turns;
+  FakeSource a(0, 1, 100, 1000, turns), b(1, 1, 100, 1000, turns);
+
+  ServiceThread thread;
+  std::shared_ptr<metrics::IngestScheduler> scheduler(
+      new metrics::IngestScheduler(thread.svc(), 10000, 0));
+  thread.run([&]() {
+        scheduler->ready(&a);
+        scheduler->ready(&b);
+        scheduler->remove(&a);
+        // unknown sources are ignored
+        scheduler->remove(&a);
+      });
+  thread.wait_drained({&b});
+
+  for (const Turn& turn : turns) {
+    EXPECT_EQ(1, turn.source);
+  }
+  EXPECT_EQ(100, a.pending);
+
+  scheduler.reset();
+  thread.join();
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -131,7 +131,7 @@ TEST_F(IORunnerImplTests, write_then_immediate_shutdown) {
   metrics::IORunnerImpl runner;
   runner.init(params);
 
-  std::shared_ptr<metrics::ContainerReader> reader1 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader1 = runner.create_container_reader(0, NULL);
   size_t input_port1 = reader1->open().get().port;
   mesos::ContainerID container1 = container_id("cid1");
   mesos::ExecutorInfo executor1 = exec_info("fid1", "eid1");
@@ -141,7 +141,7 @@ TEST_F(IORunnerImplTests, write_then_immediate_shutdown) {
 
   writer1.write("writer1:1");
 
-  std::shared_ptr<metrics::ContainerReader> reader2 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader2 = runner.create_container_reader(0, NULL);
   size_t input_port2 = reader2->open().get().port;
   // no container registered
   TestUDPWriteSocket writer2;
@@ -149,7 +149,7 @@ TEST_F(IORunnerImplTests, write_then_immediate_shutdown) {
 
   writer2.write("writer2:1");
 
-  std::shared_ptr<metrics::ContainerReader> reader3 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader3 = runner.create_container_reader(0, NULL);
   size_t input_port3 = reader3->open().get().port;
   mesos::ContainerID container3 = container_id("cid3");
   mesos::ExecutorInfo executor3 = exec_info("fid3", "eid3");
@@ -180,7 +180,7 @@ TEST_F(IORunnerImplTests, data_flow_multi_stream) {
   metrics::IORunnerImpl runner;
   runner.init(params);
 
-  std::shared_ptr<metrics::ContainerReader> reader1 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader1 = runner.create_container_reader(0, NULL);
   size_t input_port1 = reader1->open().get().port;
   mesos::ContainerID container1 = container_id("cid1");
   mesos::ExecutorInfo executor1 = exec_info("fid1", "eid1");
@@ -194,7 +194,7 @@ TEST_F(IORunnerImplTests, data_flow_multi_stream) {
 
   writer1.write("writer1:1");
 
-  std::shared_ptr<metrics::ContainerReader> reader2 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader2 = runner.create_container_reader(0, NULL);
   size_t input_port2 = reader2->open().get().port;
   // no container registered
   TestUDPWriteSocket writer2;
@@ -202,7 +202,7 @@ TEST_F(IORunnerImplTests, data_flow_multi_stream) {
 
   writer2.write("writer2:1");
 
-  std::shared_ptr<metrics::ContainerReader> reader3 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader3 = runner.create_container_reader(0, NULL);
   size_t input_port3 = reader3->open().get().port;
   mesos::ContainerID container3 = container_id("cid3");
   mesos::ExecutorInfo executor3 = exec_info("fid3", "eid3");
@@ -279,7 +279,7 @@ TEST_F(IORunnerImplTests, data_flow_multi_stream_unchunked) {
   metrics::IORunnerImpl runner;
   runner.init(params);
 
-  std::shared_ptr<metrics::ContainerReader> reader1 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader1 = runner.create_container_reader(0, NULL);
   size_t input_port1 = reader1->open().get().port;
   mesos::ContainerID container1 = container_id("cid1");
   mesos::ExecutorInfo executor1 = exec_info("fid1", "eid1");
@@ -293,7 +293,7 @@ TEST_F(IORunnerImplTests, data_flow_multi_stream_unchunked) {
 
   writer1.write("writer1:1");
 
-  std::shared_ptr<metrics::ContainerReader> reader2 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader2 = runner.create_container_reader(0, NULL);
   size_t input_port2 = reader2->open().get().port;
   // no container registered
   TestUDPWriteSocket writer2;
@@ -301,7 +301,7 @@ TEST_F(IORunnerImplTests, data_flow_multi_stream_unchunked) {
 
   writer2.write("writer2:1");
 
-  std::shared_ptr<metrics::ContainerReader> reader3 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader3 = runner.create_container_reader(0, NULL);
   size_t input_port3 = reader3->open().get().port;
   mesos::ContainerID container3 = container_id("cid3");
   mesos::ExecutorInfo executor3 = exec_info("fid3", "eid3");
@@ -371,7 +371,7 @@ TEST_F(IORunnerImplTests, data_flow_multi_stream_unannotated) {
   metrics::IORunnerImpl runner;
   runner.init(params);
 
-  std::shared_ptr<metrics::ContainerReader> reader1 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader1 = runner.create_container_reader(0, NULL);
   size_t input_port1 = reader1->open().get().port;
   mesos::ContainerID container1 = container_id("cid1");
   mesos::ExecutorInfo executor1 = exec_info("fid1", "eid1");
@@ -385,7 +385,7 @@ TEST_F(IORunnerImplTests, data_flow_multi_stream_unannotated) {
 
   writer1.write("writer1:1");
 
-  std::shared_ptr<metrics::ContainerReader> reader2 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader2 = runner.create_container_reader(0, NULL);
   size_t input_port2 = reader2->open().get().port;
   // no container registered
   TestUDPWriteSocket writer2;
@@ -393,7 +393,7 @@ TEST_F(IORunnerImplTests, data_flow_multi_stream_unannotated) {
 
   writer2.write("writer2:1");
 
-  std::shared_ptr<metrics::ContainerReader> reader3 = runner.create_container_reader(0);
+  std::shared_ptr<metrics::ContainerReader> reader3 = runner.create_container_reader(0, NULL);
   size_t input_port3 = reader3->open().get().port;
   mesos::ContainerID container3 = container_id("cid3");
   mesos::ExecutorInfo executor3 = exec_info("fid3", "eid3");
@@ -452,10 +452,101 @@ TEST_F(IORunnerImplTests, data_flow_multi_stream_unannotated) {
   EXPECT_EQ(9, datapoints);
 }
 
+TEST_F(IORunnerImplTests, data_flow_multi_stream_multi_thread) {
+  TestUDPReadSocket udp_reader;
+  size_t udp_output_port = udp_reader.listen();
+  TestTCPReadSession tcp_reader(23460);
+  size_t tcp_output_port = tcp_reader.port();
+
+  mesos::Parameters params = get_params(udp_output_port, tcp_output_port);
+
+  mesos::Parameter* param = params.add_parameter();
+  param->set_key(metrics::params::IO_THREADS);
+  param->set_value("4");
+
+  metrics::IORunnerImpl runner;
+  runner.init(params);
+
+  // Create enough readers that at least two of them are very likely to land on different threads.
+  const size_t reader_count = 8;
+  std::vector<mesos::ContainerID> containers;
+  std::vector<mesos::ExecutorInfo> executors;
+  std::vector<std::shared_ptr<metrics::ContainerReader>> readers;
+  std::vector<std::shared_ptr<TestUDPWriteSocket>> writers;
+  for (size_t i = 0; i < reader_count; ++i) {
+    std::ostringstream cid, fid, eid;
+    cid << "cid" << i;
+    fid << "fid" << i;
+    eid << "eid" << i;
+    containers.push_back(container_id(cid.str()));
+    executors.push_back(exec_info(fid.str(), eid.str()));
+
+    std::shared_ptr<metrics::ContainerReader> reader =
+      runner.create_container_reader(0, &containers[i]);
+    size_t input_port = reader->open().get().port;
+    reader->register_container(containers[i], executors[i]);
+    readers.push_back(reader);
+
+    std::shared_ptr<TestUDPWriteSocket> writer(new TestUDPWriteSocket);
+    writer->connect(input_port);
+    writers.push_back(writer);
+  }
+
+  // wait for the TCP sender to finish sending its header.
+  // otherwise it'll reject our data:
+  tcp_reader.wait_for_available(5);
+
+  for (size_t i = 0; i < reader_count; ++i) {
+    std::ostringstream oss;
+    oss << "writer" << i << ":1\nwriter" << i << ":2";
+    writers[i]->write(oss.str());
+  }
+
+  // Wait up to (30 * 100ms) = 3s for the above rows to show up in the output:
+  std::unordered_set<std::string> udp_stat_rows;
+  for (size_t i = 0; i < 30 && udp_stat_rows.size() != 2 * reader_count; i++) {
+    std::string chunk = udp_reader.read(100 /*ms*/);
+    if (chunk.empty()) {
+      continue;
+    }
+    std::istringstream iss(chunk);
+    std::copy(std::istream_iterator<std::string>(iss), std::istream_iterator<std::string>(),
+        std::inserter(udp_stat_rows, udp_stat_rows.begin()));
+  }
+
+  EXPECT_EQ(2 * reader_count, udp_stat_rows.size());
+  for (size_t i = 0; i < reader_count; ++i) {
+    std::ostringstream row1, row2;
+    row1 << "writer" << i << ":1";
+    row2 << "writer" << i << ":2";
+    EXPECT_TRUE(udp_stat_rows.count(annotated_row(row1.str(), containers[i], executors[i])));
+    EXPECT_TRUE(udp_stat_rows.count(annotated_row(row2.str(), containers[i], executors[i])));
+  }
+
+  std::ostringstream tcp_oss;
+  for (size_t i = 0; i < 10 && tcp_reader.wait_for_available(1); i++) {
+    while (tcp_reader.available()) {
+      std::string chunk = *tcp_reader.read();
+      tcp_oss << chunk;
+    }
+  }
+
+  // verify that the blocks from all threads were merged into a single valid avro file
+  LOG(INFO) << tcp_oss.str();
+  std::string tmppath = write_tmp(tcp_oss.str());
+  avro::DataFileReader<metrics_schema::MetricList> avro_reader(tmppath.data());
+  metrics_schema::MetricList flist;
+  size_t datapoints = 0;
+  while (avro_reader.read(flist)) {
+    datapoints += flist.datapoints.size();
+  }
+  EXPECT_EQ(2 * reader_count, datapoints);
+}
+
 TEST_F(IORunnerImplTests, init_fails) {
   metrics::IORunnerImpl runner;
   EXPECT_DETH(runner.dispatch(std::bind(noop)), ".*init\\(\\) wasn't called before dispatch\\(\\).*");
-  EXPECT_DETH(runner.create_container_reader(0),
+  EXPECT_DETH(runner.create_container_reader(0, NULL),
       ".*init\\(\\) wasn't called before create_container_reader\\(\\)");
 
   mesos::Parameters params;
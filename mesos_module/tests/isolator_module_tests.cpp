@@ -67,6 +67,30 @@ TEST(IsolatorModuleTests, prepare_returns_success) {
   EXPECT_EQ(std::to_string(endpoint.port), env.variables(1).value());
 }
 
+TEST(IsolatorModuleTests, prepare_returns_unix_socket) {
+  std::shared_ptr<MockContainerAssigner> mock_assigner(new MockContainerAssigner());
+  metrics::IsolatorModule<MockContainerAssigner> mod(mock_assigner);
+
+  mesos::ContainerID container_id;
+  container_id.set_value("test container");
+
+  mesos::slave::ContainerConfig config;
+  config.mutable_executor_info()->mutable_executor_id()->set_value("test executor");
+
+  metrics::UDPEndpoint endpoint("/test/dir/test container.sock", 0);
+  EXPECT_CALL(*mock_assigner, register_container(container_id, config.executor_info()))
+    .WillOnce(Return(Try<metrics::UDPEndpoint>(endpoint)));
+
+  Option<mesos::slave::ContainerLaunchInfo> ret =
+    mod.prepare(container_id, config).get();
+  EXPECT_FALSE(ret.isNone());
+
+  const mesos::Environment& env = ret.get().environment();
+  EXPECT_EQ(1, env.variables_size());
+  EXPECT_EQ("STATSD_UNIX_SOCKET", env.variables(0).name());
+  EXPECT_EQ(endpoint.host, env.variables(0).value());
+}
+
 TEST(IsolatorModuleTests, prepare_returns_error) {
   mesos::Parameters params;
   mesos::Parameter* param = params.add_parameter();
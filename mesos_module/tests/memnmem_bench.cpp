@@ -0,0 +1,67 @@
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "memnmem.h"
+
+/**
+ * Compares the memnmem() implementations when searching statsd lines for the "|#" tag section,
+ * as done by the datadog tagger for every line. Not run as part of the unit tests: timings depend
+ * heavily on the host.
+ */
+
+namespace {
+  const size_t MIN_BENCH_MS = 500;
+  const std::string TAG_PREFIX("|#");
+
+  const memnmem_impl_t IMPLS[] = {MEMNMEM_SCALAR, MEMNMEM_SSE2, MEMNMEM_AVX2};
+  const char* IMPL_NAMES[] = {"scalar", "sse2", "avx2"};
+
+  void run_bench(const std::string& label, const std::vector<std::string>& lines) {
+    for (memnmem_impl_t impl : IMPLS) {
+      if (!memnmem_supported(impl)) {
+        continue;
+      }
+      size_t searched = 0, found = 0;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      std::chrono::duration<double> elapsed;
+      do {
+        for (const std::string& line : lines) {
+          if (memnmem_with(impl, line.data(), line.size(),
+                  TAG_PREFIX.data(), TAG_PREFIX.size()) != NULL) {
+            ++found;
+          }
+        }
+        searched += lines.size();
+        elapsed = std::chrono::steady_clock::now() - start;
+      } while (elapsed < std::chrono::milliseconds(MIN_BENCH_MS));
+
+      printf("BENCH %-16s %-6s %6.1f ns/line (found %lu%%)\n", label.c_str(), IMPL_NAMES[impl],
+          1e9 * elapsed.count() / searched, (unsigned long)(100 * found / searched));
+    }
+  }
+
+  std::vector<std::string> repeat(const std::string& line) {
+    return std::vector<std::string>(1000, line);
+  }
+}
+
+TEST(MemnmemBench, tag_prefix) {
+  run_bench("short_untagged", repeat("some.app.counter:1|c"));
+  run_bench("short_tagged", repeat("some.app.counter:1|c|#env:prod"));
+  run_bench("sampled_tagged", repeat("some.app.request.latency:12.5|ms|@0.25|#env:prod,az:a"));
+  run_bench("many_sections", repeat("some.app.histogram:1|2|3|4|5|6|7|8|9|10|11|12|h|@0.5"));
+  run_bench("long_tagged", repeat("some.app.gauge:3.5|g|@0.5|#"
+          + std::string(200, 't') + ":v,host:agent-1,region:us-west-2"));
+  run_bench("long_untagged", repeat("some.app.gauge:3.5|g|@0.5|"
+          + std::string(300, 'x')));
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,3 +1,8 @@
+#include <random>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
@@ -5,6 +10,33 @@
 
 namespace {
   const std::string hello("hello"), hey("hey"), hi("hi"), h("h"), empty("");
+
+  const memnmem_impl_t IMPLS[] = {MEMNMEM_SCALAR, MEMNMEM_SSE2, MEMNMEM_AVX2};
+
+  const char* impl_name(memnmem_impl_t impl) {
+    switch (impl) {
+      case MEMNMEM_SCALAR:
+        return "scalar";
+      case MEMNMEM_SSE2:
+        return "sse2";
+      case MEMNMEM_AVX2:
+        return "avx2";
+    }
+    return "unknown";
+  }
+
+  const char* naive_memnmem(const char* haystack, size_t haystack_size,
+      const char* needle, size_t needle_size) {
+    if (needle_size == 0) {
+      return NULL;
+    }
+    for (size_t i = 0; i + needle_size <= haystack_size; ++i) {
+      if (memcmp(haystack + i, needle, needle_size) == 0) {
+        return haystack + i;
+      }
+    }
+    return NULL;
+  }
 }
 
 TEST(TaggerTests, memnmem) {
@@ -40,6 +72,120 @@ TEST(TaggerTests, memnmem) {
       memnmem((char*) hhiheyhello.data(), hhiheyhello.size(), heyhello.data(), heyhello.size()));
 }
 
+TEST(TaggerTests, memnmem_impls_exhaustive) {
+  // Haystacks made of the needle's own chars, so that partial matches (first char only, last
+  // char only, all but one char) turn up everywhere
+  const std::string needles[] = {"|#", "##", "|x#", "abcd", "|#|#|", "aaaaaaaaaaaaaaaaab"};
+  std::mt19937 rand(1);
+  for (memnmem_impl_t impl : IMPLS) {
+    if (!memnmem_supported(impl)) {
+      LOG(INFO) << "Skipping unsupported impl " << impl_name(impl);
+      continue;
+    }
+    for (const std::string& needle : needles) {
+      std::string chars = needle + "z";
+      for (size_t size = 0; size <= 100; ++size) {
+        for (size_t round = 0; round < 20; ++round) {
+          std::string haystack;
+          for (size_t i = 0; i < size; ++i) {
+            haystack += chars[rand() % chars.size()];
+          }
+          ASSERT_EQ(naive_memnmem(haystack.data(), haystack.size(), needle.data(), needle.size()),
+              memnmem_with(impl, haystack.data(), haystack.size(), needle.data(), needle.size()))
+            << impl_name(impl) << " needle=" << needle << " haystack=" << haystack;
+        }
+      }
+    }
+  }
+}
+
+TEST(TaggerTests, memnmem_impls_sparse) {
+  // Long runs without any char of the needle, so that the SIMD versions skip whole blocks
+  const std::string needles[] = {"|#", "|x#", "|" + std::string(33, 'y') + "#"};
+  std::mt19937 rand(2);
+  for (memnmem_impl_t impl : IMPLS) {
+    if (!memnmem_supported(impl)) {
+      continue;
+    }
+    for (const std::string& needle : needles) {
+      for (size_t size = 0; size <= 200; ++size) {
+        for (size_t round = 0; round < 20; ++round) {
+          std::string haystack(size, 'z');
+          // a few first chars, and sometimes the whole needle
+          for (size_t i = rand() % 3; i > 0 && size > 0; --i) {
+            haystack[rand() % size] = needle[0];
+          }
+          if (size >= needle.size() && rand() % 2 == 0) {
+            haystack.replace(rand() % (size - needle.size() + 1), needle.size(), needle);
+          }
+          ASSERT_EQ(naive_memnmem(haystack.data(), haystack.size(), needle.data(), needle.size()),
+              memnmem_with(impl, haystack.data(), haystack.size(), needle.data(), needle.size()))
+            << impl_name(impl) << " needle=" << needle << " haystack=" << haystack;
+        }
+      }
+    }
+  }
+}
+
+TEST(TaggerTests, memnmem_impls_every_position) {
+  for (memnmem_impl_t impl : IMPLS) {
+    if (!memnmem_supported(impl)) {
+      continue;
+    }
+    for (size_t needle_size = 1; needle_size <= 40; ++needle_size) {
+      std::string needle(needle_size, '|');
+      needle[needle_size - 1] = '#';
+      // a haystack of near misses ("|||...") with the needle at each possible position, across
+      // every block boundary
+      for (size_t size = needle_size; size <= 100; ++size) {
+        for (size_t pos = 0; pos + needle_size <= size; ++pos) {
+          std::string haystack(size, '|');
+          haystack.replace(pos, needle_size, needle);
+          ASSERT_EQ(haystack.data() + pos,
+              memnmem_with(impl, haystack.data(), haystack.size(), needle.data(), needle.size()))
+            << impl_name(impl) << " needle_size=" << needle_size << " size=" << size
+            << " pos=" << pos;
+        }
+        std::string haystack(size, '|');
+        ASSERT_EQ(NULL,
+            memnmem_with(impl, haystack.data(), haystack.size(), needle.data(), needle.size()))
+          << impl_name(impl) << " needle_size=" << needle_size << " size=" << size;
+      }
+    }
+  }
+}
+
+TEST(TaggerTests, memnmem_impls_no_overread) {
+  // Put the haystack right before an inaccessible page: reading past its end would crash
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  char* pages = (char*) mmap(NULL, 2 * page_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(MAP_FAILED, pages);
+  ASSERT_EQ(0, mprotect(pages + page_size, page_size, PROT_NONE));
+  char* page_end = pages + page_size;
+  memset(pages, '|', page_size);
+
+  const std::string needles[] = {"|#", "||#", "|" + std::string(33, 'x') + "#"};
+  for (memnmem_impl_t impl : IMPLS) {
+    if (!memnmem_supported(impl)) {
+      continue;
+    }
+    for (const std::string& needle : needles) {
+      for (size_t size = 0; size <= 100; ++size) {
+        EXPECT_EQ(NULL, memnmem_with(impl, page_end - size, size, needle.data(), needle.size()));
+        if (size >= needle.size()) {
+          // found right at the end
+          memcpy(page_end - needle.size(), needle.data(), needle.size());
+          EXPECT_EQ(page_end - needle.size(),
+              memnmem_with(impl, page_end - size, size, needle.data(), needle.size()));
+          memset(page_end - needle.size(), '|', needle.size());
+        }
+      }
+    }
+  }
+  munmap(pages, 2 * page_size);
+}
+
 int main(int argc, char **argv) {
   ::google::InitGoogleLogging(argv[0]);
   FLAGS_logtostderr = 1;
@@ -2,17 +2,16 @@
 #include <thread>
 
 #include <gtest/gtest.h>
+#include <stout/os.hpp>
 
 #include "metrics_tcp_sender.hpp"
+#include "output_spool.hpp"
 #include "test_tcp_socket.hpp"
 
 namespace {
   metrics::MetricsTCPSender::buf_ptr_t build_buf(const std::string& str) {
-    metrics::MetricsTCPSender::buf_ptr_t buf(new boost::asio::streambuf);
-    {
-      std::ostream ostream(buf.get());
-      ostream << str;
-    }
+    metrics::MetricsTCPSender::buf_ptr_t buf(new metrics::ByteBuffer);
+    buf->append(str.data(), str.size());
     return buf;
   }
 
@@ -197,6 +196,51 @@ TEST(MetricsTCPSenderTests, connect_succeeds_data_sent) {
   EXPECT_FALSE(test_reader.available());
 }
 
+TEST(MetricsTCPSenderTests, queued_data_sent_in_order) {
+  TestTCPReadSession test_reader;
+  size_t listen_port = test_reader.port();
+
+  ServiceThread thread;
+  {
+    metrics::MetricsTCPSender sender(thread.svc(), SESSION_HEADER, DEST_LOCAL_IP, listen_port);
+    sender.start();
+
+    thread.flush();
+    EXPECT_TRUE(test_reader.wait_for_available(1));
+    EXPECT_EQ(SESSION_HEADER, *test_reader.read());
+
+    // many small sends within a single handler: queued behind each other and gathered into writes
+    std::vector<metrics::MetricsTCPSender::buf_ptr_t> bufs;
+    std::ostringstream expect;
+    for (size_t i = 0; i < 1000; ++i) {
+      std::string str = std::to_string(i) + ",";
+      bufs.push_back(build_buf(str));
+      expect << str;
+    }
+    metrics::sync_util::dispatch_run("send", *thread.svc(), [&sender, &bufs]() {
+          for (metrics::MetricsTCPSender::buf_ptr_t buf : bufs) {
+            sender.send(buf);
+          }
+        });
+    thread.flush();
+
+    std::string got;
+    while (got.size() < expect.str().size() && test_reader.wait_for_available(1)) {
+      got += *test_reader.read();
+    }
+    EXPECT_EQ(expect.str(), got);
+
+    // the sender has released all the buffers once they're written
+    thread.flush();
+    for (const metrics::MetricsTCPSender::buf_ptr_t& buf : bufs) {
+      EXPECT_EQ(1, buf.use_count());
+    }
+  }
+  thread.join();
+
+  EXPECT_FALSE(test_reader.available());
+}
+
 TEST(MetricsTCPSenderTests, connect_fails_then_succeeds) {
   std::shared_ptr<TestTCPReadSession> test_reader(new TestTCPReadSession);
   size_t listen_port = test_reader->port();
@@ -235,6 +279,53 @@ TEST(MetricsTCPSenderTests, connect_fails_then_succeeds) {
   EXPECT_FALSE(test_reader->available());
 }
 
+TEST(MetricsTCPSenderTests, spooled_while_disconnected) {
+  std::string spool_path = "metrics_tcp_sender_tests-XXXXXX";
+  ASSERT_TRUE(mkdtemp((char*)spool_path.c_str()) != NULL);
+
+  std::shared_ptr<TestTCPReadSession> test_reader(new TestTCPReadSession);
+  size_t listen_port = test_reader->port();
+  test_reader.reset();
+
+  ServiceThread thread;
+  {
+    Try<std::shared_ptr<metrics::OutputSpool>> spool = metrics::OutputSpool::create(
+        spool_path, SESSION_HEADER, 1024 * 1024, metrics::OutputSpool::DROP_OLDEST);
+    ASSERT_FALSE(spool.isError()) << spool.error();
+    metrics::MetricsTCPSender sender(thread.svc(), SESSION_HEADER, DEST_LOCAL_IP, listen_port,
+        metrics::MetricsTCPSender::PENDING_LIMIT, spool.get(), 1024 * 1024);
+    sender.start();
+    thread.flush();
+
+    // nothing listening: spooled rather than dropped
+    sender.send(build_buf(HELLO));
+    sender.send(build_buf(HEY));
+    thread.flush();
+    EXPECT_EQ(HELLO.size() + HEY.size(), spool.get()->record_bytes());
+
+    // reopen reader socket at previous portnum
+    test_reader.reset(new TestTCPReadSession(listen_port));
+
+    // wait long enough for sender to reconnect
+    LOG(INFO) << "TEST SLEEP FOR SENDER";
+    sleep(5);
+
+    // replayed after the header, followed by new data
+    sender.send(build_buf(HI));
+    thread.flush();
+    std::string expect = SESSION_HEADER + HELLO + HEY + HI, got;
+    while (got.size() < expect.size() && test_reader->wait_for_available()) {
+      got += *test_reader->read();
+    }
+    EXPECT_EQ(expect, got);
+    EXPECT_TRUE(spool.get()->empty());
+  }
+  thread.join();
+
+  EXPECT_FALSE(test_reader->available());
+  os::rmdir(spool_path);
+}
+
 TEST(MetricsTCPSenderTests, connect_succeeds_then_fails) {
   std::shared_ptr<TestTCPReadSession> test_reader(new TestTCPReadSession);
   size_t listen_port = test_reader->port();
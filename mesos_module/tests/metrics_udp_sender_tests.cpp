@@ -1,4 +1,5 @@
 #include <atomic>
+#include <chrono>
 #include <thread>
 
 #include <gtest/gtest.h>
@@ -12,6 +13,8 @@ namespace {
 
   const boost::asio::ip::udp::endpoint DEST_LOCAL_ENDPOINT(
       boost::asio::ip::address::from_string("127.0.0.1"), 0 /* port */);
+  const boost::asio::ip::udp::endpoint DEST_LOCAL_ENDPOINT2(
+      boost::asio::ip::address::from_string("127.0.0.2"), 0 /* port */);
   const boost::asio::ip::udp::endpoint DEST_LOCAL_ENDPOINT6(
       boost::asio::ip::address::from_string("::1"), 0 /* port */);
 
@@ -144,6 +147,7 @@ TEST(UDPSenderTests, udp_resolve_reshuffle_data_sent_single_destination) {
     StubUDPSender::ptr_t sender = StubUDPSender::custom_success(
         thread.svc(), listen_port, endpoints);
     sender->start();
+    sender->wait_for_lookup();
 
     // flush a bunch to ensure resolve code is exercised between writes:
     metrics::sync_util::dispatch_run("flush1", *thread.svc(), &flush_service_queue_with_noop);
@@ -177,6 +181,163 @@ TEST(UDPSenderTests, udp_resolve_reshuffle_data_sent_single_destination) {
   }
 }
 
+TEST(UDPSenderTests, udp_queue_flush_in_order) {
+  TestUDPReadSocket test_reader;
+  size_t listen_port = test_reader.listen();
+
+  ServiceThread thread;
+  {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
+    sender->start();
+    sender->wait_for_lookup();
+
+    metrics::sync_util::dispatch_run("queue", *thread.svc(), [&sender]() {
+          // runs of equally sized datagrams (which may be merged into GSO sends), mixed sizes,
+          // and an immediate send() which goes out after anything already queued
+          sender->queue(HEY.data(), HEY.size());
+          sender->queue(HEY.data(), HEY.size());
+          sender->queue(HI.data(), HI.size());
+          sender->queue(HELLO.data(), HELLO.size());
+          sender->send(HI.data(), HI.size());
+          for (size_t i = 0; i < 100; ++i) {
+            sender->queue(HELLO.data(), HELLO.size());
+          }
+          sender->queue(HI.data(), HI.size());
+          sender->queue(HEY.data(), HEY.size());
+          sender->flush();
+        });
+  }
+  thread.join();
+
+  EXPECT_EQ(HEY, test_reader.read());
+  EXPECT_EQ(HEY, test_reader.read());
+  EXPECT_EQ(HI, test_reader.read());
+  EXPECT_EQ(HELLO, test_reader.read());
+  EXPECT_EQ(HI, test_reader.read());
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(HELLO, test_reader.read()) << i;
+  }
+  EXPECT_EQ(HI, test_reader.read());
+  EXPECT_EQ(HEY, test_reader.read());
+  EXPECT_FALSE(test_reader.available());
+}
+
+TEST(UDPSenderTests, udp_queue_destination_down) {
+  TestUDPReadSocket test_reader;
+  size_t listen_port = test_reader.listen();
+
+  ServiceThread thread;
+  {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
+    sender->start();
+    sender->wait_for_lookup();
+
+    // nothing listening: the connected socket gets ECONNREFUSED back, which is tolerated
+    test_reader.close();
+    for (size_t i = 0; i < 3; ++i) {
+      metrics::sync_util::dispatch_run("queue", *thread.svc(), [&sender]() {
+            sender->queue(HELLO.data(), HELLO.size());
+            sender->queue(HEY.data(), HEY.size());
+            sender->flush();
+            sender->send(HI.data(), HI.size());
+          });
+    }
+
+    // listening again: sends recover
+    EXPECT_EQ(listen_port, test_reader.listen(listen_port));
+    metrics::sync_util::dispatch_run("queue", *thread.svc(), [&sender]() {
+          sender->queue(HELLO.data(), HELLO.size());
+          sender->flush();
+        });
+  }
+  thread.join();
+
+  EXPECT_EQ(HELLO, test_reader.read());
+}
+
+TEST(UDPSenderTests, udp_slow_resolve_data_sent) {
+  TestUDPReadSocket test_reader;
+  size_t listen_port = test_reader.listen();
+
+  ServiceThread thread;
+  {
+    // every lookup after the first is stuck until released, refreshing every 1ms
+    StubUDPSender::ptr_t sender = StubUDPSender::blocking(thread.svc(), listen_port);
+    sender->start();
+    sender->wait_for_lookup();
+
+    // the io thread stays responsive while the next lookup is stuck, and data keeps going to the
+    // previously resolved endpoint
+    for (size_t i = 0; i < 10; ++i) {
+      const std::string data = HELLO + std::to_string(i);
+      ASSERT_TRUE(metrics::sync_util::dispatch_run("send", *thread.svc(), [&sender, &data]() {
+            sender->send(data.data(), data.size());
+          }));
+      EXPECT_EQ(data, test_reader.read()) << i;
+    }
+    EXPECT_EQ(2, sender->lookup_count());
+
+    // the stuck lookup completes, and its result is used
+    sender->release_lookups();
+    sender->wait_for_lookup(2);
+    ASSERT_TRUE(metrics::sync_util::dispatch_run("send", *thread.svc(), [&sender]() {
+          sender->send(HEY.data(), HEY.size());
+        }));
+    EXPECT_EQ(HEY, test_reader.read());
+  }
+  thread.join();
+
+  EXPECT_FALSE(test_reader.available());
+}
+
+TEST(UDPSenderTests, udp_fanout_routed_by_hash) {
+  TestUDPReadSocket test_reader1, test_reader2;
+  size_t listen_port = test_reader1.listen(DEST_LOCAL_ENDPOINT.address(), 0);
+  EXPECT_EQ(listen_port, test_reader2.listen(DEST_LOCAL_ENDPOINT2.address(), listen_port));
+
+  std::vector<std::string> expect1, expect2;
+  ServiceThread thread;
+  {
+    // duplicate addresses are only sent to once
+    std::vector<boost::asio::ip::udp::endpoint> endpoints;
+    endpoints.push_back(DEST_LOCAL_ENDPOINT2);
+    endpoints.push_back(DEST_LOCAL_ENDPOINT);
+    endpoints.push_back(DEST_LOCAL_ENDPOINT2);
+    StubUDPSender::ptr_t sender = StubUDPSender::fanout(thread.svc(), listen_port, endpoints);
+    sender->start();
+    sender->wait_for_lookup();
+
+    metrics::sync_util::dispatch_run("send", *thread.svc(), [&]() {
+          // destinations are ordered by address
+          ASSERT_EQ(2, sender->destination_count());
+          for (size_t i = 0; i < 100; ++i) {
+            std::string data = "series" + std::to_string(i);
+            uint64_t hash = std::hash<std::string>()(data) * 0x9e3779b97f4a7c15ULL;
+            size_t destination = sender->route(hash);
+            ASSERT_GT(2, destination);
+            // routing is stable
+            EXPECT_EQ(destination, sender->route(hash));
+            (destination == 0 ? expect1 : expect2).push_back(data);
+            sender->queue(destination, data.data(), data.size());
+          }
+          sender->flush();
+        });
+  }
+  thread.join();
+
+  // both got a share, and each got exactly what was routed to it
+  EXPECT_LT(10, expect1.size());
+  EXPECT_LT(10, expect2.size());
+  for (const std::string& data : expect1) {
+    EXPECT_EQ(data, test_reader1.read());
+  }
+  for (const std::string& data : expect2) {
+    EXPECT_EQ(data, test_reader2.read());
+  }
+  EXPECT_FALSE(test_reader1.available());
+  EXPECT_FALSE(test_reader2.available());
+}
+
 int main(int argc, char **argv) {
   ::google::InitGoogleLogging(argv[0]);
   // avoid non-threadsafe logging code for these tests
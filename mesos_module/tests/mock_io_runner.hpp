@@ -7,6 +7,9 @@
 class MockIORunner : public metrics::IORunner {
  public:
   MOCK_METHOD1(dispatch, void(std::function<void()> func));
-  MOCK_METHOD1(create_container_reader, std::shared_ptr<metrics::ContainerReader>(size_t port));
+  MOCK_METHOD2(create_container_reader, std::shared_ptr<metrics::ContainerReader>(
+          size_t port, const mesos::ContainerID* container_id));
+  MOCK_METHOD2(create_unix_container_reader, std::shared_ptr<metrics::ContainerReader>(
+          const std::string& path, const mesos::ContainerID* container_id));
   MOCK_METHOD1(update_usage, void(process::Future<mesos::ResourceUsage> usage));
 };
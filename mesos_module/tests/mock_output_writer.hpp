@@ -7,6 +7,7 @@
 class MockOutputWriter : public metrics::OutputWriter {
  public:
   MOCK_METHOD0(start, void());
+  MOCK_CONST_METHOD0(relative_signed_gauges, bool());
   MOCK_METHOD4(write_container_statsd, void(
           const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
           const char* data, size_t size));
@@ -0,0 +1,269 @@
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <stout/os.hpp>
+
+#include "output_spool.hpp"
+
+namespace {
+  const std::string HEADER("test header"), OTHER_HEADER("other header");
+
+  // Header plus a few 100 byte records per segment
+  const size_t SEGMENT_BYTES = 512;
+
+  std::string record(size_t i) {
+    std::string str = "record " + std::to_string(i) + " ";
+    str.resize(100, 'x');
+    return str;
+  }
+
+  std::string pop(metrics::OutputSpool& spool) {
+    const char* data;
+    size_t size;
+    if (!spool.front(data, size)) {
+      return "";
+    }
+    std::string str(data, size);
+    spool.pop();
+    return str;
+  }
+}
+
+class OutputSpoolTests : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    std::string template_copy = "output_spool_tests-XXXXXX";
+    if (mkdtemp((char*)template_copy.c_str()) == NULL) {
+      LOG(FATAL) << "Failed to create tmpdir";
+    }
+    root_path = template_copy + "/";
+    // nested: ensure that the spool creates its dir
+    spool_path = root_path + "state/spool/";
+  }
+
+  virtual void TearDown() {
+    Try<Nothing> result = os::rmdir(root_path);
+    if (result.isError()) {
+      LOG(FATAL) << "Failed to clean up root_path[" << root_path << "]: " << result.error();
+    }
+  }
+
+  std::shared_ptr<metrics::OutputSpool> create(
+      size_t max_bytes,
+      metrics::OutputSpool::Eviction eviction = metrics::OutputSpool::DROP_OLDEST,
+      const std::string& header = HEADER) {
+    Try<std::shared_ptr<metrics::OutputSpool>> spool =
+      metrics::OutputSpool::create(spool_path, header, max_bytes, eviction, SEGMENT_BYTES);
+    EXPECT_FALSE(spool.isError()) << spool.error();
+    return spool.get();
+  }
+
+  size_t segment_files() const {
+    Try<std::list<std::string>> files = os::ls(spool_path);
+    EXPECT_FALSE(files.isError()) << files.error();
+    return files.get().size();
+  }
+
+  std::string root_path, spool_path;
+};
+
+TEST_F(OutputSpoolTests, in_order_across_segments) {
+  std::shared_ptr<metrics::OutputSpool> spool = create(10 * SEGMENT_BYTES);
+  EXPECT_TRUE(spool->empty());
+  EXPECT_EQ("", pop(*spool));
+
+  for (size_t i = 0; i < 20; ++i) {
+    EXPECT_TRUE(spool->append(record(i).data(), record(i).size()));
+  }
+  EXPECT_EQ(2000, spool->record_bytes());
+  // 4 records per segment
+  EXPECT_EQ(5, segment_files());
+
+  for (size_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(record(i), pop(*spool));
+  }
+  // fully read segments are deleted
+  EXPECT_EQ(3, segment_files());
+
+  // appends continue after the remaining records
+  EXPECT_TRUE(spool->append(record(20).data(), record(20).size()));
+  for (size_t i = 10; i <= 20; ++i) {
+    EXPECT_EQ(record(i), pop(*spool));
+  }
+  EXPECT_TRUE(spool->empty());
+  EXPECT_EQ(0, spool->record_bytes());
+  // the last segment is kept for reuse, until the spool goes away
+  EXPECT_EQ(1, segment_files());
+  EXPECT_EQ(0, spool->take_evicted_bytes());
+  spool.reset();
+  EXPECT_EQ(0, segment_files());
+}
+
+TEST_F(OutputSpoolTests, drained_segment_reused) {
+  {
+    std::shared_ptr<metrics::OutputSpool> spool = create(10 * SEGMENT_BYTES);
+    for (size_t round = 0; round < 3; ++round) {
+      for (size_t i = 0; i < 4; ++i) {
+        EXPECT_TRUE(spool->append(record(i).data(), record(i).size()));
+      }
+      for (size_t i = 0; i < 4; ++i) {
+        EXPECT_EQ(record(i), pop(*spool));
+      }
+      EXPECT_TRUE(spool->empty());
+      EXPECT_EQ("", pop(*spool));
+      EXPECT_EQ(1, segment_files());
+    }
+    EXPECT_TRUE(spool->append(record(4).data(), record(4).size()));
+  }
+  {
+    // the records which were popped before the rewind aren't recovered, or appended after
+    std::shared_ptr<metrics::OutputSpool> spool = create(10 * SEGMENT_BYTES);
+    EXPECT_EQ(100, spool->record_bytes());
+    for (size_t i = 5; i < 8; ++i) {
+      EXPECT_TRUE(spool->append(record(i).data(), record(i).size()));
+    }
+    EXPECT_EQ(1, segment_files());
+    for (size_t i = 4; i < 8; ++i) {
+      EXPECT_EQ(record(i), pop(*spool));
+    }
+    EXPECT_TRUE(spool->empty());
+  }
+}
+
+TEST_F(OutputSpoolTests, drop_oldest) {
+  std::shared_ptr<metrics::OutputSpool> spool = create(2 * SEGMENT_BYTES);
+  for (size_t i = 0; i < 16; ++i) {
+    EXPECT_TRUE(spool->append(record(i).data(), record(i).size()));
+  }
+  EXPECT_EQ(2, segment_files());
+  // the first two segments were evicted
+  EXPECT_EQ(800, spool->take_evicted_bytes());
+  EXPECT_EQ(0, spool->take_evicted_bytes());
+  for (size_t i = 8; i < 16; ++i) {
+    EXPECT_EQ(record(i), pop(*spool));
+  }
+  EXPECT_TRUE(spool->empty());
+}
+
+TEST_F(OutputSpoolTests, drop_newest) {
+  std::shared_ptr<metrics::OutputSpool> spool =
+    create(2 * SEGMENT_BYTES, metrics::OutputSpool::DROP_NEWEST);
+  for (size_t i = 0; i < 8; ++i) {
+    EXPECT_TRUE(spool->append(record(i).data(), record(i).size()));
+  }
+  EXPECT_FALSE(spool->append(record(8).data(), record(8).size()));
+  EXPECT_EQ(0, spool->take_evicted_bytes());
+
+  // room again once a segment has been read
+  for (size_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(record(i), pop(*spool));
+  }
+  EXPECT_TRUE(spool->append(record(9).data(), record(9).size()));
+  for (size_t i = 4; i < 8; ++i) {
+    EXPECT_EQ(record(i), pop(*spool));
+  }
+  EXPECT_EQ(record(9), pop(*spool));
+  EXPECT_TRUE(spool->empty());
+}
+
+TEST_F(OutputSpoolTests, drop_oldest_small_spool) {
+  // Smaller than a default segment: split into several, so that eviction only drops one of them
+  Try<std::shared_ptr<metrics::OutputSpool>> spool = metrics::OutputSpool::create(
+      spool_path, HEADER, 4 * SEGMENT_BYTES, metrics::OutputSpool::DROP_OLDEST);
+  ASSERT_FALSE(spool.isError()) << spool.error();
+  for (size_t i = 0; i < 20; ++i) {
+    EXPECT_TRUE(spool.get()->append(record(i).data(), record(i).size()));
+  }
+  EXPECT_EQ(4, segment_files());
+  EXPECT_EQ(400, spool.get()->take_evicted_bytes());
+  EXPECT_EQ(record(4), pop(*spool.get()));
+}
+
+TEST_F(OutputSpoolTests, no_space) {
+  // Larger segments than usual, so that a sparse one would take fewer blocks than its size
+  const size_t segment_bytes = 64 * 1024;
+
+  // Files can't grow past the limit, as with a full disk: the append fails rather than crashing
+  struct rlimit orig_limit, limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &orig_limit));
+  limit = orig_limit;
+  limit.rlim_cur = segment_bytes / 2;
+  sighandler_t orig_handler = signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+
+  Try<std::shared_ptr<metrics::OutputSpool>> spool = metrics::OutputSpool::create(
+      spool_path, HEADER, 10 * segment_bytes, metrics::OutputSpool::DROP_OLDEST, segment_bytes);
+  ASSERT_FALSE(spool.isError()) << spool.error();
+  EXPECT_FALSE(spool.get()->append(record(0).data(), record(0).size()));
+  EXPECT_TRUE(spool.get()->empty());
+  EXPECT_EQ(0, segment_files());
+
+  ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &orig_limit));
+  signal(SIGXFSZ, orig_handler);
+  EXPECT_TRUE(spool.get()->append(record(1).data(), record(1).size()));
+  // The segment's space was reserved up front, rather than left sparse
+  Try<std::list<std::string>> files = os::ls(spool_path);
+  ASSERT_EQ(1, files.get().size());
+  struct stat st;
+  ASSERT_EQ(0, stat((spool_path + files.get().front()).c_str(), &st));
+  EXPECT_LE(segment_bytes, st.st_blocks * 512);
+  EXPECT_EQ(record(1), pop(*spool.get()));
+}
+
+TEST_F(OutputSpoolTests, oversized) {
+  std::shared_ptr<metrics::OutputSpool> spool = create(10 * SEGMENT_BYTES);
+  std::string big(SEGMENT_BYTES, 'x');
+  EXPECT_FALSE(spool->append(big.data(), big.size()));
+  EXPECT_TRUE(spool->empty());
+  EXPECT_EQ(0, segment_files());
+
+  Try<std::shared_ptr<metrics::OutputSpool>> tiny =
+    metrics::OutputSpool::create(spool_path, HEADER, 10, metrics::OutputSpool::DROP_OLDEST);
+  EXPECT_TRUE(tiny.isError());
+}
+
+TEST_F(OutputSpoolTests, recover) {
+  {
+    std::shared_ptr<metrics::OutputSpool> spool = create(10 * SEGMENT_BYTES);
+    for (size_t i = 0; i < 10; ++i) {
+      EXPECT_TRUE(spool->append(record(i).data(), record(i).size()));
+    }
+    // partially read the first segment
+    EXPECT_EQ(record(0), pop(*spool));
+    EXPECT_EQ(record(1), pop(*spool));
+  }
+  {
+    // picks up where the last one left off, including appending to the last segment
+    std::shared_ptr<metrics::OutputSpool> spool = create(10 * SEGMENT_BYTES);
+    EXPECT_EQ(800, spool->record_bytes());
+    EXPECT_EQ(3, segment_files());
+    EXPECT_TRUE(spool->append(record(10).data(), record(10).size()));
+    EXPECT_EQ(3, segment_files());
+    for (size_t i = 2; i < 5; ++i) {
+      EXPECT_EQ(record(i), pop(*spool));
+    }
+  }
+  {
+    // a lower size limit evicts the oldest
+    std::shared_ptr<metrics::OutputSpool> spool = create(SEGMENT_BYTES);
+    EXPECT_EQ(300, spool->take_evicted_bytes());
+    EXPECT_EQ(1, segment_files());
+    EXPECT_EQ(record(8), pop(*spool));
+  }
+  {
+    // different codec: discarded
+    std::shared_ptr<metrics::OutputSpool> spool =
+      create(10 * SEGMENT_BYTES, metrics::OutputSpool::DROP_OLDEST, OTHER_HEADER);
+    EXPECT_TRUE(spool->empty());
+    EXPECT_EQ(0, segment_files());
+  }
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,164 @@
+#include <atomic>
+#include <thread>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "packet_buffer.hpp"
+
+namespace {
+  std::string str(const metrics::PacketSlice& slice) {
+    return std::string(slice.data(), slice.size());
+  }
+}
+
+TEST(PacketBufferTests, acquire) {
+  std::shared_ptr<metrics::PacketBufferPool> pool = metrics::PacketBufferPool::create(16, 2);
+  metrics::PacketSlice buf = pool->acquire();
+  EXPECT_EQ(16, buf.size());
+  EXPECT_TRUE(buf.unique());
+  EXPECT_EQ(1, pool->allocated());
+}
+
+TEST(PacketBufferTests, recycled_after_last_release) {
+  std::shared_ptr<metrics::PacketBufferPool> pool = metrics::PacketBufferPool::create(16, 2);
+  metrics::PacketSlice buf = pool->acquire();
+  const char* buf_data = buf.data();
+  memcpy(buf.mutable_data(), "hello", 5);
+
+  metrics::PacketSlice kept = buf.borrow(buf.data(), 5);
+  EXPECT_TRUE(buf.unique()); // borrowing doesn't take a reference
+  kept = metrics::PacketSlice(kept);
+  EXPECT_FALSE(buf.unique());
+  metrics::PacketSlice kept2(kept);
+
+  // Still in use: the next buffer is a different one
+  buf = pool->acquire();
+  EXPECT_NE(buf_data, buf.data());
+  EXPECT_EQ(2, pool->allocated());
+  EXPECT_EQ("hello", str(kept));
+
+  kept = metrics::PacketSlice();
+  EXPECT_EQ("hello", str(kept2));
+  kept2 = metrics::PacketSlice();
+
+  // All released: reused rather than allocating another
+  metrics::PacketSlice buf2 = pool->acquire();
+  EXPECT_EQ(buf_data, buf2.data());
+  EXPECT_EQ(2, pool->allocated());
+  EXPECT_EQ(0, pool->take_unpooled_count());
+}
+
+TEST(PacketBufferTests, unpooled_past_max) {
+  std::shared_ptr<metrics::PacketBufferPool> pool = metrics::PacketBufferPool::create(16, 2);
+  std::vector<metrics::PacketSlice> bufs;
+  for (size_t i = 0; i < 5; ++i) {
+    bufs.push_back(pool->acquire());
+  }
+  EXPECT_EQ(2, pool->allocated());
+  EXPECT_EQ(3, pool->take_unpooled_count());
+  EXPECT_EQ(0, pool->take_unpooled_count());
+
+  // Only the pooled buffers come back
+  bufs.clear();
+  for (size_t i = 0; i < 2; ++i) {
+    bufs.push_back(pool->acquire());
+  }
+  EXPECT_EQ(0, pool->take_unpooled_count());
+  bufs.push_back(pool->acquire());
+  EXPECT_EQ(1, pool->take_unpooled_count());
+}
+
+TEST(PacketBufferTests, wrapped_copied) {
+  std::string data("hello");
+  metrics::PacketSlice wrapped = metrics::PacketSlice::wrap(data.data(), data.size());
+  EXPECT_EQ(data.data(), wrapped.data());
+  EXPECT_FALSE(wrapped.unique());
+
+  metrics::PacketSlice copy(wrapped);
+  metrics::PacketSlice borrowed = wrapped.borrow(data.data() + 1, 3);
+  metrics::PacketSlice moved(std::move(borrowed));
+  data.assign("world");
+  EXPECT_EQ("hello", str(copy));
+  EXPECT_EQ("ell", str(moved));
+  EXPECT_TRUE(copy.unique());
+
+  metrics::PacketSlice empty;
+  metrics::PacketSlice empty_copy(empty);
+  EXPECT_TRUE(empty_copy.empty());
+  EXPECT_FALSE(empty_copy.unique());
+}
+
+TEST(PacketBufferTests, outlives_pool) {
+  metrics::PacketSlice kept;
+  {
+    std::shared_ptr<metrics::PacketBufferPool> pool = metrics::PacketBufferPool::create(16, 2);
+    metrics::PacketSlice buf = pool->acquire();
+    memcpy(buf.mutable_data(), "hello", 5);
+    metrics::PacketSlice line = buf.borrow(buf.data(), 5);
+    EXPECT_TRUE(buf.unique());
+    kept = line;
+    EXPECT_FALSE(buf.unique());
+    pool->acquire();
+  }
+  // The pool is kept alive by the slice, and goes away with it
+  EXPECT_EQ("hello", str(kept));
+}
+
+TEST(PacketBufferTests, released_across_threads) {
+  const size_t buffers = 4, iterations = 100000;
+  std::shared_ptr<metrics::PacketBufferPool> pool =
+    metrics::PacketBufferPool::create(sizeof(size_t), buffers);
+
+  // One thread fills buffers and hands slices to the others, which check and release them.
+  // Each buffer is handed to two threads, so the last of them to finish recycles it.
+  const size_t consumers = 2;
+  std::vector<metrics::PacketSlice> slots(consumers * buffers);
+  std::vector<std::atomic<bool>> full(consumers * buffers);
+  std::atomic<size_t> bad(0);
+  std::vector<std::thread> threads;
+  for (size_t c = 0; c < consumers; ++c) {
+    threads.push_back(std::thread([&, c]() {
+              for (size_t i = 0; i < iterations; ++i) {
+                size_t slot = c * buffers + (i % buffers);
+                while (!full[slot].load(std::memory_order_acquire)) { std::this_thread::yield(); }
+                size_t val;
+                memcpy(&val, slots[slot].data(), sizeof(val));
+                if (val != i) {
+                  ++bad;
+                }
+                slots[slot] = metrics::PacketSlice();
+                full[slot].store(false, std::memory_order_release);
+              }
+            }));
+  }
+  for (size_t i = 0; i < iterations; ++i) {
+    for (size_t c = 0; c < consumers; ++c) {
+      while (full[c * buffers + (i % buffers)].load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+    }
+    metrics::PacketSlice buf = pool->acquire();
+    // Nobody else may still be looking at a recycled buffer
+    EXPECT_TRUE(buf.unique());
+    memcpy(buf.mutable_data(), &i, sizeof(i));
+    for (size_t c = 0; c < consumers; ++c) {
+      size_t slot = c * buffers + (i % buffers);
+      slots[slot] = buf;
+      full[slot].store(true, std::memory_order_release);
+    }
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(0, bad.load());
+  EXPECT_EQ(0, pool->take_unpooled_count());
+  EXPECT_GE(buffers, pool->allocated());
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -22,6 +22,7 @@ TEST(ParamsTests, to_port_mode) {
   EXPECT_EQ(params::port_mode::SINGLE, params::to_port_mode("single"));
   EXPECT_EQ(params::port_mode::EPHEMERAL, params::to_port_mode("ephemeral"));
   EXPECT_EQ(params::port_mode::RANGE, params::to_port_mode("range"));
+  EXPECT_EQ(params::port_mode::UNIX, params::to_port_mode("unix"));
 }
 
 TEST(ParamsTests, get_str) {
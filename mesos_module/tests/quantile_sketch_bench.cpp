@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "quantile_sketch.hpp"
+
+/**
+ * Measures adding timer values to a QuantileSketch, compared to keeping every raw value and
+ * selecting the percentiles from them at flush time. Not run as part of the unit tests: timings
+ * depend heavily on the host.
+ */
+
+namespace {
+  const size_t VALUE_COUNT = 100000;
+  const size_t MIN_BENCH_MS = 500;
+  const double PERCENTILES[] = { 0.5, 0.9, 0.99 };
+
+  /**
+   * Returns latency-like values: mostly a few milliseconds, with a long tail.
+   */
+  std::vector<double> build_values() {
+    std::mt19937 rand(VALUE_COUNT);
+    std::lognormal_distribution<double> dist(1, 1.2);
+    std::vector<double> values;
+    for (size_t i = 0; i < VALUE_COUNT; ++i) {
+      values.push_back(std::round(dist(rand) * 1000) / 1000);
+    }
+    return values;
+  }
+
+  void run_sketch_bench(const std::vector<double>& values, size_t flush_every) {
+    metrics::QuantileSketch sketch;
+    double checksum = 0;
+    size_t added = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed;
+    do {
+      for (size_t i = 0; i < values.size(); ++i) {
+        sketch.add(values[i]);
+        if ((i + 1) % flush_every == 0) {
+          for (double p : PERCENTILES) {
+            checksum += sketch.quantile(p);
+          }
+          sketch.clear();
+        }
+      }
+      added += values.size();
+      elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(MIN_BENCH_MS));
+
+    // accuracy and size over a single flush period
+    std::vector<double> sorted(values.begin(), values.begin() + flush_every);
+    std::sort(sorted.begin(), sorted.end());
+    sketch.clear();
+    for (size_t i = 0; i < flush_every; ++i) {
+      sketch.add(values[i]);
+    }
+    double max_error = 0;
+    for (double p : PERCENTILES) {
+      double exact = sorted[(size_t)(p * (sorted.size() - 1))];
+      max_error = std::max(max_error, std::fabs(sketch.quantile(p) - exact) / exact);
+    }
+    printf("BENCH sketch/%-6zu %5.1f ns/value, %4zu bins (%5zu bytes), max error %.2f%% (%g)\n",
+        flush_every, 1e9 * elapsed.count() / added, sketch.bin_count(),
+        sketch.bin_count() * sizeof(double), 100 * max_error, checksum);
+  }
+
+  void run_raw_bench(const std::vector<double>& values, size_t flush_every) {
+    std::vector<double> raw;
+    double checksum = 0;
+    size_t added = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed;
+    do {
+      for (size_t i = 0; i < values.size(); ++i) {
+        raw.push_back(values[i]);
+        if ((i + 1) % flush_every == 0) {
+          for (double p : PERCENTILES) {
+            std::vector<double>::iterator nth = raw.begin() + (size_t)(p * (raw.size() - 1));
+            std::nth_element(raw.begin(), nth, raw.end());
+            checksum += *nth;
+          }
+          raw.clear();
+        }
+      }
+      added += values.size();
+      elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(MIN_BENCH_MS));
+
+    printf("BENCH raw/%-9zu %5.1f ns/value, %zu bytes (%g)\n",
+        flush_every, 1e9 * elapsed.count() / added, flush_every * sizeof(double), checksum);
+  }
+}
+
+TEST(QuantileSketchBench, add) {
+  const std::vector<double> values = build_values();
+  for (size_t flush_every : { 100, 10000, 100000 }) {
+    run_raw_bench(values, flush_every);
+    run_sketch_bench(values, flush_every);
+  }
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
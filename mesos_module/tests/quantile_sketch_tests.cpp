@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "quantile_sketch.hpp"
+
+namespace {
+  /**
+   * Returns the value at the provided quantile of the sorted values, using the same rank as
+   * QuantileSketch.
+   */
+  double exact_quantile(const std::vector<double>& sorted, double q) {
+    return sorted[(size_t)(q * (sorted.size() - 1))];
+  }
+
+  void expect_accurate(const std::vector<double>& values, const metrics::QuantileSketch& sketch,
+      double relative_accuracy = metrics::QuantileSketch::DEFAULT_RELATIVE_ACCURACY) {
+    std::vector<double> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    for (double q = 0; q <= 1; q += 0.01) {
+      double exact = exact_quantile(sorted, q);
+      // allow for rounding in the bin values themselves
+      EXPECT_NEAR(exact, sketch.quantile(q), std::fabs(exact) * relative_accuracy * 1.0001)
+        << "q=" << q;
+    }
+  }
+}
+
+TEST(QuantileSketchTests, empty) {
+  metrics::QuantileSketch sketch;
+  EXPECT_TRUE(sketch.empty());
+  EXPECT_EQ(0, sketch.count());
+  EXPECT_EQ(0, sketch.quantile(0));
+  EXPECT_EQ(0, sketch.quantile(0.5));
+  EXPECT_EQ(0, sketch.quantile(1));
+  EXPECT_EQ(0, sketch.bin_count());
+}
+
+TEST(QuantileSketchTests, single_value) {
+  metrics::QuantileSketch sketch;
+  sketch.add(42.5);
+  EXPECT_FALSE(sketch.empty());
+  EXPECT_EQ(1, sketch.count());
+  EXPECT_EQ(42.5, sketch.sum());
+  // clamped to the actual min/max
+  EXPECT_EQ(42.5, sketch.quantile(0));
+  EXPECT_EQ(42.5, sketch.quantile(0.5));
+  EXPECT_EQ(42.5, sketch.quantile(1));
+}
+
+TEST(QuantileSketchTests, accuracy) {
+  std::vector<double> values;
+  metrics::QuantileSketch sketch;
+  for (size_t i = 1; i <= 10000; ++i) {
+    values.push_back(i);
+    sketch.add(i);
+  }
+  EXPECT_EQ(10000, sketch.count());
+  EXPECT_EQ(50005000, sketch.sum());
+  EXPECT_EQ(1, sketch.min());
+  EXPECT_EQ(10000, sketch.max());
+  expect_accurate(values, sketch);
+
+  // latency-like: long tail over several orders of magnitude
+  std::mt19937 rand(1234);
+  std::lognormal_distribution<double> dist(3, 1.5);
+  values.clear();
+  metrics::QuantileSketch lognormal_sketch;
+  for (size_t i = 0; i < 100000; ++i) {
+    double value = dist(rand);
+    values.push_back(value);
+    lognormal_sketch.add(value);
+  }
+  expect_accurate(values, lognormal_sketch);
+
+  // coarser accuracy: fewer bins
+  metrics::QuantileSketch coarse_sketch(0.05);
+  for (double value : values) {
+    coarse_sketch.add(value);
+  }
+  expect_accurate(values, coarse_sketch, 0.05);
+  EXPECT_LT(coarse_sketch.bin_count(), lognormal_sketch.bin_count());
+}
+
+TEST(QuantileSketchTests, negative_and_zero) {
+  std::vector<double> values;
+  metrics::QuantileSketch sketch;
+  for (int i = -500; i <= 500; ++i) {
+    values.push_back(i / 4.);
+    sketch.add(i / 4.);
+  }
+  for (size_t i = 0; i < 100; ++i) {
+    values.push_back(0);
+    sketch.add(0);
+  }
+  expect_accurate(values, sketch);
+  EXPECT_EQ(-125, sketch.quantile(0));
+  EXPECT_EQ(0, sketch.quantile(0.5));
+  EXPECT_EQ(125, sketch.quantile(1));
+}
+
+TEST(QuantileSketchTests, weights) {
+  metrics::QuantileSketch sketch;
+  sketch.add(10, 3); // eg sampled at @0.333
+  sketch.add(20);
+  sketch.add(30, 0); // ignored
+  EXPECT_EQ(4, sketch.count());
+  EXPECT_EQ(50, sketch.sum());
+  EXPECT_NEAR(10, sketch.quantile(0.5), 0.1);
+  EXPECT_NEAR(10, sketch.quantile(0.9), 0.1);
+  EXPECT_EQ(20, sketch.quantile(1));
+}
+
+TEST(QuantileSketchTests, non_finite) {
+  metrics::QuantileSketch sketch;
+  sketch.add(std::numeric_limits<double>::quiet_NaN());
+  sketch.add(std::numeric_limits<double>::infinity());
+  sketch.add(-std::numeric_limits<double>::infinity());
+  EXPECT_TRUE(sketch.empty());
+  // tiny values are counted as zero
+  sketch.add(std::numeric_limits<double>::denorm_min());
+  EXPECT_EQ(1, sketch.count());
+  EXPECT_EQ(0, sketch.bin_count());
+}
+
+TEST(QuantileSketchTests, merge) {
+  std::mt19937 rand(5678);
+  std::lognormal_distribution<double> dist(0, 2);
+  std::vector<double> values;
+  metrics::QuantileSketch all, first, second, empty;
+  for (size_t i = 0; i < 20000; ++i) {
+    double value = (i % 10 == 0) ? -dist(rand) : dist(rand);
+    values.push_back(value);
+    all.add(value);
+    (i < 5000 ? first : second).add(value);
+  }
+  first.merge(empty);
+  empty.merge(second);
+  first.merge(empty);
+
+  EXPECT_EQ(all.count(), first.count());
+  EXPECT_DOUBLE_EQ(all.sum(), first.sum());
+  EXPECT_EQ(all.min(), first.min());
+  EXPECT_EQ(all.max(), first.max());
+  // same bins: same results
+  for (double q = 0; q <= 1; q += 0.001) {
+    EXPECT_EQ(all.quantile(q), first.quantile(q)) << "q=" << q;
+  }
+  expect_accurate(values, first);
+}
+
+TEST(QuantileSketchTests, max_bins) {
+  std::vector<double> values;
+  metrics::QuantileSketch sketch(0.01, 64);
+  // 64 bins at 1% only cover a ~3.6x range. Descending, then ascending: bins are collapsed from
+  // both directions.
+  for (int i = 500; i > 0; --i) {
+    values.push_back(i);
+  }
+  for (int i = 501; i <= 1000; ++i) {
+    values.push_back(i);
+  }
+  for (double value : values) {
+    sketch.add(value);
+    ASSERT_LE(sketch.bin_count(), 64);
+  }
+  EXPECT_EQ(values.size(), sketch.count());
+
+  // the largest values are still accurate
+  std::vector<double> sorted(values);
+  std::sort(sorted.begin(), sorted.end());
+  for (double q = 0.9; q <= 1; q += 0.01) {
+    double exact = exact_quantile(sorted, q);
+    EXPECT_NEAR(exact, sketch.quantile(q), exact * 0.0101) << "q=" << q;
+  }
+  // the smallest aren't, but stay in range
+  EXPECT_EQ(sorted.front(), sketch.quantile(0));
+  EXPECT_LE(sorted.front(), sketch.quantile(0.01));
+}
+
+TEST(QuantileSketchTests, clear) {
+  metrics::QuantileSketch sketch;
+  for (size_t i = 1; i <= 1000; ++i) {
+    sketch.add(i);
+  }
+  sketch.clear();
+  EXPECT_TRUE(sketch.empty());
+  EXPECT_EQ(0, sketch.bin_count());
+  EXPECT_EQ(0, sketch.quantile(0.5));
+
+  std::vector<double> values;
+  for (size_t i = 1; i <= 100; ++i) {
+    values.push_back(i * 1000.);
+    sketch.add(i * 1000.);
+  }
+  EXPECT_EQ(100, sketch.count());
+  EXPECT_EQ(1000, sketch.min());
+  expect_accurate(values, sketch);
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "mock_container_reader.hpp"
+#include "reuse_port_container_reader.hpp"
+
+using ::testing::Return;
+
+namespace {
+  inline mesos::ContainerID container_id(const std::string& id) {
+    mesos::ContainerID cid;
+    cid.set_value(id);
+    return cid;
+  }
+
+  inline mesos::ExecutorInfo exec_info(const std::string& fid, const std::string& eid) {
+    mesos::ExecutorInfo ei;
+    ei.mutable_framework_id()->set_value(fid);
+    ei.mutable_executor_id()->set_value(eid);
+    return ei;
+  }
+
+  std::vector<std::shared_ptr<metrics::ContainerReader>> to_readers(
+      std::initializer_list<std::shared_ptr<MockContainerReader>> mocks) {
+    std::vector<std::shared_ptr<metrics::ContainerReader>> readers;
+    for (std::shared_ptr<MockContainerReader> mock : mocks) {
+      readers.push_back(mock);
+    }
+    return readers;
+  }
+}
+
+MATCHER_P(ContainerIdMatch, proto_value, "mesos::ContainerID") {
+  return arg.value() == proto_value.value();
+}
+
+MATCHER_P(ExecInfoMatch, proto_value, "mesos::ExecutorInfo") {
+  return arg.executor_id().value() == proto_value.executor_id().value()
+    && arg.framework_id().value() == proto_value.framework_id().value();
+}
+
+TEST(ReusePortContainerReaderTests, open_all) {
+  std::shared_ptr<MockContainerReader>
+    mock1(new MockContainerReader), mock2(new MockContainerReader), mock3(new MockContainerReader);
+  metrics::UDPEndpoint endpoint("127.0.0.1", 1234);
+  EXPECT_CALL(*mock1, open()).WillOnce(Return(endpoint));
+  EXPECT_CALL(*mock2, open()).WillOnce(Return(endpoint));
+  EXPECT_CALL(*mock3, open()).WillOnce(Return(endpoint));
+  EXPECT_CALL(*mock1, endpoint()).WillOnce(Return(endpoint));
+
+  metrics::ReusePortContainerReader reader(to_readers({mock1, mock2, mock3}));
+  Try<metrics::UDPEndpoint> result = reader.open();
+  EXPECT_FALSE(result.isError()) << result.error();
+  EXPECT_EQ("127.0.0.1", result.get().host);
+  EXPECT_EQ(1234, result.get().port);
+
+  result = reader.endpoint();
+  EXPECT_FALSE(result.isError()) << result.error();
+  EXPECT_EQ(1234, result.get().port);
+}
+
+TEST(ReusePortContainerReaderTests, open_first_fails) {
+  std::shared_ptr<MockContainerReader> mock1(new MockContainerReader), mock2(new MockContainerReader);
+  EXPECT_CALL(*mock1, open()).WillOnce(Return(Try<metrics::UDPEndpoint>(Error("test err"))));
+
+  metrics::ReusePortContainerReader reader(to_readers({mock1, mock2}));
+  Try<metrics::UDPEndpoint> result = reader.open();
+  EXPECT_TRUE(result.isError());
+  EXPECT_EQ("test err", result.error());
+}
+
+TEST(ReusePortContainerReaderTests, open_second_fails) {
+  std::shared_ptr<MockContainerReader> mock1(new MockContainerReader), mock2(new MockContainerReader);
+  EXPECT_CALL(*mock1, open()).WillOnce(Return(metrics::UDPEndpoint("127.0.0.1", 1234)));
+  EXPECT_CALL(*mock2, open()).WillOnce(Return(Try<metrics::UDPEndpoint>(Error("test err"))));
+
+  metrics::ReusePortContainerReader reader(to_readers({mock1, mock2}));
+  Try<metrics::UDPEndpoint> result = reader.open();
+  EXPECT_TRUE(result.isError());
+  EXPECT_NE(std::string::npos, result.error().find("test err")) << result.error();
+}
+
+TEST(ReusePortContainerReaderTests, open_port_mismatch) {
+  std::shared_ptr<MockContainerReader> mock1(new MockContainerReader), mock2(new MockContainerReader);
+  EXPECT_CALL(*mock1, open()).WillOnce(Return(metrics::UDPEndpoint("127.0.0.1", 1234)));
+  EXPECT_CALL(*mock2, open()).WillOnce(Return(metrics::UDPEndpoint("127.0.0.1", 4321)));
+
+  metrics::ReusePortContainerReader reader(to_readers({mock1, mock2}));
+  Try<metrics::UDPEndpoint> result = reader.open();
+  EXPECT_TRUE(result.isError());
+}
+
+TEST(ReusePortContainerReaderTests, register_unregister_all) {
+  std::shared_ptr<MockContainerReader> mock1(new MockContainerReader), mock2(new MockContainerReader);
+  mesos::ContainerID cid = container_id("cid");
+  mesos::ExecutorInfo einfo = exec_info("fid", "eid");
+  EXPECT_CALL(*mock1, register_container(ContainerIdMatch(cid), ExecInfoMatch(einfo)));
+  EXPECT_CALL(*mock2, register_container(ContainerIdMatch(cid), ExecInfoMatch(einfo)));
+  EXPECT_CALL(*mock1, unregister_container(ContainerIdMatch(cid)));
+  EXPECT_CALL(*mock2, unregister_container(ContainerIdMatch(cid)));
+
+  metrics::ReusePortContainerReader reader(to_readers({mock1, mock2}));
+  reader.register_container(cid, einfo);
+  reader.unregister_container(cid);
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
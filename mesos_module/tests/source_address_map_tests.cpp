@@ -0,0 +1,109 @@
+#include <map>
+#include <random>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "source_address_map.hpp"
+
+namespace {
+  boost::asio::ip::address addr(const std::string& str) {
+    return boost::asio::ip::address::from_string(str);
+  }
+}
+
+TEST(SourceAddressMapTests, empty) {
+  metrics::SourceAddressMap<int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(0, map.size());
+  EXPECT_EQ(NULL, map.find(addr("127.0.0.1"), 0));
+  EXPECT_EQ(NULL, map.find(addr("127.0.0.1"), 1234));
+  EXPECT_FALSE(map.erase(addr("127.0.0.1"), 0));
+}
+
+TEST(SourceAddressMapTests, insert_find_erase) {
+  metrics::SourceAddressMap<int> map;
+  EXPECT_TRUE(map.insert(addr("10.0.0.1"), 0, 1));
+  EXPECT_TRUE(map.insert(addr("10.0.0.2"), 0, 2));
+  EXPECT_TRUE(map.insert(addr("fe80::1"), 0, 3));
+  EXPECT_EQ(3, map.size());
+
+  ASSERT_TRUE(map.find(addr("10.0.0.1"), 5555) != NULL);
+  EXPECT_EQ(1, *map.find(addr("10.0.0.1"), 5555));
+  EXPECT_EQ(2, *map.find(addr("10.0.0.2"), 0));
+  EXPECT_EQ(3, *map.find(addr("fe80::1"), 80));
+  EXPECT_EQ(NULL, map.find(addr("10.0.0.3"), 0));
+  // IPv4 vs IPv4-mapped IPv6: the same source
+  EXPECT_EQ(1, *map.find(addr("::ffff:10.0.0.1"), 0));
+
+  EXPECT_FALSE(map.insert(addr("10.0.0.1"), 0, 11));
+  EXPECT_EQ(3, map.size());
+  EXPECT_EQ(11, *map.find(addr("10.0.0.1"), 0));
+
+  EXPECT_TRUE(map.erase(addr("10.0.0.1"), 0));
+  EXPECT_FALSE(map.erase(addr("10.0.0.1"), 0));
+  EXPECT_EQ(2, map.size());
+  EXPECT_EQ(NULL, map.find(addr("10.0.0.1"), 0));
+  EXPECT_EQ(2, *map.find(addr("10.0.0.2"), 0));
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(NULL, map.find(addr("10.0.0.2"), 0));
+}
+
+TEST(SourceAddressMapTests, port_precedence) {
+  metrics::SourceAddressMap<int> map;
+  map.insert(addr("10.0.0.1"), 0, 1);
+  map.insert(addr("10.0.0.1"), 1000, 2);
+  map.insert(addr("10.0.0.2"), 2000, 3);
+
+  EXPECT_EQ(1, *map.find(addr("10.0.0.1"), 999));
+  EXPECT_EQ(2, *map.find(addr("10.0.0.1"), 1000));
+  EXPECT_EQ(3, *map.find(addr("10.0.0.2"), 2000));
+  EXPECT_EQ(NULL, map.find(addr("10.0.0.2"), 2001));
+
+  map.erase(addr("10.0.0.1"), 1000);
+  EXPECT_EQ(1, *map.find(addr("10.0.0.1"), 1000));
+}
+
+TEST(SourceAddressMapTests, many_random_ops) {
+  // Compare against std::map across growth and lots of collisions/deletions.
+  metrics::SourceAddressMap<size_t> map(8);
+  std::map<std::pair<unsigned long, size_t>, size_t> expected;
+  std::mt19937 rand(1234);
+  for (size_t i = 0; i < 100000; ++i) {
+    unsigned long ip = 0x0a000000 | (rand() % 5000);
+    size_t port = (rand() % 4 == 0) ? rand() % 3 : 0;
+    boost::asio::ip::address a = boost::asio::ip::address_v4(ip);
+    if (rand() % 3 == 0) {
+      EXPECT_EQ(expected.erase(std::make_pair(ip, port)) == 1, map.erase(a, port));
+    } else {
+      EXPECT_EQ(expected.count(std::make_pair(ip, port)) == 0, map.insert(a, port, i));
+      expected[std::make_pair(ip, port)] = i;
+    }
+  }
+  EXPECT_EQ(expected.size(), map.size());
+  for (unsigned long ip = 0x0a000000; ip < 0x0a000000 + 5000; ++ip) {
+    boost::asio::ip::address a = boost::asio::ip::address_v4(ip);
+    for (size_t port = 0; port < 3; ++port) {
+      auto iter = expected.find(std::make_pair(ip, port));
+      if (iter == expected.end()) {
+        // may fall back to port 0
+        iter = expected.find(std::make_pair(ip, 0));
+      }
+      const size_t* found = map.find(a, port);
+      if (iter == expected.end()) {
+        EXPECT_EQ(NULL, found) << a << ":" << port;
+      } else {
+        ASSERT_TRUE(found != NULL) << a << ":" << port;
+        EXPECT_EQ(iter->second, *found) << a << ":" << port;
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
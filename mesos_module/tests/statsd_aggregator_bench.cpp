@@ -0,0 +1,155 @@
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "statsd_aggregator.hpp"
+#include "statsd_tagger.hpp"
+#include "sync_util.hpp"
+
+/**
+ * Measures the cost of aggregating statsd lines, and how much it reduces the data passed to the
+ * writers. Not run as part of the unit tests: timings depend heavily on the host.
+ */
+
+namespace {
+  const size_t CONTAINER_COUNT = 10;
+  const size_t LINES_PER_FLUSH = 100000;
+  const size_t MIN_BENCH_MS = 500;
+
+  class CountingOutputWriter : public metrics::OutputWriter {
+   public:
+    CountingOutputWriter() : lines(0), bytes(0) { }
+    void start() { }
+    void write_container_statsd(
+        const mesos::ContainerID* /*container_id*/, const mesos::ExecutorInfo* /*executor_info*/,
+        const char* /*data*/, size_t size) {
+      ++lines;
+      bytes += size;
+    }
+    size_t lines, bytes;
+  };
+
+  class ServiceThread {
+   public:
+    ServiceThread()
+      : svc_(new boost::asio::io_service),
+        work(new boost::asio::io_service::work(*svc_)),
+        svc_thread(std::bind(&ServiceThread::run_svc, this)) { }
+    ~ServiceThread() {
+      work.reset();
+      svc_->stop();
+      svc_thread.join();
+    }
+
+    std::shared_ptr<boost::asio::io_service> svc() {
+      return svc_;
+    }
+
+   private:
+    void run_svc() {
+      svc_->run();
+    }
+
+    std::shared_ptr<boost::asio::io_service> svc_;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::thread svc_thread;
+  };
+
+  /**
+   * Returns a mix of statsd lines resembling a busy container, spread across 'series' names.
+   */
+  std::vector<std::string> build_lines(size_t series) {
+    std::mt19937 rand(series);
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < LINES_PER_FLUSH; ++i) {
+      size_t name = rand() % series;
+      std::ostringstream oss;
+      switch (name % 4) {
+        case 0:
+          oss << "requests." << name << ":1|c";
+          break;
+        case 1:
+          oss << "queue_depth." << name << ":" << rand() % 100 << "|g";
+          break;
+        case 2:
+          oss << "latency." << name << ":" << (rand() % 10000) / 10. << "|ms|@0.5";
+          break;
+        case 3:
+          oss << "requests." << name << ":1|c|#endpoint:/api,status:" << 200 + rand() % 3;
+          break;
+      }
+      lines.push_back(oss.str());
+    }
+    return lines;
+  }
+
+  void run_bench(const std::string& label, size_t series,
+      const std::vector<double>& percentiles = std::vector<double>()) {
+    std::vector<mesos::ContainerID> container_ids(CONTAINER_COUNT);
+    std::vector<mesos::ExecutorInfo> executor_infos(CONTAINER_COUNT);
+    std::vector<std::shared_ptr<metrics::ContainerTags>> container_tags;
+    for (size_t i = 0; i < CONTAINER_COUNT; ++i) {
+      container_ids[i].set_value("container-" + std::to_string(i));
+      executor_infos[i].mutable_framework_id()->set_value("framework");
+      executor_infos[i].mutable_executor_id()->set_value("executor-" + std::to_string(i));
+      container_tags.push_back(std::shared_ptr<metrics::ContainerTags>(
+              new metrics::ContainerTags(container_ids[i], executor_infos[i])));
+    }
+    const std::vector<std::string> lines = build_lines(series);
+
+    ServiceThread thread;
+    std::shared_ptr<CountingOutputWriter> counter(new CountingOutputWriter);
+    std::vector<metrics::output_writer_ptr_t> writers;
+    writers.push_back(counter);
+    metrics::StatsdAggregator agg(thread.svc(), writers, 60000, 1000000, percentiles);
+
+    // The flush timer isn't started, so the aggregator may be used directly from this thread
+    size_t written = 0, flushes = 0;
+    std::chrono::duration<double> write_elapsed(0), flush_elapsed(0);
+    do {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < lines.size(); ++i) {
+        size_t c = (i / 16) % CONTAINER_COUNT; // lines arrive in per-container bursts
+        agg.write_registered_container_statsd(container_ids[c], executor_infos[c],
+            *container_tags[c], lines[i].data(), lines[i].size());
+      }
+      std::chrono::steady_clock::time_point flush_start = std::chrono::steady_clock::now();
+      agg.flush();
+      write_elapsed += flush_start - start;
+      flush_elapsed += std::chrono::steady_clock::now() - flush_start;
+      written += lines.size();
+      ++flushes;
+    } while (write_elapsed + flush_elapsed < std::chrono::milliseconds(MIN_BENCH_MS));
+
+    size_t in_bytes = 0;
+    for (const std::string& line : lines) {
+      in_bytes += line.size();
+    }
+    printf("BENCH %-10s %6.1f ns/line + %5.2f ms/flush, "
+        "%zu -> %zu lines/flush, %zu -> %zu bytes/flush\n",
+        label.c_str(), 1e9 * write_elapsed.count() / written, 1e3 * flush_elapsed.count() / flushes,
+        lines.size(), counter->lines / flushes, in_bytes, counter->bytes / flushes);
+  }
+}
+
+TEST(StatsdAggregatorBench, series_100) {
+  run_bench("series_100", 100);
+}
+
+TEST(StatsdAggregatorBench, series_10k) {
+  run_bench("series_10k", 10000);
+}
+
+TEST(StatsdAggregatorBench, percentiles) {
+  run_bench("pct_100", 100, std::vector<double>({50, 90, 99}));
+  run_bench("pct_10k", 10000, std::vector<double>({50, 90, 99}));
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
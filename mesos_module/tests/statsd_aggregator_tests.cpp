@@ -0,0 +1,435 @@
+#include <mutex>
+#include <thread>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "mock_output_writer.hpp"
+#include "statsd_aggregator.hpp"
+#include "statsd_tagger.hpp"
+#include "sync_util.hpp"
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+namespace {
+  inline mesos::ContainerID container_id(const std::string& id) {
+    mesos::ContainerID cid;
+    cid.set_value(id);
+    return cid;
+  }
+  inline mesos::ExecutorInfo exec_info(const std::string& fid, const std::string& eid) {
+    mesos::ExecutorInfo ei;
+    ei.mutable_framework_id()->set_value(fid);
+    ei.mutable_executor_id()->set_value(eid);
+    return ei;
+  }
+
+  const mesos::ContainerID CONTAINER_ID1 = container_id("c1"), CONTAINER_ID2 = container_id("c2");
+  const mesos::ExecutorInfo EXECUTOR_INFO1 = exec_info("f1", "e1"),
+    EXECUTOR_INFO2 = exec_info("f2", "e2");
+  const metrics::ContainerTags CONTAINER_TAGS1(CONTAINER_ID1, EXECUTOR_INFO1);
+
+  /**
+   * Runs an io_service in a background thread. The aggregator only uses it for its flush timer
+   * and to flush on destruction, so tests may otherwise call the aggregator directly.
+   */
+  class ServiceThread {
+   public:
+    ServiceThread()
+      : svc_(new boost::asio::io_service),
+        work(new boost::asio::io_service::work(*svc_)),
+        svc_thread(std::bind(&ServiceThread::run_svc, this)) { }
+    virtual ~ServiceThread() {
+      work.reset();
+      svc_->stop();
+      svc_thread.join();
+    }
+
+    std::shared_ptr<boost::asio::io_service> svc() {
+      return svc_;
+    }
+
+   private:
+    void run_svc() {
+      svc_->run();
+    }
+
+    std::shared_ptr<boost::asio::io_service> svc_;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::thread svc_thread;
+  };
+
+  /**
+   * Records the lines passed to a mock writer as "<container id or '-'> <line>".
+   */
+  class Recorder {
+   public:
+    explicit Recorder(bool relative_signed_gauges = true)
+      : writer(new NiceMock<MockOutputWriter>) {
+      ON_CALL(*writer, write_container_statsd(_, _, _, _))
+        .WillByDefault(Invoke(this, &Recorder::record));
+      ON_CALL(*writer, relative_signed_gauges()).WillByDefault(Return(relative_signed_gauges));
+    }
+
+    std::vector<std::string> take() {
+      std::unique_lock<std::mutex> lock(mutex);
+      std::vector<std::string> ret;
+      ret.swap(lines);
+      return ret;
+    }
+
+    size_t size() {
+      std::unique_lock<std::mutex> lock(mutex);
+      return lines.size();
+    }
+
+    std::shared_ptr<NiceMock<MockOutputWriter>> writer;
+
+   private:
+    void record(const mesos::ContainerID* container_id, const mesos::ExecutorInfo* executor_info,
+        const char* data, size_t size) {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (container_id == NULL || executor_info == NULL) {
+        lines.push_back("- " + std::string(data, size));
+      } else {
+        lines.push_back(container_id->value() + " " + std::string(data, size));
+      }
+    }
+
+    std::mutex mutex;
+    std::vector<std::string> lines;
+  };
+
+  std::shared_ptr<metrics::StatsdAggregator> create(
+      ServiceThread& thread, Recorder& recorder,
+      size_t flush_period_ms = 60000, size_t max_series = 1000,
+      const std::vector<double>& percentiles = std::vector<double>()) {
+    std::vector<metrics::output_writer_ptr_t> writers;
+    writers.push_back(recorder.writer);
+    return std::shared_ptr<metrics::StatsdAggregator>(new metrics::StatsdAggregator(
+            thread.svc(), writers, flush_period_ms, max_series, percentiles));
+  }
+
+  void write(metrics::StatsdAggregator& agg, const std::string& line) {
+    agg.write_container_statsd(NULL, NULL, line.data(), line.size());
+  }
+
+  void flush(ServiceThread& thread, metrics::StatsdAggregator& agg) {
+    ASSERT_TRUE(metrics::sync_util::dispatch_run("flush", *thread.svc(),
+            std::bind(&metrics::StatsdAggregator::flush, &agg)));
+  }
+
+  std::vector<std::string> lines(std::initializer_list<std::string> list) {
+    return std::vector<std::string>(list);
+  }
+}
+
+TEST(StatsdAggregatorTests, counters) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg = create(thread, recorder);
+
+  write(*agg, "a:1|c");
+  write(*agg, "a:2|c|@0.5");
+  write(*agg, "b:1.5|c");
+  write(*agg, "a:3|c");
+  write(*agg, "b:-0.25|c");
+  EXPECT_EQ(2, agg->series_count());
+  EXPECT_EQ(0, recorder.size());
+
+  flush(thread, *agg);
+  EXPECT_EQ(lines({"- a:8|c", "- b:1.25|c"}), recorder.take());
+  EXPECT_EQ(0, agg->series_count());
+
+  // the next period starts from zero
+  write(*agg, "a:1|c");
+  flush(thread, *agg);
+  EXPECT_EQ(lines({"- a:1|c"}), recorder.take());
+
+  // nothing to send
+  flush(thread, *agg);
+  EXPECT_EQ(0, recorder.size());
+}
+
+TEST(StatsdAggregatorTests, gauges) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg = create(thread, recorder);
+
+  write(*agg, "last:1|g");
+  write(*agg, "last:5|g");
+  write(*agg, "delta:+2|g");
+  write(*agg, "delta:-5|g");
+  write(*agg, "abs_delta:3|g");
+  write(*agg, "abs_delta:+1.5|g");
+  write(*agg, "negative:4|g");
+  write(*agg, "negative:-6|g");
+  write(*agg, "reset:+4|g");
+  write(*agg, "reset:0|g");
+
+  flush(thread, *agg);
+  EXPECT_EQ(lines({
+            "- last:5|g",
+            "- delta:-3|g",
+            "- abs_delta:4.5|g",
+            "- negative:0|g",
+            "- negative:-2|g",
+            "- reset:0|g"}),
+      recorder.take());
+}
+
+TEST(StatsdAggregatorTests, negative_gauge_writers) {
+  ServiceThread thread;
+  // a statsd writer, and one which takes values as-is like the collector writer
+  Recorder statsd_recorder, collector_recorder(false);
+  std::vector<metrics::output_writer_ptr_t> writers{
+    statsd_recorder.writer, collector_recorder.writer};
+  std::shared_ptr<metrics::StatsdAggregator> agg(
+      new metrics::StatsdAggregator(thread.svc(), writers, 60000, 1000));
+
+  write(*agg, "negative:4|g");
+  write(*agg, "negative:-6|g");
+  write(*agg, "delta:-2|g");
+  flush(thread, *agg);
+  EXPECT_EQ(lines({"- negative:0|g", "- negative:-2|g", "- delta:-2|g"}), statsd_recorder.take());
+  // no zeroing value for the collector to record
+  EXPECT_EQ(lines({"- negative:-2|g", "- delta:-2|g"}), collector_recorder.take());
+}
+
+TEST(StatsdAggregatorTests, sets) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg = create(thread, recorder);
+
+  write(*agg, "users:alice|s");
+  write(*agg, "users:bob|s");
+  write(*agg, "users:alice|s");
+  write(*agg, "other:alice|s");
+  EXPECT_EQ(3, agg->series_count());
+
+  flush(thread, *agg);
+  EXPECT_EQ(lines({"- users:alice|s", "- users:bob|s", "- other:alice|s"}), recorder.take());
+}
+
+TEST(StatsdAggregatorTests, timers_histograms) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg = create(thread, recorder);
+
+  write(*agg, "t:10|ms");
+  write(*agg, "t:20|ms|@0.5");
+  write(*agg, "h:0.5|h");
+  write(*agg, "t:30|ms");
+
+  flush(thread, *agg);
+  EXPECT_EQ(lines({
+            "- t.count:4|g",
+            "- t.sum:60|g",
+            "- t.min:10|g",
+            "- t.max:30|g",
+            "- t.avg:20|g",
+            "- h.count:1|g",
+            "- h.sum:0.5|g",
+            "- h.min:0.5|g",
+            "- h.max:0.5|g",
+            "- h.avg:0.5|g"}),
+      recorder.take());
+}
+
+TEST(StatsdAggregatorTests, timer_percentiles) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg =
+    create(thread, recorder, 60000, 1000, std::vector<double>({50, 99.9, 100}));
+
+  for (size_t round = 0; round < 2; ++round) {
+    for (size_t i = 1; i <= 1000; ++i) {
+      write(*agg, "t:" + std::to_string(i) + "|ms");
+    }
+    write(*agg, "h:-5|h|@0.25");
+    write(*agg, "h:5|h");
+
+    flush(thread, *agg);
+    std::vector<std::string> flushed = recorder.take();
+    ASSERT_EQ(16, flushed.size());
+    // the estimate is within 1% of the exact value, 500
+    const std::string p50_prefix("- t.p50:");
+    ASSERT_EQ(p50_prefix, flushed[5].substr(0, p50_prefix.size()));
+    EXPECT_NEAR(500, std::stod(flushed[5].substr(p50_prefix.size())), 5);
+    flushed[5] = "(checked)";
+    EXPECT_EQ(lines({
+              "- t.count:1000|g",
+              "- t.sum:500500|g",
+              "- t.min:1|g",
+              "- t.max:1000|g",
+              "- t.avg:500.5|g",
+              "(checked)",
+              "- t.p99_9:1000|g",
+              "- t.p100:1000|g",
+              // -5 is weighted by its sample rate
+              "- h.count:5|g",
+              "- h.sum:0|g",
+              "- h.min:-5|g",
+              "- h.max:5|g",
+              "- h.avg:0|g",
+              "- h.p50:-5|g",
+              "- h.p99_9:-5|g",
+              "- h.p100:5|g"}),
+        flushed);
+  }
+}
+
+TEST(StatsdAggregatorTests, tags) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg = create(thread, recorder);
+
+  // tag order doesn't matter, but the tags themselves do, as does the type
+  write(*agg, "a:1|c|#x:1,y:2");
+  write(*agg, "a:1|c|@1|#y:2,x:1");
+  write(*agg, "a:1|c|#x:1");
+  write(*agg, "a:1|c");
+  write(*agg, "a:1|g|#x:1");
+  write(*agg, "a:1|c|#x:1,y:3");
+  write(*agg, "a:1|c|#z,y:2,x:1");
+  write(*agg, "a:1|c|#y:2,x:1");
+
+  flush(thread, *agg);
+  EXPECT_EQ(lines({
+            "- a:3|c|#x:1,y:2",
+            "- a:1|c|#x:1",
+            "- a:1|c",
+            "- a:1|g|#x:1",
+            "- a:1|c|#x:1,y:3",
+            "- a:1|c|#x:1,y:2,z"}),
+      recorder.take());
+}
+
+TEST(StatsdAggregatorTests, containers) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg = create(thread, recorder);
+
+  const std::string line("a:1|c");
+  for (size_t i = 0; i < 2; ++i) {
+    agg->write_registered_container_statsd(
+        CONTAINER_ID1, EXECUTOR_INFO1, CONTAINER_TAGS1, line.data(), line.size());
+    agg->write_container_statsd(&CONTAINER_ID2, &EXECUTOR_INFO2, line.data(), line.size());
+    agg->write_container_statsd(NULL, NULL, line.data(), line.size());
+    agg->write_registered_container_statsd(
+        CONTAINER_ID1, EXECUTOR_INFO1, CONTAINER_TAGS1, line.data(), line.size());
+  }
+  EXPECT_EQ(3, agg->series_count());
+
+  flush(thread, *agg);
+  EXPECT_EQ(lines({"c1 a:4|c", "c2 a:2|c", "- a:2|c"}), recorder.take());
+
+  // containers are forgotten between periods
+  agg->write_container_statsd(&CONTAINER_ID2, &EXECUTOR_INFO2, line.data(), line.size());
+  flush(thread, *agg);
+  EXPECT_EQ(lines({"c2 a:1|c"}), recorder.take());
+}
+
+TEST(StatsdAggregatorTests, passthrough) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg = create(thread, recorder);
+
+  const std::vector<std::string> unaggregated = lines({
+      "no_type",
+      "no_type:1",
+      "no_value|c",
+      "empty_value:|c",
+      ":1|c",
+      "bad_value:abc|c",
+      "multi_value:1:2|c",
+      "unknown_type:1|d",
+      "unknown_type:1|cc",
+      "bad_rate:1|c|@0",
+      "bad_rate:1|c|@2",
+      "bad_rate:1|c|@abc",
+      "extra_section:1|c|T1234",
+      "empty_section:1|c||#x:1",
+      "double_tags:1|c|#x:1|#y:2",
+      "_e{5,4}:title|text",
+      "_sc|name|0"});
+  for (const std::string& line : unaggregated) {
+    write(*agg, line);
+  }
+  agg->write_container_statsd(&CONTAINER_ID2, &EXECUTOR_INFO2, "bad", 3);
+  EXPECT_EQ(0, agg->series_count());
+
+  std::vector<std::string> expected;
+  for (const std::string& line : unaggregated) {
+    expected.push_back("- " + line);
+  }
+  expected.push_back("c2 bad");
+  EXPECT_EQ(expected, recorder.take());
+
+  flush(thread, *agg);
+  EXPECT_EQ(0, recorder.size());
+}
+
+TEST(StatsdAggregatorTests, max_series) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg = create(thread, recorder, 60000, 2);
+
+  write(*agg, "a:1|c");
+  write(*agg, "b:1|c");
+  write(*agg, "a:1|c");
+  EXPECT_EQ(0, recorder.size());
+  // full: the existing series are flushed before starting a new period
+  write(*agg, "c:1|c");
+  EXPECT_EQ(lines({"- a:2|c", "- b:1|c"}), recorder.take());
+  EXPECT_EQ(1, agg->series_count());
+
+  // remaining data is flushed on destruction
+  agg.reset();
+  EXPECT_EQ(lines({"- c:1|c"}), recorder.take());
+}
+
+TEST(StatsdAggregatorTests, many_series) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg = create(thread, recorder, 60000, 100000);
+
+  // enough series to force several table resizes
+  for (size_t round = 0; round < 3; ++round) {
+    for (size_t i = 0; i < 10000; ++i) {
+      write(*agg, "metric." + std::to_string(i) + ":1|c");
+    }
+  }
+  EXPECT_EQ(10000, agg->series_count());
+  flush(thread, *agg);
+  std::vector<std::string> flushed = recorder.take();
+  ASSERT_EQ(10000, flushed.size());
+  for (size_t i = 0; i < 10000; ++i) {
+    EXPECT_EQ("- metric." + std::to_string(i) + ":3|c", flushed[i]);
+  }
+}
+
+TEST(StatsdAggregatorTests, flush_timer) {
+  ServiceThread thread;
+  Recorder recorder;
+  std::shared_ptr<metrics::StatsdAggregator> agg = create(thread, recorder, 10);
+  EXPECT_CALL(*recorder.writer, start());
+  agg->start();
+
+  // writes must now come from the io thread, alongside the timer
+  ASSERT_TRUE(metrics::sync_util::dispatch_run("write", *thread.svc(),
+          [&agg]() { write(*agg, "a:1|c"); write(*agg, "a:1|c"); }));
+  for (size_t i = 0; i < 500 && recorder.size() == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(lines({"- a:2|c"}), recorder.take());
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
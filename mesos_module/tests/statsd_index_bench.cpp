@@ -0,0 +1,188 @@
+#include <chrono>
+#include <random>
+#include <string.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "statsd_index.hpp"
+#include "statsd_util.hpp"
+
+/**
+ * Compares repeated memchr() searches against a StatsdIndex of each supported implementation, for
+ * finding the lines and sections of mixed-size packets, and for hashing each line's series as the
+ * reader does when the series limit is enabled. Not run as part of the unit tests: timings depend
+ * heavily on the host.
+ */
+
+namespace {
+  const size_t PACKET_COUNT = 1000;
+  const size_t MIN_BENCH_MS = 500;
+  const metrics::StatsdIndex::Impl IMPLS[] = {
+    metrics::StatsdIndex::SCALAR, metrics::StatsdIndex::MEMCHR, metrics::StatsdIndex::SSE2,
+    metrics::StatsdIndex::AVX2};
+
+  std::string build_line(std::mt19937& rand) {
+    std::string line = "some.app.metric" + std::to_string(rand() % 100) + ":"
+      + std::to_string(rand() % 10000) + "|" + "cgmsh"[rand() % 5];
+    if (rand() % 4 == 0) {
+      line += "|@0.5";
+    }
+    if (rand() % 2 == 0) {
+      line += "|#host:agent" + std::to_string(rand() % 10) + ",env:prod,region:us-west-2";
+    }
+    return line;
+  }
+
+  /**
+   * Returns a mix of packet sizes: single lines, typical client batches, and large batches.
+   */
+  std::vector<std::string> build_packets() {
+    std::mt19937 rand(PACKET_COUNT);
+    std::vector<std::string> packets;
+    const size_t target_sizes[] = {1, 512, 1432, 8192};
+    for (size_t i = 0; i < PACKET_COUNT; ++i) {
+      size_t target = target_sizes[i % 4];
+      std::string packet;
+      do {
+        packet += build_line(rand) + "\n";
+      } while (packet.size() < target);
+      packets.push_back(packet);
+    }
+    return packets;
+  }
+
+  /**
+   * Finds the sections of each line as the reader did before the index: memchr() for each newline,
+   * then for the name's ':' and each '|' within the line.
+   */
+  uint64_t sections_memchr(const std::string& packet) {
+    const char* data = packet.data();
+    const char* packet_end = data + packet.size();
+    uint64_t sum = 0;
+    for (const char* start = data; start < packet_end;) {
+      const char* end = (const char*) memchr(start, '\n', packet_end - start);
+      if (end == NULL) {
+        end = packet_end;
+      }
+      const char* section = (const char*) memchr(start, '|', end - start);
+      if (section == NULL) {
+        section = end;
+      }
+      const char* name_end = (const char*) memchr(start, ':', section - start);
+      sum += (name_end == NULL ? section : name_end) - data;
+      while (section < end) {
+        sum += section - data;
+        section = (const char*) memchr(section + 1, '|', end - section - 1);
+        if (section == NULL) {
+          section = end;
+        }
+      }
+      start = end + 1;
+    }
+    return sum;
+  }
+
+  uint64_t sections_index(metrics::StatsdIndex& index, const std::string& packet) {
+    index.build(packet.data(), packet.size());
+    uint64_t sum = 0;
+    metrics::StatsdIndex::Line line;
+    while (index.next_line(line)) {
+      const char* section = (line.section_count > 0) ? line.section(0) : line.data + line.size;
+      const char* name_end = (const char*) memchr(line.data, ':', section - line.data);
+      sum += (name_end == NULL ? section : name_end) - packet.data();
+      for (size_t i = 0; i < line.section_count; ++i) {
+        sum += line.sections[i];
+      }
+    }
+    return sum;
+  }
+
+  /**
+   * Splits lines and hashes each line's series, as the reader does when the series limit is on.
+   */
+  uint64_t hash_memchr(const std::string& packet) {
+    const char* data = packet.data();
+    size_t size = packet.size();
+    uint64_t sum = 0;
+    size_t start = 0;
+    while (start < size) {
+      const char* newline = (const char*) memchr(data + start, '\n', size - start);
+      size_t end = (newline == NULL) ? size : newline - data;
+      if (end > start) {
+        sum += metrics::statsd_series_hash(data + start, end - start);
+      }
+      start = end + 1;
+    }
+    return sum;
+  }
+
+  uint64_t hash_index(metrics::StatsdIndex& index, const std::string& packet) {
+    index.build(packet.data(), packet.size());
+    uint64_t sum = 0;
+    metrics::StatsdIndex::Line line;
+    while (index.next_line(line)) {
+      if (line.size > 0) {
+        sum += metrics::statsd_series_hash(line);
+      }
+    }
+    return sum;
+  }
+
+  template <typename ScanFunc>
+  void run_bench(const std::string& label, const std::vector<std::string>& packets, ScanFunc func) {
+    size_t bytes = 0;
+    uint64_t sum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed;
+    do {
+      for (const std::string& packet : packets) {
+        sum += func(packet);
+        bytes += packet.size();
+      }
+      elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(MIN_BENCH_MS));
+
+    printf("BENCH %-8s %7.1f MB/s (sum=%lu)\n",
+        label.c_str(), bytes / elapsed.count() / 1e6, (unsigned long)sum);
+  }
+}
+
+TEST(StatsdIndexBench, sections) {
+  const std::vector<std::string> packets = build_packets();
+  run_bench("memchr", packets, sections_memchr);
+  for (metrics::StatsdIndex::Impl impl : IMPLS) {
+    if (!metrics::StatsdIndex::supported(impl)) {
+      continue;
+    }
+    metrics::StatsdIndex index(impl);
+    // check the implementations agree before timing them
+    for (const std::string& packet : packets) {
+      ASSERT_EQ(sections_memchr(packet), sections_index(index, packet));
+    }
+    run_bench(metrics::StatsdIndex::impl_name(impl), packets,
+        [&index](const std::string& packet) { return sections_index(index, packet); });
+  }
+}
+
+TEST(StatsdIndexBench, series_hash) {
+  const std::vector<std::string> packets = build_packets();
+  run_bench("memchr", packets, hash_memchr);
+  for (metrics::StatsdIndex::Impl impl : IMPLS) {
+    if (!metrics::StatsdIndex::supported(impl)) {
+      continue;
+    }
+    metrics::StatsdIndex index(impl);
+    for (const std::string& packet : packets) {
+      ASSERT_EQ(hash_memchr(packet), hash_index(index, packet));
+    }
+    run_bench(metrics::StatsdIndex::impl_name(impl), packets,
+        [&index](const std::string& packet) { return hash_index(index, packet); });
+  }
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
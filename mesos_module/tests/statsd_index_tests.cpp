@@ -0,0 +1,128 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "statsd_index.hpp"
+
+namespace {
+  const std::vector<metrics::StatsdIndex::Impl> IMPLS{
+    metrics::StatsdIndex::SCALAR, metrics::StatsdIndex::MEMCHR, metrics::StatsdIndex::SSE2,
+    metrics::StatsdIndex::AVX2};
+
+  /**
+   * Returns the offsets of the newlines followed by the offsets of the '|'s, as seen by walking
+   * the lines.
+   */
+  std::vector<uint32_t> offsets(metrics::StatsdIndex& index, const char* data, size_t size) {
+    index.build(data, size);
+    std::vector<uint32_t> ret, sections;
+    metrics::StatsdIndex::Line line;
+    while (index.next_line(line)) {
+      EXPECT_EQ(data, line.packet);
+      size_t line_end = line.data + line.size - data;
+      if (line_end < size) {
+        ret.push_back(line_end);
+      }
+      sections.insert(sections.end(), line.sections, line.sections + line.section_count);
+    }
+    ret.insert(ret.end(), sections.begin(), sections.end());
+    return ret;
+  }
+
+  std::vector<uint32_t> expected_offsets(const char* data, size_t size) {
+    std::vector<uint32_t> ret;
+    for (size_t i = 0; i < size; ++i) {
+      if (data[i] == '\n') {
+        ret.push_back(i);
+      }
+    }
+    for (size_t i = 0; i < size; ++i) {
+      if (data[i] == '|') {
+        ret.push_back(i);
+      }
+    }
+    return ret;
+  }
+
+  std::vector<std::string> lines(metrics::StatsdIndex& index, const std::string& packet) {
+    index.build(packet.data(), packet.size());
+    std::vector<std::string> ret;
+    metrics::StatsdIndex::Line line;
+    while (index.next_line(line)) {
+      std::string str(line.data, line.size);
+      // followed by the position of each '|' within the line
+      for (size_t i = 0; i < line.section_count; ++i) {
+        EXPECT_GE(line.section(i), line.data);
+        EXPECT_LT(line.section(i), line.data + line.size);
+        str += " " + std::to_string(line.section(i) - line.data);
+      }
+      ret.push_back(str);
+    }
+    return ret;
+  }
+}
+
+TEST(StatsdIndexTests, impls_match_scalar) {
+  std::mt19937 rand(1);
+  const std::string chars("ab:|\n#,\xfc\x8a\0", 10);
+  // fill a buffer with a mix of separators, other statsd chars, and bytes which only differ from
+  // the separators in their high bit
+  std::vector<char> buf(1024);
+  for (size_t i = 0; i < buf.size(); ++i) {
+    buf[i] = (rand() % 4 == 0) ? chars[rand() % chars.size()] : (char)rand();
+  }
+  for (metrics::StatsdIndex::Impl impl : IMPLS) {
+    if (!metrics::StatsdIndex::supported(impl)) {
+      LOG(INFO) << "Skipping unsupported impl " << metrics::StatsdIndex::impl_name(impl);
+      continue;
+    }
+    metrics::StatsdIndex index(impl);
+    // every size around the block boundaries, at every alignment
+    for (size_t start = 0; start < 64; ++start) {
+      for (size_t size = 0; size <= 260; ++size) {
+        ASSERT_EQ(expected_offsets(buf.data() + start, size),
+            offsets(index, buf.data() + start, size))
+          << metrics::StatsdIndex::impl_name(impl) << " start=" << start << " size=" << size;
+      }
+    }
+    // whole buffer, then a smaller packet reusing the offsets
+    EXPECT_EQ(expected_offsets(buf.data(), buf.size()), offsets(index, buf.data(), buf.size()));
+    EXPECT_EQ(expected_offsets(buf.data(), 10), offsets(index, buf.data(), 10));
+  }
+}
+
+TEST(StatsdIndexTests, all_separators) {
+  std::string packet(300, '|');
+  packet[100] = '\n';
+  for (metrics::StatsdIndex::Impl impl : IMPLS) {
+    metrics::StatsdIndex index(impl);
+    EXPECT_EQ(expected_offsets(packet.data(), packet.size()),
+        offsets(index, packet.data(), packet.size()));
+  }
+}
+
+TEST(StatsdIndexTests, lines) {
+  for (metrics::StatsdIndex::Impl impl : IMPLS) {
+    metrics::StatsdIndex index(impl);
+    EXPECT_EQ(std::vector<std::string>{}, lines(index, ""));
+    EXPECT_EQ(std::vector<std::string>{"a:1|c 3"}, lines(index, "a:1|c"));
+    EXPECT_EQ(std::vector<std::string>{"a:1|c 3"}, lines(index, "a:1|c\n"));
+    EXPECT_EQ((std::vector<std::string>{"", "a:1|c 3"}), lines(index, "\na:1|c"));
+    std::vector<std::string> expected{"a:1|c 3", "", "bb:2|g|#x:y 4 6", "c"};
+    EXPECT_EQ(expected, lines(index, "a:1|c\n\nbb:2|g|#x:y\nc"));
+
+    // a line which spans several blocks, following another line
+    std::string longline = "name:1|c|#" + std::string(200, 't') + ":v";
+    expected = {"a", longline + " 6 8"};
+    EXPECT_EQ(expected, lines(index, "a\n" + longline + "\n"));
+  }
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
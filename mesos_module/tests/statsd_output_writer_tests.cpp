@@ -1,4 +1,6 @@
 #include <atomic>
+#include <map>
+#include <sstream>
 #include <thread>
 
 #include <glog/logging.h>
@@ -30,9 +32,26 @@ namespace {
 
   const boost::asio::ip::udp::endpoint DEST_LOCAL_ENDPOINT(
       boost::asio::ip::address::from_string("127.0.0.1"), 0 /* port */);
+  const boost::asio::ip::udp::endpoint DEST_LOCAL_ENDPOINT2(
+      boost::asio::ip::address::from_string("127.0.0.2"), 0 /* port */);
   const boost::asio::ip::udp::endpoint DEST_LOCAL_ENDPOINT6(
       boost::asio::ip::address::from_string("::1"), 0 /* port */);
 
+  /**
+   * Reads all available datagrams and returns the number of times each line was received.
+   */
+  std::map<std::string, size_t> read_lines(TestUDPReadSocket& reader) {
+    std::map<std::string, size_t> lines;
+    while (reader.available()) {
+      std::istringstream datagram(reader.read());
+      std::string line;
+      while (std::getline(datagram, line)) {
+        ++lines[line];
+      }
+    }
+    return lines;
+  }
+
   mesos::Parameters build_params(
       const std::string& annotation_mode, size_t chunk_size = 0) {
     mesos::Parameters params;
@@ -114,17 +133,17 @@ TEST(StatsdOutputWriterTests, chunking_off) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_KEY_PREFIX),
-            StubUDPSender::success(thread.svc(), listen_port)));
-    writer->start();
-
+            sender));
     // value is dropped because we didn't give writer a chance to resolve the host:
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, HELLO.data(), HELLO.size());
     EXPECT_FALSE(test_reader.available());
 
-    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    writer->start();
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(&CONTAINER_ID2, &EXECUTOR_INFO2, HELLO.data(), HELLO.size());
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, HEY.data(), HEY.size());
@@ -143,42 +162,125 @@ TEST(StatsdOutputWriterTests, chunking_on_flush_when_full) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_TAG_DATADOG, 150 /* chunk_size */),
-            StubUDPSender::success(thread.svc(), listen_port),
+            sender,
             9999999 /* chunk_timeout_ms */));
     writer->start();
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, HELLO.data(), HELLO.size());// 53 bytes
     EXPECT_EQ("", test_reader.read(1 /* timeout_ms */));
     writer->write_container_statsd(&CONTAINER_ID2, &EXECUTOR_INFO2, HEY.data(), HEY.size());// 51 bytes
     EXPECT_EQ("", test_reader.read(1 /* timeout_ms */));
-    writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, HI.data(), HI.size());// 50 bytes (FLUSH)
-    EXPECT_EQ("hello|#framework_id:f1,executor_id:e1,container_id:c1\n"
-        "hey|#framework_id:f2,executor_id:e2,container_id:c2", test_reader.read(1 /* timeout_ms */));
-
+    writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, HI.data(), HI.size());// 50 bytes (FULL)
+    // the full chunk is queued until the end of the flush period, which here is the teardown
     EXPECT_EQ("", test_reader.read(1 /* timeout_ms */));
 
     metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
   }
   thread.join();
 
+  EXPECT_EQ("hello|#framework_id:f1,executor_id:e1,container_id:c1\n"
+      "hey|#framework_id:f2,executor_id:e2,container_id:c2", test_reader.read(1 /* timeout_ms */));
   EXPECT_EQ("hi|#framework_id:f1,executor_id:e1,container_id:c1", test_reader.read(1 /* timeout_ms */));
 }
 
+TEST(StatsdOutputWriterTests, chunking_on_full_chunks_batched) {
+  TestUDPReadSocket test_reader;
+  size_t listen_port = test_reader.listen();
+
+  ServiceThread thread;
+  {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
+    metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
+            thread.svc(),
+            build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_NONE, 12 /* chunk_size */),
+            sender,
+            9999999 /* chunk_timeout_ms */));
+    writer->start();
+    // let resolve finish before sending data:
+    sender->wait_for_lookup();
+
+    // 100 equally sized chunks, more than the sender queues at once: the oldest are sent when the
+    // queue fills, and the rest at teardown
+    for (size_t i = 0; i < 300; ++i) {
+      writer->write_container_statsd(NULL, NULL, HEY.data(), HEY.size());
+    }
+  }
+  thread.join();
+
+  // still received as separate datagrams, in order
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_EQ("hey\nhey\nhey", test_reader.read(1 /* timeout_ms */)) << "chunk " << i;
+  }
+  EXPECT_EQ("", test_reader.read(1 /* timeout_ms */));
+}
+
+TEST(StatsdOutputWriterTests, chunking_on_fanout_series_routed) {
+  TestUDPReadSocket test_reader1, test_reader2;
+  size_t listen_port = test_reader1.listen(DEST_LOCAL_ENDPOINT.address(), 0);
+  EXPECT_EQ(listen_port, test_reader2.listen(DEST_LOCAL_ENDPOINT2.address(), listen_port));
+
+  ServiceThread thread;
+  {
+    std::vector<boost::asio::ip::udp::endpoint> endpoints;
+    endpoints.push_back(DEST_LOCAL_ENDPOINT);
+    endpoints.push_back(DEST_LOCAL_ENDPOINT2);
+    StubUDPSender::ptr_t sender = StubUDPSender::fanout(thread.svc(), listen_port, endpoints);
+    metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
+            thread.svc(),
+            build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_NONE, 100 /* chunk_size */),
+            sender,
+            9999999 /* chunk_timeout_ms */));
+    writer->start();
+    sender->wait_for_lookup();
+
+    // each series is written several times, with different values
+    for (size_t value = 0; value < 3; ++value) {
+      for (size_t series = 0; series < 50; ++series) {
+        std::string line =
+          "series" + std::to_string(series) + ":" + std::to_string(value) + "|c";
+        writer->write_container_statsd(NULL, NULL, line.data(), line.size());
+      }
+    }
+  }
+  thread.join();
+
+  std::map<std::string, size_t> lines1 = read_lines(test_reader1), lines2 = read_lines(test_reader2);
+  // both destinations got a share of the series
+  EXPECT_LT(3 * 10, lines1.size());
+  EXPECT_LT(3 * 10, lines2.size());
+  for (size_t series = 0; series < 50; ++series) {
+    std::string name = "series" + std::to_string(series);
+    // every value of a series goes to the same destination
+    size_t count1 = 0, count2 = 0;
+    for (size_t value = 0; value < 3; ++value) {
+      std::string line = name + ":" + std::to_string(value) + "|c";
+      EXPECT_EQ(1, lines1[line] + lines2[line]) << line;
+      count1 += lines1[line];
+      count2 += lines2[line];
+    }
+    EXPECT_TRUE((count1 == 3 && count2 == 0) || (count1 == 0 && count2 == 3)) << name;
+  }
+}
+
 TEST(StatsdOutputWriterTests, chunking_on_flush_timer) {
   TestUDPReadSocket test_reader;
   size_t listen_port = test_reader.listen();
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_KEY_PREFIX, 100 /* chunk_size */),
-            StubUDPSender::success(thread.svc(), listen_port),
+            sender,
             1 /* chunk_timeout_ms */));
     writer->start();
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, HELLO.data(), HELLO.size());
     EXPECT_FALSE(test_reader.available());
@@ -202,14 +304,15 @@ TEST(StatsdOutputWriterTests, chunked_annotations_off) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_NONE, 100 /* chunk_size */),
-            StubUDPSender::success(thread.svc(), listen_port),
+            sender,
             1 /* chunk_timeout_ms */));
     writer->start();
     // let resolve finish before sending data:
-    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, HELLO.data(), HELLO.size());
     writer->write_container_statsd(&CONTAINER_ID2, &EXECUTOR_INFO2, HEY.data(), HEY.size());
@@ -226,14 +329,15 @@ TEST(StatsdOutputWriterTests, chunked_datadog_annotations_no_containerinfo) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_TAG_DATADOG, 100 /* chunk_size */),
-            StubUDPSender::success(thread.svc(), listen_port),
+            sender,
             1 /* chunk_timeout_ms */));
     writer->start();
     // let resolve finish before sending data:
-    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(NULL, NULL, HELLO.data(), HELLO.size());
     writer->write_container_statsd(NULL, NULL, HEY.data(), HEY.size());
@@ -249,14 +353,15 @@ TEST(StatsdOutputWriterTests, chunked_datadog_annotations) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_TAG_DATADOG, 150 /* chunk_size */),
-            StubUDPSender::success(thread.svc(), listen_port),
+            sender,
             1 /* chunk_timeout_ms */));
     writer->start();
     // let resolve finish before sending data:
-    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, HELLO.data(), HELLO.size());
     writer->write_container_statsd(&CONTAINER_ID2, &EXECUTOR_INFO2, HEY.data(), HEY.size());
@@ -276,13 +381,14 @@ TEST(StatsdOutputWriterTests, datadog_annotations_tagged_input) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_TAG_DATADOG),
-            StubUDPSender::success(thread.svc(), listen_port)));
+            sender));
     writer->start();
     // let resolve finish before sending data:
-    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, hello.data(), hello.size());
     EXPECT_EQ("hello|#tag1,framework_id:f1,executor_id:e1,container_id:c1|@0.1",
@@ -306,14 +412,15 @@ TEST(StatsdOutputWriterTests, chunked_datadog_annotations_tagged_input) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_TAG_DATADOG, 150 /* chunk_size */),
-            StubUDPSender::success(thread.svc(), listen_port),
+            sender,
             1 /* chunk_timeout_ms */));
     writer->start();
     // let resolve finish before sending data:
-    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, hello.data(), hello.size());
     writer->write_container_statsd(&CONTAINER_ID2, &EXECUTOR_INFO2, hey.data(), hey.size());
@@ -335,13 +442,14 @@ TEST(StatsdOutputWriterTests, prefix_annotations_no_containerinfo) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_KEY_PREFIX),
-            StubUDPSender::success(thread.svc(), listen_port)));
+            sender));
     writer->start();
     // let resolve finish before sending data:
-    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(NULL, NULL, HELLO.data(), HELLO.size());
     EXPECT_EQ("unknown_container." + HELLO, test_reader.read(100 /* timeout_ms */));
@@ -359,13 +467,14 @@ TEST(StatsdOutputWriterTests, prefix_annotations) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_KEY_PREFIX),
-            StubUDPSender::success(thread.svc(), listen_port)));
+            sender));
     writer->start();
     // let resolve finish before sending data:
-    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, HELLO.data(), HELLO.size());
     EXPECT_EQ("f1.e1.c1." + HELLO, test_reader.read(100 /* timeout_ms */));
@@ -385,14 +494,15 @@ TEST(StatsdOutputWriterTests, chunked_prefix_annotations_tagged_input) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_KEY_PREFIX, 150 /* chunk_size */),
-            StubUDPSender::success(thread.svc(), listen_port),
-            1 /* chunk_timeout_ms */));
+            sender,
+            50 /* chunk_timeout_ms: long enough for all three writes */));
     writer->start();
     // let resolve finish before sending data:
-    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, hello.data(), hello.size());
     metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
@@ -414,13 +524,14 @@ TEST(StatsdOutputWriterTests, prefix_annotations_tagged_input) {
 
   ServiceThread thread;
   {
+    StubUDPSender::ptr_t sender = StubUDPSender::success(thread.svc(), listen_port);
     metrics::output_writer_ptr_t writer(new metrics::StatsdOutputWriter(
             thread.svc(),
             build_params(metrics::params::OUTPUT_STATSD_ANNOTATION_MODE_KEY_PREFIX),
-            StubUDPSender::success(thread.svc(), listen_port)));
+            sender));
     writer->start();
     // let resolve finish before sending data:
-    metrics::sync_util::dispatch_run("flush", *thread.svc(), &flush_service_queue_with_noop);
+    sender->wait_for_lookup();
 
     writer->write_container_statsd(&CONTAINER_ID1, &EXECUTOR_INFO1, hello.data(), hello.size());
     EXPECT_EQ("f1.e1.c1." + hello, test_reader.read(100 /* timeout_ms */));
@@ -0,0 +1,88 @@
+#include <chrono>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "statsd_tagger.hpp"
+
+/**
+ * Compares the per-line cost of tagging statsd data when the container tags are rendered for
+ * every line (as was done before tags were cached at registration) against reusing a
+ * ContainerTags which was rendered once.
+ * Not run as part of the unit tests: timings depend heavily on the host.
+ */
+
+namespace {
+  const size_t LINE_COUNT = 2000000;
+
+  mesos::ContainerID container_id() {
+    mesos::ContainerID cid;
+    cid.set_value("a1b2c3d4-e5f6-a7b8-c9d0-e1f2a3b4c5d6");
+    return cid;
+  }
+  mesos::ExecutorInfo exec_info() {
+    mesos::ExecutorInfo ei;
+    ei.mutable_framework_id()->set_value("5c8f2a3e-1d4b-4f6a-9e7c-0b2d4f6a8c0e-0001");
+    ei.mutable_executor_id()->set_value("marathon-app.9f1e3d5b-7a2c-11e6-8b4d-0242ac110002");
+    return ei;
+  }
+
+  void run_bench(const std::string& desc, metrics::StatsdTagger& tagger, bool cached) {
+    const mesos::ContainerID cid = container_id();
+    const mesos::ExecutorInfo ei = exec_info();
+    const metrics::ContainerTags cached_tags(cid, ei);
+    const std::string lines[] = {
+      "bench.counter:1|c",
+      "bench.gauge:3.5|g|#tag:val",
+      "bench.timer:12|ms|@0.5" };
+    std::vector<char> buf(1024, '\0');
+
+    size_t total_bytes = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < LINE_COUNT; ++i) {
+      const std::string& line = lines[i % 3];
+      if (cached) {
+        size_t size = tagger.calculate_size(&cached_tags, line.data(), line.size());
+        tagger.tag_copy(&cached_tags, line.data(), line.size(), buf.data());
+        total_bytes += size;
+      } else {
+        metrics::ContainerTags tags(cid, ei);
+        size_t size = tagger.calculate_size(&tags, line.data(), line.size());
+        tagger.tag_copy(&tags, line.data(), line.size(), buf.data());
+        total_bytes += size;
+      }
+    }
+    double secs = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    printf("BENCH %-10s %-8s lines=%zu bytes=%zu in %.3fs: %.1f ns/line\n",
+        desc.c_str(), cached ? "cached" : "per-line", LINE_COUNT, total_bytes, secs,
+        1e9 * secs / LINE_COUNT);
+  }
+}
+
+TEST(StatsdTaggerBench, key_prefix_per_line) {
+  metrics::KeyPrefixTagger tagger;
+  run_bench("key_prefix", tagger, false);
+}
+
+TEST(StatsdTaggerBench, key_prefix_cached) {
+  metrics::KeyPrefixTagger tagger;
+  run_bench("key_prefix", tagger, true);
+}
+
+TEST(StatsdTaggerBench, datadog_per_line) {
+  metrics::DatadogTagger tagger;
+  run_bench("datadog", tagger, false);
+}
+
+TEST(StatsdTaggerBench, datadog_cached) {
+  metrics::DatadogTagger tagger;
+  run_bench("datadog", tagger, true);
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
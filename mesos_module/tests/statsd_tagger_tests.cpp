@@ -26,68 +26,78 @@ namespace {
   // exercise . -> _ conversion:
   mesos::ContainerID cid = container_id("c.id");
   mesos::ExecutorInfo ei = exec_info("f.id", "e.id");
+  metrics::ContainerTags tags(cid, ei);
 
   const std::string hello("hello"), hey("hey"), hi("hi"), h("h"), empty("");
 }
 
+TEST(TaggerTests, container_tags) {
+  EXPECT_EQ("f_id.e_id.c_id.", tags.key_prefix());
+  EXPECT_EQ("framework_id:f.id,executor_id:e.id,container_id:c.id", tags.datadog_tags());
+
+  metrics::ContainerTags empty_tags(container_id(""), exec_info("", ""));
+  EXPECT_EQ("...", empty_tags.key_prefix());
+  EXPECT_EQ("framework_id:,executor_id:,container_id:", empty_tags.datadog_tags());
+}
+
 TEST(TaggerTests, null_tagger_no_container) {
   metrics::NullTagger tagger;
-  EXPECT_EQ(hello.size(), tagger.calculate_size(NULL, NULL, hello.data(), hello.size()));
-  EXPECT_EQ(hey.size(), tagger.calculate_size(NULL, NULL, hey.data(), hey.size()));
-  EXPECT_EQ(hi.size(), tagger.calculate_size(NULL, NULL, hi.data(), hi.size()));
-  EXPECT_EQ(h.size(), tagger.calculate_size(NULL, NULL, h.data(), h.size()));
-  EXPECT_EQ(empty.size(), tagger.calculate_size(NULL, NULL, empty.data(), empty.size()));
+  EXPECT_EQ(hello.size(), tagger.calculate_size(NULL, hello.data(), hello.size()));
+  EXPECT_EQ(hey.size(), tagger.calculate_size(NULL, hey.data(), hey.size()));
+  EXPECT_EQ(hi.size(), tagger.calculate_size(NULL, hi.data(), hi.size()));
+  EXPECT_EQ(h.size(), tagger.calculate_size(NULL, h.data(), h.size()));
+  EXPECT_EQ(empty.size(), tagger.calculate_size(NULL, empty.data(), empty.size()));
 
   std::vector<char> buf(100,'\0');
 
-  tagger.tag_copy(NULL, NULL, hello.data(), hello.size(), buf.data());
+  tagger.tag_copy(NULL, hello.data(), hello.size(), buf.data());
   std::string got(buf.data(), hello.size());
   EXPECT_EQ(hello, got);
 
-  tagger.tag_copy(NULL, NULL, hey.data(), hey.size(), buf.data());
+  tagger.tag_copy(NULL, hey.data(), hey.size(), buf.data());
   got = std::string(buf.data(), hey.size());
   EXPECT_EQ(hey, got);
 
-  tagger.tag_copy(NULL, NULL, hi.data(), hi.size(), buf.data());
+  tagger.tag_copy(NULL, hi.data(), hi.size(), buf.data());
   got = std::string(buf.data(), hi.size());
   EXPECT_EQ(hi, got);
 
-  tagger.tag_copy(NULL, NULL, h.data(), h.size(), buf.data());
+  tagger.tag_copy(NULL, h.data(), h.size(), buf.data());
   got = std::string(buf.data(), h.size());
   EXPECT_EQ(h, got);
 
-  tagger.tag_copy(NULL, NULL, empty.data(), empty.size(), buf.data());
+  tagger.tag_copy(NULL, empty.data(), empty.size(), buf.data());
   got = std::string(buf.data(), empty.size());
   EXPECT_EQ(empty, got);
 }
 
 TEST(TaggerTests, null_tagger_with_container) {
   metrics::NullTagger tagger;
-  EXPECT_EQ(hello.size(), tagger.calculate_size(&cid, &ei, hello.data(), hello.size()));
-  EXPECT_EQ(hey.size(), tagger.calculate_size(&cid, &ei, hey.data(), hey.size()));
-  EXPECT_EQ(hi.size(), tagger.calculate_size(&cid, &ei, hi.data(), hi.size()));
-  EXPECT_EQ(h.size(), tagger.calculate_size(&cid, &ei, h.data(), h.size()));
-  EXPECT_EQ(empty.size(), tagger.calculate_size(&cid, &ei, empty.data(), empty.size()));
+  EXPECT_EQ(hello.size(), tagger.calculate_size(&tags, hello.data(), hello.size()));
+  EXPECT_EQ(hey.size(), tagger.calculate_size(&tags, hey.data(), hey.size()));
+  EXPECT_EQ(hi.size(), tagger.calculate_size(&tags, hi.data(), hi.size()));
+  EXPECT_EQ(h.size(), tagger.calculate_size(&tags, h.data(), h.size()));
+  EXPECT_EQ(empty.size(), tagger.calculate_size(&tags, empty.data(), empty.size()));
 
   std::vector<char> buf(100,'\0');
 
-  tagger.tag_copy(&cid, &ei, hello.data(), hello.size(), buf.data());
+  tagger.tag_copy(&tags, hello.data(), hello.size(), buf.data());
   std::string got(buf.data(), hello.size());
   EXPECT_EQ(hello, got);
 
-  tagger.tag_copy(&cid, &ei, hey.data(), hey.size(), buf.data());
+  tagger.tag_copy(&tags, hey.data(), hey.size(), buf.data());
   got = std::string(buf.data(), hey.size());
   EXPECT_EQ(hey, got);
 
-  tagger.tag_copy(&cid, &ei, hi.data(), hi.size(), buf.data());
+  tagger.tag_copy(&tags, hi.data(), hi.size(), buf.data());
   got = std::string(buf.data(), hi.size());
   EXPECT_EQ(hi, got);
 
-  tagger.tag_copy(&cid, &ei, h.data(), h.size(), buf.data());
+  tagger.tag_copy(&tags, h.data(), h.size(), buf.data());
   got = std::string(buf.data(), h.size());
   EXPECT_EQ(h, got);
 
-  tagger.tag_copy(&cid, &ei, empty.data(), empty.size(), buf.data());
+  tagger.tag_copy(&tags, empty.data(), empty.size(), buf.data());
   got = std::string(buf.data(), empty.size());
   EXPECT_EQ(empty, got);
 }
@@ -99,40 +109,40 @@ TEST(TaggerTests, key_prefix_tagger_no_container) {
   std::string prefix = UNKNOWN_CONTAINER_TAG + ".";
 
   EXPECT_EQ(prefix.size() + hello.size(),
-      tagger.calculate_size(NULL, NULL, hello.data(), hello.size()));
+      tagger.calculate_size(NULL, hello.data(), hello.size()));
   EXPECT_EQ(prefix.size() + hey.size(),
-      tagger.calculate_size(NULL, NULL, hey.data(), hey.size()));
+      tagger.calculate_size(NULL, hey.data(), hey.size()));
   EXPECT_EQ(prefix.size() + hi.size(),
-      tagger.calculate_size(NULL, NULL, hi.data(), hi.size()));
+      tagger.calculate_size(NULL, hi.data(), hi.size()));
   EXPECT_EQ(prefix.size() + h.size(),
-      tagger.calculate_size(NULL, NULL, h.data(), h.size()));
+      tagger.calculate_size(NULL, h.data(), h.size()));
   EXPECT_EQ(prefix.size() + empty.size(),
-      tagger.calculate_size(NULL, NULL, empty.data(), empty.size()));
+      tagger.calculate_size(NULL, empty.data(), empty.size()));
 
   std::vector<char> buf(100,'\0');
 
   std::string expect = prefix + hello;
-  tagger.tag_copy(NULL, NULL, hello.data(), hello.size(), buf.data());
+  tagger.tag_copy(NULL, hello.data(), hello.size(), buf.data());
   std::string got(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = prefix + hey;
-  tagger.tag_copy(NULL, NULL, hey.data(), hey.size(), buf.data());
+  tagger.tag_copy(NULL, hey.data(), hey.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = prefix + hi;
-  tagger.tag_copy(NULL, NULL, hi.data(), hi.size(), buf.data());
+  tagger.tag_copy(NULL, hi.data(), hi.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = prefix + h;
-  tagger.tag_copy(NULL, NULL, h.data(), h.size(), buf.data());
+  tagger.tag_copy(NULL, h.data(), h.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = prefix + empty;
-  tagger.tag_copy(NULL, NULL, empty.data(), empty.size(), buf.data());
+  tagger.tag_copy(NULL, empty.data(), empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 }
@@ -142,40 +152,40 @@ TEST(TaggerTests, key_prefix_tagger_with_container) {
   std::string prefix = "f_id.e_id.c_id.";
 
   EXPECT_EQ(prefix.size() + hello.size(),
-      tagger.calculate_size(&cid, &ei, hello.data(), hello.size()));
+      tagger.calculate_size(&tags, hello.data(), hello.size()));
   EXPECT_EQ(prefix.size() + hey.size(),
-      tagger.calculate_size(&cid, &ei, hey.data(), hey.size()));
+      tagger.calculate_size(&tags, hey.data(), hey.size()));
   EXPECT_EQ(prefix.size() + hi.size(),
-      tagger.calculate_size(&cid, &ei, hi.data(), hi.size()));
+      tagger.calculate_size(&tags, hi.data(), hi.size()));
   EXPECT_EQ(prefix.size() + h.size(),
-      tagger.calculate_size(&cid, &ei, h.data(), h.size()));
+      tagger.calculate_size(&tags, h.data(), h.size()));
   EXPECT_EQ(prefix.size() + empty.size(),
-      tagger.calculate_size(&cid, &ei, empty.data(), empty.size()));
+      tagger.calculate_size(&tags, empty.data(), empty.size()));
 
   std::vector<char> buf(100,'\0');
 
   std::string expect = prefix + hello;
-  tagger.tag_copy(&cid, &ei, hello.data(), hello.size(), buf.data());
+  tagger.tag_copy(&tags, hello.data(), hello.size(), buf.data());
   std::string got(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = prefix + hey;
-  tagger.tag_copy(&cid, &ei, hey.data(), hey.size(), buf.data());
+  tagger.tag_copy(&tags, hey.data(), hey.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = prefix + hi;
-  tagger.tag_copy(&cid, &ei, hi.data(), hi.size(), buf.data());
+  tagger.tag_copy(&tags, hi.data(), hi.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = prefix + h;
-  tagger.tag_copy(&cid, &ei, h.data(), h.size(), buf.data());
+  tagger.tag_copy(&tags, h.data(), h.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = prefix + empty;
-  tagger.tag_copy(&cid, &ei, empty.data(), empty.size(), buf.data());
+  tagger.tag_copy(&tags, empty.data(), empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 }
@@ -188,37 +198,37 @@ TEST(TaggerTests, datadog_tagger_no_container) {
   std::vector<char> buf(100,'\0');
 
   EXPECT_EQ(hello.size() + suffix.size(),
-      tagger.calculate_size(NULL, NULL, hello.data(), hello.size()));
+      tagger.calculate_size(NULL, hello.data(), hello.size()));
   std::string expect = hello + suffix;
-  tagger.tag_copy(NULL, NULL, hello.data(), hello.size(), buf.data());
+  tagger.tag_copy(NULL, hello.data(), hello.size(), buf.data());
   std::string got(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   EXPECT_EQ(hey.size() + suffix.size(),
-      tagger.calculate_size(NULL, NULL, hey.data(), hey.size()));
+      tagger.calculate_size(NULL, hey.data(), hey.size()));
   expect = hey + suffix;
-  tagger.tag_copy(NULL, NULL, hey.data(), hey.size(), buf.data());
+  tagger.tag_copy(NULL, hey.data(), hey.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   EXPECT_EQ(hi.size() + suffix.size(),
-      tagger.calculate_size(NULL, NULL, hi.data(), hi.size()));
+      tagger.calculate_size(NULL, hi.data(), hi.size()));
   expect = hi + suffix;
-  tagger.tag_copy(NULL, NULL, hi.data(), hi.size(), buf.data());
+  tagger.tag_copy(NULL, hi.data(), hi.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   EXPECT_EQ(h.size() + suffix.size(),
-      tagger.calculate_size(NULL, NULL, h.data(), h.size()));
+      tagger.calculate_size(NULL, h.data(), h.size()));
   expect = h + suffix;
-  tagger.tag_copy(NULL, NULL, h.data(), h.size(), buf.data());
+  tagger.tag_copy(NULL, h.data(), h.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   EXPECT_EQ(empty.size() + suffix.size(),
-      tagger.calculate_size(NULL, NULL, empty.data(), empty.size()));
+      tagger.calculate_size(NULL, empty.data(), empty.size()));
   expect = empty + suffix;
-  tagger.tag_copy(NULL, NULL, empty.data(), empty.size(), buf.data());
+  tagger.tag_copy(NULL, empty.data(), empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 }
@@ -231,37 +241,37 @@ TEST(TaggerTests, datadog_tagger_with_container) {
   std::vector<char> buf(100,'\0');
 
   EXPECT_EQ(hello.size() + suffix.size(),
-      tagger.calculate_size(&cid, &ei, hello.data(), hello.size()));
+      tagger.calculate_size(&tags, hello.data(), hello.size()));
   std::string expect = hello + suffix;
-  tagger.tag_copy(&cid, &ei, hello.data(), hello.size(), buf.data());
+  tagger.tag_copy(&tags, hello.data(), hello.size(), buf.data());
   std::string got(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   EXPECT_EQ(hey.size() + suffix.size(),
-      tagger.calculate_size(&cid, &ei, hey.data(), hey.size()));
+      tagger.calculate_size(&tags, hey.data(), hey.size()));
   expect = hey + suffix;
-  tagger.tag_copy(&cid, &ei, hey.data(), hey.size(), buf.data());
+  tagger.tag_copy(&tags, hey.data(), hey.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   EXPECT_EQ(hi.size() + suffix.size(),
-      tagger.calculate_size(&cid, &ei, hi.data(), hi.size()));
+      tagger.calculate_size(&tags, hi.data(), hi.size()));
   expect = hi + suffix;
-  tagger.tag_copy(&cid, &ei, hi.data(), hi.size(), buf.data());
+  tagger.tag_copy(&tags, hi.data(), hi.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   EXPECT_EQ(h.size() + suffix.size(),
-      tagger.calculate_size(&cid, &ei, h.data(), h.size()));
+      tagger.calculate_size(&tags, h.data(), h.size()));
   expect = h + suffix;
-  tagger.tag_copy(&cid, &ei, h.data(), h.size(), buf.data());
+  tagger.tag_copy(&tags, h.data(), h.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   EXPECT_EQ(empty.size() + suffix.size(),
-      tagger.calculate_size(&cid, &ei, empty.data(), empty.size()));
+      tagger.calculate_size(&tags, empty.data(), empty.size()));
   expect = empty + suffix;
-  tagger.tag_copy(&cid, &ei, empty.data(), empty.size(), buf.data());
+  tagger.tag_copy(&tags, empty.data(), empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 }
@@ -274,8 +284,8 @@ TEST(TaggerTests, datadog_corner_cases_no_container) {
 
   std::string expect = hello_1tag + "," + UNKNOWN_CONTAINER_TAG;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_1tag.data(), hello_1tag.size()));
-  tagger.tag_copy(NULL, NULL, hello_1tag.data(), hello_1tag.size(), buf.data());
+      tagger.calculate_size(NULL, hello_1tag.data(), hello_1tag.size()));
+  tagger.tag_copy(NULL, hello_1tag.data(), hello_1tag.size(), buf.data());
   std::string got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
@@ -283,15 +293,15 @@ TEST(TaggerTests, datadog_corner_cases_no_container) {
 
   expect = hello_2endtag + "," + UNKNOWN_CONTAINER_TAG;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_2endtag.data(), hello_2endtag.size()));
-  tagger.tag_copy(NULL, NULL, hello_2endtag.data(), hello_2endtag.size(), buf.data());
+      tagger.calculate_size(NULL, hello_2endtag.data(), hello_2endtag.size()));
+  tagger.tag_copy(NULL, hello_2endtag.data(), hello_2endtag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = "hello|#ta," + UNKNOWN_CONTAINER_TAG + "|@0.5";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_2starttag.data(), hello_2starttag.size()));
-  tagger.tag_copy(NULL, NULL, hello_2starttag.data(), hello_2starttag.size(), buf.data());
+      tagger.calculate_size(NULL, hello_2starttag.data(), hello_2starttag.size()));
+  tagger.tag_copy(NULL, hello_2starttag.data(), hello_2starttag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
@@ -302,22 +312,22 @@ TEST(TaggerTests, datadog_corner_cases_no_container) {
 
   expect = hello_3endtag + "," + UNKNOWN_CONTAINER_TAG;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_3endtag.data(), hello_3endtag.size()));
-  tagger.tag_copy(NULL, NULL, hello_3endtag.data(), hello_3endtag.size(), buf.data());
+      tagger.calculate_size(NULL, hello_3endtag.data(), hello_3endtag.size()));
+  tagger.tag_copy(NULL, hello_3endtag.data(), hello_3endtag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = "hello|&other|#tag," + UNKNOWN_CONTAINER_TAG + "|@0.5";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_3midtag.data(), hello_3midtag.size()));
-  tagger.tag_copy(NULL, NULL, hello_3midtag.data(), hello_3midtag.size(), buf.data());
+      tagger.calculate_size(NULL, hello_3midtag.data(), hello_3midtag.size()));
+  tagger.tag_copy(NULL, hello_3midtag.data(), hello_3midtag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = "hello|#t," + UNKNOWN_CONTAINER_TAG + "|&other|@0.5";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_3starttag.data(), hello_3starttag.size()));
-  tagger.tag_copy(NULL, NULL, hello_3starttag.data(), hello_3starttag.size(), buf.data());
+      tagger.calculate_size(NULL, hello_3starttag.data(), hello_3starttag.size()));
+  tagger.tag_copy(NULL, hello_3starttag.data(), hello_3starttag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
@@ -336,104 +346,104 @@ TEST(TaggerTests, datadog_corner_cases_no_container) {
 
   expect = hello_1emptytag + UNKNOWN_CONTAINER_TAG;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_1emptytag.data(), hello_1emptytag.size()));
-  tagger.tag_copy(NULL, NULL, hello_1emptytag.data(), hello_1emptytag.size(), buf.data());
+      tagger.calculate_size(NULL, hello_1emptytag.data(), hello_1emptytag.size()));
+  tagger.tag_copy(NULL, hello_1emptytag.data(), hello_1emptytag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = hello_1emptytagval + UNKNOWN_CONTAINER_TAG;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_1emptytagval.data(), hello_1emptytagval.size()));
-  tagger.tag_copy(NULL, NULL, hello_1emptytagval.data(), hello_1emptytagval.size(), buf.data());
+      tagger.calculate_size(NULL, hello_1emptytagval.data(), hello_1emptytagval.size()));
+  tagger.tag_copy(NULL, hello_1emptytagval.data(), hello_1emptytagval.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = hello_1emptyend + "|#" + UNKNOWN_CONTAINER_TAG;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_1emptyend.data(), hello_1emptyend.size()));
-  tagger.tag_copy(NULL, NULL, hello_1emptyend.data(), hello_1emptyend.size(), buf.data());
+      tagger.calculate_size(NULL, hello_1emptyend.data(), hello_1emptyend.size()));
+  tagger.tag_copy(NULL, hello_1emptyend.data(), hello_1emptyend.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = "hello|#tag1," + UNKNOWN_CONTAINER_TAG + "|";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_2tag_empty.data(), hello_2tag_empty.size()));
-  tagger.tag_copy(NULL, NULL, hello_2tag_empty.data(), hello_2tag_empty.size(), buf.data());
+      tagger.calculate_size(NULL, hello_2tag_empty.data(), hello_2tag_empty.size()));
+  tagger.tag_copy(NULL, hello_2tag_empty.data(), hello_2tag_empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = "hello|||#" + UNKNOWN_CONTAINER_TAG;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_2empty_empty.data(), hello_2empty_empty.size()));
-  tagger.tag_copy(NULL, NULL, hello_2empty_empty.data(), hello_2empty_empty.size(), buf.data());
+      tagger.calculate_size(NULL, hello_2empty_empty.data(), hello_2empty_empty.size()));
+  tagger.tag_copy(NULL, hello_2empty_empty.data(), hello_2empty_empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = "hello||#tag1," + UNKNOWN_CONTAINER_TAG;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_2empty_tag.data(), hello_2empty_tag.size()));
-  tagger.tag_copy(NULL, NULL, hello_2empty_tag.data(), hello_2empty_tag.size(), buf.data());
+      tagger.calculate_size(NULL, hello_2empty_tag.data(), hello_2empty_tag.size()));
+  tagger.tag_copy(NULL, hello_2empty_tag.data(), hello_2empty_tag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = "hello|#tag1," + UNKNOWN_CONTAINER_TAG + "|#tag2";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_2tag_tag.data(), hello_2tag_tag.size()));
-  tagger.tag_copy(NULL, NULL, hello_2tag_tag.data(), hello_2tag_tag.size(), buf.data());
+      tagger.calculate_size(NULL, hello_2tag_tag.data(), hello_2tag_tag.size()));
+  tagger.tag_copy(NULL, hello_2tag_tag.data(), hello_2tag_tag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = "hello||#" + UNKNOWN_CONTAINER_TAG;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_2empty_emptytag.data(), hello_2empty_emptytag.size()));
-  tagger.tag_copy(NULL, NULL, hello_2empty_emptytag.data(), hello_2empty_emptytag.size(), buf.data());
+      tagger.calculate_size(NULL, hello_2empty_emptytag.data(), hello_2empty_emptytag.size()));
+  tagger.tag_copy(NULL, hello_2empty_emptytag.data(), hello_2empty_emptytag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = "hello|#" + UNKNOWN_CONTAINER_TAG + "|";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_2emptytag_empty.data(), hello_2emptytag_empty.size()));
-  tagger.tag_copy(NULL, NULL, hello_2emptytag_empty.data(), hello_2emptytag_empty.size(), buf.data());
+      tagger.calculate_size(NULL, hello_2emptytag_empty.data(), hello_2emptytag_empty.size()));
+  tagger.tag_copy(NULL, hello_2emptytag_empty.data(), hello_2emptytag_empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   expect = "hello|#," + UNKNOWN_CONTAINER_TAG + "|";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(NULL, NULL, hello_2emptytagval_empty.data(), hello_2emptytagval_empty.size()));
-  tagger.tag_copy(NULL, NULL, hello_2emptytagval_empty.data(), hello_2emptytagval_empty.size(), buf.data());
+      tagger.calculate_size(NULL, hello_2emptytagval_empty.data(), hello_2emptytagval_empty.size()));
+  tagger.tag_copy(NULL, hello_2emptytagval_empty.data(), hello_2emptytagval_empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 }
 
 TEST(TaggerTests, datadog_corner_cases_with_container) {
   metrics::DatadogTagger tagger;
-  std::string tags = FRAMEWORK_ID_DATADOG_KEY + ":f.id,"
+  std::string expect_tags = FRAMEWORK_ID_DATADOG_KEY + ":f.id,"
     + EXECUTOR_ID_DATADOG_KEY + ":e.id,"
     + CONTAINER_ID_DATADOG_KEY + ":c.id";
   std::vector<char> buf(100,'\0');
 
   std::string hello_1tag("hello|#tag");
 
-  std::string expect = hello_1tag + "," + tags;
+  std::string expect = hello_1tag + "," + expect_tags;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_1tag.data(), hello_1tag.size()));
-  tagger.tag_copy(&cid, &ei, hello_1tag.data(), hello_1tag.size(), buf.data());
+      tagger.calculate_size(&tags, hello_1tag.data(), hello_1tag.size()));
+  tagger.tag_copy(&tags, hello_1tag.data(), hello_1tag.size(), buf.data());
   std::string got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
   std::string hello_2endtag("hello|@0.5|#tag"), hello_2starttag("hello|#ta|@0.5");
 
-  expect = hello_2endtag + "," + tags;
+  expect = hello_2endtag + "," + expect_tags;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_2endtag.data(), hello_2endtag.size()));
-  tagger.tag_copy(&cid, &ei, hello_2endtag.data(), hello_2endtag.size(), buf.data());
+      tagger.calculate_size(&tags, hello_2endtag.data(), hello_2endtag.size()));
+  tagger.tag_copy(&tags, hello_2endtag.data(), hello_2endtag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = "hello|#ta," + tags + "|@0.5";
+  expect = "hello|#ta," + expect_tags + "|@0.5";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_2starttag.data(), hello_2starttag.size()));
-  tagger.tag_copy(&cid, &ei, hello_2starttag.data(), hello_2starttag.size(), buf.data());
+      tagger.calculate_size(&tags, hello_2starttag.data(), hello_2starttag.size()));
+  tagger.tag_copy(&tags, hello_2starttag.data(), hello_2starttag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
@@ -442,24 +452,24 @@ TEST(TaggerTests, datadog_corner_cases_with_container) {
     hello_3midtag("hello|&other|#tag|@0.5"),
     hello_3starttag("hello|#t|&other|@0.5");
 
-  expect = hello_3endtag + "," + tags;
+  expect = hello_3endtag + "," + expect_tags;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_3endtag.data(), hello_3endtag.size()));
-  tagger.tag_copy(&cid, &ei, hello_3endtag.data(), hello_3endtag.size(), buf.data());
+      tagger.calculate_size(&tags, hello_3endtag.data(), hello_3endtag.size()));
+  tagger.tag_copy(&tags, hello_3endtag.data(), hello_3endtag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = "hello|&other|#tag," + tags + "|@0.5";
+  expect = "hello|&other|#tag," + expect_tags + "|@0.5";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_3midtag.data(), hello_3midtag.size()));
-  tagger.tag_copy(&cid, &ei, hello_3midtag.data(), hello_3midtag.size(), buf.data());
+      tagger.calculate_size(&tags, hello_3midtag.data(), hello_3midtag.size()));
+  tagger.tag_copy(&tags, hello_3midtag.data(), hello_3midtag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = "hello|#t," + tags + "|&other|@0.5";
+  expect = "hello|#t," + expect_tags + "|&other|@0.5";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_3starttag.data(), hello_3starttag.size()));
-  tagger.tag_copy(&cid, &ei, hello_3starttag.data(), hello_3starttag.size(), buf.data());
+      tagger.calculate_size(&tags, hello_3starttag.data(), hello_3starttag.size()));
+  tagger.tag_copy(&tags, hello_3starttag.data(), hello_3starttag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
@@ -476,73 +486,73 @@ TEST(TaggerTests, datadog_corner_cases_with_container) {
     hello_2emptytag_empty("hello|#|"),
     hello_2emptytagval_empty("hello|#,|");
 
-  expect = hello_1emptytag + tags;
+  expect = hello_1emptytag + expect_tags;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_1emptytag.data(), hello_1emptytag.size()));
-  tagger.tag_copy(&cid, &ei, hello_1emptytag.data(), hello_1emptytag.size(), buf.data());
+      tagger.calculate_size(&tags, hello_1emptytag.data(), hello_1emptytag.size()));
+  tagger.tag_copy(&tags, hello_1emptytag.data(), hello_1emptytag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = hello_1emptytagval + tags;
+  expect = hello_1emptytagval + expect_tags;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_1emptytagval.data(), hello_1emptytagval.size()));
-  tagger.tag_copy(&cid, &ei, hello_1emptytagval.data(), hello_1emptytagval.size(), buf.data());
+      tagger.calculate_size(&tags, hello_1emptytagval.data(), hello_1emptytagval.size()));
+  tagger.tag_copy(&tags, hello_1emptytagval.data(), hello_1emptytagval.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = hello_1emptyend + "|#" + tags;
+  expect = hello_1emptyend + "|#" + expect_tags;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_1emptyend.data(), hello_1emptyend.size()));
-  tagger.tag_copy(&cid, &ei, hello_1emptyend.data(), hello_1emptyend.size(), buf.data());
+      tagger.calculate_size(&tags, hello_1emptyend.data(), hello_1emptyend.size()));
+  tagger.tag_copy(&tags, hello_1emptyend.data(), hello_1emptyend.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = "hello|#tag1," + tags + "|";
+  expect = "hello|#tag1," + expect_tags + "|";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_2tag_empty.data(), hello_2tag_empty.size()));
-  tagger.tag_copy(&cid, &ei, hello_2tag_empty.data(), hello_2tag_empty.size(), buf.data());
+      tagger.calculate_size(&tags, hello_2tag_empty.data(), hello_2tag_empty.size()));
+  tagger.tag_copy(&tags, hello_2tag_empty.data(), hello_2tag_empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = "hello|||#" + tags;
+  expect = "hello|||#" + expect_tags;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_2empty_empty.data(), hello_2empty_empty.size()));
-  tagger.tag_copy(&cid, &ei, hello_2empty_empty.data(), hello_2empty_empty.size(), buf.data());
+      tagger.calculate_size(&tags, hello_2empty_empty.data(), hello_2empty_empty.size()));
+  tagger.tag_copy(&tags, hello_2empty_empty.data(), hello_2empty_empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = "hello||#tag1," + tags;
+  expect = "hello||#tag1," + expect_tags;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_2empty_tag.data(), hello_2empty_tag.size()));
-  tagger.tag_copy(&cid, &ei, hello_2empty_tag.data(), hello_2empty_tag.size(), buf.data());
+      tagger.calculate_size(&tags, hello_2empty_tag.data(), hello_2empty_tag.size()));
+  tagger.tag_copy(&tags, hello_2empty_tag.data(), hello_2empty_tag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = "hello|#tag1," + tags + "|#tag2";
+  expect = "hello|#tag1," + expect_tags + "|#tag2";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_2tag_tag.data(), hello_2tag_tag.size()));
-  tagger.tag_copy(&cid, &ei, hello_2tag_tag.data(), hello_2tag_tag.size(), buf.data());
+      tagger.calculate_size(&tags, hello_2tag_tag.data(), hello_2tag_tag.size()));
+  tagger.tag_copy(&tags, hello_2tag_tag.data(), hello_2tag_tag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = "hello||#" + tags;
+  expect = "hello||#" + expect_tags;
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_2empty_emptytag.data(), hello_2empty_emptytag.size()));
-  tagger.tag_copy(&cid, &ei, hello_2empty_emptytag.data(), hello_2empty_emptytag.size(), buf.data());
+      tagger.calculate_size(&tags, hello_2empty_emptytag.data(), hello_2empty_emptytag.size()));
+  tagger.tag_copy(&tags, hello_2empty_emptytag.data(), hello_2empty_emptytag.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = "hello|#" + tags + "|";
+  expect = "hello|#" + expect_tags + "|";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_2emptytag_empty.data(), hello_2emptytag_empty.size()));
-  tagger.tag_copy(&cid, &ei, hello_2emptytag_empty.data(), hello_2emptytag_empty.size(), buf.data());
+      tagger.calculate_size(&tags, hello_2emptytag_empty.data(), hello_2emptytag_empty.size()));
+  tagger.tag_copy(&tags, hello_2emptytag_empty.data(), hello_2emptytag_empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 
-  expect = "hello|#," + tags + "|";
+  expect = "hello|#," + expect_tags + "|";
   EXPECT_EQ(expect.size(),
-      tagger.calculate_size(&cid, &ei, hello_2emptytagval_empty.data(), hello_2emptytagval_empty.size()));
-  tagger.tag_copy(&cid, &ei, hello_2emptytagval_empty.data(), hello_2emptytagval_empty.size(), buf.data());
+      tagger.calculate_size(&tags, hello_2emptytagval_empty.data(), hello_2emptytagval_empty.size()));
+  tagger.tag_copy(&tags, hello_2emptytagval_empty.data(), hello_2emptytagval_empty.size(), buf.data());
   got = std::string(buf.data(), expect.size());
   EXPECT_EQ(expect, got);
 }
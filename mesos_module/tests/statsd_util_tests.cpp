@@ -0,0 +1,56 @@
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "statsd_util.hpp"
+
+namespace {
+  uint64_t hash(const std::string& line) {
+    return metrics::statsd_series_hash(line.data(), line.size());
+  }
+}
+
+TEST(StatsdUtilTests, statsd_series_hash) {
+  // values and rates don't matter
+  EXPECT_EQ(hash("a:1|c"), hash("a:2|c"));
+  EXPECT_EQ(hash("a:1|c"), hash("a:2|c|@0.5"));
+  EXPECT_EQ(hash("a|c"), hash("a:2|c"));
+  // tags match in any order
+  EXPECT_EQ(hash("a:1|c|#x:1,y:2"), hash("a:2|c|#y:2,x:1"));
+  EXPECT_EQ(hash("a:1|c|#x:1,y:2"), hash("a:2|c|@0.1|#y:2,x:1"));
+
+  EXPECT_NE(hash("a:1|c"), hash("b:1|c"));
+  EXPECT_NE(hash("a:1|c"), hash("a:1|g"));
+  EXPECT_NE(hash("a:1|c"), hash("a:1|c|#x:1"));
+  EXPECT_NE(hash("a:1|c|#x:1"), hash("a:1|c|#x:2"));
+  EXPECT_NE(hash("a:1|c|#x:1,y:2"), hash("a:1|c|#x:1y:2"));
+  EXPECT_NE(hash("a:1|c|#x:1,x:1"), hash("a:1|c"));
+
+  EXPECT_NE(0, hash(""));
+  EXPECT_NE(0, hash("|||"));
+}
+
+TEST(StatsdUtilTests, statsd_series_hash_indexed) {
+  const std::vector<std::string> lines{
+    "a:1|c", "a|c", "a:1|c|@0.5|#x:1,y:2", "a:1|c|#y:2,x:1|@0.5", "a:1:2|c", "a", "a:1",
+    "", "|", "|||", ":", "a:1|#x:1|c", "a:1||#x:1", "a:1|c|#", "a:1|c|#x:1|#y:2"};
+  metrics::StatsdIndex index;
+  for (const std::string& line : lines) {
+    index.build(line.data(), line.size());
+    metrics::StatsdIndex::Line indexed;
+    if (line.empty()) {
+      EXPECT_FALSE(index.next_line(indexed));
+      continue;
+    }
+    ASSERT_TRUE(index.next_line(indexed)) << line;
+    EXPECT_EQ(hash(line), metrics::statsd_series_hash(indexed)) << line;
+  }
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,282 @@
+#include <chrono>
+#include <thread>
+#include <sys/stat.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "stream_listener.hpp"
+#include "sync_util.hpp"
+
+namespace {
+  const size_t BUFFER_BYTES = 16;
+
+  /**
+   * Records each line passed to the listener's consumer. Optionally rejects the first few offers.
+   */
+  class LineConsumer {
+   public:
+    LineConsumer(size_t reject_count = 0)
+      : reject_count(reject_count), offers(0) { }
+
+    bool consume(const metrics::StreamListener::endpoint_t& /*peer*/, const char* data, size_t size) {
+      ++offers;
+      if (reject_count > 0) {
+        --reject_count;
+        return false;
+      }
+      std::string lines(data, size);
+      size_t start = 0;
+      for (;;) {
+        size_t end = lines.find('\n', start);
+        lines_recvd.push_back(lines.substr(start, end - start));
+        if (end == std::string::npos) {
+          break;
+        }
+        start = end + 1;
+      }
+      return true;
+    }
+
+    size_t reject_count;
+    size_t offers;
+    std::vector<std::string> lines_recvd;
+  };
+
+  class ServiceThread {
+   public:
+    ServiceThread()
+      : svc_(new boost::asio::io_service),
+        work(new boost::asio::io_service::work(*svc_)),
+        svc_thread(std::bind(&ServiceThread::run_svc, this)) { }
+
+    std::shared_ptr<boost::asio::io_service> svc() {
+      return svc_;
+    }
+
+    void run(std::function<void()> func) {
+      EXPECT_TRUE(metrics::sync_util::dispatch_run("run", *svc_, func));
+    }
+
+    /**
+     * Waits for the consumer to have received the provided number of lines.
+     */
+    void wait_lines(LineConsumer& consumer, size_t count, size_t timeout_ms = 5000) {
+      for (size_t waited_ms = 0; waited_ms < timeout_ms; waited_ms += 5) {
+        std::shared_ptr<size_t> recvd = metrics::sync_util::dispatch_get<
+          boost::asio::io_service, size_t>("check", *svc_, [&consumer]() {
+              return consumer.lines_recvd.size();
+            });
+        if (recvd && *recvd >= count) {
+          return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+      ADD_FAILURE() << "Timed out waiting for " << count << " lines";
+    }
+
+    void join() {
+      work.reset();
+      svc_->stop();
+      svc_thread.join();
+    }
+
+   private:
+    void run_svc() {
+      svc_->run();
+    }
+
+    std::shared_ptr<boost::asio::io_service> svc_;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::thread svc_thread;
+  };
+
+  std::string socket_path(const std::string& name) {
+    return "/tmp/stream_listener_tests-" + std::to_string(getpid()) + "-" + name + ".sock";
+  }
+
+  std::shared_ptr<metrics::StreamListener> create(
+      ServiceThread& thread, LineConsumer& consumer, size_t max_connections = 10) {
+    return std::shared_ptr<metrics::StreamListener>(new metrics::StreamListener(
+            thread.svc(),
+            std::bind(&LineConsumer::consume, &consumer,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+            max_connections, BUFFER_BYTES));
+  }
+
+  void destroy(ServiceThread& thread, std::shared_ptr<metrics::StreamListener>& listener) {
+    // Must be destroyed within the io thread
+    thread.run([&listener]() { listener.reset(); });
+  }
+
+  void send(boost::asio::local::stream_protocol::socket& socket, const std::string& data) {
+    boost::asio::write(socket, boost::asio::buffer(data));
+    // Give the listener a chance to read each write separately
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+TEST(StreamListenerTests, lines_split_across_reads) {
+  const std::string path = socket_path("split");
+  ServiceThread thread;
+  LineConsumer consumer;
+  std::shared_ptr<metrics::StreamListener> listener = create(thread, consumer);
+  Try<Nothing> result = listener->open_unix(path);
+  ASSERT_FALSE(result.isError()) << result.error();
+
+  {
+    boost::asio::io_service svc;
+    boost::asio::local::stream_protocol::socket client(svc);
+    client.connect(boost::asio::local::stream_protocol::endpoint(path));
+    send(client, "one\ntw");
+    send(client, "o\nthr");
+    send(client, "ee");
+    send(client, "\n\nfour\nfive");
+    // five has no trailing newline: passed along when the connection closes
+  }
+  thread.wait_lines(consumer, 6);
+
+  thread.run([&]() {
+        EXPECT_EQ(0, listener->connection_count());
+        EXPECT_EQ(0, listener->take_paused_count());
+        EXPECT_EQ(0, listener->take_dropped_bytes());
+      });
+  destroy(thread, listener);
+  thread.join();
+
+  // empty lines are left for the consumer to skip
+  std::vector<std::string> expected{"one", "two", "three", "", "four", "five"};
+  EXPECT_EQ(expected, consumer.lines_recvd);
+  // removed along with the listener
+  struct stat path_stat;
+  EXPECT_NE(0, stat(path.c_str(), &path_stat));
+}
+
+TEST(StreamListenerTests, overlong_line_dropped) {
+  const std::string path = socket_path("overlong");
+  ServiceThread thread;
+  LineConsumer consumer;
+  std::shared_ptr<metrics::StreamListener> listener = create(thread, consumer);
+  Try<Nothing> result = listener->open_unix(path);
+  ASSERT_FALSE(result.isError()) << result.error();
+
+  {
+    boost::asio::io_service svc;
+    boost::asio::local::stream_protocol::socket client(svc);
+    client.connect(boost::asio::local::stream_protocol::endpoint(path));
+    send(client, "short\n");
+    // 40 bytes without a newline don't fit in the 16 byte buffer
+    send(client, std::string(20, 'x'));
+    send(client, std::string(20, 'x') + "\nafter\n");
+  }
+  thread.wait_lines(consumer, 2);
+
+  thread.run([&]() {
+        // the long line along with its newline
+        EXPECT_EQ(41, listener->take_dropped_bytes());
+      });
+  destroy(thread, listener);
+  thread.join();
+
+  std::vector<std::string> expected{"short", "after"};
+  EXPECT_EQ(expected, consumer.lines_recvd);
+}
+
+TEST(StreamListenerTests, paused_until_accepted) {
+  const std::string path = socket_path("paused");
+  ServiceThread thread;
+  // each rejection pauses the connection for a bit
+  LineConsumer consumer(3);
+  std::shared_ptr<metrics::StreamListener> listener = create(thread, consumer);
+  Try<Nothing> result = listener->open_unix(path);
+  ASSERT_FALSE(result.isError()) << result.error();
+
+  std::vector<std::string> expected;
+  {
+    boost::asio::io_service svc;
+    boost::asio::local::stream_protocol::socket client(svc);
+    client.connect(boost::asio::local::stream_protocol::endpoint(path));
+    for (size_t i = 0; i < 100; ++i) {
+      expected.push_back("line" + std::to_string(i));
+      boost::asio::write(client, boost::asio::buffer(expected.back() + "\n"));
+    }
+  }
+  thread.wait_lines(consumer, expected.size());
+
+  thread.run([&]() {
+        EXPECT_EQ(3, listener->take_paused_count());
+        EXPECT_EQ(0, listener->take_dropped_bytes());
+      });
+  destroy(thread, listener);
+  thread.join();
+
+  // nothing lost, in order
+  EXPECT_EQ(expected, consumer.lines_recvd);
+}
+
+TEST(StreamListenerTests, max_connections) {
+  const std::string path = socket_path("max");
+  ServiceThread thread;
+  LineConsumer consumer;
+  std::shared_ptr<metrics::StreamListener> listener = create(thread, consumer, 1);
+  Try<Nothing> result = listener->open_unix(path);
+  ASSERT_FALSE(result.isError()) << result.error();
+
+  boost::asio::io_service svc;
+  boost::asio::local::stream_protocol::socket client1(svc), client2(svc);
+  client1.connect(boost::asio::local::stream_protocol::endpoint(path));
+  send(client1, "first\n");
+  client2.connect(boost::asio::local::stream_protocol::endpoint(path));
+
+  // the second connection is closed by the listener
+  char buf[1];
+  boost::system::error_code ec;
+  client2.read_some(boost::asio::buffer(buf), ec);
+  EXPECT_EQ(boost::asio::error::eof, ec);
+
+  thread.wait_lines(consumer, 1);
+  thread.run([&]() {
+        EXPECT_EQ(1, listener->connection_count());
+        EXPECT_EQ(1, listener->take_rejected_connections());
+      });
+  client1.close();
+  client2.close();
+  destroy(thread, listener);
+  thread.join();
+
+  std::vector<std::string> expected{"first"};
+  EXPECT_EQ(expected, consumer.lines_recvd);
+}
+
+TEST(StreamListenerTests, tcp) {
+  // find a free port
+  boost::asio::io_service svc;
+  boost::asio::ip::tcp::acceptor probe(svc, boost::asio::ip::tcp::endpoint(
+          boost::asio::ip::address::from_string("127.0.0.1"), 0));
+  boost::asio::ip::tcp::endpoint endpoint = probe.local_endpoint();
+  probe.close();
+
+  ServiceThread thread;
+  LineConsumer consumer;
+  std::shared_ptr<metrics::StreamListener> listener = create(thread, consumer);
+  Try<Nothing> result = listener->open_tcp(endpoint);
+  ASSERT_FALSE(result.isError()) << result.error();
+
+  {
+    boost::asio::ip::tcp::socket client(svc);
+    client.connect(endpoint);
+    boost::asio::write(client, boost::asio::buffer(std::string("hello\nhey\n")));
+  }
+  thread.wait_lines(consumer, 2);
+  destroy(thread, listener);
+  thread.join();
+
+  std::vector<std::string> expected{"hello", "hey"};
+  EXPECT_EQ(expected, consumer.lines_recvd);
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,108 @@
+#include <sstream>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "string_interner.hpp"
+
+TEST(StringInternerTests, intern) {
+  metrics::StringInterner strings;
+  EXPECT_EQ(0, strings.size());
+
+  std::string hello("hello"), hello2("hello"), hey("hey");
+  metrics::InternedString a = strings.intern(hello);
+  metrics::InternedString b = strings.intern(hello2);
+  metrics::InternedString c = strings.intern(hey.data(), hey.size());
+  EXPECT_EQ(2, strings.size());
+
+  // same content: same copy, not pointing at the input
+  EXPECT_EQ(a.data(), b.data());
+  EXPECT_NE(hello.data(), a.data());
+  EXPECT_NE(a.data(), c.data());
+  EXPECT_EQ("hello", a.str());
+  EXPECT_EQ("hey", c.str());
+
+  // only 'size' bytes are used:
+  metrics::InternedString d = strings.intern(hello.data(), 3);
+  EXPECT_EQ("hel", d.str());
+  EXPECT_EQ(3, strings.size());
+
+  EXPECT_TRUE(a == b);
+  EXPECT_TRUE(a == hello);
+  EXPECT_TRUE(hello == a);
+  EXPECT_TRUE(a != c);
+  EXPECT_TRUE(a != d);
+  EXPECT_TRUE(a != hey);
+  EXPECT_TRUE(hey != a);
+
+  std::ostringstream oss;
+  oss << a << "," << d;
+  EXPECT_EQ("hello,hel", oss.str());
+}
+
+TEST(StringInternerTests, empty) {
+  metrics::StringInterner strings;
+  metrics::InternedString empty = strings.intern("", 0);
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(0, strings.size());
+  EXPECT_TRUE(empty == metrics::InternedString());
+  EXPECT_TRUE(empty == std::string());
+  EXPECT_EQ("", metrics::InternedString().str());
+}
+
+TEST(StringInternerTests, many_strings) {
+  // small chunks and enough strings to force several chunks and table resizes
+  metrics::StringInterner strings(256);
+  std::vector<metrics::InternedString> interned;
+  for (size_t i = 0; i < 10000; ++i) {
+    interned.push_back(strings.intern("metric.name." + std::to_string(i)));
+  }
+  // large strings get their own allocation
+  std::string large(1000, 'x');
+  metrics::InternedString large_interned = strings.intern(large);
+  EXPECT_EQ(10001, strings.size());
+
+  for (size_t i = 0; i < 10000; ++i) {
+    ASSERT_EQ("metric.name." + std::to_string(i), interned[i].str());
+    ASSERT_EQ(interned[i].data(), strings.intern("metric.name." + std::to_string(i)).data());
+  }
+  EXPECT_EQ(large, large_interned.str());
+  EXPECT_EQ(large_interned.data(), strings.intern(large).data());
+  EXPECT_EQ(10001, strings.size());
+}
+
+TEST(StringInternerTests, reset) {
+  metrics::StringInterner strings(256);
+  metrics::InternedString first = strings.intern("first");
+  for (size_t i = 0; i < 1000; ++i) {
+    strings.intern("metric.name." + std::to_string(i));
+  }
+  EXPECT_EQ(1001, strings.size());
+
+  strings.reset();
+  EXPECT_EQ(0, strings.size());
+
+  // chunks are reused from the start, and old entries are no longer found
+  metrics::InternedString second = strings.intern("second");
+  EXPECT_EQ(first.data(), second.data());
+  EXPECT_EQ("second", second.str());
+  metrics::InternedString first_again = strings.intern("first");
+  EXPECT_EQ("first", first_again.str());
+  EXPECT_NE(second.data(), first_again.data());
+  EXPECT_EQ(2, strings.size());
+
+  for (size_t round = 0; round < 10; ++round) {
+    strings.reset();
+    for (size_t i = 0; i < 1000; ++i) {
+      std::string name = "metric.name." + std::to_string(i + round);
+      ASSERT_EQ(name, strings.intern(name).str());
+    }
+    EXPECT_EQ(1000, strings.size());
+  }
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,124 @@
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <string.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "avro_encoder.hpp"
+#include "strntod.h"
+
+/**
+ * Compares strntod() against the std::stod() parsing previously used for statsd values, both on
+ * its own and as part of statsd_to_map(). Not run as part of the unit tests: timings depend
+ * heavily on the host.
+ */
+
+namespace {
+  const size_t VALUE_COUNT = 10000;
+  const size_t MIN_BENCH_MS = 500;
+
+  /**
+   * Returns a mix of values resembling statsd traffic: counts, gauges, timings and sample rates.
+   */
+  std::vector<std::string> build_values() {
+    std::mt19937 rand(VALUE_COUNT);
+    std::vector<std::string> values;
+    for (size_t i = 0; i < VALUE_COUNT; ++i) {
+      std::ostringstream oss;
+      switch (rand() % 4) {
+        case 0:
+          oss << (rand() % 10 + 1);
+          break;
+        case 1:
+          oss << (rand() % 100000) / 100.;
+          break;
+        case 2:
+          oss << (int)(rand() % 2000000) - 1000000;
+          break;
+        case 3:
+          oss << "0." << (rand() % 100);
+          break;
+      }
+      values.push_back(oss.str());
+    }
+    return values;
+  }
+
+  double parse_stod(const char* data, size_t size) {
+    std::string str(data, size);
+    try {
+      return std::stod(str);
+    } catch (...) {
+      return 0;
+    }
+  }
+
+  double parse_strntod(const char* data, size_t size) {
+    double val;
+    return strntod(data, size, &val) ? val : 0;
+  }
+
+  template <typename ParseFunc>
+  void run_bench(const std::string& label, const std::vector<std::string>& values, ParseFunc func) {
+    size_t parsed = 0;
+    double sum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed;
+    do {
+      for (const std::string& value : values) {
+        sum += func(value.data(), value.size());
+      }
+      parsed += values.size();
+      elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(MIN_BENCH_MS));
+
+    printf("BENCH %-10s %6.1f ns/value (sum=%g)\n",
+        label.c_str(), 1e9 * elapsed.count() / parsed, sum / (parsed / values.size()));
+  }
+}
+
+TEST(StrntodBench, parse_values) {
+  const std::vector<std::string> values = build_values();
+  // check the implementations agree before timing them
+  for (const std::string& value : values) {
+    double stod_val = parse_stod(value.data(), value.size());
+    double strntod_val = parse_strntod(value.data(), value.size());
+    ASSERT_EQ(0, memcmp(&stod_val, &strntod_val, sizeof(double))) << value;
+  }
+  run_bench("stod", values, parse_stod);
+  run_bench("strntod", values, parse_strntod);
+}
+
+TEST(StrntodBench, statsd_to_map) {
+  std::vector<std::string> lines;
+  for (const std::string& value : build_values()) {
+    lines.push_back("some.metric.name:" + value + "|c|@0.5");
+  }
+  mesos::ContainerID cid;
+  cid.set_value("cid");
+  mesos::ExecutorInfo ei;
+  ei.mutable_framework_id()->set_value("fid");
+  ei.mutable_executor_id()->set_value("eid");
+
+  size_t parsed = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed;
+  do {
+    metrics::avro_metrics_map_t map;
+    for (const std::string& line : lines) {
+      metrics::AvroEncoder::statsd_to_map(&cid, &ei, line.data(), line.size(), map);
+    }
+    parsed += lines.size();
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed < std::chrono::milliseconds(MIN_BENCH_MS));
+
+  printf("BENCH statsd_to_map %6.1f ns/line\n", 1e9 * elapsed.count() / parsed);
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
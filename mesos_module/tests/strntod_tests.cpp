@@ -0,0 +1,142 @@
+#include <math.h>
+#include <memory>
+#include <random>
+#include <string.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "strntod.h"
+
+namespace {
+  /**
+   * Returns whether strntod() matches std::stod() for the provided string: both succeed with
+   * bit-identical results, or both fail.
+   */
+  ::testing::AssertionResult matches_stod(const std::string& str) {
+    bool stod_ok = true;
+    double stod_val = 0;
+    try {
+      stod_val = std::stod(str);
+    } catch (...) {
+      stod_ok = false;
+    }
+
+    // copy into an exactly-sized buffer without a trailing \0, to catch overreads under ASAN
+    std::unique_ptr<char[]> buf(new char[str.size() + 1]);
+    memcpy(buf.get(), str.data(), str.size());
+    double strntod_val = 0;
+    bool strntod_ok = strntod(buf.get(), str.size(), &strntod_val);
+
+    if (stod_ok != strntod_ok) {
+      return ::testing::AssertionFailure() << "'" << str << "': stod "
+        << (stod_ok ? "succeeded" : "failed") << ", strntod " << (strntod_ok ? "succeeded" : "failed");
+    }
+    if (stod_ok && memcmp(&stod_val, &strntod_val, sizeof(double)) != 0) {
+      return ::testing::AssertionFailure() << "'" << str << "': stod=" << stod_val
+        << " strntod=" << strntod_val;
+    }
+    return ::testing::AssertionSuccess();
+  }
+
+  std::string format(const char* fmt, double val) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), fmt, val);
+    return buf;
+  }
+}
+
+TEST(StrntodTests, values) {
+  double val = -1;
+  std::string str("0.35");
+  EXPECT_TRUE(strntod(str.data(), str.size(), &val));
+  EXPECT_EQ(0.35, val);
+  str = "3.8";
+  EXPECT_TRUE(strntod(str.data(), str.size(), &val));
+  EXPECT_EQ(3.8, val);
+  str = "-10";
+  EXPECT_TRUE(strntod(str.data(), str.size(), &val));
+  EXPECT_EQ(-10, val);
+
+  // only reads 'size' bytes:
+  str = "12345";
+  EXPECT_TRUE(strntod(str.data(), 2, &val));
+  EXPECT_EQ(12, val);
+
+  // stops at the first non-numeric character:
+  str = "3.8|c";
+  EXPECT_TRUE(strntod(str.data(), str.size(), &val));
+  EXPECT_EQ(3.8, val);
+}
+
+TEST(StrntodTests, invalid_values) {
+  double val = 5;
+  for (const char* chars : { "", " ", "hi", "-", ".", "+.", "e5", "|c", "1e999", "-1e999" }) {
+    std::string str(chars);
+    EXPECT_FALSE(strntod(str.data(), str.size(), &val)) << str;
+    EXPECT_EQ(5, val) << str;
+  }
+  std::string str("3.8");
+  EXPECT_FALSE(strntod(str.data(), 0, &val));
+  EXPECT_EQ(5, val);
+}
+
+TEST(StrntodTests, matches_stod_encoder_values) {
+  // values used in avro_encoder_tests
+  for (const char* str : {
+          "", " ", "hi", "0", "0.0", "1", "2", "3", "10", "10.3", "11", "12", "13", "123",
+          "0.35", "0.5", "0.7", "3.8", "0.35|@0.5", "1|c", "3.8|#tag" }) {
+    EXPECT_TRUE(matches_stod(str));
+  }
+}
+
+TEST(StrntodTests, matches_stod_edge_cases) {
+  for (const char* str : {
+          "-0", "-0.0", "+0", "+1.5", "1.", ".5", "-.5", "007", "0.000", " 1", "\t-2", "1 ",
+          "1e5", "1E-5", "-1.5e+3", "1e", "1e+", "1.5x", "0x1p3", "0X10", "inf", "-INF",
+          "infinity", "nan", "NaN(123)", "1,5", "--1", "+-1",
+          // fast path limits
+          "9007199254740991", "9007199254740992", "9007199254740993", "-9007199254740993",
+          "18446744073709551615", "18446744073709551616", "123456789012345678901234567890",
+          "0.1234567890123456789012", "0.12345678901234567890123", "1.0000000000000000000001",
+          "0.0000000000000000000001", "0.00000000000000000000001", "1e22", "1e23",
+          // denormals, overflow
+          "4.9e-324", "2.4e-324", "1e-400", "1.7976931348623157e308", "1.8e308",
+          // longer than the stack buffer
+          "0.0000000000000000000000000000000000000000000000000000000000000000000000000000001",
+          "1.00000000000000000000000000000000000000000000000000000000000000000000000000000001",
+          "3.14159265358979323846264338327950288419716939937510582097494459230781640628620899" }) {
+    EXPECT_TRUE(matches_stod(str));
+  }
+  // embedded \0:
+  EXPECT_TRUE(matches_stod(std::string("12\0" "3", 4)));
+}
+
+TEST(StrntodTests, matches_stod_random) {
+  std::mt19937_64 rand(1234);
+  std::uniform_real_distribution<double> small(-1000, 1000);
+  std::uniform_int_distribution<int> exp(-30, 30);
+  std::uniform_int_distribution<int> digit_count(1, 25);
+  for (size_t i = 0; i < 200000; ++i) {
+    double val = small(rand) * pow(10, exp(rand));
+    ASSERT_TRUE(matches_stod(format("%.17g", val)));
+    ASSERT_TRUE(matches_stod(format("%g", val)));
+    ASSERT_TRUE(matches_stod(format("%f", val)));
+    ASSERT_TRUE(matches_stod(format("%.3f", small(rand))));
+
+    // random digit strings with a decimal point somewhere: exercises the fast path bounds
+    std::string digits;
+    int count = digit_count(rand);
+    for (int d = 0; d < count; ++d) {
+      digits.push_back('0' + rand() % 10);
+    }
+    digits.insert(rand() % (digits.size() + 1), 1, '.');
+    ASSERT_TRUE(matches_stod(digits));
+  }
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,3 +1,9 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include "metrics_udp_sender.hpp"
 
 class StubUDPSender : public metrics::MetricsUDPSender {
@@ -24,11 +30,59 @@ class StubUDPSender : public metrics::MetricsUDPSender {
     return custom_success(io_service, port, endpoints);
   }
 
+  /**
+   * Resolves to localhost, but every lookup after the first one is stuck until release_lookups().
+   */
+  static ptr_t blocking(std::shared_ptr<boost::asio::io_service> io_service, size_t port) {
+    std::vector<boost::asio::ip::udp::endpoint> endpoints;
+    endpoints.push_back(boost::asio::ip::udp::endpoint(
+            boost::asio::ip::address::from_string("127.0.0.1"), 0 /* port */));
+    return ptr_t(new StubUDPSender(
+            io_service, port, endpoints, boost::system::error_code(), true /* block_lookups */));
+  }
+
+  /**
+   * Sends to every address in lookup_result, routing data across them by hash.
+   */
+  static ptr_t fanout(std::shared_ptr<boost::asio::io_service> io_service, size_t port,
+      std::vector<boost::asio::ip::udp::endpoint> lookup_result) {
+    return ptr_t(new StubUDPSender(
+            io_service, port, lookup_result, boost::system::error_code(), false, true /* fanout */));
+  }
+
   static ptr_t empty(std::shared_ptr<boost::asio::io_service> io_service, size_t port) {
     return custom_success(io_service, port, std::vector<boost::asio::ip::udp::endpoint>());
   }
 
+  /**
+   * Waits until the sender has handled the results of its first 'handled' lookups.
+   */
+  void wait_for_lookup(size_t handled = 1) {
+    // Lookups don't overlap: the next one only starts once the last result has been handled.
+    while (lookups < handled + 1) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  /**
+   * Returns the number of lookups started so far.
+   */
+  size_t lookup_count() const {
+    return lookups;
+  }
+
+  /**
+   * Lets any stuck lookup complete, along with all the following ones.
+   */
+  void release_lookups() {
+    std::unique_lock<std::mutex> lock(lookup_mutex);
+    lookups_released = true;
+    lookup_cond.notify_all();
+  }
+
   virtual ~StubUDPSender() {
+    // let a stuck lookup finish, as shutdown waits for it
+    release_lookups();
     // cancel timers in parent class before we get destroyed:
     // ensure their timers don't call OUR resolve() after we're destroyed
     this->shutdown();
@@ -36,6 +90,10 @@ class StubUDPSender : public metrics::MetricsUDPSender {
 
  protected:
   boost::asio::ip::udp::resolver::iterator resolve(boost::system::error_code& ec) {
+    if (lookups++ > 0 && block_lookups) {
+      std::unique_lock<std::mutex> lock(lookup_mutex);
+      lookup_cond.wait(lock, [this]() { return lookups_released; });
+    }
     if (lookup_error) {
       ec = lookup_error;
       return boost::asio::ip::udp::resolver::iterator();
@@ -77,15 +135,25 @@ class StubUDPSender : public metrics::MetricsUDPSender {
       std::shared_ptr<boost::asio::io_service> io_service,
       size_t port,
       std::vector<boost::asio::ip::udp::endpoint> lookup_result,
-      boost::system::error_code lookup_error)
-    : metrics::MetricsUDPSender(io_service, "fakehost", port, 1 /* resolve_period_ms */),
+      boost::system::error_code lookup_error,
+      bool block_lookups = false,
+      bool fanout = false)
+    : metrics::MetricsUDPSender(io_service, "fakehost", port, 1 /* resolve_period_ms */, fanout),
       io_service(io_service),
       lookup_result(lookup_result),
       lookup_error(lookup_error),
+      block_lookups(block_lookups),
+      lookups(0),
+      lookups_released(false),
       dest_hostname("fakehost") { }
 
   const std::shared_ptr<boost::asio::io_service> io_service;
   const std::vector<boost::asio::ip::udp::endpoint> lookup_result;
   const boost::system::error_code lookup_error;
+  const bool block_lookups;
+  std::atomic<size_t> lookups;
+  std::mutex lookup_mutex;
+  std::condition_variable lookup_cond;
+  bool lookups_released;
   const std::string dest_hostname;
 };
@@ -70,6 +70,12 @@ class TestUDPReadSocket : public AbstractTestUDPSocket {
     return listener_endpoint.port();
   }
 
+  void close() {
+    socket.close();
+    listener_endpoint = boost::asio::ip::udp::endpoint();
+    LOG(INFO) << "(TEST) Stopped listening";
+  }
+
   size_t available() {
     return socket.available();
   }
@@ -0,0 +1,87 @@
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "token_bucket.hpp"
+
+namespace {
+  typedef metrics::TokenBucket::clock_t clock_t;
+
+  clock_t::time_point at_ms(size_t ms) {
+    return clock_t::time_point(std::chrono::milliseconds(ms));
+  }
+
+  bool consume(metrics::TokenBucket& bucket, size_t count, clock_t::time_point now) {
+    if (!bucket.allow(count, now)) {
+      return false;
+    }
+    bucket.take(count);
+    return true;
+  }
+}
+
+TEST(TokenBucketTests, burst_then_refill) {
+  // 100 per second, up to 50 at once
+  metrics::TokenBucket bucket(100, 1000, 50);
+  EXPECT_TRUE(consume(bucket, 30, at_ms(0)));
+  EXPECT_TRUE(consume(bucket, 20, at_ms(0)));
+  EXPECT_FALSE(consume(bucket, 1, at_ms(0)));
+  EXPECT_EQ(0, bucket.available());
+
+  // refilled continuously, not all at the end of the period
+  EXPECT_FALSE(consume(bucket, 2, at_ms(10)));
+  EXPECT_TRUE(consume(bucket, 1, at_ms(10)));
+  EXPECT_TRUE(consume(bucket, 10, at_ms(110)));
+  EXPECT_FALSE(consume(bucket, 1, at_ms(110)));
+
+  // capped at the burst size
+  EXPECT_TRUE(bucket.allow(50, at_ms(10000)));
+  EXPECT_EQ(50, bucket.available());
+
+  // time going backwards is ignored
+  EXPECT_TRUE(consume(bucket, 50, at_ms(10000)));
+  EXPECT_FALSE(consume(bucket, 1, at_ms(5000)));
+  EXPECT_TRUE(consume(bucket, 1, at_ms(10010)));
+}
+
+TEST(TokenBucketTests, steady_rate) {
+  // a sender at 10x the limit only gets the limit through, plus the initial burst
+  metrics::TokenBucket bucket(1000, 1000, 100);
+  size_t allowed = 0;
+  for (size_t ms = 0; ms < 10000; ++ms) {
+    for (size_t i = 0; i < 10; ++i) {
+      if (consume(bucket, 1, at_ms(ms))) {
+        ++allowed;
+      }
+    }
+  }
+  EXPECT_NEAR(10000 + 100, allowed, 2);
+}
+
+TEST(TokenBucketTests, oversized) {
+  metrics::TokenBucket bucket(100, 1000, 50);
+  // only when full, then in debt until refilled
+  EXPECT_TRUE(consume(bucket, 80, at_ms(0)));
+  EXPECT_EQ(-30, bucket.available());
+  EXPECT_FALSE(consume(bucket, 1, at_ms(300)));
+  EXPECT_TRUE(consume(bucket, 1, at_ms(310)));
+  EXPECT_FALSE(consume(bucket, 80, at_ms(310)));
+  EXPECT_TRUE(consume(bucket, 80, at_ms(2000)));
+}
+
+TEST(TokenBucketTests, zero) {
+  metrics::TokenBucket empty(0, 1000, 0);
+  EXPECT_FALSE(empty.allow(1, at_ms(0)));
+  EXPECT_FALSE(empty.allow(0, at_ms(0)));
+  EXPECT_FALSE(empty.allow(1, at_ms(100000)));
+
+  metrics::TokenBucket unlimited(0, 0, 0);
+  EXPECT_TRUE(unlimited.allow(1000000, at_ms(0)));
+  unlimited.take(1000000);
+  EXPECT_TRUE(unlimited.allow(1000000, at_ms(0)));
+}
+
+int main(int argc, char **argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,26 @@
+#include "token_bucket.hpp"
+
+#include <algorithm>
+
+metrics::TokenBucket::TokenBucket(size_t amount, size_t period_ms, size_t burst)
+  : unlimited(period_ms == 0),
+    tokens_per_ns((period_ms == 0) ? 0 : amount / (period_ms * 1000000.)),
+    burst(burst),
+    tokens(burst),
+    started(false) { }
+
+bool metrics::TokenBucket::allow(size_t count, clock_t::time_point now) {
+  if (unlimited) {
+    return true;
+  }
+  if (!started) {
+    started = true;
+    last_refill = now;
+  } else if (now > last_refill) {
+    double elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now - last_refill).count();
+    tokens = std::min(burst, tokens + elapsed_ns * tokens_per_ns);
+    last_refill = now;
+  }
+  return tokens > 0 && (tokens >= count || tokens >= burst);
+}
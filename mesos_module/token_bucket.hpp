@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <stddef.h>
+
+namespace metrics {
+
+  /**
+   * A token bucket which refills at 'amount' tokens per 'period_ms', up to 'burst' tokens. The
+   * bucket starts full. Refills are computed lazily from the provided monotonic time whenever the
+   * bucket is checked, so no timer is needed.
+   *
+   * Items larger than 'burst' are allowed when the bucket is full, leaving it in debt which must be
+   * refilled before anything else is allowed. This lets a single oversized item through an
+   * otherwise idle bucket without letting the average rate exceed 'amount' per 'period_ms'.
+   */
+  class TokenBucket {
+   public:
+    typedef std::chrono::steady_clock clock_t;
+
+    /**
+     * A 'period_ms' of 0 disables the limit.
+     */
+    TokenBucket(size_t amount, size_t period_ms, size_t burst);
+
+    /**
+     * Refills the bucket up to 'now', then returns whether 'count' tokens may be taken.
+     */
+    bool allow(size_t count, clock_t::time_point now);
+
+    /**
+     * Removes the provided number of tokens, following a successful allow().
+     */
+    void take(size_t count) {
+      tokens -= count;
+    }
+
+    /**
+     * Returns the number of tokens as of the last allow(). Negative when in debt.
+     */
+    double available() const {
+      return tokens;
+    }
+
+   private:
+    const bool unlimited;
+    const double tokens_per_ns;
+    const double burst;
+
+    double tokens;
+    bool started;
+    clock_t::time_point last_refill;
+  };
+
+}
@@ -7,13 +7,24 @@
 #include "params.hpp"
 
 namespace metrics {
+  /**
+   * A host and port to send statsd data to. The host may instead be the absolute path of a unix
+   * datagram socket, in which case the port is 0.
+   */
   class UDPEndpoint {
    public:
     UDPEndpoint(const std::string& host, size_t port)
       : host(host), port(port) { }
     virtual ~UDPEndpoint() { }
 
+    bool is_unix() const {
+      return !host.empty() && host[0] == '/';
+    }
+
     std::string string() const {
+      if (is_unix()) {
+        return host;
+      }
       std::ostringstream oss;
       oss << host << ":" << port;
       return oss.str();